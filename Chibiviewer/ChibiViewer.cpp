@@ -1,122 +1,105 @@
 #define NOMINMAX
 #include <windows.h>
 #include <windowsx.h>
-#include <objidl.h>
-#include <gdiplus.h>
 #include <shlwapi.h>
 #include <shlobj.h>
+#include <mmsystem.h>
 #include <vector>
 #include <memory>
 #include <string>
 #include <algorithm>
-#include <random>
 #include <ctime>
+#include <cmath>
+#include <cwchar>
+
+#include "core/GifDecoder.h"
+#include "core/FrameCache.h"
+#include "core/FramePool.h"
+#include "core/FrameStore.h"
+#include "core/Atlas.h"
+#include "core/Trim.h"
+#include "core/Compositor.h"
+#include "core/Engine.h"
+#include "core/Metrics.h"
+#include "core/Trace.h"
+#include "core/AssetLoader.h"
+#include "core/DiskCache.h"
+#include "core/MappedFile.h"
+#include "LayeredWindowPresenter.h"
 
 #pragma comment(lib, "user32.lib")
 #pragma comment(lib, "gdi32.lib")
-#pragma comment(lib, "gdiplus.lib")
 #pragma comment(lib, "shlwapi.lib")
-
-// Add using namespace for GDI+ at the top
-using namespace Gdiplus;
+#pragma comment(lib, "winmm.lib")
 
 // Application constants
-const int TIMER_ID = 1;
 const int MIN_STATE_DURATION = 5000;  // 5 seconds in milliseconds
 const int MAX_STATE_DURATION = 20000; // 20 seconds in milliseconds
 const int ANIMATION_TIMER_ID = 2;
 const int ANIMATION_INTERVAL = 16;  // 16ms for 60 FPS
-const int FRAME_BUFFER_SIZE = 5;  // Number of frames to buffer ahead
 const UINT MIN_FRAME_DELAY = 16;   // Minimum frame delay (60 FPS)
-const int MOVE_INTERVAL = 16;  // Changed to 16ms for smoother movement
-const int MOVE_DISTANCE = 2;   // Reduced movement distance per step
-
-// GIF categories
-enum GifType {
-    MOVE,
-    WAIT,
-    SIT,
-    PICK,
-    MISC
-};
-
-// Application modes
-enum AppMode {
-    AUTOMATIC,
-    MANUAL
-};
-
-// Application states
-enum AppState {
-    STATE_MOVE,
-    STATE_WAIT,
-    STATE_SIT,
-    STATE_PICK,
-    STATE_MISC
-};
+const double WALK_SPEED = 125.0;  // Pixels per second (the old 2 px every 16 ms)
+const UINT WM_ASSETS_LOADED = WM_APP + 1;  // Posted by loader threads as GIFs finish
+const bool LAZY_LOADING = true;  // Show the first frame before the rest has decoded
+const double STREAM_MIN_IDLE_MS = 4.0;  // Decode a streamed frame only with this much time to spare
+const wchar_t* const ANIMATION_PATTERNS[] = { L"*.gif", L"*.webp" };  // Files picked up by an import
+const size_t FRAME_STORE_BUDGET = 4 * 1024 * 1024;  // Decoded bytes for the playing animation; 0 keeps every frame decoded
+const wchar_t* const DISK_CACHE_FOLDER = L"ChibiViewer\\FrameCache";  // Under %LOCALAPPDATA%; empty disables the cache
+const bool TRIM_TRANSPARENT_BORDERS = true;  // Size the window to the part of the canvas an animation draws on
+const wchar_t* const METRICS_LOG_FILE = L"ChibiViewer\\metrics.csv";  // Under %LOCALAPPDATA%; empty disables the log
+const double METRICS_PERIOD_MS = 10000.0;  // Frame-time histograms are logged and restarted this often
+const double OVERLAY_REFRESH_MS = 250.0;   // How often the metrics overlay redraws while shown
+const wchar_t* const TRACE_FILE = L"ChibiViewer\\trace.json";  // Under %LOCALAPPDATA%; written when tracing stops
+const wchar_t* const TRACE_ENVIRONMENT_VARIABLE = L"CHIBIVIEWER_TRACE";  // If set, tracing starts at launch
 
 // Structure to store GIF information
 struct GifAnimation {
-    Gdiplus::Image* image;
+    chibi::FrameCache cache;  // All frames pre-composed as premultiplied BGRA
+    chibi::CompressedFrameStore store;  // Frames once fully decoded; cache then keeps only its layout
+    chibi::AtlasAnimation atlas;  // Or, when frames stay decoded, where they sit in g_atlas
     UINT frameCount;
     UINT currentFrame;
-    std::vector<UINT> frameDelays;
     bool isPlaying;
-    std::unique_ptr<Gdiplus::Bitmap> backBuffer;
 
     // Default constructor
-    GifAnimation() : image(nullptr), frameCount(0), currentFrame(0), isPlaying(false) {}
+    GifAnimation() : frameCount(0), currentFrame(0), isPlaying(false) {}
 
     // Move constructor
     GifAnimation(GifAnimation&& other) noexcept
-        : image(other.image),
+        : cache(std::move(other.cache)),
+          store(std::move(other.store)),
+          atlas(std::move(other.atlas)),
           frameCount(other.frameCount),
           currentFrame(other.currentFrame),
-          frameDelays(std::move(other.frameDelays)),
-          isPlaying(other.isPlaying),
-          backBuffer(std::move(other.backBuffer)) {
-        other.image = nullptr;
-    }
+          isPlaying(other.isPlaying) {}
 
     // Move assignment operator
     GifAnimation& operator=(GifAnimation&& other) noexcept {
         if (this != &other) {
-            if (image) delete image;
-            image = other.image;
+            cache = std::move(other.cache);
+            store = std::move(other.store);
+            atlas = std::move(other.atlas);
             frameCount = other.frameCount;
             currentFrame = other.currentFrame;
-            frameDelays = std::move(other.frameDelays);
             isPlaying = other.isPlaying;
-            backBuffer = std::move(other.backBuffer);
-            other.image = nullptr;
         }
         return *this;
     }
-
-    // Destructor
-    ~GifAnimation() {
-        if (image) {
-            delete image;
-            image = nullptr;
-        }
-    }
 };
 
 struct GifInfo {
     std::wstring filePath;
-    GifType type;
+    chibi::AnimationType type;
     GifAnimation animation;
-    bool flipped;
 
     // Default constructor
-    GifInfo() : type(MISC), flipped(false) {}
+    GifInfo() : type(chibi::ANIMATION_MISC) {}
 
     // Move constructor
     GifInfo(GifInfo&& other) noexcept
         : filePath(std::move(other.filePath)),
           type(other.type),
-          animation(std::move(other.animation)),
-          flipped(other.flipped) {}
+          animation(std::move(other.animation)) {}
 
     // Move assignment operator
     GifInfo& operator=(GifInfo&& other) noexcept {
@@ -124,34 +107,23 @@ struct GifInfo {
             filePath = std::move(other.filePath);
             type = other.type;
             animation = std::move(other.animation);
-            flipped = other.flipped;
         }
         return *this;
     }
 };
 
-// Add new structures for frame queueing
-struct FrameInfo {
-    Gdiplus::Image* image;
-    UINT frameIndex;
-    UINT delay;
-    bool flipped;
-};
-
 // Global variables
 HWND g_hwnd = NULL;
+// Coded frames shared by every animation's store; declared first so it
+// outlives them
+chibi::FramePool g_framePool;
+// Trimmed frames of every animation, when frames are kept decoded
+chibi::FrameAtlas g_atlas;
+chibi::DiskCache g_diskCache;
 std::vector<GifInfo> g_gifs;
-size_t g_currentGifIndex = 0;
-AppMode g_appMode = AUTOMATIC;
-AppState g_appState = STATE_WAIT;
-AppState g_prevState = STATE_WAIT;
-bool g_isPickMode = false;
-bool g_moveDirectionRight = true;
 bool g_menuVisible = false;
 HWND g_importButton = NULL;
 HWND g_quitButton = NULL;
-int g_miscGifIndex = 0;
-std::mt19937 g_randomEngine(static_cast<unsigned int>(time(nullptr)));
 HWND g_startupText = NULL;
 bool g_hasGifs = false;
 const int MENU_WIDTH = 300;  // Reduced size since we only have buttons
@@ -161,92 +133,137 @@ const int BUTTON_HEIGHT = 40;
 const int BUTTON_MARGIN = 20;
 const int TEXT_MARGIN = 30;
 
-// Add global variables for frame queueing
-std::vector<FrameInfo> g_frameQueue;
-size_t g_currentFrameIndex = 0;
-bool g_isQueueingFrames = false;
-
 // Add new global variables for menu window
 HWND g_menuHwnd = NULL;
 const wchar_t MENU_CLASS_NAME[] = L"ChibiViewerMenuClass";
 
-// Add new global variable for frame timing
-LARGE_INTEGER g_performanceFrequency;
-LARGE_INTEGER g_lastFrameTime;
-double g_frameTime = 0.0;
+// Real time, fed to the engine in slices by UpdateFrame
+chibi::SteadyClock g_clock;
+double g_lastTickMs = 0.0;
+
+// States, walking, playback timing and window placement. The engine never
+// touches the window; it queues commands for ApplyEngineCommands.
+chibi::Engine g_engine(chibi::EngineConfig(WALK_SPEED, MIN_FRAME_DELAY, MIN_STATE_DURATION, MAX_STATE_DURATION),
+                       static_cast<uint32_t>(time(nullptr)));
+std::vector<chibi::EngineCommand> g_engineCommands;
+
+// Pushes finished frames to the layered main window
+std::unique_ptr<chibi::IPresenter> g_presenter;
+
+// Writes cached frames into the presenter's surface, skipping unchanged work
+chibi::Compositor g_compositor;
+
+// Animation whose frames the surface shows; it alone keeps decoded frames
+size_t g_shownGifIndex = SIZE_MAX;
+
+// GIF files found by the last folder scan, decoded in the background
+struct PendingGif {
+    std::wstring filePath;
+    chibi::AnimationType type;
+};
+std::vector<PendingGif> g_pendingGifs;
+chibi::AssetLoader g_assetLoader;
+
+// With lazy loading, the first animation shown is decoded one frame at a
+// time on the UI thread, between frame deadlines
+struct StreamingGif {
+    bool active;
+    size_t gifIndex;                 // Entry in g_gifs being filled
+    chibi::MappedFile file;          // Read by the builder until it finishes
+    chibi::FrameCacheBuilder builder;
+    chibi::CompressedFrameStore store;  // Frames compressed as they are decoded
+    chibi::AssetStamp stamp;            // The mapped file, for saving to the disk cache
 
-// Add new global variables for frame management
-bool g_isRendering = false;
-Gdiplus::Image* g_currentRenderedFrame = nullptr;
+    StreamingGif() : active(false), gifIndex(0) {}
+};
+StreamingGif g_streaming;
 
-// Add at the top of the file with other global variables
-bool needsClear = true;
+// Time to first pixel and to fully loaded, for the last folder load
+chibi::LoadTimings g_loadTimings;
 
-// Add at the top with other global variables
-Gdiplus::Bitmap* g_topLayer = nullptr;
-Gdiplus::Bitmap* g_bottomLayer = nullptr;
+// Frame interval, decode, compose and present times over the current
+// period, and frames per state. Loader threads record decodes too.
+chibi::FrameMetrics g_metrics;
+double g_lastPresentMs = -1.0;
+int g_metricsState = -1;  // State the last entry was counted for
+std::wstring g_metricsLogPath;
+
+// Shows g_metrics above the character, toggled with F
+HWND g_overlayHwnd = NULL;
+bool g_overlayVisible = false;
+double g_nextOverlayRefreshMs = 0.0;
+const wchar_t OVERLAY_CLASS_NAME[] = L"ChibiViewerOverlayClass";
+const int OVERLAY_WIDTH = 420;
+const int OVERLAY_LINE_HEIGHT = 16;
+const int OVERLAY_MARGIN = 6;
 
 // Function prototypes
 LRESULT CALLBACK WindowProc(HWND hwnd, UINT uMsg, WPARAM wParam, LPARAM lParam);
-void RenderGif(HWND hwnd);
+void PresentCurrentFrame();
+void PresentFrame(size_t gifIndex, size_t frameIndex, bool flipped);
+chibi::PixelRect AnimationView(const GifAnimation& gif);
 bool LoadGifsFromFolder(const std::wstring& folderPath);
-void SwitchToNextGif();
-void UpdateAppState();
-void StartStateTimer();
-void MoveWindow();
+void OnAssetsLoaded();
+void AddGif(const PendingGif& pending, chibi::FrameCache&& cache,
+            chibi::CompressedFrameStore&& store = chibi::CompressedFrameStore());
+bool StartStreamingGif(size_t pendingIndex);
+bool StreamNextFrame();
+bool HasIdleTimeForStreaming();
+void FinishStreamingStore(GifInfo& gif);
+void PackIntoAtlas(GifAnimation& animation);
+void CheckFullyLoaded();
 void ToggleMenu();
 void CreateButtons(HWND hwnd);
-GifType GetGifTypeFromFilename(const std::wstring& filename);
+chibi::AnimationType GetGifTypeFromFilename(const std::wstring& filename);
+std::string GifTagFromPath(const std::wstring& filePath);
 void CleanupGifs();
-void QueueFramesFromGif(size_t gifIndex);
+void UpdateFrame();
+void ApplyEngineCommands();
+double MsUntilNextUpdate();
+void ArmAnimationTimer();
+void UpdateMetrics(double now);
+void DumpMetrics(double now);
+void ToggleOverlay();
+void ToggleTracing();
+bool WriteTextFile(const std::wstring& path, const std::string& text, bool append);
+void PlaceOverlay();
+LRESULT CALLBACK OverlayWindowProc(HWND hwnd, UINT uMsg, WPARAM wParam, LPARAM lParam);
 
 // Add new helper functions
-std::vector<UINT> LoadGifFrameInfo(Gdiplus::Image* image) {
-    UINT count = image->GetFrameDimensionsCount();
-    if (count != 1) {
-        return std::vector<UINT>();
-    }
-
-    GUID guid;
-    if (image->GetFrameDimensionsList(&guid, 1) != 0) {
-        return std::vector<UINT>();
+// Read a GIF or WebP and pre-compose all of its frames. Safe to call from any thread.
+// If stamp is given it describes the bytes that were decoded, for the disk
+// cache (size 0 if the file could not be stamped).
+bool LoadFrameCache(const std::wstring& filePath, chibi::FrameCache& cache, chibi::AssetStamp* stamp = NULL) {
+    chibi::TraceScope span("decode_file", "load");
+    
+    // The decoder parses straight out of the mapping, which is released
+    // as soon as the frames are cached
+    chibi::MappedFile file;
+    if (!file.Open(filePath.c_str())) {
+        return false;
     }
-    UINT frameCount = image->GetFrameCount(&guid);
-
-    UINT sz = image->GetPropertyItemSize(PropertyTagFrameDelay);
-    if (sz == 0) {
-        return std::vector<UINT>();
+    
+    if (stamp && !chibi::MakeAssetStamp(filePath, file.Data(), file.Size(), *stamp)) {
+        stamp->size = 0;
     }
 
-    std::vector<BYTE> buffer(sz);
-    Gdiplus::PropertyItem* propertyItem = reinterpret_cast<Gdiplus::PropertyItem*>(&buffer[0]);
-    image->GetPropertyItem(PropertyTagFrameDelay, sz, propertyItem);
-    UINT* frameDelayArray = (UINT*)propertyItem->value;
-
-    std::vector<UINT> frameDelays(frameCount);
-    std::transform(frameDelayArray, frameDelayArray + frameCount, frameDelays.begin(),
-        [](UINT n) { return n * 10; });
-
-    return frameDelays;
-}
-
-void GenerateFrame(Gdiplus::Bitmap* bmp, Gdiplus::Image* gif) {
-    Gdiplus::Graphics dest(bmp);
-    
-    // Clear with black (transparent color)
-    Gdiplus::SolidBrush black(Gdiplus::Color::Black);
-    dest.FillRectangle(&black, 0, 0, bmp->GetWidth(), bmp->GetHeight());
-    
-    if (gif) {
-        // Draw the GIF
-        dest.DrawImage(gif, 0, 0);
+    // Timed as a whole and counted once per frame
+    double start = g_clock.NowMs();
+    if (!chibi::BuildFrameCache(file.Data(), file.Size(), cache) || cache.Empty()) {
+        return false;
     }
+    span.SetArg("frames", static_cast<int64_t>(cache.frameCount));
+    double perFrameMs = (g_clock.NowMs() - start) / cache.frameCount;
+    g_metrics.Histogram(chibi::METRIC_DECODE).RecordMany(static_cast<uint64_t>(perFrameMs * 1000.0 + 0.5), cache.frameCount);
+    return true;
 }
 
-std::unique_ptr<Gdiplus::Bitmap> CreateBackBuffer(HWND hwnd) {
-    RECT r;
-    GetClientRect(hwnd, &r);
-    return std::make_unique<Gdiplus::Bitmap>(r.right - r.left, r.bottom - r.top);
+// Compressed frames saved by an earlier run, if they are still current.
+// Safe to call from any thread.
+bool LoadCachedAnimation(const std::wstring& filePath, chibi::FrameCache& cache, chibi::CompressedFrameStore& store) {
+    chibi::TraceScope span("disk_cache_load", "load");
+    return FRAME_STORE_BUDGET > 0 &&
+           g_diskCache.Load(filePath, g_framePool, cache, store) == chibi::DISK_CACHE_HIT;
 }
 
 // Modify MenuWindowProc to create opaque grey buttons
@@ -353,7 +370,7 @@ LRESULT CALLBACK MenuWindowProc(HWND hwnd, UINT uMsg, WPARAM wParam, LPARAM lPar
                 } else if ((HWND)lParam == g_importButton) {
                     BROWSEINFOW bi = {0};
                     bi.hwndOwner = hwnd;
-                    bi.lpszTitle = L"Select Folder with GIF Files";
+                    bi.lpszTitle = L"Select Folder with GIF or WebP Files";
                     bi.ulFlags = BIF_RETURNONLYFSDIRS | BIF_NEWDIALOGSTYLE;
                     
                     LPITEMIDLIST pidl = SHBrowseForFolderW(&bi);
@@ -366,13 +383,8 @@ LRESULT CALLBACK MenuWindowProc(HWND hwnd, UINT uMsg, WPARAM wParam, LPARAM lPar
                             // Load new GIFs
                             if (LoadGifsFromFolder(folderPath)) {
                                 // Reset to initial state
-                                g_currentGifIndex = 0;
-                                g_appState = STATE_WAIT;
-                                InvalidateRect(g_hwnd, NULL, TRUE);
-                                
-                                if (g_appMode == AUTOMATIC) {
-                                    StartStateTimer();
-                                }
+                                g_engine.Restart();
+                                ApplyEngineCommands();
                             }
                         }
                         CoTaskMemFree(pidl);
@@ -409,16 +421,25 @@ std::wstring GetProgramDirectory() {
     return std::wstring(path);
 }
 
+// A path under %LOCALAPPDATA%; empty if relative is empty or there is nowhere
+std::wstring GetLocalAppDataPath(const wchar_t* relative) {
+    wchar_t path[MAX_PATH];
+    DWORD length = GetEnvironmentVariableW(L"LOCALAPPDATA", path, MAX_PATH);
+    if (relative[0] == L'\0' || length == 0 || length >= MAX_PATH) {
+        return std::wstring();
+    }
+    return std::wstring(path) + L"\\" + relative;
+}
+
+// Where decoded frames are cached between runs; empty if there is nowhere
+std::wstring GetDiskCacheDirectory() {
+    return GetLocalAppDataPath(DISK_CACHE_FOLDER);
+}
+
 // Main entry point
 int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR lpCmdLine, int nCmdShow) {
-    // Initialize performance counter
-    QueryPerformanceFrequency(&g_performanceFrequency);
-    QueryPerformanceCounter(&g_lastFrameTime);
-    
-    // Initialize GDI+
-    Gdiplus::GdiplusStartupInput gdiplusStartupInput;
-    ULONG_PTR gdiplusToken;
-    Gdiplus::GdiplusStartup(&gdiplusToken, &gdiplusStartupInput, NULL);
+    // 1 ms timer resolution so waits end close to frame deadlines
+    timeBeginPeriod(1);
 
     // Register the main window class
     const wchar_t CLASS_NAME[] = L"ChibiViewerWindowClass";
@@ -439,6 +460,15 @@ int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR lpCmdLine
     menuWc.hCursor = LoadCursor(NULL, IDC_ARROW);
     menuWc.hbrBackground = (HBRUSH)(COLOR_WINDOW + 1);
     RegisterClassW(&menuWc);
+    
+    // Register the metrics overlay class
+    WNDCLASSW overlayWc = {};
+    overlayWc.lpfnWndProc = OverlayWindowProc;
+    overlayWc.hInstance = hInstance;
+    overlayWc.lpszClassName = OVERLAY_CLASS_NAME;
+    overlayWc.hCursor = LoadCursor(NULL, IDC_ARROW);
+    overlayWc.hbrBackground = NULL;
+    RegisterClassW(&overlayWc);
 
     // Create the main window
     g_hwnd = CreateWindowExW(
@@ -454,6 +484,13 @@ int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR lpCmdLine
         return 0;
     }
 
+    // The engine places the window from here on, starting where it was created
+    RECT windowRect;
+    GetWindowRect(g_hwnd, &windowRect);
+    g_engine.SetWindow(chibi::PixelRect::Make(windowRect.left, windowRect.top, windowRect.right, windowRect.bottom));
+    g_engine.SetScreen(GetSystemMetrics(SM_CXSCREEN), GetSystemMetrics(SM_CYSCREEN));
+    g_lastTickMs = g_clock.NowMs();
+
     // Create the menu window
     g_menuHwnd = CreateWindowExW(
         WS_EX_LAYERED | WS_EX_TOPMOST,
@@ -468,38 +505,90 @@ int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR lpCmdLine
         DestroyWindow(g_hwnd);
         return 0;
     }
+    
+    // Create the metrics overlay; it never takes focus or clicks
+    g_overlayHwnd = CreateWindowExW(
+        WS_EX_LAYERED | WS_EX_TOPMOST | WS_EX_TOOLWINDOW | WS_EX_NOACTIVATE | WS_EX_TRANSPARENT,
+        OVERLAY_CLASS_NAME,
+        L"Chibi Viewer Metrics",
+        WS_POPUP,
+        100, 100, OVERLAY_WIDTH, OVERLAY_LINE_HEIGHT,
+        g_hwnd, NULL, hInstance, NULL
+    );
 
-    // Set window transparency
-    SetLayeredWindowAttributes(g_hwnd, RGB(0, 0, 0), 0, LWA_COLORKEY);
+    // Set window transparency. The main window uses per-pixel alpha through
+    // UpdateLayeredWindow, so it gets a presenter instead of a colour key.
+    g_presenter.reset(new LayeredWindowPresenter(g_hwnd));
     SetLayeredWindowAttributes(g_menuHwnd, RGB(240, 240, 240), 0, LWA_COLORKEY);
+    if (g_overlayHwnd != NULL) {
+        SetLayeredWindowAttributes(g_overlayHwnd, 0, 200, LWA_ALPHA);
+    }
     
     // Show the windows
     ShowWindow(g_hwnd, nCmdShow);
     ShowWindow(g_menuHwnd, SW_HIDE);  // Menu starts hidden
 
     // Try to load GIFs from program directory first
+    g_diskCache.SetDirectory(GetDiskCacheDirectory());
+    g_metricsLogPath = GetLocalAppDataPath(METRICS_LOG_FILE);
+    g_metrics.Reset(g_clock.NowMs());
+    
+    // Set to trace loading as well
+    if (GetEnvironmentVariableW(TRACE_ENVIRONMENT_VARIABLE, NULL, 0) > 0) {
+        ToggleTracing();
+    }
     std::wstring programDir = GetProgramDirectory();
     if (!LoadGifsFromFolder(programDir)) {
         // If no GIFs found in program directory, show menu
         ToggleMenu();
     } else {
         // If GIFs were loaded, start with automatic mode
-        g_appMode = AUTOMATIC;
-        StartStateTimer();
+        g_engine.SetMode(chibi::MODE_AUTOMATIC);
     }
 
-    // Main message loop
+    // Main message loop. Sleeps until a message arrives or the next frame
+    // is due, whichever comes first.
     MSG msg = {};
-    while (GetMessage(&msg, NULL, 0, 0)) {
-        TranslateMessage(&msg);
-        DispatchMessage(&msg);
+    bool running = true;
+    while (running) {
+        double wait = MsUntilNextUpdate();
+        DWORD timeout = wait < 0.0 ? INFINITE : static_cast<DWORD>(std::ceil(wait));
+        if (HasIdleTimeForStreaming()) {
+            timeout = 0;  // Frames left to decode; just check for messages
+        }
+        {
+            chibi::TraceScope span("wait", "loop", "timeout_ms", timeout == INFINITE ? -1 : static_cast<int64_t>(timeout));
+            MsgWaitForMultipleObjectsEx(0, NULL, timeout, QS_ALLINPUT, MWMO_INPUTAVAILABLE);
+        }
+        
+        while (PeekMessage(&msg, NULL, 0, 0, PM_REMOVE)) {
+            if (msg.message == WM_QUIT) {
+                running = false;
+                break;
+            }
+            // How long the message sat in the queue, to the tick count's resolution
+            chibi::TraceScope span("dispatch", "loop", "queued_ms", static_cast<int64_t>(GetTickCount() - msg.time));
+            TranslateMessage(&msg);
+            DispatchMessage(&msg);
+        }
+        
+        if (running) {
+            UpdateFrame();
+            
+            if (HasIdleTimeForStreaming()) {
+                StreamNextFrame();
+            }
+        }
     }
 
     // Cleanup
+    DumpMetrics(g_clock.NowMs());
+    if (chibi::GlobalTracer().Enabled()) {
+        ToggleTracing();
+    }
     CleanupGifs();
-    
-    // Shutdown GDI+
-    Gdiplus::GdiplusShutdown(gdiplusToken);
+    g_presenter.reset();
+    timeEndPeriod(1);
 
     return 0;
 }
@@ -511,120 +600,39 @@ LRESULT CALLBACK WindowProc(HWND hwnd, UINT uMsg, WPARAM wParam, LPARAM lParam)
             PostQuitMessage(0);
             return 0;
 
+        case WM_ASSETS_LOADED:
+            OnAssetsLoaded();
+            return 0;
+
         case WM_TIMER:
-            if (wParam == TIMER_ID) {
-                if (g_appState == STATE_MOVE) {
-                    MoveWindow();
-                } else {
-                    UpdateAppState();
-                }
-            } else if (wParam == ANIMATION_TIMER_ID && !g_frameQueue.empty()) {
-                // Calculate frame time
-                LARGE_INTEGER currentTime;
-                QueryPerformanceCounter(&currentTime);
-                double deltaTime = (currentTime.QuadPart - g_lastFrameTime.QuadPart) * 1000.0 / g_performanceFrequency.QuadPart;
-                g_lastFrameTime = currentTime;
-                
-                // Move to next frame in queue
-                g_currentFrameIndex = (g_currentFrameIndex + 1) % g_frameQueue.size();
-                
-                // Set timer for next frame
-                UINT nextDelay = std::max(g_frameQueue[g_currentFrameIndex].delay, MIN_FRAME_DELAY);
-                SetTimer(hwnd, ANIMATION_TIMER_ID, nextDelay, NULL);
-                
-                // Force redraw
-                InvalidateRect(hwnd, NULL, TRUE);
+            if (wParam == ANIMATION_TIMER_ID) {
+                // Only reached when a modal loop keeps the main loop from
+                // waking when the next update is due
+                chibi::TraceScope span("timer", "loop");
+                UpdateFrame();
+                ArmAnimationTimer();
             }
             return 0;
 
         case WM_PAINT: {
-            if (g_isRendering) return 0;  // Prevent re-entrant rendering
-            g_isRendering = true;
-            
+            // Layered window contents are pushed by PresentFrame
             PAINTSTRUCT ps;
-            HDC hdc = BeginPaint(hwnd, &ps);
-            
-            // Only clear if necessary (when switching GIFs or states)
-            if (needsClear) {
-                RECT clientRect;
-                GetClientRect(hwnd, &clientRect);
-                HBRUSH hBrush = CreateSolidBrush(RGB(0, 0, 0));
-                FillRect(hdc, &clientRect, hBrush);
-                DeleteObject(hBrush);
-                needsClear = false;
-                
-                // Initialize layers if needed
-                if (!g_topLayer || !g_bottomLayer) {
-                    if (g_topLayer) delete g_topLayer;
-                    if (g_bottomLayer) delete g_bottomLayer;
-                    
-                    RECT rect;
-                    GetClientRect(hwnd, &rect);
-                    g_topLayer = new Gdiplus::Bitmap(rect.right, rect.bottom);
-                    g_bottomLayer = new Gdiplus::Bitmap(rect.right, rect.bottom);
-                }
-            }
-            
-            // Draw the current frame from the queue
-            if (!g_frameQueue.empty() && g_currentFrameIndex < g_frameQueue.size()) {
-                FrameInfo& frame = g_frameQueue[g_currentFrameIndex];
-                
-                // Select the correct frame
-                GUID timeDimension = Gdiplus::FrameDimensionTime;
-                frame.image->SelectActiveFrame(&timeDimension, frame.frameIndex);
-                
-                // Draw new frame to top layer
-                Gdiplus::Graphics topGraphics(g_topLayer);
-                topGraphics.Clear(Gdiplus::Color::Black);
-                topGraphics.SetInterpolationMode(Gdiplus::InterpolationModeHighQuality);
-                topGraphics.SetSmoothingMode(Gdiplus::SmoothingModeHighQuality);
-                
-                // Get image dimensions
-                int width = frame.image->GetWidth();
-                int height = frame.image->GetHeight();
-                
-                // Apply horizontal flip if needed
-                if (frame.flipped) {
-                    // Create a temporary bitmap for the flipped image
-                    Gdiplus::Bitmap flippedBitmap(width, height);
-                    Gdiplus::Graphics flippedGraphics(&flippedBitmap);
-                    
-                    // Draw the original image to the temporary bitmap
-                    flippedGraphics.DrawImage(frame.image, 0, 0, width, height);
-                    
-                    // Draw the flipped image to the top layer
-                    topGraphics.DrawImage(&flippedBitmap, 0, 0, width, height);
-                } else {
-                    // Draw the original image
-                    topGraphics.DrawImage(frame.image, 0, 0, width, height);
-                }
-                
-                // Draw to screen
-                Gdiplus::Graphics screenGraphics(hdc);
-                screenGraphics.DrawImage(g_bottomLayer, 0, 0);
-                screenGraphics.DrawImage(g_topLayer, 0, 0);
-                
-                // Move top layer to bottom layer for next frame
-                Gdiplus::Graphics bottomGraphics(g_bottomLayer);
-                bottomGraphics.Clear(Gdiplus::Color::Black);
-                bottomGraphics.DrawImage(g_topLayer, 0, 0);
-            }
-            
+            BeginPaint(hwnd, &ps);
             EndPaint(hwnd, &ps);
-            g_isRendering = false;
             return 0;
         }
 
         case WM_SIZE: {
-            // Recreate back buffers for all GIFs
-            for (auto& gif : g_gifs) {
-                gif.animation.backBuffer = CreateBackBuffer(hwnd);
-                GenerateFrame(gif.animation.backBuffer.get(), gif.animation.image);
-            }
-            InvalidateRect(hwnd, NULL, TRUE);
+            // The presenter's surface follows the animation size
+            PresentCurrentFrame();
             return 0;
         }
 
+        case WM_DISPLAYCHANGE:
+            // Walking and dragging stay on the screen
+            g_engine.SetScreen(GetSystemMetrics(SM_CXSCREEN), GetSystemMetrics(SM_CYSCREEN));
+            return 0;
+
         case WM_KEYDOWN:
             switch (wParam) {
                 case 'M':
@@ -632,126 +640,55 @@ LRESULT CALLBACK WindowProc(HWND hwnd, UINT uMsg, WPARAM wParam, LPARAM lParam)
                     break;
                     
                 case 'A':
-                    g_appMode = (g_appMode == AUTOMATIC) ? MANUAL : AUTOMATIC;
-                    if (g_appMode == AUTOMATIC) {
-                        StartStateTimer();
-                    } else {
-                        KillTimer(hwnd, TIMER_ID);
-                    }
+                    g_engine.ToggleMode();
+                    ApplyEngineCommands();
+                    break;
+                    
+                case 'F':
+                    ToggleOverlay();
+                    break;
+                    
+                case 'T':
+                    ToggleTracing();
                     break;
                     
                 case VK_SPACE:
-                    if (g_appMode == MANUAL && !g_gifs.empty()) {
-                        SwitchToNextGif();
-                        InvalidateRect(hwnd, NULL, TRUE);
+                    if (g_engine.Mode() == chibi::MODE_MANUAL) {
+                        g_engine.CycleState();
+                        ApplyEngineCommands();
                     }
                     break;
             }
             return 0;
             
         case WM_MOUSEMOVE:
-            if (g_isPickMode) {
-                // Move the window with the mouse
+            if (g_engine.Picking()) {
+                // The engine keeps the window on the screen, centred on the mouse
                 POINT pt;
                 pt.x = GET_X_LPARAM(lParam);
                 pt.y = GET_Y_LPARAM(lParam);
                 ClientToScreen(hwnd, &pt);
                 
-                RECT windowRect;
-                GetWindowRect(hwnd, &windowRect);
-                int width = windowRect.right - windowRect.left;
-                int height = windowRect.bottom - windowRect.top;
-                
-                // Ensure the window stays within screen bounds
-                int screenWidth = GetSystemMetrics(SM_CXSCREEN);
-                int screenHeight = GetSystemMetrics(SM_CYSCREEN);
-                
-                // Calculate new position
-                int newX = pt.x - width / 2;
-                int newY = pt.y - height / 2;
-                
-                // Clamp to screen bounds
-                newX = std::max(0, std::min(newX, screenWidth - width));
-                newY = std::max(0, std::min(newY, screenHeight - height));
-                
-                SetWindowPos(hwnd, NULL, newX, newY, 0, 0, SWP_NOSIZE | SWP_NOZORDER);
+                g_engine.PointerMove(pt.x, pt.y);
+                ApplyEngineCommands();
             }
             return 0;
             
         case WM_LBUTTONDOWN:
-            if (!g_gifs.empty()) {
-                g_prevState = g_appState;
-                g_isPickMode = true;
-                g_appState = STATE_PICK;
-                
-                // Queue frames from the PICK GIF
-                for (size_t i = 0; i < g_gifs.size(); i++) {
-                    if (g_gifs[i].type == PICK) {
-                        // Clear existing queue
-                        g_frameQueue.clear();
-                        g_currentFrameIndex = 0;
-                        
-                        // Queue frames from the PICK GIF
-                        QueueFramesFromGif(i);
-                        
-                        // Start animation timer
-                        if (!g_frameQueue.empty()) {
-                            SetTimer(hwnd, ANIMATION_TIMER_ID, g_frameQueue[0].delay, NULL);
-                        }
-                        break;
-                    }
-                }
-                
-                InvalidateRect(hwnd, NULL, TRUE);
+            // Picked up: plays the PICK GIF until released
+            g_engine.PointerDown();
+            if (g_engine.Picking()) {
+                ApplyEngineCommands();
                 SetCapture(hwnd);
             }
             return 0;
             
         case WM_LBUTTONUP:
-            if (g_isPickMode) {
-                g_isPickMode = false;
-                g_appState = g_prevState;
-                
-                // Queue frames from the previous state GIF
-                size_t newGifIndex = g_currentGifIndex;
-                bool foundGif = false;
-                
-                GifType targetType;
-                switch (g_prevState) {
-                    case STATE_MOVE: targetType = MOVE; break;
-                    case STATE_WAIT: targetType = WAIT; break;
-                    case STATE_SIT: targetType = SIT; break;
-                    default: targetType = MISC; break;
-                }
-                
-                for (size_t i = 0; i < g_gifs.size(); i++) {
-                    if (g_gifs[i].type == targetType) {
-                        newGifIndex = i;
-                        foundGif = true;
-                        break;
-                    }
-                }
-                
-                if (foundGif && newGifIndex < g_gifs.size()) {
-                    // Clear existing queue
-                    g_frameQueue.clear();
-                    g_currentFrameIndex = 0;
-                    
-                    // Queue frames from the new GIF
-                    QueueFramesFromGif(newGifIndex);
-                    
-                    // Start animation timer
-                    if (!g_frameQueue.empty()) {
-                        SetTimer(hwnd, ANIMATION_TIMER_ID, g_frameQueue[0].delay, NULL);
-                    }
-                }
-                
-                InvalidateRect(hwnd, NULL, TRUE);
+            // Back to the previous state's GIF
+            if (g_engine.Picking()) {
+                g_engine.PointerUp();
+                ApplyEngineCommands();
                 ReleaseCapture();
-                
-                if (g_appMode == AUTOMATIC) {
-                    StartStateTimer();
-                }
             }
             return 0;
     }
@@ -759,386 +696,649 @@ LRESULT CALLBACK WindowProc(HWND hwnd, UINT uMsg, WPARAM wParam, LPARAM lParam)
     return DefWindowProc(hwnd, uMsg, wParam, lParam);
 }
 
-// Render the current GIF
-void RenderGif(HWND hwnd) {
-    if (g_gifs.empty()) {
-        return;
+// Show the engine's current frame again (after a resize or reload)
+void PresentCurrentFrame() {
+    if (!g_engine.Playing()) return;
+    PresentFrame(g_engine.CurrentAnimation(), g_engine.CurrentFrame(), g_engine.CurrentFlipped());
+}
+
+// Compose a frame into the presenter's surface and show it
+void PresentFrame(size_t gifIndex, size_t frameIndex, bool flipped) {
+    if (!g_presenter || gifIndex >= g_gifs.size()) return;
+    chibi::TraceScope span("present_frame", "render", "frame", static_cast<int64_t>(frameIndex));
+    
+    // Only the animation on screen keeps decoded frames around
+    if (g_shownGifIndex != gifIndex && g_shownGifIndex < g_gifs.size()) {
+        g_gifs[g_shownGifIndex].animation.store.ReleaseHot();
     }
+    g_shownGifIndex = gifIndex;
     
-    size_t gifIndex = g_currentGifIndex;
+    GifInfo& gif = g_gifs[gifIndex];
     
-    // If in pick mode, find and use the PICK gif
-    if (g_appState == STATE_PICK) {
-        for (size_t i = 0; i < g_gifs.size(); i++) {
-            if (g_gifs[i].type == PICK) {
-                gifIndex = i;
-                break;
-            }
-        }
-    } else {
-        // Otherwise, find a gif of the appropriate type for the current state
-        GifType targetType;
-        switch (g_appState) {
-            case STATE_MOVE: targetType = MOVE; break;
-            case STATE_WAIT: targetType = WAIT; break;
-            case STATE_SIT: targetType = SIT; break;
-            default: targetType = MISC; break;
+    // Left-facing frames come from the mirrored copy (built once); a
+    // compressed store or the atlas flips them as they are copied out
+    if (flipped && gif.animation.store.Empty() && gif.animation.atlas.Empty()) {
+        gif.animation.cache.EnsureMirrored();
+    }
+    
+    const chibi::FrameCache& cache = gif.animation.cache;
+    chibi::PixelRect view = AnimationView(gif.animation);
+    int width = view.Width();
+    int height = view.Height();
+    g_compositor.SetView(view);
+    
+    // Keep the presentation surface the size of the animation's trimmed box
+    chibi::Surface surface = g_presenter->GetSurface();
+    if (surface.width != width || surface.height != height) {
+        g_presenter->Resize(width, height);
+        surface = g_presenter->GetSurface();
+        g_compositor.Invalidate();
+    }
+    
+    // Copy the pre-composed frame straight into the layered window's DIB;
+    // nothing is presented if the surface already shows this frame
+    double composeStart = g_clock.NowMs();
+    bool composed;
+    {
+        chibi::TraceScope composeSpan("compose", "render");
+        if (!gif.animation.store.Empty()) {
+            composed = g_compositor.Compose(surface, gif.animation.store, frameIndex, flipped);
+        } else if (!gif.animation.atlas.Empty()) {
+            composed = g_compositor.Compose(surface, g_atlas, gif.animation.atlas, frameIndex, flipped);
+        } else {
+            composed = g_compositor.Compose(surface, cache, frameIndex, flipped);
         }
+    }
+    if (composed) {
+        double presentStart = g_clock.NowMs();
+        g_metrics.Record(chibi::METRIC_COMPOSE, presentStart - composeStart);
         
-        for (size_t i = 0; i < g_gifs.size(); i++) {
-            if (g_gifs[i].type == targetType) {
-                gifIndex = i;
-                break;
+        // Only the area that changed since the previous frame is pushed
+        chibi::TraceScope presentSpan("present", "render");
+        if (g_presenter->Present(g_compositor.LastRegion())) {
+            double presented = g_clock.NowMs();
+            g_loadTimings.MarkFirstPixel(presented);
+            g_metrics.Record(chibi::METRIC_PRESENT, presented - presentStart);
+            if (g_lastPresentMs >= 0.0) {
+                g_metrics.Record(chibi::METRIC_FRAME_INTERVAL, presented - g_lastPresentMs);
             }
+            g_lastPresentMs = presented;
+            g_metrics.CountFrame(g_engine.State());
+        } else {
+            // The window still shows an older frame; compose this one in
+            // full next time instead of counting it as already shown
+            g_compositor.Invalidate();
         }
     }
-    
-    if (gifIndex < g_gifs.size() && g_gifs[gifIndex].animation.image != nullptr) {
-        // Update the back buffer
-        GenerateFrame(g_gifs[gifIndex].animation.backBuffer.get(), g_gifs[gifIndex].animation.image);
-    }
 }
 
-// Modify ResizeWindowToGif to reduce unnecessary updates
-void ResizeWindowToGif(HWND hwnd, Gdiplus::Image* gif) {
-    if (!gif) return;
-    
-    // Get current window position
-    RECT windowRect;
-    GetWindowRect(hwnd, &windowRect);
-    
-    // Get GIF dimensions
-    int gifWidth = gif->GetWidth();
-    int gifHeight = gif->GetHeight();
-    
-    // Only resize if dimensions have changed
-    if (windowRect.right - windowRect.left != gifWidth || 
-        windowRect.bottom - windowRect.top != gifHeight) {
-        // Resize window to fit GIF without forcing redraw
-        SetWindowPos(hwnd, NULL, windowRect.left, windowRect.top, 
-                    gifWidth, gifHeight, 
-                    SWP_NOZORDER | SWP_NOREDRAW);
+// Part of the canvas the window shows for an animation: trimmed to what its
+// frames draw on once all of them are known, the whole canvas while it is
+// still streaming in
+chibi::PixelRect AnimationView(const GifAnimation& gif) {
+    const chibi::FrameCache& cache = gif.cache;
+    if (!TRIM_TRANSPARENT_BORDERS || !cache.Complete()) {
+        return chibi::PixelRect::Make(0, 0, cache.width, cache.height);
     }
+    return chibi::TrimView(cache.opaqueBounds, cache.width, cache.height);
 }
 
-// Modify QueueFramesFromGif to properly handle flipped state
-void QueueFramesFromGif(size_t gifIndex) {
-    if (gifIndex >= g_gifs.size()) return;
+// One update: hand the engine the time since the last one. It steps the
+// walk at its fixed rate and moves playback to the frame its deadline
+// calls for, skipping frames whose time went by while the thread was busy;
+// the window then moves and presents once.
+void UpdateFrame() {
+    chibi::TraceScope span("update", "loop");
+    double now = g_clock.NowMs();
+    bool busy = g_engine.Tick(now - g_lastTickMs);
+    g_lastTickMs = now;
     
-    GifInfo& gif = g_gifs[gifIndex];
-    GUID timeDimension = Gdiplus::FrameDimensionTime;
-    
-    // Clear existing queue
-    g_frameQueue.clear();
-    g_currentFrameIndex = 0;
-    
-    // Queue all frames from the GIF multiple times to create a larger buffer
-    for (int bufferPass = 0; bufferPass < FRAME_BUFFER_SIZE; bufferPass++) {
-        for (UINT i = 0; i < gif.animation.frameCount; i++) {
-            FrameInfo frame;
-            frame.image = gif.animation.image;
-            frame.frameIndex = i;
-            frame.delay = std::max(gif.animation.frameDelays[i], MIN_FRAME_DELAY);
-            frame.flipped = gif.flipped;  // Set the flipped state from the GIF
-            g_frameQueue.push_back(frame);
-        }
+    if (busy || g_engine.HasCommands()) {
+        ApplyEngineCommands();
     }
     
-    // Reset timing
-    QueryPerformanceCounter(&g_lastFrameTime);
+    UpdateMetrics(now);
 }
 
-// Modify SwitchToNextGif to set needsClear
-void SwitchToNextGif() {
-    if (g_gifs.empty()) return;
+// Carry out what the engine asked for: window moves in order, then only the
+// last frame shown, since earlier ones would be covered straight away
+void ApplyEngineCommands() {
+    g_engine.TakeCommands(g_engineCommands);
     
-    // Store previous state
-    AppState prevState = g_appState;
+    if (g_engine.Playing() && g_metricsState != g_engine.State()) {
+        g_metricsState = g_engine.State();
+        g_metrics.CountEntry(g_engine.State());
+    }
     
-    // Cycle through states
-    switch (g_appState) {
-        case STATE_MOVE: g_appState = STATE_WAIT; break;
-        case STATE_WAIT: g_appState = STATE_SIT; break;
-        case STATE_SIT: g_appState = STATE_MISC; break;
-        case STATE_MISC: g_appState = STATE_MOVE; break;
-        default: g_appState = STATE_WAIT; break;
+    const chibi::EngineCommand* show = nullptr;
+    for (size_t i = 0; i < g_engineCommands.size(); i++) {
+        const chibi::EngineCommand& command = g_engineCommands[i];
+        if (command.type == chibi::ENGINE_PLACE_WINDOW) {
+            chibi::TraceScope span("place_window", "window");
+            SetWindowPos(g_hwnd, NULL, command.rect.left, command.rect.top,
+                        command.rect.Width(), command.rect.Height(),
+                        SWP_NOZORDER | SWP_NOREDRAW | SWP_NOACTIVATE);
+        } else if (command.type == chibi::ENGINE_SHOW_FRAME) {
+            show = &command;
+        }
+    }
+    if (show) {
+        PresentFrame(show->animation, show->frame, show->flipped);
     }
     
-    // Find appropriate GIF for new state
-    size_t newGifIndex = g_currentGifIndex;
-    bool foundGif = false;
+    ArmAnimationTimer();
+}
+
+// Time until UpdateFrame has work to do, or -1 if nothing is scheduled. The
+// engine counts from its last tick, which may be a while ago.
+double MsUntilNextUpdate() {
+    double wait = g_engine.MsUntilNextUpdate();
+    if (wait < 0.0) return wait;
+    return std::max(0.0, wait - (g_clock.NowMs() - g_lastTickMs));
+}
+
+// Backup timer for modal loops (dialogs, menus) that bypass the main message
+// loop. It is pushed past the next update every frame, so it does not fire
+// while the main loop keeps up.
+void ArmAnimationTimer() {
+    double wait = MsUntilNextUpdate();
+    if (wait < 0.0) return;
     
-    GifType targetType;
-    switch (g_appState) {
-        case STATE_MOVE: targetType = MOVE; break;
-        case STATE_WAIT: targetType = WAIT; break;
-        case STATE_SIT: targetType = SIT; break;
-        default: targetType = MISC; break;
+    SetTimer(g_hwnd, ANIMATION_TIMER_ID, static_cast<UINT>(std::ceil(wait)) + ANIMATION_INTERVAL, NULL);
+}
+
+// Log and restart the frame-time period when it is over, and redraw the
+// overlay every so often while it is shown
+void UpdateMetrics(double now) {
+    if (now - g_metrics.SinceMs() >= METRICS_PERIOD_MS) {
+        DumpMetrics(now);
     }
     
-    for (size_t i = 0; i < g_gifs.size(); i++) {
-        if (g_gifs[i].type == targetType) {
-            newGifIndex = i;
-            foundGif = true;
-            break;
+    if (g_overlayVisible && now >= g_nextOverlayRefreshMs) {
+        g_nextOverlayRefreshMs = now + OVERLAY_REFRESH_MS;
+        PlaceOverlay();
+        InvalidateRect(g_overlayHwnd, NULL, FALSE);
+    }
+}
+
+// Append the current period to the CSV log (with a header if the file is
+// new) and start the next one. Decodes finishing on loader threads at the
+// same moment may land in either period.
+void DumpMetrics(double now) {
+    if (!g_metricsLogPath.empty() &&
+        (g_metrics.Histogram(chibi::METRIC_FRAME_INTERVAL).Count() > 0 ||
+         g_metrics.Histogram(chibi::METRIC_DECODE).Count() > 0)) {
+        std::string rows;
+        if (GetFileAttributesW(g_metricsLogPath.c_str()) == INVALID_FILE_ATTRIBUTES) {
+            rows = chibi::FrameMetrics::CsvHeader();
         }
+        g_metrics.AppendCsv(rows, now);
+        WriteTextFile(g_metricsLogPath, rows, true);
     }
     
-    if (foundGif && newGifIndex < g_gifs.size()) {
-        // Clear existing queue
-        g_frameQueue.clear();
-        g_currentFrameIndex = 0;
-        
-        // Queue frames from the new GIF
-        QueueFramesFromGif(newGifIndex);
-        
-        // Resize window to fit new GIF
-        ResizeWindowToGif(g_hwnd, g_gifs[newGifIndex].animation.image);
-        
-        // Set needsClear flag
-        needsClear = true;
-        
-        // Start animation timer
-        if (!g_frameQueue.empty()) {
-            SetTimer(g_hwnd, ANIMATION_TIMER_ID, g_frameQueue[0].delay, NULL);
-        }
+    g_metrics.Reset(now);
+}
+
+// Start recording trace spans, or stop and write them to TRACE_FILE as
+// Chrome trace-event JSON (open it in ui.perfetto.dev)
+void ToggleTracing() {
+    chibi::Tracer& tracer = chibi::GlobalTracer();
+    if (!tracer.Enabled()) {
+        tracer.Start();
+        tracer.NameThread("ui");
+        OutputDebugStringW(L"ChibiViewer: tracing started\n");
+        return;
+    }
+    
+    tracer.Stop();
+    std::string json;
+    tracer.AppendChromeJson(json);
+    
+    std::wstring path = GetLocalAppDataPath(TRACE_FILE);
+    wchar_t report[MAX_PATH + 128];
+    if (!path.empty() && WriteTextFile(path, json, false)) {
+        swprintf(report, MAX_PATH + 128, L"ChibiViewer: %u trace events (%u dropped) written to %ls\n",
+                 static_cast<unsigned>(tracer.EventCount()), static_cast<unsigned>(tracer.DroppedCount()), path.c_str());
     } else {
-        // If no valid GIF found, revert to previous state
-        g_appState = prevState;
+        swprintf(report, MAX_PATH + 128, L"ChibiViewer: could not write the trace\n");
     }
+    OutputDebugStringW(report);
 }
 
-// Modify UpdateAppState to properly handle move state
-void UpdateAppState() {
-    if (g_gifs.empty()) {
-        return;
+// Write text to a file, creating its folder if needed, or add it to the end
+bool WriteTextFile(const std::wstring& path, const std::string& text, bool append) {
+    std::wstring folder = path.substr(0, path.find_last_of(L'\\'));
+    CreateDirectoryW(folder.c_str(), NULL);
+    
+    HANDLE file = CreateFileW(path.c_str(), append ? FILE_APPEND_DATA : GENERIC_WRITE, FILE_SHARE_READ, NULL,
+                              append ? OPEN_ALWAYS : CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE) {
+        return false;
     }
     
-    // Store current state
-    AppState prevState = g_appState;
+    DWORD written = 0;
+    bool ok = WriteFile(file, text.data(), static_cast<DWORD>(text.size()), &written, NULL) &&
+              written == text.size();
+    CloseHandle(file);
+    return ok;
+}
+
+// Show or hide the metrics overlay
+void ToggleOverlay() {
+    if (g_overlayHwnd == NULL) return;
     
-    // Force move state for testing
-    int nextState = 0;  // Always use move state
+    g_overlayVisible = !g_overlayVisible;
+    if (g_overlayVisible) {
+        g_nextOverlayRefreshMs = 0.0;
+        PlaceOverlay();
+        ShowWindow(g_overlayHwnd, SW_SHOWNOACTIVATE);
+    } else {
+        ShowWindow(g_overlayHwnd, SW_HIDE);
+    }
+}
+
+// Keep the overlay just above the character, or below it at the top of
+// the screen
+void PlaceOverlay() {
+    int height = static_cast<int>(chibi::METRIC_COUNT + 1) * OVERLAY_LINE_HEIGHT + OVERLAY_MARGIN * 2;
     
-    // Move the dirDist declaration outside the switch
-    std::uniform_int_distribution<int> dirDist(0, 1);
+    RECT mainRect;
+    GetWindowRect(g_hwnd, &mainRect);
+    int top = mainRect.top - height;
+    if (top < 0) {
+        top = mainRect.bottom;
+    }
     
-    // Kill existing timers before state transition
-    KillTimer(g_hwnd, TIMER_ID);
-    KillTimer(g_hwnd, ANIMATION_TIMER_ID);
+    SetWindowPos(g_overlayHwnd, NULL, mainRect.left, top, OVERLAY_WIDTH, height,
+                SWP_NOZORDER | SWP_NOACTIVATE);
+}
+
+// Draws the current period's p50/p99/max per histogram and frames per state
+LRESULT CALLBACK OverlayWindowProc(HWND hwnd, UINT uMsg, WPARAM wParam, LPARAM lParam) {
+    static HFONT hFont = NULL;
     
-    switch (nextState) {
-        case 0:
-            g_appState = STATE_MOVE;
+    switch (uMsg) {
+        case WM_CREATE:
+            hFont = CreateFontW(
+                14, 0, 0, 0, FW_NORMAL, FALSE, FALSE, FALSE,
+                DEFAULT_CHARSET, OUT_DEFAULT_PRECIS, CLIP_DEFAULT_PRECIS,
+                DEFAULT_QUALITY, FIXED_PITCH | FF_MODERN, L"Consolas"
+            );
+            return 0;
+            
+        case WM_DESTROY:
+            if (hFont != NULL) {
+                DeleteObject(hFont);
+                hFont = NULL;
+            }
+            return 0;
             
-            // Randomly decide movement direction
-            g_moveDirectionRight = dirDist(g_randomEngine) == 1;
+        case WM_NCHITTEST:
+            return HTTRANSPARENT;
             
-            // Set the flipped state of MOVE gifs based on direction
-            for (size_t i = 0; i < g_gifs.size(); i++) {
-                if (g_gifs[i].type == MOVE) {
-                    g_gifs[i].flipped = !g_moveDirectionRight;
-                }
+        case WM_PAINT: {
+            PAINTSTRUCT ps;
+            HDC hdc = BeginPaint(hwnd, &ps);
+            
+            RECT clientRect;
+            GetClientRect(hwnd, &clientRect);
+            HBRUSH background = CreateSolidBrush(RGB(20, 20, 20));
+            FillRect(hdc, &clientRect, background);
+            DeleteObject(background);
+            
+            HFONT oldFont = (HFONT)SelectObject(hdc, hFont);
+            SetBkMode(hdc, TRANSPARENT);
+            SetTextColor(hdc, RGB(230, 230, 230));
+            
+            std::vector<std::string> lines;
+            g_metrics.FormatSummary(lines);
+            for (size_t i = 0; i < lines.size(); i++) {
+                std::wstring text(lines[i].begin(), lines[i].end());  // ASCII only
+                TextOutW(hdc, OVERLAY_MARGIN, OVERLAY_MARGIN + static_cast<int>(i) * OVERLAY_LINE_HEIGHT,
+                         text.c_str(), static_cast<int>(text.size()));
             }
             
-            // Start moving the window with consistent timing
-            SetTimer(g_hwnd, TIMER_ID, MOVE_INTERVAL, NULL);
-            break;
+            SelectObject(hdc, oldFont);
+            EndPaint(hwnd, &ps);
+            return 0;
+        }
     }
     
-    // Find the appropriate GIF for the new state 
-    size_t newGifIndex = g_currentGifIndex;
-    bool foundGif = false;
+    return DefWindowProc(hwnd, uMsg, wParam, lParam);
+}
+
+// Find the GIFs and animated WebPs in a folder and start decoding them on
+// the loader threads. Returns false if there are none; the animations
+// themselves arrive through OnAssetsLoaded as each one finishes.
+bool LoadGifsFromFolder(const std::wstring& folderPath) {
+    std::vector<PendingGif> found;
+    
+    for (size_t i = 0; i < sizeof(ANIMATION_PATTERNS) / sizeof(ANIMATION_PATTERNS[0]); i++) {
+        WIN32_FIND_DATAW findData;
+        std::wstring searchPath = folderPath + L"\\" + ANIMATION_PATTERNS[i];
+        
+        HANDLE hFind = FindFirstFileW(searchPath.c_str(), &findData);
+        if (hFind == INVALID_HANDLE_VALUE) {
+            continue;
+        }
+        
+        do {
+            if (!(findData.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)) {
+                std::wstring filename = findData.cFileName;
+                
+                PendingGif pending;
+                pending.filePath = folderPath + L"\\" + filename;
+                pending.type = GetGifTypeFromFilename(filename);
+                found.push_back(pending);
+            }
+        } while (FindNextFileW(hFind, &findData) != 0);
+        
+        FindClose(hFind);
+    }
     
-    GifType targetType;
-    switch (g_appState) {
-        case STATE_MOVE: targetType = MOVE; break;
+    if (found.empty()) {
+        return false;
     }
     
-    for (size_t i = 0; i < g_gifs.size(); i++) {
-        if (g_gifs[i].type == targetType) {
-            newGifIndex = i;
-            foundGif = true;
-            break;
+    g_assetLoader.Cancel();
+    g_pendingGifs.swap(found);
+    
+    g_loadTimings.Start(g_clock.NowMs());
+    g_diskCache.ResetStats();
+    
+    // Lazy mode: the WAIT animation (or the first GIF found) gets only its
+    // first frame decoded here, so something is on screen right away. If it
+    // cannot be decoded the next GIF is tried; the ones that fail stay
+    // pending, so the loader reports them and opens the menu if none loads.
+    if (LAZY_LOADING) {
+        size_t initial = 0;
+        for (size_t i = 0; i < g_pendingGifs.size(); i++) {
+            if (g_pendingGifs[i].type == chibi::ANIMATION_WAIT) {
+                initial = i;
+                break;
+            }
+        }
+        bool streaming = StartStreamingGif(initial);
+        for (size_t i = 0; i < g_pendingGifs.size() && !streaming; i++) {
+            if (i != initial) {
+                streaming = StartStreamingGif(i);
+            }
         }
     }
     
-    // Queue frames from the new GIF
-    if (foundGif && newGifIndex < g_gifs.size()) {
-        // Clear existing queue
-        g_frameQueue.clear();
-        g_currentFrameIndex = 0;
-        
-        // Queue frames from the new GIF
-        QueueFramesFromGif(newGifIndex);
-        
-        // Resize window to fit new GIF without forcing redraw
-        ResizeWindowToGif(g_hwnd, g_gifs[newGifIndex].animation.image);
-        
-        // Set needsClear flag
-        needsClear = true;
-        
-        // Start animation timer with consistent timing
-        if (!g_frameQueue.empty()) {
-            SetTimer(g_hwnd, ANIMATION_TIMER_ID, MIN_FRAME_DELAY, NULL);
-        }
+    // g_pendingGifs stays untouched until the loader is cancelled or finished
+    g_assetLoader.Start(g_pendingGifs.size(),
+        [](size_t index, chibi::FrameCache& cache, chibi::CompressedFrameStore& store) {
+            const PendingGif& pending = g_pendingGifs[index];
+            if (LoadCachedAnimation(pending.filePath, cache, store)) {
+                return true;
+            }
+            
+            // Missing or stale on disk: decode, and save for the next start
+            chibi::AssetStamp stamp;
+            if (!LoadFrameCache(pending.filePath, cache, &stamp)) {
+                return false;
+            }
+            
+            // Compress here rather than on the UI thread; the store flips
+            // walk cycles on demand. Kept decoded, the frames are packed
+            // into the atlas when the GIF is added.
+            if (FRAME_STORE_BUDGET > 0 && store.Build(cache, g_framePool)) {
+                g_diskCache.Save(pending.filePath, stamp, cache, store);
+                cache.ReleasePixels();
+            }
+            return true;
+        },
+        []() {
+            PostMessageW(g_hwnd, WM_ASSETS_LOADED, 0, 0);
+        });
+    
+    CheckFullyLoaded();
+    return true;
+}
+
+// Add a decoded (or partly decoded) GIF to the list and the registry. The
+// first one to arrive starts playing straight away.
+void AddGif(const PendingGif& pending, chibi::FrameCache&& cache, chibi::CompressedFrameStore&& store) {
+    GifInfo gifInfo;
+    gifInfo.filePath = pending.filePath;
+    gifInfo.type = pending.type;
+    gifInfo.animation.cache = std::move(cache);
+    gifInfo.animation.frameCount = static_cast<UINT>(gifInfo.animation.cache.frameCount);
+    gifInfo.animation.isPlaying = false;
+    if (!store.Empty()) {
+        gifInfo.animation.store = std::move(store);
+        gifInfo.animation.store.SetBudget(FRAME_STORE_BUDGET);
     } else {
-        // If no valid GIF found, revert to previous state
-        g_appState = prevState;
+        PackIntoAtlas(gifInfo.animation);
+    }
+    
+    // The compositor knows what the surface shows by the address of its
+    // source, which moves if the list has to grow
+    if (g_gifs.size() == g_gifs.capacity()) {
+        g_compositor.Invalidate();
     }
+    g_gifs.push_back(std::move(gifInfo));
+    g_hasGifs = true;
     
-    // Start a new timer for the next state change
-    StartStateTimer();
+    // The engine indexes it by type and by file name, under the same index
+    // as in g_gifs, and sizes the window to the first one and plays it
+    const GifInfo& gif = g_gifs.back();
+    const chibi::FrameCache& added = gif.animation.cache;
+    g_engine.AddAnimation(gif.type, GifTagFromPath(gif.filePath), added.width, added.height,
+                          added.delays, added.decodedCount, AnimationView(gif.animation));
+    ApplyEngineCommands();
 }
 
-// Modify LoadGifsFromFolder to queue frames after loading
-bool LoadGifsFromFolder(const std::wstring& folderPath) {
-    WIN32_FIND_DATAW findData;
-    HANDLE hFind;
-    std::wstring searchPath = folderPath + L"\\*.gif";
+// Decode the first frame of one pending GIF and show it. Its other frames
+// follow through StreamNextFrame; the loader threads get the other GIFs.
+// Only a GIF that starts streaming leaves g_pendingGifs.
+bool StartStreamingGif(size_t pendingIndex) {
+    if (pendingIndex >= g_pendingGifs.size()) return false;
+    
+    PendingGif pending = g_pendingGifs[pendingIndex];
+    
+    // Saved by an earlier run: every frame is ready without decoding
+    g_streaming.active = false;
+    chibi::FrameCache cached;
+    chibi::CompressedFrameStore cachedStore;
+    if (LoadCachedAnimation(pending.filePath, cached, cachedStore)) {
+        g_pendingGifs.erase(g_pendingGifs.begin() + pendingIndex);
+        AddGif(pending, std::move(cached), std::move(cachedStore));
+        return true;
+    }
+    
+    if (!g_streaming.file.Open(pending.filePath.c_str())) {
+        return false;
+    }
+    if (!chibi::MakeAssetStamp(pending.filePath, g_streaming.file.Data(), g_streaming.file.Size(), g_streaming.stamp)) {
+        g_streaming.stamp.size = 0;
+    }
     
-    hFind = FindFirstFileW(searchPath.c_str(), &findData);
-    if (hFind == INVALID_HANDLE_VALUE) {
+    chibi::FrameCache cache;
+    chibi::TraceScope span("decode_first_frame", "decode");
+    double decodeStart = g_clock.NowMs();
+    if (!g_streaming.builder.Begin(g_streaming.file.Data(), g_streaming.file.Size(), cache) ||
+        !g_streaming.builder.DecodeNext(cache)) {
+        g_streaming.file.Close();
         return false;
     }
+    g_metrics.Record(chibi::METRIC_DECODE, g_clock.NowMs() - decodeStart);
+    g_pendingGifs.erase(g_pendingGifs.begin() + pendingIndex);
     
-    do {
-        if (!(findData.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)) {
-            std::wstring filename = findData.cFileName;
-            std::wstring filePath = folderPath + L"\\" + filename;
-            
-            // Create a GIF info structure
-            GifInfo gifInfo;
-            gifInfo.filePath = filePath;
-            gifInfo.type = GetGifTypeFromFilename(filename);
-            gifInfo.animation.image = Gdiplus::Image::FromFile(filePath.c_str());
-            gifInfo.animation.isPlaying = false;
-            gifInfo.flipped = false;
-            
-            // Load frame info
-            gifInfo.animation.frameDelays = LoadGifFrameInfo(gifInfo.animation.image);
-            if (gifInfo.animation.frameDelays.empty()) {
-                delete gifInfo.animation.image;
-                continue;
-            }
-            
-            // Get frame count
-            UINT count = gifInfo.animation.image->GetFrameDimensionsCount();
-            GUID* dimensionIDs = new GUID[count];
-            gifInfo.animation.image->GetFrameDimensionsList(dimensionIDs, count);
-            gifInfo.animation.frameCount = gifInfo.animation.image->GetFrameCount(&dimensionIDs[0]);
-            delete[] dimensionIDs;
-            
-            // Add to our collection using move semantics
-            g_gifs.push_back(std::move(gifInfo));
-        }
-    } while (FindNextFileW(hFind, &findData) != 0);
+    // Later frames are mirrored as they are decoded
+    if (pending.type == chibi::ANIMATION_MOVE) {
+        cache.EnsureMirrored();
+    }
     
-    FindClose(hFind);
+    // Frames are compressed as they arrive and handed over once all are in
+    g_streaming.store.Clear();
+    if (FRAME_STORE_BUDGET > 0) {
+        g_streaming.store.Begin(cache, g_framePool);
+        g_streaming.store.Append(cache);
+    }
     
-    g_hasGifs = !g_gifs.empty();
+    g_streaming.gifIndex = g_gifs.size();
+    g_streaming.active = !g_streaming.builder.Finished();
+    AddGif(pending, std::move(cache));
+    if (!g_streaming.active) {
+        FinishStreamingStore(g_gifs[g_streaming.gifIndex]);
+    }
+    return true;
+}
+
+// Decode one more frame of the streaming GIF. Returns true while frames remain.
+bool StreamNextFrame() {
+    if (!g_streaming.active) return false;
     
-    // After loading GIFs, resize window to fit the first GIF and queue its frames
-    if (!g_gifs.empty() && g_gifs[0].animation.image != nullptr) {
-        // Clear any existing queue
-        g_frameQueue.clear();
-        g_currentFrameIndex = 0;
-        
-        // Queue frames from the first GIF
-        QueueFramesFromGif(0);
-        
-        // Resize window to fit the GIF
-        ResizeWindowToGif(g_hwnd, g_gifs[0].animation.image);
-        
-        // Start animation timer
-        if (!g_frameQueue.empty()) {
-            SetTimer(g_hwnd, ANIMATION_TIMER_ID, g_frameQueue[0].delay, NULL);
+    if (g_streaming.gifIndex < g_gifs.size()) {
+        GifAnimation& animation = g_gifs[g_streaming.gifIndex].animation;
+        double decodeStart = g_clock.NowMs();
+        {
+            chibi::TraceScope span("decode_frame", "decode", "frame", static_cast<int64_t>(animation.cache.decodedCount));
+            g_streaming.builder.DecodeNext(animation.cache);
+        }
+        g_metrics.Record(chibi::METRIC_DECODE, g_clock.NowMs() - decodeStart);
+        if (!g_streaming.store.Empty()) {
+            g_streaming.store.Append(animation.cache);
+        }
+        bool finished = g_streaming.builder.Finished();
+        if (finished) {
+            animation.frameCount = static_cast<UINT>(animation.cache.frameCount);
+            FinishStreamingStore(g_gifs[g_streaming.gifIndex]);
         }
         
-        // Force redraw
-        InvalidateRect(g_hwnd, NULL, TRUE);
+        // Once every frame is in, the window shrinks to the trimmed box
+        const chibi::FrameCache& cache = animation.cache;
+        g_engine.UpdateAnimation(g_streaming.gifIndex, cache.delays, cache.decodedCount, AnimationView(animation));
+        ApplyEngineCommands();
+        if (!finished) {
+            return true;
+        }
     }
     
-    return g_hasGifs;
+    g_streaming.active = false;
+    g_streaming.file.Close();
+    CheckFullyLoaded();
+    return false;
 }
 
-// Modify StartStateTimer to use consistent timing
-void StartStateTimer() {
-    // Kill any existing timers
-    KillTimer(g_hwnd, TIMER_ID);
-    KillTimer(g_hwnd, ANIMATION_TIMER_ID);
+// Streamed frames are decoded only when the next frame or walk step is not
+// due for a while, so playback never waits on them
+bool HasIdleTimeForStreaming() {
+    if (!g_streaming.active) return false;
     
-    if (g_appState == STATE_MOVE) {
-        // For movement state, use consistent timing
-        SetTimer(g_hwnd, TIMER_ID, MOVE_INTERVAL, NULL);
-    } else {
-        // For other states, use the random duration
-        std::uniform_int_distribution<int> durationDist(MIN_STATE_DURATION, MAX_STATE_DURATION);
-        int duration = durationDist(g_randomEngine);
-        SetTimer(g_hwnd, TIMER_ID, duration, NULL);
+    double wait = MsUntilNextUpdate();
+    return wait < 0.0 || wait > STREAM_MIN_IDLE_MS;
+}
+
+// Hand the streamed animation's compressed frames over once every frame is
+// in, keeping only a few decoded at a time from then on, and save them for
+// the next start
+void FinishStreamingStore(GifInfo& gif) {
+    GifAnimation& animation = gif.animation;
+    if (g_streaming.store.Empty() || !g_streaming.store.Finish(animation.cache)) {
+        g_streaming.store.Clear();
+        PackIntoAtlas(animation);
+        return;
     }
     
-    // Start animation for current GIF with minimum frame delay
-    if (g_hasGifs && g_currentGifIndex < g_gifs.size()) {
-        UINT initialDelay = std::max(g_gifs[g_currentGifIndex].animation.frameDelays[0], MIN_FRAME_DELAY);
-        SetTimer(g_hwnd, ANIMATION_TIMER_ID, initialDelay, NULL);
-    }
+    g_diskCache.Save(gif.filePath, g_streaming.stamp, animation.cache, g_streaming.store);
+    animation.store = std::move(g_streaming.store);
+    animation.store.SetBudget(FRAME_STORE_BUDGET);
+    animation.cache.ReleasePixels();
+    g_streaming.store.Clear();
 }
 
-// Modify MoveWindow to properly update flipped state
-void MoveWindow() {
-    if (g_appState != STATE_MOVE) {
-        return;
+// Move a fully decoded animation that has no compressed store into the
+// shared atlas, trimmed, and free its full-canvas frames. Left as it is if
+// packing fails.
+void PackIntoAtlas(GifAnimation& animation) {
+    if (!animation.store.Empty() || !animation.atlas.Empty() || !animation.cache.Complete()) return;
+    
+    if (animation.atlas.Build(g_atlas, animation.cache)) {
+        animation.cache.ReleasePixels();
     }
+}
+
+// Record and report the load timings once every GIF is fully decoded
+void CheckFullyLoaded() {
+    if (g_streaming.active || !g_assetLoader.Finished() || g_loadTimings.FullyLoaded()) return;
     
-    RECT windowRect;
-    GetWindowRect(g_hwnd, &windowRect);
+    g_loadTimings.MarkFullyLoaded(g_clock.NowMs());
     
-    int screenWidth = GetSystemMetrics(SM_CXSCREEN);
-    int windowWidth = windowRect.right - windowRect.left;
+    wchar_t report[128];
+    swprintf(report, 128, L"ChibiViewer: first pixel after %.1f ms, fully loaded after %.1f ms\n",
+             g_loadTimings.TimeToFirstPixelMs(), g_loadTimings.TimeToFullyLoadedMs());
+    OutputDebugStringW(report);
     
-    // Calculate the new position
-    int newX = windowRect.left;
-    if (g_moveDirectionRight) {
-        newX += MOVE_DISTANCE;
-        
-        // If we've reached the right edge, change direction
-        if (newX + windowWidth > screenWidth) {
-            g_moveDirectionRight = false;
-            
-            // Flip the GIF and update frame queue
-            for (size_t i = 0; i < g_gifs.size(); i++) {
-                if (g_gifs[i].type == MOVE) {
-                    g_gifs[i].flipped = true;
-                    // Re-queue frames with new flipped state
-                    QueueFramesFromGif(i);
-                }
+    if (g_diskCache.Enabled()) {
+        const chibi::DiskCacheStats& disk = g_diskCache.Stats();
+        swprintf(report, 128, L"ChibiViewer: disk cache %u hits, %u missing, %u stale, %u saved\n",
+                 disk.hits.load(), disk.misses.load(), disk.stale.load(), disk.saved.load());
+        OutputDebugStringW(report);
+    }
+    
+    // Frame memory: what the compressed stores hold against fully decoded
+    // frames, and how much of that the pack shares
+    size_t compressedBytes = 0;
+    size_t rawBytes = 0;
+    size_t frameCount = 0;
+    size_t repeatedFrames = 0;
+    for (size_t i = 0; i < g_gifs.size(); i++) {
+        const chibi::CompressedFrameStore& store = g_gifs[i].animation.store;
+        compressedBytes += store.CompressedBytes();
+        rawBytes += store.RawBytes();
+        frameCount += store.FrameCount();
+        repeatedFrames += store.RepeatedFrames();
+    }
+    if (rawBytes > 0) {
+        chibi::FramePoolStats pool = g_framePool.Stats();
+        swprintf(report, 128, L"ChibiViewer: frames compressed to %.1f MB from %.1f MB\n",
+                 compressedBytes / 1048576.0, rawBytes / 1048576.0);
+        OutputDebugStringW(report);
+        swprintf(report, 128, L"ChibiViewer: %zu of %zu frames repeated, %.1f MB shared down to %.1f MB (%.1f%% deduplicated)\n",
+                 repeatedFrames, frameCount, pool.referencedBytes / 1048576.0, pool.storedBytes / 1048576.0,
+                 pool.DedupeRatio() * 100.0);
+        OutputDebugStringW(report);
+    }
+    
+    // Frames kept decoded: the atlas pages against full canvases
+    if (g_atlas.PageCount() > 0) {
+        g_atlas.Compact();
+        size_t canvasBytes = 0;
+        for (size_t i = 0; i < g_gifs.size(); i++) {
+            const GifAnimation& animation = g_gifs[i].animation;
+            if (!animation.atlas.Empty()) {
+                canvasBytes += animation.cache.FrameBytes() * animation.atlas.FrameCount();
             }
         }
-    } else {
-        newX -= MOVE_DISTANCE;
-        
-        // If we've reached the left edge, change direction
-        if (newX < 0) {
-            g_moveDirectionRight = true;
-            
-            // Flip the GIF and update frame queue
-            for (size_t i = 0; i < g_gifs.size(); i++) {
-                if (g_gifs[i].type == MOVE) {
-                    g_gifs[i].flipped = false;
-                    // Re-queue frames with new flipped state
-                    QueueFramesFromGif(i);
-                }
-            }
+        swprintf(report, 128, L"ChibiViewer: frames packed into %zu atlas pages, %.1f MB instead of %.1f MB (%.1f%% occupied)\n",
+                 g_atlas.PageCount(), g_atlas.AllocatedBytes() / 1048576.0, canvasBytes / 1048576.0,
+                 g_atlas.Occupancy() * 100.0);
+        OutputDebugStringW(report);
+    }
+}
+
+// Take the GIFs the loader threads have finished
+void OnAssetsLoaded() {
+    std::vector<chibi::AssetLoadResult> results;
+    if (!g_assetLoader.Poll(results)) {
+        return;
+    }
+    
+    for (size_t i = 0; i < results.size(); i++) {
+        if (results[i].ok) {
+            AddGif(g_pendingGifs[results[i].index], std::move(results[i].cache), std::move(results[i].store));
         }
     }
     
-    // Update the window position
-    SetWindowPos(g_hwnd, NULL, newX, windowRect.top, 0, 0, 
-                SWP_NOSIZE | SWP_NOZORDER);
+    // Nothing in the folder could be decoded
+    if (g_assetLoader.Finished() && !g_hasGifs && !g_menuVisible) {
+        ToggleMenu();
+    }
     
-    // Force redraw to ensure smooth animation
-    InvalidateRect(g_hwnd, NULL, TRUE);
+    CheckFullyLoaded();
 }
 
 // Modify ToggleMenu to switch states when menu becomes visible
@@ -1156,58 +1356,79 @@ void ToggleMenu() {
                     SWP_NOZORDER);
         
         // Switch states immediately when menu becomes visible
-        if (!g_gifs.empty()) {
-            SwitchToNextGif();
-        }
+        g_engine.CycleState();
+        ApplyEngineCommands();
     }
 }
 
 // Determine GIF type from filename
-GifType GetGifTypeFromFilename(const std::wstring& filename) {
+chibi::AnimationType GetGifTypeFromFilename(const std::wstring& filename) {
     std::wstring lowerFilename = filename;
     std::transform(lowerFilename.begin(), lowerFilename.end(), lowerFilename.begin(), ::tolower);
     
     if (lowerFilename.find(L"move") != std::wstring::npos) {
-        return MOVE;
+        return chibi::ANIMATION_MOVE;
     } else if (lowerFilename.find(L"wait") != std::wstring::npos) {
-        return WAIT;
+        return chibi::ANIMATION_WAIT;
     } else if (lowerFilename.find(L"sit") != std::wstring::npos) {
-        return SIT;
+        return chibi::ANIMATION_SIT;
     } else if (lowerFilename.find(L"pick") != std::wstring::npos) {
-        return PICK;
+        return chibi::ANIMATION_PICK;
     } else {
-        return MISC;
+        return chibi::ANIMATION_MISC;
     }
 }
 
+// Registry tag for a GIF: its lower-case file name without extension, UTF-8
+std::string GifTagFromPath(const std::wstring& filePath) {
+    size_t nameStart = filePath.find_last_of(L"\\/");
+    nameStart = (nameStart == std::wstring::npos) ? 0 : nameStart + 1;
+    size_t nameEnd = filePath.find_last_of(L'.');
+    if (nameEnd == std::wstring::npos || nameEnd < nameStart) {
+        nameEnd = filePath.size();
+    }
+    
+    std::wstring name = filePath.substr(nameStart, nameEnd - nameStart);
+    std::transform(name.begin(), name.end(), name.begin(), ::tolower);
+    
+    int length = WideCharToMultiByte(CP_UTF8, 0, name.c_str(), static_cast<int>(name.size()), NULL, 0, NULL, NULL);
+    std::string tag(length > 0 ? length : 0, '\0');
+    if (length > 0) {
+        WideCharToMultiByte(CP_UTF8, 0, name.c_str(), static_cast<int>(name.size()), &tag[0], length, NULL, NULL);
+    }
+    return tag;
+}
+
 // Modify CleanupGifs to ensure proper cleanup
 void CleanupGifs() {
-    // Kill any existing timers
-    KillTimer(g_hwnd, TIMER_ID);
+    // Stop decoding before the list the loader reads from goes away
+    g_assetLoader.Cancel();
+    g_pendingGifs.clear();
+    g_streaming.active = false;
+    g_streaming.file.Close();
+    g_streaming.store.Clear();
+    
+    // Kill the backup timer and stop playback
     KillTimer(g_hwnd, ANIMATION_TIMER_ID);
+    g_engine.Clear();
+    g_shownGifIndex = SIZE_MAX;
     
-    // Clear frame queue
-    g_frameQueue.clear();
-    g_currentFrameIndex = 0;
-    
-    // Clean up layers
-    if (g_topLayer) {
-        delete g_topLayer;
-        g_topLayer = nullptr;
-    }
-    if (g_bottomLayer) {
-        delete g_bottomLayer;
-        g_bottomLayer = nullptr;
-    }
+    // The surface may show frames from caches that are about to be freed
+    g_compositor.Invalidate();
     
     // Clean up GIFs
     for (size_t i = 0; i < g_gifs.size(); i++) {
-        if (g_gifs[i].animation.image != nullptr) {
-            delete g_gifs[i].animation.image;
-            g_gifs[i].animation.image = nullptr;
-        }
+        g_gifs[i].animation.cache.Clear();
+        g_gifs[i].animation.store.Clear();
+        g_gifs[i].animation.atlas.Clear();
     }
+    g_atlas.Clear();
     
     g_gifs.clear();
     g_hasGifs = false;
+    
+    // Every store has released its pool references by now
+    if (!g_framePool.Empty()) {
+        OutputDebugStringW(L"ChibiViewer: frame pool still holds frames after cleanup\n");
+    }
 } 
\ No newline at end of file
@@ -0,0 +1,114 @@
+// Presenter that shows frames through UpdateLayeredWindow.
+//
+// Keeps a single top-down 32-bit DIB section selected into a memory DC for
+// the lifetime of the window. Frames are written straight into the DIB bits
+// and pushed with per-pixel alpha, so edges are smooth instead of colour-keyed
+// and no WM_PAINT round trip is needed. Only the dirty part of the DIB is
+// handed to the compositor when the window size has not changed.
+#pragma once
+
+#include <windows.h>
+
+#include "core/Presenter.h"
+
+class LayeredWindowPresenter : public chibi::IPresenter {
+public:
+    explicit LayeredWindowPresenter(HWND hwnd)
+        : hwnd(hwnd), memDC(NULL), dib(NULL), oldBitmap(NULL), bits(nullptr), width(0), height(0),
+          sizeChanged(true) {}
+
+    ~LayeredWindowPresenter() {
+        ReleaseSurface();
+    }
+
+    bool Resize(int newWidth, int newHeight) override {
+        ReleaseSurface();
+        if (newWidth <= 0 || newHeight <= 0) return false;
+
+        HDC screenDC = GetDC(NULL);
+        memDC = CreateCompatibleDC(screenDC);
+        ReleaseDC(NULL, screenDC);
+        if (!memDC) return false;
+
+        BITMAPINFO bmi = {};
+        bmi.bmiHeader.biSize = sizeof(BITMAPINFOHEADER);
+        bmi.bmiHeader.biWidth = newWidth;
+        bmi.bmiHeader.biHeight = -newHeight;  // Top-down rows
+        bmi.bmiHeader.biPlanes = 1;
+        bmi.bmiHeader.biBitCount = 32;
+        bmi.bmiHeader.biCompression = BI_RGB;
+
+        void* dibBits = nullptr;
+        dib = CreateDIBSection(memDC, &bmi, DIB_RGB_COLORS, &dibBits, NULL, 0);
+        if (!dib) {
+            ReleaseSurface();
+            return false;
+        }
+
+        oldBitmap = SelectObject(memDC, dib);
+        bits = static_cast<uint8_t*>(dibBits);
+        width = newWidth;
+        height = newHeight;
+        sizeChanged = true;
+        return true;
+    }
+
+    chibi::Surface GetSurface() override {
+        chibi::Surface surface = { bits, width, height, static_cast<size_t>(width) * 4 };
+        return surface;
+    }
+
+    using chibi::IPresenter::Present;
+
+    bool Present(const chibi::PixelRect& dirty) override {
+        if (!bits) return false;
+        if (dirty.Empty() && !sizeChanged) return true;
+
+        POINT sourcePos = { 0, 0 };
+        SIZE size = { width, height };
+        BLENDFUNCTION blend = { AC_SRC_OVER, 0, 255, AC_SRC_ALPHA };
+        RECT dirtyRect = { dirty.left, dirty.top, dirty.right, dirty.bottom };
+
+        UPDATELAYEREDWINDOWINFO info = {};
+        info.cbSize = sizeof(info);
+        info.hdcDst = NULL;
+        info.pptDst = NULL;  // Keep the window where it is
+        info.psize = &size;
+        info.hdcSrc = memDC;
+        info.pptSrc = &sourcePos;
+        info.crKey = 0;
+        info.pblend = &blend;
+        info.dwFlags = ULW_ALPHA;
+        info.prcDirty = sizeChanged ? NULL : &dirtyRect;  // A resize needs the whole surface
+
+        // A failed update leaves the window at its old size, so the next
+        // one must still send the whole surface
+        if (!UpdateLayeredWindowIndirect(hwnd, &info)) return false;
+        sizeChanged = false;
+        return true;
+    }
+
+private:
+    void ReleaseSurface() {
+        if (memDC) {
+            if (oldBitmap) SelectObject(memDC, oldBitmap);
+            DeleteDC(memDC);
+        }
+        if (dib) DeleteObject(dib);
+        memDC = NULL;
+        dib = NULL;
+        oldBitmap = NULL;
+        bits = nullptr;
+        width = 0;
+        height = 0;
+    }
+
+    HWND hwnd;
+    HDC memDC;
+    HBITMAP dib;
+    HGDIOBJ oldBitmap;
+    uint8_t* bits;
+    int width;
+    int height;
+    bool sizeChanged;
+};
@@ -0,0 +1,93 @@
+// Owning, move-only byte buffer with a guaranteed start alignment.
+//
+// Used for pixel storage so SIMD kernels can rely on aligned rows and a
+// whole animation can live in a single allocation.
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+
+namespace chibi {
+
+const size_t PIXEL_ALIGNMENT = 32;  // Enough for AVX2 loads and stores
+
+class AlignedBuffer {
+public:
+    AlignedBuffer() : raw(nullptr), aligned(nullptr), bytes(0) {}
+
+    explicit AlignedBuffer(size_t size, size_t alignment = PIXEL_ALIGNMENT)
+        : raw(nullptr), aligned(nullptr), bytes(0) {
+        Allocate(size, alignment);
+    }
+
+    AlignedBuffer(AlignedBuffer&& other) noexcept
+        : raw(other.raw), aligned(other.aligned), bytes(other.bytes) {
+        other.raw = nullptr;
+        other.aligned = nullptr;
+        other.bytes = 0;
+    }
+
+    AlignedBuffer& operator=(AlignedBuffer&& other) noexcept {
+        if (this != &other) {
+            Release();
+            raw = other.raw;
+            aligned = other.aligned;
+            bytes = other.bytes;
+            other.raw = nullptr;
+            other.aligned = nullptr;
+            other.bytes = 0;
+        }
+        return *this;
+    }
+
+    AlignedBuffer(const AlignedBuffer&) = delete;
+    AlignedBuffer& operator=(const AlignedBuffer&) = delete;
+
+    ~AlignedBuffer() {
+        Release();
+    }
+
+    // Replaces the contents with size zeroed bytes. Returns false on allocation failure.
+    bool Allocate(size_t size, size_t alignment = PIXEL_ALIGNMENT) {
+        Release();
+        if (size == 0) return true;
+
+        // calloc hands large blocks over as fresh zero pages, so nothing is
+        // touched until it is written
+        raw = std::calloc(size + alignment - 1, 1);
+        if (!raw) return false;
+
+        uintptr_t address = reinterpret_cast<uintptr_t>(raw);
+        address = (address + alignment - 1) & ~static_cast<uintptr_t>(alignment - 1);
+        aligned = reinterpret_cast<uint8_t*>(address);
+        bytes = size;
+        return true;
+    }
+
+    void Release() {
+        std::free(raw);
+        raw = nullptr;
+        aligned = nullptr;
+        bytes = 0;
+    }
+
+    uint8_t* Data() { return aligned; }
+    const uint8_t* Data() const { return aligned; }
+    size_t Size() const { return bytes; }
+    bool Empty() const { return bytes == 0; }
+
+private:
+    void* raw;
+    uint8_t* aligned;
+    size_t bytes;
+};
+
+// Rounds a row size in bytes up to the pixel alignment
+inline size_t AlignedStride(int width) {
+    size_t rowBytes = static_cast<size_t>(width) * 4;
+    return (rowBytes + PIXEL_ALIGNMENT - 1) & ~(PIXEL_ALIGNMENT - 1);
+}
+
+} // namespace chibi
@@ -0,0 +1,145 @@
+// Animation lookup by state and tag.
+//
+// Animations are referred to by the caller's own index; the registry never
+// sees the animation objects. Each state keeps its own list of variants and
+// a Vose alias table over their weights, so finding the variants of a state
+// and picking one at random are both O(1) regardless of how many animations
+// are registered.
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <vector>
+#include <random>
+#include <unordered_map>
+
+namespace chibi {
+
+typedef size_t AnimationId;
+
+class AnimationRegistry {
+public:
+    AnimationRegistry() : count(0) {}
+
+    void Clear() {
+        states.clear();
+        tags.clear();
+        count = 0;
+    }
+
+    // Registers an animation as a variant of state (any small non-negative
+    // number, e.g. an enum). Higher weights are picked more often.
+    void Add(AnimationId id, int state, double weight = 1.0) {
+        if (state < 0) return;
+        if (static_cast<size_t>(state) >= states.size()) {
+            states.resize(state + 1);
+        }
+        Bucket& bucket = states[state];
+        bucket.ids.push_back(id);
+        bucket.weights.push_back(weight > 0.0 ? weight : 0.0);
+        bucket.dirty = true;
+        count++;
+    }
+
+    void AddTag(AnimationId id, const std::string& tag) {
+        tags[tag].push_back(id);
+    }
+
+    // Every variant of a state, in registration order
+    const std::vector<AnimationId>& ForState(int state) const {
+        if (state < 0 || static_cast<size_t>(state) >= states.size()) return empty;
+        return states[state].ids;
+    }
+
+    const std::vector<AnimationId>& ForTag(const std::string& tag) const {
+        auto it = tags.find(tag);
+        return it == tags.end() ? empty : it->second;
+    }
+
+    // First registered variant of a state
+    bool First(int state, AnimationId& id) const {
+        const std::vector<AnimationId>& ids = ForState(state);
+        if (ids.empty()) return false;
+        id = ids[0];
+        return true;
+    }
+
+    // Weighted random variant of a state
+    template <typename Rng>
+    bool Pick(int state, Rng& rng, AnimationId& id) const {
+        if (state < 0 || static_cast<size_t>(state) >= states.size()) return false;
+        const Bucket& bucket = states[state];
+        if (bucket.ids.empty()) return false;
+        if (bucket.ids.size() == 1) {
+            id = bucket.ids[0];
+            return true;
+        }
+
+        if (bucket.dirty) BuildAliasTable(bucket);
+
+        std::uniform_int_distribution<size_t> column(0, bucket.ids.size() - 1);
+        std::uniform_real_distribution<double> coin(0.0, 1.0);
+        size_t i = column(rng);
+        id = coin(rng) < bucket.probability[i] ? bucket.ids[i] : bucket.ids[bucket.alias[i]];
+        return true;
+    }
+
+    size_t Size() const { return count; }
+    size_t StateCount() const { return states.size(); }
+
+private:
+    struct Bucket {
+        std::vector<AnimationId> ids;
+        std::vector<double> weights;
+        // Alias table, rebuilt on the first pick after a change
+        mutable std::vector<double> probability;
+        mutable std::vector<size_t> alias;
+        mutable bool dirty;
+
+        Bucket() : dirty(true) {}
+    };
+
+    // Vose's alias method: O(n) to build, O(1) per pick
+    static void BuildAliasTable(const Bucket& bucket) {
+        size_t n = bucket.ids.size();
+        bucket.probability.assign(n, 1.0);
+        bucket.alias.assign(n, 0);
+
+        double total = 0.0;
+        for (size_t i = 0; i < n; i++) total += bucket.weights[i];
+
+        bucket.dirty = false;
+        if (total <= 0.0) return;  // All weights zero: uniform
+
+        std::vector<double> scaled(n);
+        std::vector<size_t> small;
+        std::vector<size_t> large;
+        for (size_t i = 0; i < n; i++) {
+            scaled[i] = bucket.weights[i] * n / total;
+            (scaled[i] < 1.0 ? small : large).push_back(i);
+        }
+
+        while (!small.empty() && !large.empty()) {
+            size_t s = small.back();
+            small.pop_back();
+            size_t l = large.back();
+            large.pop_back();
+
+            bucket.probability[s] = scaled[s];
+            bucket.alias[s] = l;
+            scaled[l] = (scaled[l] + scaled[s]) - 1.0;
+            (scaled[l] < 1.0 ? small : large).push_back(l);
+        }
+
+        // Whatever is left is 1 up to rounding
+        for (size_t i : small) bucket.probability[i] = 1.0;
+        for (size_t i : large) bucket.probability[i] = 1.0;
+    }
+
+    std::vector<Bucket> states;
+    std::unordered_map<std::string, std::vector<AnimationId>> tags;
+    std::vector<AnimationId> empty;
+    size_t count;
+};
+
+} // namespace chibi
@@ -0,0 +1,172 @@
+// Parallel asset loading.
+//
+// The caller lists its assets up front; a small pool of worker threads then
+// claims them one at a time and decodes each into its own FrameCache, and
+// optionally compresses it into a CompressedFrameStore as well. Results
+// come back through a lock-free completion queue in the order they finish,
+// so the first animation can be shown while the rest are still decoding. An
+// optional notify callback runs on the worker after each result is queued,
+// e.g. to wake the UI thread.
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <functional>
+#include <thread>
+#include <vector>
+#include <algorithm>
+
+#include "CompletionQueue.h"
+#include "FrameCache.h"
+#include "FrameStore.h"
+#include "Trace.h"
+
+namespace chibi {
+
+const unsigned MAX_LOADER_THREADS = 8;
+
+struct AssetLoadResult {
+    size_t index;      // Position in the list passed to Start
+    bool ok;
+    FrameCache cache;
+    CompressedFrameStore store;  // Empty unless the load function filled it
+
+    AssetLoadResult() : index(0), ok(false) {}
+};
+
+// Startup milestones on an IClock timeline. Negative until reached.
+struct LoadTimings {
+    double startMs;
+    double firstPixelMs;
+    double fullyLoadedMs;
+
+    LoadTimings() : startMs(-1.0), firstPixelMs(-1.0), fullyLoadedMs(-1.0) {}
+
+    void Start(double nowMs) {
+        startMs = nowMs;
+        firstPixelMs = -1.0;
+        fullyLoadedMs = -1.0;
+    }
+
+    void MarkFirstPixel(double nowMs) {
+        if (startMs >= 0.0 && firstPixelMs < 0.0) firstPixelMs = nowMs;
+    }
+
+    void MarkFullyLoaded(double nowMs) {
+        if (startMs >= 0.0 && fullyLoadedMs < 0.0) fullyLoadedMs = nowMs;
+    }
+
+    bool FullyLoaded() const { return fullyLoadedMs >= 0.0; }
+
+    double TimeToFirstPixelMs() const { return firstPixelMs < 0.0 ? -1.0 : firstPixelMs - startMs; }
+    double TimeToFullyLoadedMs() const { return fullyLoadedMs < 0.0 ? -1.0 : fullyLoadedMs - startMs; }
+};
+
+class AssetLoader {
+public:
+    // Decodes asset index into cache. Runs on a worker thread.
+    typedef std::function<bool(size_t index, FrameCache& cache, CompressedFrameStore& store)> LoadFunc;
+    typedef std::function<void()> NotifyFunc;
+
+    AssetLoader() : count(0), next(0), completed(0), delivered(0), cancelled(false) {}
+
+    ~AssetLoader() {
+        Cancel();
+    }
+
+    AssetLoader(const AssetLoader&) = delete;
+    AssetLoader& operator=(const AssetLoader&) = delete;
+
+    // Starts loading count assets on up to maxThreads workers (0 = one per
+    // hardware thread, capped at MAX_LOADER_THREADS). Any load in progress
+    // is cancelled first.
+    void Start(size_t assetCount, LoadFunc loadFunc, NotifyFunc notifyFunc = NotifyFunc(), unsigned maxThreads = 0) {
+        Cancel();
+
+        count = assetCount;
+        next = 0;
+        completed = 0;
+        delivered = 0;
+        cancelled = false;
+        load = loadFunc;
+        notify = notifyFunc;
+
+        if (maxThreads == 0) {
+            maxThreads = std::min(std::max(std::thread::hardware_concurrency(), 1u), MAX_LOADER_THREADS);
+        }
+        size_t threadCount = std::min<size_t>(maxThreads, assetCount);
+        for (size_t i = 0; i < threadCount; i++) {
+            workers.emplace_back(&AssetLoader::WorkerLoop, this);
+        }
+    }
+
+    // Consumer thread only. Appends results finished since the last call.
+    bool Poll(std::vector<AssetLoadResult>& results) {
+        size_t before = results.size();
+        if (!done.PopAll(results)) return false;
+        delivered += results.size() - before;
+        return true;
+    }
+
+    // Every asset has been loaded (or failed) and handed out by Poll
+    bool Finished() const { return delivered == count; }
+
+    size_t Count() const { return count; }
+    size_t Completed() const { return completed.load(); }
+
+    // Stops handing out work, waits for the workers and drops undelivered
+    // results
+    void Cancel() {
+        cancelled = true;
+        Wait();
+        std::vector<AssetLoadResult> dropped;
+        done.PopAll(dropped);
+        count = 0;
+        delivered = 0;
+    }
+
+    // Blocks until the workers have finished
+    void Wait() {
+        for (size_t i = 0; i < workers.size(); i++) {
+            if (workers[i].joinable()) workers[i].join();
+        }
+        workers.clear();
+    }
+
+private:
+    void WorkerLoop() {
+        GlobalTracer().NameThread("loader");
+        for (;;) {
+            if (cancelled.load()) return;
+            size_t index = next.fetch_add(1);
+            if (index >= count) return;
+
+            AssetLoadResult result;
+            result.index = index;
+            {
+                TraceScope span("load_asset", "load", "index", static_cast<int64_t>(index));
+                result.ok = load(index, result.cache, result.store);
+            }
+            if (!result.ok) {
+                result.cache.Clear();
+                result.store.Clear();
+            }
+
+            done.Push(std::move(result));
+            completed.fetch_add(1);
+            if (notify) notify();
+        }
+    }
+
+    size_t count;
+    std::atomic<size_t> next;
+    std::atomic<size_t> completed;
+    size_t delivered;
+    std::atomic<bool> cancelled;
+    LoadFunc load;
+    NotifyFunc notify;
+    std::vector<std::thread> workers;
+    CompletionQueue<AssetLoadResult> done;
+};
+
+} // namespace chibi
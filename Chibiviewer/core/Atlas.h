@@ -0,0 +1,295 @@
+// Texture atlas of trimmed frames.
+//
+// Every frame is cut down to the box around its non-transparent pixels and
+// packed with a skyline (bottom-left) packer into a few large pages shared
+// by all animations, so decoded frames cost a handful of allocations
+// instead of one full canvas (plus a mirrored copy) per frame. Sprites
+// start on aligned columns and each keeps its page position and its box in
+// frame coordinates; everything outside the box is transparent. Mirrored
+// frames are not stored; the compositor flips sprite rows as it copies.
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <vector>
+
+#include "AlignedBuffer.h"
+#include "FrameCache.h"
+#include "PixelRect.h"
+#include "Trim.h"
+
+namespace chibi {
+
+const int ATLAS_PAGE_SIZE = 2048;  // Pixels per side of a page
+const int ATLAS_COLUMN_ALIGNMENT = static_cast<int>(PIXEL_ALIGNMENT / 4);  // Sprites start on aligned columns
+
+struct AtlasSprite {
+    uint32_t page;
+    int x;              // Top-left corner in the page
+    int y;
+    PixelRect source;   // Box in frame coordinates; empty for a blank frame
+};
+
+// Skyline bin packer for one page: keeps the height of the packed area
+// along the page width and puts each rectangle as low as it fits, leftmost
+// on ties
+class SkylinePacker {
+public:
+    SkylinePacker() : width(0), height(0), usedHeight(0) {}
+
+    void Reset(int pageWidth, int pageHeight) {
+        width = pageWidth;
+        height = pageHeight;
+        usedHeight = 0;
+        Segment floor = { 0, 0, pageWidth };
+        skyline.assign(1, floor);
+    }
+
+    bool Insert(int rectWidth, int rectHeight, int& x, int& y) {
+        size_t best = skyline.size();
+        int bestTop = height + 1;
+        int bestWaste = 0;
+        for (size_t i = 0; i < skyline.size(); i++) {
+            int top = 0;
+            if (!Fit(i, rectWidth, rectHeight, top)) continue;
+            int waste = skyline[i].width;
+            if (top + rectHeight < bestTop || (top + rectHeight == bestTop && waste < bestWaste)) {
+                best = i;
+                bestTop = top + rectHeight;
+                bestWaste = waste;
+            }
+        }
+        if (best == skyline.size()) return false;
+
+        x = skyline[best].x;
+        y = bestTop - rectHeight;
+        Place(best, x, bestTop, rectWidth);
+        if (bestTop > usedHeight) usedHeight = bestTop;
+        return true;
+    }
+
+    // Stops packing below the given height (after the page was cut down)
+    void Shrink(int pageHeight) { height = pageHeight; }
+
+    int Width() const { return width; }
+    int Height() const { return height; }
+    int UsedHeight() const { return usedHeight; }
+
+private:
+    struct Segment {
+        int x;
+        int y;      // Height of the packed area over [x, x + width)
+        int width;
+    };
+
+    // Lowest y at which a rectangle starting at segment index fits
+    bool Fit(size_t index, int rectWidth, int rectHeight, int& y) const {
+        int x = skyline[index].x;
+        if (x + rectWidth > width) return false;
+
+        y = 0;
+        int remaining = rectWidth;
+        for (size_t i = index; remaining > 0; i++) {
+            if (skyline[i].y > y) y = skyline[i].y;
+            if (y + rectHeight > height) return false;
+            remaining -= skyline[i].width;
+        }
+        return true;
+    }
+
+    // Raises the skyline over [x, x + rectWidth) to top
+    void Place(size_t index, int x, int top, int rectWidth) {
+        Segment raised = { x, top, rectWidth };
+        skyline.insert(skyline.begin() + index, raised);
+
+        // Cut back the segments the new one now covers
+        int right = x + rectWidth;
+        while (index + 1 < skyline.size() && skyline[index + 1].x < right) {
+            Segment& next = skyline[index + 1];
+            int covered = right - next.x;
+            if (next.width <= covered) {
+                skyline.erase(skyline.begin() + index + 1);
+            } else {
+                next.x += covered;
+                next.width -= covered;
+                break;
+            }
+        }
+
+        // Merge neighbours at the same height
+        for (size_t i = 0; i + 1 < skyline.size();) {
+            if (skyline[i].y == skyline[i + 1].y) {
+                skyline[i].width += skyline[i + 1].width;
+                skyline.erase(skyline.begin() + i + 1);
+            } else {
+                i++;
+            }
+        }
+    }
+
+    int width;
+    int height;
+    int usedHeight;
+    std::vector<Segment> skyline;
+};
+
+class FrameAtlas {
+public:
+    explicit FrameAtlas(int pageSize = ATLAS_PAGE_SIZE) : pageSize(AlignColumns(pageSize)), spritePixels(0) {}
+
+    FrameAtlas(const FrameAtlas&) = delete;
+    FrameAtlas& operator=(const FrameAtlas&) = delete;
+
+    // Trims a frame to its non-transparent box and copies that in
+    bool Add(const uint32_t* frame, int width, int height, size_t stride, AtlasSprite& sprite) {
+        sprite.page = 0;
+        sprite.x = 0;
+        sprite.y = 0;
+        sprite.source = OpaqueBounds(frame, width, height, stride);
+        if (sprite.source.Empty()) return true;
+
+        int spriteWidth = sprite.source.Width();
+        int spriteHeight = sprite.source.Height();
+        if (!Allocate(AlignColumns(spriteWidth), spriteHeight, sprite)) return false;
+
+        Page& page = pages[sprite.page];
+        const uint8_t* src = reinterpret_cast<const uint8_t*>(frame) + sprite.source.top * stride + sprite.source.left * 4;
+        uint8_t* dst = page.pixels.Data() + sprite.y * page.stride + sprite.x * 4;
+        for (int y = 0; y < spriteHeight; y++) {
+            std::memcpy(dst + y * page.stride, src + y * stride, static_cast<size_t>(spriteWidth) * 4);
+        }
+        spritePixels += static_cast<size_t>(spriteWidth) * spriteHeight;
+        return true;
+    }
+
+    // Row of a sprite, counted from the top of its box
+    const uint32_t* SpriteRow(const AtlasSprite& sprite, int row) const {
+        const Page& page = pages[sprite.page];
+        return reinterpret_cast<const uint32_t*>(page.pixels.Data() + (sprite.y + row) * page.stride) + sprite.x;
+    }
+
+    // Cuts every page down to the rows in use. Sprites keep their places;
+    // later sprites only go into what is left of each page.
+    bool Compact() {
+        for (size_t i = 0; i < pages.size(); i++) {
+            Page& page = pages[i];
+            int rows = page.packer.UsedHeight();
+            if (rows >= page.packer.Height()) continue;
+
+            AlignedBuffer smaller;
+            if (!smaller.Allocate(page.stride * rows)) return false;
+            std::memcpy(smaller.Data(), page.pixels.Data(), page.stride * rows);
+            page.pixels = std::move(smaller);
+            page.packer.Shrink(rows);
+        }
+        return true;
+    }
+
+    void Clear() {
+        pages.clear();
+        spritePixels = 0;
+    }
+
+    size_t PageCount() const { return pages.size(); }
+
+    size_t AllocatedBytes() const {
+        size_t total = 0;
+        for (size_t i = 0; i < pages.size(); i++) total += pages[i].pixels.Size();
+        return total;
+    }
+
+    // Pixels inside sprites, against everything allocated for the pages
+    size_t SpriteBytes() const { return spritePixels * 4; }
+
+    double Occupancy() const {
+        size_t allocated = AllocatedBytes();
+        return allocated > 0 ? static_cast<double>(SpriteBytes()) / allocated : 0.0;
+    }
+
+private:
+    struct Page {
+        AlignedBuffer pixels;
+        size_t stride;
+        SkylinePacker packer;
+    };
+
+    static int AlignColumns(int width) {
+        return (width + ATLAS_COLUMN_ALIGNMENT - 1) / ATLAS_COLUMN_ALIGNMENT * ATLAS_COLUMN_ALIGNMENT;
+    }
+
+    // Finds room in an existing page, or starts a new one (bigger than
+    // usual for a sprite that would not fit a normal page)
+    bool Allocate(int width, int height, AtlasSprite& sprite) {
+        for (size_t i = 0; i < pages.size(); i++) {
+            if (pages[i].packer.Insert(width, height, sprite.x, sprite.y)) {
+                sprite.page = static_cast<uint32_t>(i);
+                return true;
+            }
+        }
+
+        Page page;
+        int pageWidth = width > pageSize ? width : pageSize;
+        int pageHeight = height > pageSize ? height : pageSize;
+        page.stride = AlignedStride(pageWidth);
+        if (!page.pixels.Allocate(page.stride * pageHeight)) return false;
+        page.packer.Reset(pageWidth, pageHeight);
+        page.packer.Insert(width, height, sprite.x, sprite.y);
+
+        pages.push_back(std::move(page));
+        sprite.page = static_cast<uint32_t>(pages.size() - 1);
+        return true;
+    }
+
+    int pageSize;
+    size_t spritePixels;
+    std::vector<Page> pages;
+};
+
+// One animation's frames in an atlas, plus what playback needs besides
+// the pixels
+struct AtlasAnimation {
+    int width;
+    int height;
+    std::vector<AtlasSprite> sprites;
+    std::vector<PixelRect> dirtyRects;
+
+    AtlasAnimation() : width(0), height(0) {}
+
+    bool Empty() const { return sprites.empty(); }
+    size_t FrameCount() const { return sprites.size(); }
+
+    // Dirty box of a frame as shown, mirrored along with the pixels
+    PixelRect DirtyRect(size_t index, bool flipped) const {
+        if (index >= dirtyRects.size()) return PixelRect::Make(0, 0, width, height);
+        return flipped ? dirtyRects[index].Mirrored(width) : dirtyRects[index];
+    }
+
+    // Packs every frame of a fully decoded cache. The cache is left
+    // untouched; release its pixels afterwards to get the memory back.
+    bool Build(FrameAtlas& atlas, const FrameCache& cache) {
+        Clear();
+        if (cache.Empty() || !cache.Complete() || !cache.HasPixels()) return false;
+
+        sprites.resize(cache.frameCount);
+        for (size_t i = 0; i < cache.frameCount; i++) {
+            if (!atlas.Add(cache.Frame(i), cache.width, cache.height, cache.stride, sprites[i])) {
+                Clear();
+                return false;
+            }
+        }
+        width = cache.width;
+        height = cache.height;
+        dirtyRects = cache.dirtyRects;
+        return true;
+    }
+
+    void Clear() {
+        width = 0;
+        height = 0;
+        sprites.clear();
+        dirtyRects.clear();
+    }
+};
+
+} // namespace chibi
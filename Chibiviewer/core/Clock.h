@@ -0,0 +1,43 @@
+// Time sources.
+//
+// Code that waits on or measures time takes an IClock instead of calling the
+// OS directly, so the same logic runs against the real monotonic clock in the
+// viewer and against a hand-driven clock in headless runs.
+#pragma once
+
+#include <chrono>
+
+namespace chibi {
+
+class IClock {
+public:
+    virtual ~IClock() {}
+
+    // Milliseconds on a monotonic timeline with an arbitrary origin
+    virtual double NowMs() const = 0;
+};
+
+// std::chrono::steady_clock (QueryPerformanceCounter on Windows)
+class SteadyClock : public IClock {
+public:
+    double NowMs() const override {
+        return std::chrono::duration<double, std::milli>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+};
+
+// Only moves when told to
+class ManualClock : public IClock {
+public:
+    explicit ManualClock(double startMs = 0.0) : now(startMs) {}
+
+    double NowMs() const override { return now; }
+
+    void Set(double ms) { now = ms; }
+    void AdvanceMs(double ms) { now += ms; }
+
+private:
+    double now;
+};
+
+} // namespace chibi
@@ -0,0 +1,77 @@
+// Lock-free multi-producer, single-consumer queue.
+//
+// Worker threads push finished items with a single compare-and-swap; the
+// consumer takes everything pushed so far with one atomic exchange and gets
+// it back in the order it was pushed. Neither side ever blocks.
+#pragma once
+
+#include <atomic>
+#include <vector>
+#include <utility>
+
+namespace chibi {
+
+template <typename T>
+class CompletionQueue {
+public:
+    CompletionQueue() : head(nullptr) {}
+
+    ~CompletionQueue() {
+        Node* node = head.exchange(nullptr);
+        while (node) {
+            Node* next = node->next;
+            delete node;
+            node = next;
+        }
+    }
+
+    CompletionQueue(const CompletionQueue&) = delete;
+    CompletionQueue& operator=(const CompletionQueue&) = delete;
+
+    // Any thread
+    void Push(T item) {
+        Node* node = new Node(std::move(item));
+        node->next = head.load(std::memory_order_relaxed);
+        while (!head.compare_exchange_weak(node->next, node, std::memory_order_release,
+                                           std::memory_order_relaxed)) {
+        }
+    }
+
+    // Consumer thread only. Appends everything pushed so far, oldest first.
+    // Returns false if there was nothing.
+    bool PopAll(std::vector<T>& out) {
+        Node* node = head.exchange(nullptr, std::memory_order_acquire);
+        if (!node) return false;
+
+        // The stack holds newest first
+        Node* reversed = nullptr;
+        while (node) {
+            Node* next = node->next;
+            node->next = reversed;
+            reversed = node;
+            node = next;
+        }
+
+        while (reversed) {
+            Node* next = reversed->next;
+            out.push_back(std::move(reversed->item));
+            delete reversed;
+            reversed = next;
+        }
+        return true;
+    }
+
+    bool Empty() const { return head.load(std::memory_order_acquire) == nullptr; }
+
+private:
+    struct Node {
+        T item;
+        Node* next;
+
+        explicit Node(T&& item) : item(std::move(item)), next(nullptr) {}
+    };
+
+    std::atomic<Node*> head;
+};
+
+} // namespace chibi
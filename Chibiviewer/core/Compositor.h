@@ -0,0 +1,235 @@
+// Frame compositor.
+//
+// Writes cached frames straight into a presenter's surface. It remembers
+// which frame the surface currently holds, so re-showing the same frame
+// costs nothing and stepping to the next frame of the same animation
+// (including the wrap back to frame 0) only copies that frame's dirty box.
+// Anything else (new animation, direction change, resize) is a full copy.
+// Frames can come from a FrameCache, from a CompressedFrameStore (decoded
+// on demand) or from a FrameAtlas, where trimmed sprites are expanded back
+// to the full canvas and flipped while copying. A view crops the frames to
+// the part of the canvas the window shows (see Trim.h).
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+
+#include "Atlas.h"
+#include "FrameCache.h"
+#include "FrameStore.h"
+#include "Mirror.h"
+#include "PixelRect.h"
+#include "Presenter.h"
+
+namespace chibi {
+
+struct CompositorStats {
+    uint64_t framesComposed;  // Frames that changed the surface
+    uint64_t framesReused;    // Requests for the frame already on the surface
+    uint64_t fullCopies;
+    uint64_t partialCopies;
+    uint64_t bytesRead;
+    uint64_t bytesWritten;
+};
+
+class Compositor {
+public:
+    Compositor() : lastSource(nullptr), lastFrame(0), lastFlipped(false), valid(false),
+                   lastRegion(PixelRect::EmptyRect()), view(PixelRect::EmptyRect()) {
+        ResetStats();
+    }
+
+    // Forget what the surface holds (after a resize or when caches are freed)
+    void Invalidate() {
+        valid = false;
+        lastSource = nullptr;
+    }
+
+    // Shows only this box of the frames (as shown, after any flip) with its
+    // top-left corner at the surface's. Empty shows whole frames.
+    void SetView(const PixelRect& newView) {
+        if (newView.left == view.left && newView.top == view.top &&
+            newView.right == view.right && newView.bottom == view.bottom) {
+            return;
+        }
+        view = newView;
+        Invalidate();
+    }
+
+    // Puts frame frameIndex of cache on the surface. Returns true if any
+    // pixel was written, false if the surface already showed that frame.
+    bool Compose(const Surface& surface, const FrameCache& cache, size_t frameIndex, bool flipped) {
+        if (!surface.pixels || frameIndex >= cache.decodedCount) return false;
+
+        flipped = flipped && cache.HasMirrored();
+
+        PixelRect region;
+        if (!PlanRegion(surface, &cache, cache.width, cache.height, cache.frameCount, frameIndex, flipped,
+                        cache.DirtyRect(frameIndex, flipped), region)) {
+            return false;
+        }
+
+        CopyRegion(surface, cache.Frame(frameIndex, flipped), cache.stride, region);
+        Commit(&cache, frameIndex, flipped, region);
+        return true;
+    }
+
+    // Same for a compressed store. The frame is only decoded if the surface
+    // does not already show it.
+    bool Compose(const Surface& surface, CompressedFrameStore& store, size_t frameIndex, bool flipped) {
+        if (!surface.pixels || frameIndex >= store.FrameCount()) return false;
+
+        PixelRect region;
+        if (!PlanRegion(surface, &store, store.Width(), store.Height(), store.FrameCount(), frameIndex, flipped,
+                        store.DirtyRect(frameIndex, flipped), region)) {
+            return false;
+        }
+
+        const uint32_t* pixels = store.Frame(frameIndex, flipped);
+        if (!pixels) {
+            Invalidate();
+            return false;
+        }
+
+        CopyRegion(surface, pixels, store.Stride(), region);
+        Commit(&store, frameIndex, flipped, region);
+        return true;
+    }
+
+    // Same for an animation packed into an atlas
+    bool Compose(const Surface& surface, const FrameAtlas& atlas, const AtlasAnimation& animation,
+                 size_t frameIndex, bool flipped) {
+        if (!surface.pixels || frameIndex >= animation.FrameCount()) return false;
+
+        PixelRect region;
+        if (!PlanRegion(surface, &animation, animation.width, animation.height, animation.FrameCount(), frameIndex,
+                        flipped, animation.DirtyRect(frameIndex, flipped), region)) {
+            return false;
+        }
+
+        CopySpriteRegion(surface, atlas, animation.sprites[frameIndex], animation.width, flipped, region);
+        Commit(&animation, frameIndex, flipped, region);
+        return true;
+    }
+
+    // Area of the surface written by the last Compose call; what needs
+    // presenting
+    PixelRect LastRegion() const { return lastRegion; }
+
+    const CompositorStats& Stats() const { return stats; }
+
+    void ResetStats() {
+        std::memset(&stats, 0, sizeof(stats));
+    }
+
+private:
+    // Picks the area to copy. Returns false if the surface already shows
+    // the frame.
+    bool PlanRegion(const Surface& surface, const void* source, int width, int height, size_t frameCount,
+                    size_t frameIndex, bool flipped, const PixelRect& dirty, PixelRect& region) {
+        if (valid && lastSource == source && lastFrame == frameIndex && lastFlipped == flipped) {
+            stats.framesReused++;
+            lastRegion = PixelRect::EmptyRect();
+            return false;
+        }
+
+        // Everything is in frame coordinates until Commit
+        PixelRect full = PixelRect::Make(0, 0, width, height);
+        if (!view.Empty()) full = PixelRect::Intersect(full, view);
+        full.right = std::min(full.right, OriginX() + surface.width);
+        full.bottom = std::min(full.bottom, OriginY() + surface.height);
+        region = full;
+
+        // The next frame of what is already shown only needs its dirty box
+        bool sequential = valid && lastSource == source && lastFlipped == flipped &&
+                          frameIndex == (lastFrame + 1) % frameCount;
+        if (sequential) {
+            region = PixelRect::Intersect(dirty, full);
+            stats.partialCopies++;
+        } else {
+            stats.fullCopies++;
+        }
+        return true;
+    }
+
+    void Commit(const void* source, size_t frameIndex, bool flipped, const PixelRect& region) {
+        lastSource = source;
+        lastFrame = frameIndex;
+        lastFlipped = flipped;
+        lastRegion = region.Empty() ? region : PixelRect::Make(region.left - OriginX(), region.top - OriginY(),
+                                                               region.right - OriginX(), region.bottom - OriginY());
+        valid = true;
+        stats.framesComposed++;
+    }
+
+    void CopyRegion(const Surface& surface, const uint32_t* frame, size_t frameStride, const PixelRect& region) {
+        if (region.Empty()) return;
+
+        const uint8_t* src = reinterpret_cast<const uint8_t*>(frame);
+        size_t rowBytes = static_cast<size_t>(region.Width()) * 4;
+        for (int y = region.top; y < region.bottom; y++) {
+            std::memcpy(surface.pixels + (y - OriginY()) * surface.stride + (region.left - OriginX()) * 4,
+                        src + y * frameStride + region.left * 4, rowBytes);
+        }
+
+        uint64_t bytes = static_cast<uint64_t>(rowBytes) * region.Height();
+        stats.bytesRead += bytes;
+        stats.bytesWritten += bytes;
+    }
+
+    // Copies the sprite's part of each region row and clears the rest
+    void CopySpriteRegion(const Surface& surface, const FrameAtlas& atlas, const AtlasSprite& sprite, int width,
+                          bool flipped, const PixelRect& region) {
+        static const MirrorRowFunc mirrorRow = GetMirrorRowFunc();
+        if (region.Empty()) return;
+
+        const PixelRect& source = sprite.source;
+        PixelRect shown = flipped ? source.Mirrored(width) : source;
+        size_t rowBytes = static_cast<size_t>(region.Width()) * 4;
+        uint64_t bytesRead = 0;
+
+        for (int y = region.top; y < region.bottom; y++) {
+            // dst[i] is frame column region.left + i
+            uint32_t* dst = reinterpret_cast<uint32_t*>(surface.pixels + (y - OriginY()) * surface.stride) +
+                            (region.left - OriginX());
+            int left = std::max(region.left, shown.left);
+            int right = std::min(region.right, shown.right);
+            if (y < shown.top || y >= shown.bottom || left >= right) {
+                std::memset(dst, 0, rowBytes);
+                continue;
+            }
+
+            std::memset(dst, 0, static_cast<size_t>(left - region.left) * 4);
+            std::memset(dst + (right - region.left), 0, static_cast<size_t>(region.right - right) * 4);
+
+            // Shown columns [left, right) come from frame columns
+            // [width - right, width - left) when flipped
+            const uint32_t* row = atlas.SpriteRow(sprite, y - source.top);
+            if (flipped) {
+                mirrorRow(row + (width - right - source.left), dst + (left - region.left), right - left);
+            } else {
+                std::memcpy(dst + (left - region.left), row + (left - source.left),
+                            static_cast<size_t>(right - left) * 4);
+            }
+            bytesRead += static_cast<uint64_t>(right - left) * 4;
+        }
+
+        stats.bytesRead += bytesRead;
+        stats.bytesWritten += static_cast<uint64_t>(rowBytes) * region.Height();
+    }
+
+    // Frame coordinates of the surface's top-left pixel
+    int OriginX() const { return view.Empty() ? 0 : view.left; }
+    int OriginY() const { return view.Empty() ? 0 : view.top; }
+
+    const void* lastSource;  // FrameCache, CompressedFrameStore or AtlasAnimation
+    size_t lastFrame;
+    bool lastFlipped;
+    bool valid;
+    PixelRect lastRegion;
+    PixelRect view;
+    CompositorStats stats;
+};
+
+} // namespace chibi
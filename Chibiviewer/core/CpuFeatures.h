@@ -0,0 +1,92 @@
+// Runtime CPU feature detection for the SIMD kernels.
+//
+// Kernels are compiled for the baseline target plus per-function target
+// attributes, and the best one is picked once at runtime, so a single
+// binary runs on any x86-64 machine and on non-x86 builds (scalar only).
+#pragma once
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define CHIBI_X86 1
+#if defined(_MSC_VER)
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#include <immintrin.h>
+#else
+#define CHIBI_X86 0
+#endif
+
+// MSVC accepts any intrinsic without flags; GCC and Clang need the ISA
+// enabled on the function that uses it.
+#if CHIBI_X86 && !defined(_MSC_VER)
+#define CHIBI_TARGET_SSE2 __attribute__((target("sse2")))
+#define CHIBI_TARGET_SSSE3 __attribute__((target("ssse3")))
+#define CHIBI_TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define CHIBI_TARGET_SSE2
+#define CHIBI_TARGET_SSSE3
+#define CHIBI_TARGET_AVX2
+#endif
+
+namespace chibi {
+
+struct CpuFeatures {
+    bool sse2;
+    bool ssse3;
+    bool avx2;
+};
+
+namespace detail {
+
+inline CpuFeatures DetectCpuFeatures() {
+    CpuFeatures features = { false, false, false };
+#if CHIBI_X86
+    unsigned int regs[4] = { 0, 0, 0, 0 };  // eax, ebx, ecx, edx
+    unsigned int maxLeaf = 0;
+
+#if defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 0);
+    maxLeaf = static_cast<unsigned int>(info[0]);
+    __cpuid(info, 1);
+    for (int i = 0; i < 4; i++) regs[i] = static_cast<unsigned int>(info[i]);
+#else
+    maxLeaf = __get_cpuid_max(0, nullptr);
+    __get_cpuid(1, &regs[0], &regs[1], &regs[2], &regs[3]);
+#endif
+
+    features.sse2 = (regs[3] & (1u << 26)) != 0;
+    features.ssse3 = (regs[2] & (1u << 9)) != 0;
+
+    // AVX2 also needs the OS to save YMM state (OSXSAVE + XCR0 bits 1 and 2)
+    bool osxsave = (regs[2] & (1u << 27)) != 0;
+    bool avx = (regs[2] & (1u << 28)) != 0;
+    if (maxLeaf >= 7 && osxsave && avx) {
+#if defined(_MSC_VER)
+        unsigned long long xcr0 = _xgetbv(0);
+        __cpuidex(info, 7, 0);
+        unsigned int leaf7ebx = static_cast<unsigned int>(info[1]);
+#else
+        unsigned int xcrLow = 0, xcrHigh = 0;
+        __asm__ volatile("xgetbv" : "=a"(xcrLow), "=d"(xcrHigh) : "c"(0));
+        unsigned long long xcr0 = (static_cast<unsigned long long>(xcrHigh) << 32) | xcrLow;
+        unsigned int leaf7[4] = { 0, 0, 0, 0 };
+        __cpuid_count(7, 0, leaf7[0], leaf7[1], leaf7[2], leaf7[3]);
+        unsigned int leaf7ebx = leaf7[1];
+#endif
+        features.avx2 = (xcr0 & 0x6) == 0x6 && (leaf7ebx & (1u << 5)) != 0;
+    }
+#endif
+    return features;
+}
+
+} // namespace detail
+
+// Detected once, on first use
+inline const CpuFeatures& GetCpuFeatures() {
+    static const CpuFeatures features = detail::DetectCpuFeatures();
+    return features;
+}
+
+} // namespace chibi
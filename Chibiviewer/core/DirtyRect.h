@@ -0,0 +1,179 @@
+// Bounding box of the pixels that differ between two images.
+//
+// Computed once per frame at load time so the renderer only copies and
+// presents the part of the window that actually changes. Rows are compared
+// 8 (AVX2) or 4 (SSE2) pixels per instruction, and once a box is known only
+// the columns outside it are scanned on the remaining rows.
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+
+#include "CpuFeatures.h"
+#include "PixelRect.h"
+
+namespace chibi {
+
+// Index of the first differing pixel in [begin, end), or end
+typedef int (*FirstDiffFunc)(const uint32_t* a, const uint32_t* b, int begin, int end);
+// Index of the last differing pixel in [begin, end), or begin - 1
+typedef int (*LastDiffFunc)(const uint32_t* a, const uint32_t* b, int begin, int end);
+
+inline int FirstDiffScalar(const uint32_t* a, const uint32_t* b, int begin, int end) {
+    for (int x = begin; x < end; x++) {
+        if (a[x] != b[x]) return x;
+    }
+    return end;
+}
+
+inline int LastDiffScalar(const uint32_t* a, const uint32_t* b, int begin, int end) {
+    for (int x = end - 1; x >= begin; x--) {
+        if (a[x] != b[x]) return x;
+    }
+    return begin - 1;
+}
+
+#if CHIBI_X86
+CHIBI_TARGET_SSE2 inline int FirstDiffSse2(const uint32_t* a, const uint32_t* b, int begin, int end) {
+    int x = begin;
+    for (; x + 4 <= end; x += 4) {
+        __m128i va = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a + x));
+        __m128i vb = _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + x));
+        int equal = _mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(va, vb)));
+        if (equal != 0xF) {
+            for (int i = 0; i < 4; i++) {
+                if (!(equal & (1 << i))) return x + i;
+            }
+        }
+    }
+    return FirstDiffScalar(a, b, x, end);
+}
+
+CHIBI_TARGET_SSE2 inline int LastDiffSse2(const uint32_t* a, const uint32_t* b, int begin, int end) {
+    int x = end;
+    for (; x - 4 >= begin; x -= 4) {
+        __m128i va = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a + x - 4));
+        __m128i vb = _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + x - 4));
+        int equal = _mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(va, vb)));
+        if (equal != 0xF) {
+            for (int i = 3; i >= 0; i--) {
+                if (!(equal & (1 << i))) return x - 4 + i;
+            }
+        }
+    }
+    return LastDiffScalar(a, b, begin, x);
+}
+
+CHIBI_TARGET_AVX2 inline int FirstDiffAvx2(const uint32_t* a, const uint32_t* b, int begin, int end) {
+    int x = begin;
+    for (; x + 8 <= end; x += 8) {
+        __m256i va = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + x));
+        __m256i vb = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b + x));
+        int equal = _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpeq_epi32(va, vb)));
+        if (equal != 0xFF) {
+            for (int i = 0; i < 8; i++) {
+                if (!(equal & (1 << i))) return x + i;
+            }
+        }
+    }
+    return FirstDiffScalar(a, b, x, end);
+}
+
+CHIBI_TARGET_AVX2 inline int LastDiffAvx2(const uint32_t* a, const uint32_t* b, int begin, int end) {
+    int x = end;
+    for (; x - 8 >= begin; x -= 8) {
+        __m256i va = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + x - 8));
+        __m256i vb = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b + x - 8));
+        int equal = _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpeq_epi32(va, vb)));
+        if (equal != 0xFF) {
+            for (int i = 7; i >= 0; i--) {
+                if (!(equal & (1 << i))) return x - 8 + i;
+            }
+        }
+    }
+    return LastDiffScalar(a, b, begin, x);
+}
+#endif
+
+struct DiffKernels {
+    FirstDiffFunc firstDiff;
+    LastDiffFunc lastDiff;
+};
+
+// Best kernels for this CPU, chosen once
+inline const DiffKernels& GetDiffKernels() {
+    static const DiffKernels kernels = []() {
+        DiffKernels chosen = { FirstDiffScalar, LastDiffScalar };
+#if CHIBI_X86
+        const CpuFeatures& cpu = GetCpuFeatures();
+        if (cpu.avx2) {
+            chosen.firstDiff = FirstDiffAvx2;
+            chosen.lastDiff = LastDiffAvx2;
+        } else if (cpu.sse2) {
+            chosen.firstDiff = FirstDiffSse2;
+            chosen.lastDiff = LastDiffSse2;
+        }
+#endif
+        return chosen;
+    }();
+    return kernels;
+}
+
+// Smallest rectangle inside bounds containing every pixel that differs
+// between images a and b (same size and stride). Empty if they match.
+inline PixelRect ComputeDirtyRect(const uint8_t* a, const uint8_t* b, size_t stride, const PixelRect& bounds,
+                                  const DiffKernels& kernels = GetDiffKernels()) {
+    if (bounds.Empty()) return PixelRect::EmptyRect();
+
+    const int left = bounds.left;
+    const int right = bounds.right;
+
+    // First changed row from the top, with its leftmost and rightmost change
+    int top = bounds.top;
+    int minX = right;
+    int maxX = left - 1;
+    for (; top < bounds.bottom; top++) {
+        const uint32_t* rowA = reinterpret_cast<const uint32_t*>(a + top * stride);
+        const uint32_t* rowB = reinterpret_cast<const uint32_t*>(b + top * stride);
+        minX = kernels.firstDiff(rowA, rowB, left, right);
+        if (minX < right) {
+            maxX = kernels.lastDiff(rowA, rowB, minX, right);
+            break;
+        }
+    }
+    if (top == bounds.bottom) return PixelRect::EmptyRect();
+
+    // Last changed row from the bottom
+    int bottom = bounds.bottom - 1;
+    for (; bottom > top; bottom--) {
+        const uint32_t* rowA = reinterpret_cast<const uint32_t*>(a + bottom * stride);
+        const uint32_t* rowB = reinterpret_cast<const uint32_t*>(b + bottom * stride);
+        int first = kernels.firstDiff(rowA, rowB, left, right);
+        if (first < right) {
+            minX = first < minX ? first : minX;
+            int last = kernels.lastDiff(rowA, rowB, first, right);
+            maxX = last > maxX ? last : maxX;
+            break;
+        }
+    }
+
+    // Rows in between can only widen the box, so only scan outside it
+    for (int y = top + 1; y < bottom; y++) {
+        const uint32_t* rowA = reinterpret_cast<const uint32_t*>(a + y * stride);
+        const uint32_t* rowB = reinterpret_cast<const uint32_t*>(b + y * stride);
+        if (minX > left) {
+            int first = kernels.firstDiff(rowA, rowB, left, minX);
+            if (first < minX) minX = first;
+        }
+        if (maxX < right - 1) {
+            int last = kernels.lastDiff(rowA, rowB, maxX + 1, right);
+            if (last > maxX) maxX = last;
+        }
+        if (minX == left && maxX == right - 1) break;
+    }
+
+    return PixelRect::Make(minX, top, maxX + 1, bottom + 1);
+}
+
+} // namespace chibi
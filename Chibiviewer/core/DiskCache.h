@@ -0,0 +1,479 @@
+// Persistent on-disk cache of compressed frames.
+//
+// Each animation file gets one cache file holding its frames exactly as a
+// CompressedFrameStore codes them, plus delays and dirty rects, so the next
+// start maps one file and skips decoding altogether. Entries are keyed by
+// the source path (hashed into the file name, and stored in full), size,
+// modification time and a HashBytes of its contents. A source with the
+// same size and time is taken as unchanged without reading it; only one
+// whose time moved is hashed, and if its contents are the same the entry
+// is kept and given the new time. Any other mismatch, a different format
+// version or a corrupt payload makes the entry stale, and the caller
+// decodes the source and saves a fresh entry. Files are written
+// to a temporary name and renamed into place, so a reader never sees a
+// half-written entry. Thread-safe: loader workers load and save in
+// parallel.
+//
+// Layout, little-endian: header (stamp, canvas, opaque bounds), source
+// path, delays, dirty rects, frame table (source, keyframe flag, offset,
+// size), coded runs. Mirrored frames are not stored; the store flips them
+// on demand.
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "FrameCache.h"
+#include "FramePool.h"
+#include "FrameStore.h"
+#include "Hash.h"
+#include "MappedFile.h"
+
+namespace chibi {
+
+#ifdef _WIN32
+typedef std::wstring NativePath;
+#else
+typedef std::string NativePath;
+#endif
+
+const uint32_t DISK_CACHE_MAGIC = 0x43464243u;  // "CBFC"
+const uint32_t DISK_CACHE_VERSION = 2;  // 2: opaque bounds in the header
+const size_t MAX_DISK_CACHE_FRAMES = 1 << 16;
+const int MAX_DISK_CACHE_DIMENSION = 65535;  // The largest GIF canvas
+
+// What a cache entry was built from
+struct AssetStamp {
+    uint64_t size;
+    uint64_t modified;     // Platform file time; only compared for equality
+    uint64_t contentHash;  // HashBytes of the whole file
+};
+
+enum DiskCacheStatus {
+    DISK_CACHE_HIT,
+    DISK_CACHE_MISS,   // No entry yet
+    DISK_CACHE_STALE   // Entry for an older file, another format or corrupt
+};
+
+struct DiskCacheStats {
+    std::atomic<unsigned> hits;
+    std::atomic<unsigned> misses;
+    std::atomic<unsigned> stale;
+    std::atomic<unsigned> saved;
+    std::atomic<unsigned> restamped;  // Hits whose source was touched but not changed
+
+    DiskCacheStats() : hits(0), misses(0), stale(0), saved(0), restamped(0) {}
+};
+
+namespace detail {
+
+const size_t DISK_CACHE_HEADER_BYTES = 72;
+const size_t DISK_CACHE_RECT_BYTES = 16;
+const size_t DISK_CACHE_FRAME_ENTRY_BYTES = 24;
+
+inline void PutLe32(std::vector<uint8_t>& out, uint32_t value) {
+    for (int i = 0; i < 4; i++) out.push_back(static_cast<uint8_t>(value >> (8 * i)));
+}
+
+inline void PutLe64(std::vector<uint8_t>& out, uint64_t value) {
+    for (int i = 0; i < 8; i++) out.push_back(static_cast<uint8_t>(value >> (8 * i)));
+}
+
+inline uint32_t GetLe32(const uint8_t* p) {
+    return static_cast<uint32_t>(p[0]) | (static_cast<uint32_t>(p[1]) << 8) |
+           (static_cast<uint32_t>(p[2]) << 16) | (static_cast<uint32_t>(p[3]) << 24);
+}
+
+inline uint64_t GetLe64(const uint8_t* p) {
+    return static_cast<uint64_t>(GetLe32(p)) | (static_cast<uint64_t>(GetLe32(p + 4)) << 32);
+}
+
+inline void PadTo8(std::vector<uint8_t>& out) {
+    while (out.size() % 8 != 0) out.push_back(0);
+}
+
+inline size_t RoundUp8(size_t value) {
+    return (value + 7) & ~static_cast<size_t>(7);
+}
+
+// Size and modification time of a file
+inline bool StatFile(const NativePath& path, uint64_t& size, uint64_t& modified) {
+#ifdef _WIN32
+    WIN32_FILE_ATTRIBUTE_DATA info;
+    if (!GetFileAttributesExW(path.c_str(), GetFileExInfoStandard, &info)) return false;
+    size = (static_cast<uint64_t>(info.nFileSizeHigh) << 32) | info.nFileSizeLow;
+    modified = (static_cast<uint64_t>(info.ftLastWriteTime.dwHighDateTime) << 32) | info.ftLastWriteTime.dwLowDateTime;
+#else
+    struct stat info;
+    if (stat(path.c_str(), &info) != 0) return false;
+    size = static_cast<uint64_t>(info.st_size);
+    modified = static_cast<uint64_t>(info.st_mtim.tv_sec) * 1000000000ull + static_cast<uint64_t>(info.st_mtim.tv_nsec);
+#endif
+    return true;
+}
+
+// Writes bytes to a temporary file and renames it over path
+inline bool WriteFileAtomically(const NativePath& path, const std::vector<uint8_t>& bytes) {
+#ifdef _WIN32
+    NativePath temp = path + L".tmp";
+    HANDLE file = CreateFileW(temp.c_str(), GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE) return false;
+
+    DWORD written = 0;
+    bool ok = WriteFile(file, bytes.data(), static_cast<DWORD>(bytes.size()), &written, NULL) &&
+              written == bytes.size();
+    CloseHandle(file);
+    if (!ok || !MoveFileExW(temp.c_str(), path.c_str(), MOVEFILE_REPLACE_EXISTING)) {
+        DeleteFileW(temp.c_str());
+        return false;
+    }
+#else
+    NativePath temp = path + ".tmp";
+    int fd = open(temp.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) return false;
+
+    size_t done = 0;
+    while (done < bytes.size()) {
+        ssize_t n = write(fd, bytes.data() + done, bytes.size() - done);
+        if (n <= 0) break;
+        done += static_cast<size_t>(n);
+    }
+    close(fd);
+    if (done != bytes.size() || rename(temp.c_str(), path.c_str()) != 0) {
+        unlink(temp.c_str());
+        return false;
+    }
+#endif
+    return true;
+}
+
+// Overwrites 8 bytes of an existing file, little-endian
+inline bool PatchLe64(const NativePath& path, size_t offset, uint64_t value) {
+    uint8_t bytes[8];
+    for (int i = 0; i < 8; i++) bytes[i] = static_cast<uint8_t>(value >> (8 * i));
+#ifdef _WIN32
+    HANDLE file = CreateFileW(path.c_str(), GENERIC_WRITE, 0, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE) return false;
+
+    DWORD written = 0;
+    bool ok = SetFilePointer(file, static_cast<LONG>(offset), NULL, FILE_BEGIN) != INVALID_SET_FILE_POINTER &&
+              WriteFile(file, bytes, sizeof(bytes), &written, NULL) && written == sizeof(bytes);
+    CloseHandle(file);
+    return ok;
+#else
+    int fd = open(path.c_str(), O_WRONLY);
+    if (fd < 0) return false;
+    bool ok = pwrite(fd, bytes, sizeof(bytes), static_cast<off_t>(offset)) == static_cast<ssize_t>(sizeof(bytes));
+    close(fd);
+    return ok;
+#endif
+}
+
+// Creates a directory and any missing parents
+inline void CreateDirectories(const NativePath& path) {
+    for (size_t i = 1; i <= path.size(); i++) {
+        if (i < path.size() && path[i] != '/' && path[i] != '\\') continue;
+        NativePath prefix = path.substr(0, i);
+#ifdef _WIN32
+        CreateDirectoryW(prefix.c_str(), NULL);
+#else
+        mkdir(prefix.c_str(), 0755);
+#endif
+    }
+}
+
+} // namespace detail
+
+// Stamp of a file whose contents are already in memory (e.g. mapped for
+// decoding), so the stamp matches exactly what was decoded
+inline bool MakeAssetStamp(const NativePath& path, const uint8_t* contents, size_t contentSize, AssetStamp& stamp) {
+    if (!detail::StatFile(path, stamp.size, stamp.modified) || stamp.size != contentSize) return false;
+    stamp.contentHash = HashBytes(contents, contentSize);
+    return true;
+}
+
+class DiskCache {
+public:
+    DiskCache() {}
+
+    DiskCache(const DiskCache&) = delete;
+    DiskCache& operator=(const DiskCache&) = delete;
+
+    // Directory for the cache files, created on the first save. An empty
+    // directory disables the cache. Not thread-safe; set it before loading.
+    void SetDirectory(const NativePath& path) {
+        directory = path;
+        if (!directory.empty() && directory.back() != '/' && directory.back() != '\\') {
+            directory += static_cast<NativePath::value_type>(PATH_SEPARATOR);
+        }
+    }
+
+    bool Enabled() const { return !directory.empty(); }
+
+    // The entry for sourcePath: <directory><hash of the path>.cfc
+    NativePath EntryPath(const NativePath& sourcePath) const {
+        uint64_t key = HashBytes(sourcePath.data(), sourcePath.size() * sizeof(NativePath::value_type));
+        char name[32];
+        std::snprintf(name, sizeof(name), "%016llx.cfc", static_cast<unsigned long long>(key));
+        return directory + NativePath(name, name + std::strlen(name));
+    }
+
+    // Fills store (in pool) and the metadata of cache (size, delays, dirty
+    // rects; no pixels) from the entry for sourcePath
+    DiskCacheStatus Load(const NativePath& sourcePath, FramePool& pool, FrameCache& cache, CompressedFrameStore& store) {
+        uint64_t touchedTime = 0;
+        DiskCacheStatus status = TryLoad(sourcePath, pool, cache, store, touchedTime);
+        if (status != DISK_CACHE_HIT) {
+            cache.Clear();
+            store.Clear();
+        }
+
+        // Same contents under a new time: the next start skips the hash.
+        // The time is outside the payload hash, so a torn write only means
+        // hashing again.
+        if (status == DISK_CACHE_HIT && touchedTime != 0 &&
+            detail::PatchLe64(EntryPath(sourcePath), STAMP_MODIFIED_OFFSET, touchedTime)) {
+            stats.restamped++;
+        }
+
+        if (status == DISK_CACHE_HIT) {
+            stats.hits++;
+        } else if (status == DISK_CACHE_STALE) {
+            stats.stale++;
+        } else {
+            stats.misses++;
+        }
+        return status;
+    }
+
+    // Writes the entry for sourcePath, replacing any older one
+    bool Save(const NativePath& sourcePath, const AssetStamp& stamp, const FrameCache& cache,
+              const CompressedFrameStore& store) {
+        if (!Enabled() || store.Empty() || cache.frameCount != store.FrameCount() ||
+            cache.delays.size() != store.FrameCount()) {
+            return false;
+        }
+
+        std::vector<uint8_t> bytes;
+        if (!Serialize(sourcePath, stamp, cache, store, bytes)) return false;
+
+        detail::CreateDirectories(directory);
+        if (!detail::WriteFileAtomically(EntryPath(sourcePath), bytes)) return false;
+        stats.saved++;
+        return true;
+    }
+
+    const DiskCacheStats& Stats() const { return stats; }
+
+    void ResetStats() {
+        stats.hits = 0;
+        stats.misses = 0;
+        stats.stale = 0;
+        stats.saved = 0;
+        stats.restamped = 0;
+    }
+
+private:
+#ifdef _WIN32
+    static const char PATH_SEPARATOR = '\\';
+#else
+    static const char PATH_SEPARATOR = '/';
+#endif
+    static const size_t STAMP_MODIFIED_OFFSET = 16;
+
+    static bool Serialize(const NativePath& sourcePath, const AssetStamp& stamp, const FrameCache& cache,
+                          const CompressedFrameStore& store, std::vector<uint8_t>& out) {
+        const size_t frameCount = store.FrameCount();
+        const size_t pathBytes = sourcePath.size() * sizeof(NativePath::value_type);
+        const std::vector<PixelRect>& rects = store.DirtyRects();
+        if (rects.size() != frameCount) return false;
+
+        // Header; the payload hash is patched in once the rest is written
+        detail::PutLe32(out, DISK_CACHE_MAGIC);
+        detail::PutLe32(out, DISK_CACHE_VERSION);
+        detail::PutLe64(out, stamp.size);
+        detail::PutLe64(out, stamp.modified);
+        detail::PutLe64(out, stamp.contentHash);
+        detail::PutLe64(out, 0);
+        detail::PutLe32(out, static_cast<uint32_t>(pathBytes));
+        detail::PutLe32(out, static_cast<uint32_t>(store.Width()));
+        detail::PutLe32(out, static_cast<uint32_t>(store.Height()));
+        detail::PutLe32(out, static_cast<uint32_t>(frameCount));
+        detail::PutLe32(out, static_cast<uint32_t>(store.KeyframeInterval()));
+        detail::PutLe32(out, 0);
+
+        // Opaque bounds as four 16-bit edges; they fit any cached canvas
+        const PixelRect opaque = cache.opaqueBounds.Empty() ? PixelRect::EmptyRect() : cache.opaqueBounds;
+        detail::PutLe32(out, static_cast<uint32_t>(opaque.left) | (static_cast<uint32_t>(opaque.top) << 16));
+        detail::PutLe32(out, static_cast<uint32_t>(opaque.right) | (static_cast<uint32_t>(opaque.bottom) << 16));
+
+        const uint8_t* path = reinterpret_cast<const uint8_t*>(sourcePath.data());
+        out.insert(out.end(), path, path + pathBytes);
+        detail::PadTo8(out);
+
+        for (size_t i = 0; i < frameCount; i++) detail::PutLe32(out, cache.delays[i]);
+        detail::PadTo8(out);
+        for (size_t i = 0; i < frameCount; i++) {
+            detail::PutLe32(out, static_cast<uint32_t>(rects[i].left));
+            detail::PutLe32(out, static_cast<uint32_t>(rects[i].top));
+            detail::PutLe32(out, static_cast<uint32_t>(rects[i].right));
+            detail::PutLe32(out, static_cast<uint32_t>(rects[i].bottom));
+        }
+
+        // Frame table, then the runs it points into
+        uint64_t offset = 0;
+        for (size_t i = 0; i < frameCount; i++) {
+            size_t size = 0;
+            size_t source = 0;
+            bool keyframe = false;
+            store.CodedFrame(i, size, source, keyframe);
+            detail::PutLe32(out, static_cast<uint32_t>(source));
+            detail::PutLe32(out, keyframe ? 1u : 0u);
+            detail::PutLe64(out, offset);
+            detail::PutLe64(out, size);
+            offset += size;
+        }
+        for (size_t i = 0; i < frameCount; i++) {
+            size_t size = 0;
+            size_t source = 0;
+            bool keyframe = false;
+            const uint8_t* runs = store.CodedFrame(i, size, source, keyframe);
+            if (runs) out.insert(out.end(), runs, runs + size);
+        }
+
+        uint64_t payloadHash = HashBytes(out.data() + detail::DISK_CACHE_HEADER_BYTES,
+                                         out.size() - detail::DISK_CACHE_HEADER_BYTES);
+        for (int i = 0; i < 8; i++) out[32 + i] = static_cast<uint8_t>(payloadHash >> (8 * i));
+        return true;
+    }
+
+    // touchedTime is set to the source's time when it differs from the
+    // entry's (and the contents are the same, on a hit)
+    DiskCacheStatus TryLoad(const NativePath& sourcePath, FramePool& pool, FrameCache& cache,
+                            CompressedFrameStore& store, uint64_t& touchedTime) const {
+        touchedTime = 0;
+        if (!Enabled()) return DISK_CACHE_MISS;
+
+        MappedFile entry;
+        if (!entry.Open(EntryPath(sourcePath).c_str())) return DISK_CACHE_MISS;
+        const uint8_t* p = entry.Data();
+        const size_t fileSize = entry.Size();
+        if (fileSize < detail::DISK_CACHE_HEADER_BYTES) return DISK_CACHE_STALE;
+
+        if (detail::GetLe32(p) != DISK_CACHE_MAGIC || detail::GetLe32(p + 4) != DISK_CACHE_VERSION) {
+            return DISK_CACHE_STALE;
+        }
+
+        // Cheap checks first: a different size is a different file, and an
+        // unchanged time means unchanged contents
+        uint64_t sourceSize = 0;
+        uint64_t modified = 0;
+        if (!detail::StatFile(sourcePath, sourceSize, modified)) return DISK_CACHE_MISS;
+        if (detail::GetLe64(p + 8) != sourceSize) return DISK_CACHE_STALE;
+        bool touched = detail::GetLe64(p + STAMP_MODIFIED_OFFSET) != modified;
+
+        const size_t pathBytes = detail::GetLe32(p + 40);
+        const int width = static_cast<int>(detail::GetLe32(p + 44));
+        const int height = static_cast<int>(detail::GetLe32(p + 48));
+        const size_t frameCount = detail::GetLe32(p + 52);
+        const size_t interval = detail::GetLe32(p + 56);
+        const uint32_t opaqueTopLeft = detail::GetLe32(p + 64);
+        const uint32_t opaqueBottomRight = detail::GetLe32(p + 68);
+        const PixelRect opaque = PixelRect::Make(static_cast<int>(opaqueTopLeft & 0xFFFF),
+                                                 static_cast<int>(opaqueTopLeft >> 16),
+                                                 static_cast<int>(opaqueBottomRight & 0xFFFF),
+                                                 static_cast<int>(opaqueBottomRight >> 16));
+        if (pathBytes != sourcePath.size() * sizeof(NativePath::value_type) || width <= 0 || height <= 0 ||
+            width > MAX_DISK_CACHE_DIMENSION || height > MAX_DISK_CACHE_DIMENSION ||
+            frameCount == 0 || frameCount > MAX_DISK_CACHE_FRAMES ||
+            (!opaque.Empty() && (opaque.right > width || opaque.bottom > height))) {
+            return DISK_CACHE_STALE;
+        }
+
+        const size_t pathOffset = detail::DISK_CACHE_HEADER_BYTES;
+        const size_t delayOffset = pathOffset + detail::RoundUp8(pathBytes);
+        const size_t rectOffset = delayOffset + detail::RoundUp8(frameCount * 4);
+        const size_t tableOffset = rectOffset + frameCount * detail::DISK_CACHE_RECT_BYTES;
+        const size_t runsOffset = tableOffset + frameCount * detail::DISK_CACHE_FRAME_ENTRY_BYTES;
+        if (runsOffset > fileSize) return DISK_CACHE_STALE;
+
+        // A different file that hashed to the same entry name
+        if (std::memcmp(p + pathOffset, sourcePath.data(), pathBytes) != 0) return DISK_CACHE_STALE;
+
+        // Torn or corrupted entry
+        if (HashBytes(p + detail::DISK_CACHE_HEADER_BYTES, fileSize - detail::DISK_CACHE_HEADER_BYTES) !=
+            detail::GetLe64(p + 32)) {
+            return DISK_CACHE_STALE;
+        }
+
+        // Touched, copied or restored: only the contents tell
+        if (touched) {
+            MappedFile source;
+            if (!source.Open(sourcePath.c_str())) return DISK_CACHE_MISS;
+            if (source.Size() != sourceSize || HashBytes(source.Data(), source.Size()) != detail::GetLe64(p + 24)) {
+                return DISK_CACHE_STALE;
+            }
+            touchedTime = modified;
+        }
+
+        if (!store.Begin(pool, width, height, interval)) return DISK_CACHE_STALE;
+        const size_t runsBytes = fileSize - runsOffset;
+        for (size_t i = 0; i < frameCount; i++) {
+            const uint8_t* row = p + tableOffset + i * detail::DISK_CACHE_FRAME_ENTRY_BYTES;
+            size_t source = detail::GetLe32(row);
+            bool keyframe = detail::GetLe32(row + 4) != 0;
+            uint64_t offset = detail::GetLe64(row + 8);
+            uint64_t size = detail::GetLe64(row + 16);
+            if (offset > runsBytes || size > runsBytes - offset) return DISK_CACHE_STALE;
+
+            const uint8_t* runs = size > 0 ? p + runsOffset + offset : nullptr;
+            if (!store.AppendCoded(runs, static_cast<size_t>(size), source, keyframe)) return DISK_CACHE_STALE;
+        }
+
+        cache.Clear();
+        cache.width = width;
+        cache.height = height;
+        cache.stride = AlignedStride(width);
+        cache.frameCount = frameCount;
+        cache.decodedCount = frameCount;
+        cache.delays.resize(frameCount);
+        cache.dirtyRects.resize(frameCount);
+        cache.opaqueBounds = opaque.Empty() ? PixelRect::EmptyRect() : opaque;
+        for (size_t i = 0; i < frameCount; i++) {
+            cache.delays[i] = detail::GetLe32(p + delayOffset + i * 4);
+            const uint8_t* rect = p + rectOffset + i * detail::DISK_CACHE_RECT_BYTES;
+            cache.dirtyRects[i] = PixelRect::Make(static_cast<int>(detail::GetLe32(rect)),
+                                                  static_cast<int>(detail::GetLe32(rect + 4)),
+                                                  static_cast<int>(detail::GetLe32(rect + 8)),
+                                                  static_cast<int>(detail::GetLe32(rect + 12)));
+
+            // Presenting copies exactly this box, so it has to be on the canvas
+            const PixelRect& dirty = cache.dirtyRects[i];
+            if (!dirty.Empty() && (dirty.left < 0 || dirty.top < 0 || dirty.right > width || dirty.bottom > height)) {
+                return DISK_CACHE_STALE;
+            }
+        }
+        return store.Finish(cache.dirtyRects) ? DISK_CACHE_HIT : DISK_CACHE_STALE;
+    }
+
+    NativePath directory;
+    DiskCacheStats stats;
+};
+
+} // namespace chibi
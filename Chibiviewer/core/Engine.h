@@ -0,0 +1,474 @@
+// Platform-neutral engine core.
+//
+// Everything the character does, without a window: the state machine
+// (wait, walk, sit, picked up), how long each state lasts, walking along
+// the screen, which animation plays and which of its frames is due, and
+// where the window goes when the animation changes. Time only moves through
+// Tick, and the engine never touches the screen itself; it queues commands
+// (place the window, show a frame) that the front end drains and carries
+// out with whatever API it has. The Win32 viewer is one such front end; a
+// headless run just counts the commands.
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <cmath>
+#include <algorithm>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "AnimationRegistry.h"
+#include "Clock.h"
+#include "FrameScheduler.h"
+#include "PixelRect.h"
+#include "PlaybackCursor.h"
+#include "Simulation.h"
+#include "Trace.h"
+#include "Trim.h"
+
+namespace chibi {
+
+// What an animation shows; also its state in the registry
+enum AnimationType {
+    ANIMATION_MOVE,
+    ANIMATION_WAIT,
+    ANIMATION_SIT,
+    ANIMATION_PICK,
+    ANIMATION_MISC
+};
+
+enum CharacterState {
+    STATE_MOVE,
+    STATE_WAIT,
+    STATE_SIT,
+    STATE_PICK,
+    STATE_MISC
+};
+
+inline const char* CharacterStateName(CharacterState state) {
+    switch (state) {
+        case STATE_MOVE: return "move";
+        case STATE_WAIT: return "wait";
+        case STATE_SIT: return "sit";
+        case STATE_PICK: return "pick";
+        case STATE_MISC: return "misc";
+        default: return "?";
+    }
+}
+
+enum EngineMode {
+    MODE_AUTOMATIC,  // States change on their own
+    MODE_MANUAL      // States change on request
+};
+
+struct EngineConfig {
+    double walkSpeed;          // Pixels per second
+    unsigned minFrameDelayMs;  // Shortest time a frame is shown
+    int minStateMs;            // Automatic states last a random time in [minStateMs, maxStateMs]
+    int maxStateMs;
+
+    EngineConfig(double walkSpeed = 125.0, unsigned minFrameDelayMs = 16, int minStateMs = 5000,
+                 int maxStateMs = 20000)
+        : walkSpeed(walkSpeed), minFrameDelayMs(minFrameDelayMs), minStateMs(minStateMs), maxStateMs(maxStateMs) {}
+};
+
+enum EngineCommandType {
+    ENGINE_PLACE_WINDOW,  // Move and size the window to rect
+    ENGINE_SHOW_FRAME     // Show frame of animation, mirrored if flipped
+};
+
+struct EngineCommand {
+    EngineCommandType type;
+    PixelRect rect;         // Screen coordinates
+    AnimationId animation;
+    size_t frame;
+    bool flipped;
+};
+
+class Engine {
+public:
+    explicit Engine(const EngineConfig& config = EngineConfig(), uint32_t seed = 5489u)
+        : config(config), scheduler(clock), simulation(clock), rng(seed), mode(MODE_AUTOMATIC),
+          state(STATE_WAIT), previousState(STATE_WAIT), picking(false), facingRight(true),
+          stateDeadlineMs(-1.0), screenWidth(0), screenHeight(0), window(PixelRect::EmptyRect()),
+          feetX(0), feetY(0), feetPlaced(false) {}
+
+    Engine(const Engine&) = delete;
+    Engine& operator=(const Engine&) = delete;
+
+    // Where the window is now, before the engine first places it
+    void SetWindow(const PixelRect& rect) { window = rect; }
+
+    void SetScreen(int width, int height) {
+        screenWidth = width;
+        screenHeight = height;
+    }
+
+    // Registers an animation; ids count up from 0 in the order added. The
+    // first one starts playing straight away. Frames [0, availableFrames)
+    // can be shown; view is the part of the canvas the window covers.
+    AnimationId AddAnimation(AnimationType type, const std::string& tag, int canvasWidth, int canvasHeight,
+                             const std::vector<unsigned>& delays, size_t availableFrames, const PixelRect& view) {
+        AnimationId id = animations.size();
+        Animation animation;
+        animation.type = type;
+        animation.canvasWidth = canvasWidth;
+        animation.canvasHeight = canvasHeight;
+        animation.delays = delays;
+        animation.availableFrames = availableFrames;
+        animation.view = view;
+        animations.push_back(animation);
+
+        registry.Add(id, type);
+        registry.AddTag(id, tag);
+
+        if (id == 0) Play(id);
+        return id;
+    }
+
+    // More frames decoded, or the final delays and view once all are in
+    void UpdateAnimation(AnimationId id, const std::vector<unsigned>& delays, size_t availableFrames,
+                         const PixelRect& view) {
+        if (id >= animations.size()) return;
+
+        Animation& animation = animations[id];
+        animation.delays = delays;
+        animation.availableFrames = availableFrames;
+        if (SameRect(animation.view, view)) return;
+
+        animation.view = view;
+        if (cursor.active && cursor.gifIndex == id) {
+            PlaceWindow(id);
+            QueueShow();
+        }
+    }
+
+    // Forgets every animation and stops; the mode and state are kept
+    void Clear() {
+        cursor.Stop();
+        scheduler.Stop();
+        simulation.StopWalk();
+        stateDeadlineMs = -1.0;
+        picking = false;
+        registry.Clear();
+        animations.clear();
+    }
+
+    // Back to waiting, as after loading a new pack
+    void Restart() {
+        state = STATE_WAIT;
+        if (mode == MODE_AUTOMATIC) StartStateTimer();
+    }
+
+    void SetMode(EngineMode newMode) {
+        mode = newMode;
+        if (mode == MODE_AUTOMATIC) {
+            StartStateTimer();
+        } else {
+            stateDeadlineMs = -1.0;
+            simulation.StopWalk();
+        }
+    }
+
+    void ToggleMode() {
+        SetMode(mode == MODE_AUTOMATIC ? MODE_MANUAL : MODE_AUTOMATIC);
+    }
+
+    // Moves on to the next state in the cycle wait, sit, misc, move
+    void CycleState() {
+        if (animations.empty()) return;
+
+        CharacterState previous = state;
+        switch (state) {
+            case STATE_MOVE: state = STATE_WAIT; break;
+            case STATE_WAIT: state = STATE_SIT; break;
+            case STATE_SIT: state = STATE_MISC; break;
+            case STATE_MISC: state = STATE_MOVE; break;
+            default: state = STATE_WAIT; break;
+        }
+
+        AnimationId id = 0;
+        if (registry.Pick(TypeForState(state), rng, id)) {
+            Play(id);
+        } else {
+            state = previous;
+        }
+    }
+
+    // Picked up: plays the pick animation until the pointer is released
+    void PointerDown() {
+        if (animations.empty()) return;
+
+        previousState = state;
+        picking = true;
+        state = STATE_PICK;
+        stateDeadlineMs = -1.0;
+        simulation.StopWalk();
+
+        AnimationId id = 0;
+        if (registry.Pick(ANIMATION_PICK, rng, id)) Play(id);
+    }
+
+    // While picked up, the window follows the pointer (screen coordinates)
+    void PointerMove(int x, int y) {
+        if (!picking) return;
+
+        int width = window.Width();
+        int height = window.Height();
+        int left = std::max(0, std::min(x - width / 2, screenWidth - width));
+        int top = std::max(0, std::min(y - height / 2, screenHeight - height));
+        MoveWindowTo(left, top);
+    }
+
+    void PointerUp() {
+        if (!picking) return;
+
+        picking = false;
+        state = previousState;
+
+        AnimationId id = 0;
+        if (registry.Pick(TypeForState(state), rng, id)) Play(id);
+        if (mode == MODE_AUTOMATIC) StartStateTimer();
+    }
+
+    // Runs deltaMs of time: ends a state whose time is up, steps the walk
+    // at its fixed rate and moves playback to the frame that is due.
+    // Returns true if anything moved.
+    bool Tick(double deltaMs) {
+        TraceScope span("tick", "engine");
+        clock.AdvanceMs(std::max(deltaMs, 0.0));
+
+        // Walking has no time limit; it ends on a pick or mode change
+        bool busy = false;
+        if (stateDeadlineMs >= 0.0 && clock.NowMs() >= stateDeadlineMs) {
+            stateDeadlineMs = -1.0;
+            if (state != STATE_MOVE) {
+                StartWalking();
+                busy = true;
+            }
+        }
+
+        bool changed = false;
+        if (simulation.Walking() && simulation.Update() > 0) {
+            busy = true;
+            changed |= StepWalk();
+        }
+
+        if (cursor.active && cursor.gifIndex < animations.size()) {
+            // A frame still being decoded is not shown; the last one stays up
+            const Animation& animation = animations[cursor.gifIndex];
+            changed |= scheduler.Advance(cursor, animation.delays, config.minFrameDelayMs,
+                                         animation.availableFrames);
+        }
+
+        if (changed) QueueShow();
+        return busy || changed;
+    }
+
+    // Time until Tick has work to do, or -1 if nothing is scheduled
+    double MsUntilNextUpdate() const {
+        double wait = -1.0;
+        if (scheduler.Running() && cursor.active) {
+            wait = scheduler.MsUntilDeadline();
+        }
+        if (simulation.Walking()) {
+            double step = simulation.MsUntilNextStep();
+            wait = wait < 0.0 ? step : std::min(wait, step);
+        }
+        if (stateDeadlineMs >= 0.0) {
+            double stateWait = std::max(0.0, stateDeadlineMs - clock.NowMs());
+            wait = wait < 0.0 ? stateWait : std::min(wait, stateWait);
+        }
+        return wait;
+    }
+
+    bool HasCommands() const { return !commands.empty(); }
+
+    // Hands over the commands queued since the last call, oldest first
+    void TakeCommands(std::vector<EngineCommand>& out) {
+        out.clear();
+        out.swap(commands);
+    }
+
+    EngineMode Mode() const { return mode; }
+    CharacterState State() const { return state; }
+    bool Picking() const { return picking; }
+    bool FacingRight() const { return facingRight; }
+    size_t AnimationCount() const { return animations.size(); }
+
+    bool Playing() const { return cursor.active; }
+    AnimationId CurrentAnimation() const { return cursor.gifIndex; }
+    size_t CurrentFrame() const { return cursor.frameIndex; }
+    bool CurrentFlipped() const { return cursor.active && Flipped(cursor.gifIndex); }
+
+    const PixelRect& Window() const { return window; }
+    double NowMs() const { return clock.NowMs(); }
+    const SchedulerStats& PlaybackStats() const { return scheduler.Stats(); }
+    const AnimationRegistry& Registry() const { return registry; }
+
+private:
+    struct Animation {
+        AnimationType type;
+        int canvasWidth;
+        int canvasHeight;
+        std::vector<unsigned> delays;
+        size_t availableFrames;
+        PixelRect view;
+    };
+
+    static AnimationType TypeForState(CharacterState state) {
+        switch (state) {
+            case STATE_MOVE: return ANIMATION_MOVE;
+            case STATE_WAIT: return ANIMATION_WAIT;
+            case STATE_SIT: return ANIMATION_SIT;
+            case STATE_PICK: return ANIMATION_PICK;
+            default: return ANIMATION_MISC;
+        }
+    }
+
+    static bool SameRect(const PixelRect& a, const PixelRect& b) {
+        return a.left == b.left && a.top == b.top && a.right == b.right && a.bottom == b.bottom;
+    }
+
+    // Walk cycles face the way the character walks
+    bool Flipped(AnimationId id) const {
+        return id < animations.size() && animations[id].type == ANIMATION_MOVE && !facingRight;
+    }
+
+    // Sizes the window to the animation and plays it from its first frame
+    void Play(AnimationId id) {
+        if (id >= animations.size() || animations[id].delays.empty()) return;
+
+        // Every state change and animation switch comes through here
+        GlobalTracer().Instant(CharacterStateName(state), "state", "animation", static_cast<int64_t>(id));
+        PlaceWindow(id);
+        cursor.Start(id);
+
+        // First deadline is one frame from now
+        scheduler.Start(cursor, animations[id].delays, config.minFrameDelayMs);
+        QueueShow();
+    }
+
+    // Sizes the window to an animation's view, keeping the feet where they
+    // are on screen so the character does not jump between animations
+    void PlaceWindow(AnimationId id) {
+        const Animation& animation = animations[id];
+
+        // Before the first animation, the feet are the window's bottom centre
+        if (!feetPlaced) {
+            feetX = window.Width() / 2;
+            feetY = window.Height();
+            feetPlaced = true;
+        }
+
+        int newFeetX = 0;
+        int newFeetY = 0;
+        FeetOffset(animation.view, animation.canvasWidth, animation.canvasHeight, newFeetX, newFeetY);
+        int left = window.left + feetX - newFeetX;
+        int top = window.top + feetY - newFeetY;
+        feetX = newFeetX;
+        feetY = newFeetY;
+
+        PixelRect placed = PixelRect::Make(left, top, left + animation.view.Width(), top + animation.view.Height());
+        if (SameRect(placed, window)) return;
+        window = placed;
+        QueuePlace();
+    }
+
+    void MoveWindowTo(int left, int top) {
+        if (left == window.left && top == window.top) return;
+        window = PixelRect::Make(left, top, left + window.Width(), top + window.Height());
+        QueuePlace();
+    }
+
+    // Walking starts from where the window is; other automatic states end
+    // after a random time
+    void StartStateTimer() {
+        stateDeadlineMs = -1.0;
+        if (state == STATE_MOVE) {
+            simulation.StartWalk(window.left, 0, screenWidth - window.Width(), facingRight, config.walkSpeed);
+        } else {
+            simulation.StopWalk();
+            std::uniform_int_distribution<int> duration(config.minStateMs, config.maxStateMs);
+            stateDeadlineMs = clock.NowMs() + duration(rng);
+        }
+    }
+
+    // The only automatic change: start walking in a random direction
+    void StartWalking() {
+        if (animations.empty()) return;
+
+        CharacterState previous = state;
+        state = STATE_MOVE;
+        std::uniform_int_distribution<int> direction(0, 1);
+        facingRight = direction(rng) == 1;
+
+        AnimationId id = 0;
+        if (registry.Pick(ANIMATION_MOVE, rng, id)) {
+            Play(id);
+        } else {
+            state = previous;
+        }
+        StartStateTimer();
+    }
+
+    // Moves the window to where the walk is. Returns true if the walk
+    // turned around and the frames need to face the other way.
+    bool StepWalk() {
+        if (state != STATE_MOVE) return false;
+
+        // Blended between the last two steps so motion stays smooth
+        MoveWindowTo(static_cast<int>(std::lround(simulation.WalkX())), window.top);
+
+        // The simulation bounces off the screen edges on its own; playback
+        // carries on from the same frame
+        if (simulation.FacingRight() == facingRight) return false;
+        facingRight = simulation.FacingRight();
+        return true;
+    }
+
+    void QueuePlace() {
+        EngineCommand command = {};
+        command.type = ENGINE_PLACE_WINDOW;
+        command.rect = window;
+        commands.push_back(command);
+    }
+
+    void QueueShow() {
+        if (!cursor.active) return;
+        EngineCommand command = {};
+        command.type = ENGINE_SHOW_FRAME;
+        command.animation = cursor.gifIndex;
+        command.frame = cursor.frameIndex;
+        command.flipped = Flipped(cursor.gifIndex);
+        commands.push_back(command);
+    }
+
+    EngineConfig config;
+    ManualClock clock;  // Engine time; only Tick moves it
+    FrameScheduler scheduler;
+    Simulation simulation;
+    PlaybackCursor cursor;
+    AnimationRegistry registry;
+    std::vector<Animation> animations;
+    std::mt19937 rng;
+
+    EngineMode mode;
+    CharacterState state;
+    CharacterState previousState;  // To return to after a pick
+    bool picking;
+    bool facingRight;
+    double stateDeadlineMs;  // When the current automatic state ends; -1 for never
+
+    int screenWidth;
+    int screenHeight;
+    PixelRect window;  // Screen rectangle the window was last placed at
+    int feetX;         // Feet relative to the window's top-left corner
+    int feetY;
+    bool feetPlaced;
+
+    std::vector<EngineCommand> commands;
+};
+
+} // namespace chibi
@@ -0,0 +1,298 @@
+// Pre-decoded frame cache.
+//
+// Every frame of an animation (GIF or animated WebP) is composed once at
+// load time and stored as premultiplied BGRA (the layout GDI+ PARGB and
+// layered windows expect) in a single 32-byte-aligned allocation.
+// Presenting a frame is then a plain copy of already-final pixels.
+// FrameCacheBuilder can also fill a cache one frame at a time, so the first
+// frame is usable before the rest have decoded.
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <vector>
+
+#include "AlignedBuffer.h"
+#include "DirtyRect.h"
+#include "GifDecoder.h"
+#include "Mirror.h"
+#include "PixelRect.h"
+#include "Trim.h"
+#include "WebPDecoder.h"
+
+namespace chibi {
+
+struct FrameCache {
+    int width;
+    int height;
+    size_t stride;      // Bytes per row, multiple of PIXEL_ALIGNMENT
+    size_t frameCount;
+    size_t decodedCount;  // Frames [0, decodedCount) hold final pixels
+    std::vector<unsigned> delays;  // Milliseconds per frame, as stored in the file
+    std::vector<PixelRect> dirtyRects;  // Box of pixels that differ from the previous frame
+                                        // (frame 0 is compared with the last frame)
+    PixelRect opaqueBounds;  // Union of every decoded frame's non-transparent pixels
+    AlignedBuffer pixels;          // frameCount * FrameBytes() premultiplied BGRA
+    AlignedBuffer mirrored;        // Horizontally flipped copy, built on demand
+
+    FrameCache() : width(0), height(0), stride(0), frameCount(0), decodedCount(0),
+                   opaqueBounds(PixelRect::EmptyRect()) {}
+
+    size_t FrameBytes() const { return stride * height; }
+
+    uint32_t* Frame(size_t index) {
+        return reinterpret_cast<uint32_t*>(pixels.Data() + index * FrameBytes());
+    }
+
+    const uint32_t* Frame(size_t index) const {
+        return reinterpret_cast<const uint32_t*>(pixels.Data() + index * FrameBytes());
+    }
+
+    const uint32_t* MirroredFrame(size_t index) const {
+        return reinterpret_cast<const uint32_t*>(mirrored.Data() + index * FrameBytes());
+    }
+
+    // Frame as shown when facing the other way, or the original if no
+    // mirrored copy has been built
+    const uint32_t* Frame(size_t index, bool flipped) const {
+        return flipped && HasMirrored() ? MirroredFrame(index) : Frame(index);
+    }
+
+    bool Empty() const { return frameCount == 0; }
+    bool Complete() const { return decodedCount == frameCount; }
+    bool HasMirrored() const { return !mirrored.Empty(); }
+    bool HasPixels() const { return !pixels.Empty(); }
+
+    // Dirty box of a frame as shown, mirrored along with the pixels
+    PixelRect DirtyRect(size_t index, bool flipped) const {
+        if (index >= dirtyRects.size()) return PixelRect::Make(0, 0, width, height);
+        return flipped && HasMirrored() ? dirtyRects[index].Mirrored(width) : dirtyRects[index];
+    }
+
+    // Mean fraction of the canvas that changes from one frame to the next
+    double AverageDirtyFraction() const {
+        if (Empty() || width <= 0 || height <= 0) return 0.0;
+        double total = 0.0;
+        for (size_t i = 0; i < dirtyRects.size(); i++) {
+            total += static_cast<double>(dirtyRects[i].Area());
+        }
+        return total / (static_cast<double>(width) * height * dirtyRects.size());
+    }
+
+    // Builds the mirrored copy of every frame once. Cheap to call again.
+    // Frames decoded later are mirrored as they arrive.
+    bool EnsureMirrored() {
+        if (HasMirrored() || Empty()) return true;
+        if (!HasPixels()) return false;
+        if (!mirrored.Allocate(FrameBytes() * frameCount)) return false;
+        MirrorImage(pixels.Data(), mirrored.Data(), width, height * static_cast<int>(decodedCount), stride);
+        return true;
+    }
+
+    void MirrorFrame(size_t index) {
+        if (!HasMirrored()) return;
+        MirrorImage(pixels.Data() + index * FrameBytes(), mirrored.Data() + index * FrameBytes(),
+                    width, height, stride);
+    }
+
+    // Sizes the cache for count frames of the given canvas. Pixels start transparent.
+    bool Allocate(int canvasWidth, int canvasHeight, size_t count) {
+        width = canvasWidth;
+        height = canvasHeight;
+        stride = AlignedStride(canvasWidth);
+        frameCount = count;
+        decodedCount = 0;
+        delays.assign(count, 0);
+        dirtyRects.assign(count, PixelRect::Make(0, 0, canvasWidth, canvasHeight));
+        opaqueBounds = PixelRect::EmptyRect();
+        mirrored.Release();
+        return pixels.Allocate(FrameBytes() * count);
+    }
+
+    // Frees the pixels (and mirrored copy) but keeps the size, delays and
+    // dirty rects, for when the frames have moved to a CompressedFrameStore
+    // or a FrameAtlas
+    void ReleasePixels() {
+        pixels.Release();
+        mirrored.Release();
+    }
+
+    void Clear() {
+        width = 0;
+        height = 0;
+        stride = 0;
+        frameCount = 0;
+        decodedCount = 0;
+        delays.clear();
+        dirtyRects.clear();
+        opaqueBounds = PixelRect::EmptyRect();
+        pixels.Release();
+        mirrored.Release();
+    }
+};
+
+// (c * a + 127) / 255 without a division
+inline uint32_t MultiplyAlpha(uint32_t c, uint32_t a) {
+    uint32_t t = c * a + 128;
+    return (t + (t >> 8)) >> 8;
+}
+
+// Converts straight-alpha RGBA pixels to premultiplied BGRA
+inline void PremultiplyRgbaToBgra(const uint8_t* src, uint32_t* dst, size_t count) {
+    for (size_t i = 0; i < count; i++, src += 4) {
+        uint32_t a = src[3];
+        if (a == 255) {
+            dst[i] = 0xFF000000u | (static_cast<uint32_t>(src[0]) << 16) | (static_cast<uint32_t>(src[1]) << 8) | src[2];
+        } else if (a == 0) {
+            dst[i] = 0;
+        } else {
+            dst[i] = (a << 24) | (MultiplyAlpha(src[0], a) << 16) | (MultiplyAlpha(src[1], a) << 8) | MultiplyAlpha(src[2], a);
+        }
+    }
+}
+
+// Copies one composed RGBA canvas into a cache slot
+inline void StoreCacheFrame(FrameCache& cache, size_t index, const uint8_t* rgba) {
+    uint8_t* base = reinterpret_cast<uint8_t*>(cache.Frame(index));
+    for (int y = 0; y < cache.height; y++) {
+        PremultiplyRgbaToBgra(rgba + static_cast<size_t>(y) * cache.width * 4,
+                              reinterpret_cast<uint32_t*>(base + y * cache.stride), cache.width);
+    }
+}
+
+// Copies one already-premultiplied BGRA canvas into a cache slot
+inline void StoreCacheFrameBgra(FrameCache& cache, size_t index, const uint8_t* bgra) {
+    uint8_t* base = reinterpret_cast<uint8_t*>(cache.Frame(index));
+    const size_t rowBytes = static_cast<size_t>(cache.width) * 4;
+    for (int y = 0; y < cache.height; y++) {
+        std::memcpy(base + y * cache.stride, bgra + y * rowBytes, rowBytes);
+    }
+}
+
+// Fills a cache from a GIF or WebP held in memory, one frame per DecodeNext
+// call. Only one composed canvas is alive at a time; the cache itself is a
+// single allocation made by Begin. The file bytes must outlive the builder.
+class FrameCacheBuilder {
+public:
+    FrameCacheBuilder() : webp(false), next(0), finished(true) {}
+
+    // Sizes the cache for every frame in the file. Nothing is decoded yet.
+    bool Begin(const uint8_t* data, size_t size, FrameCache& cache) {
+        finished = true;
+        next = 0;
+        webp = WebPReader::IsWebP(data, size);
+
+        bool opened = webp ? webpReader.Open(data, size) : reader.Open(data, size);
+        if (!opened) {
+            cache.Clear();
+            return false;
+        }
+
+        int width = webp ? webpReader.Width() : reader.Width();
+        int height = webp ? webpReader.Height() : reader.Height();
+        size_t count = webp ? webpReader.CountFrames() : reader.CountFrames();
+        if (count == 0 || !cache.Allocate(width, height, count)) {
+            cache.Clear();
+            return false;
+        }
+
+        if (webp) {
+            webpCanvas.Reset(width, height);
+        } else {
+            // Composed straight into the cache's pixel format
+            canvas.Reset(width, height, GIF_ORDER_BGRA);
+        }
+        finished = false;
+        return true;
+    }
+
+    // Decodes the next frame into the cache. Returns false once every frame
+    // is in (or the file turned out to be truncated).
+    bool DecodeNext(FrameCache& cache) {
+        if (finished) return false;
+
+        if (next >= cache.frameCount || !ComposeNext(cache)) {
+            Finish(cache);
+            return false;
+        }
+
+        if (next > 0) {
+            // Nothing outside the decoder's own update area can have changed
+            PixelRect update = webp ? webpCanvas.LastUpdate() : canvas.LastUpdate();
+            cache.dirtyRects[next] = ComputeDirtyRect(
+                reinterpret_cast<const uint8_t*>(cache.Frame(next - 1)),
+                reinterpret_cast<const uint8_t*>(cache.Frame(next)), cache.stride, update);
+        }
+        ExpandOpaqueBounds(cache.Frame(next), cache.width, cache.height, cache.stride, cache.opaqueBounds);
+        cache.MirrorFrame(next);
+        cache.decodedCount = ++next;
+
+        if (next == cache.frameCount) {
+            Finish(cache);
+        }
+        return true;
+    }
+
+    bool Finished() const { return finished; }
+
+private:
+    // Decodes and composes the next frame into cache slot next
+    bool ComposeNext(FrameCache& cache) {
+        if (webp) {
+            if (!webpReader.NextFrame(webpRecord)) return false;
+            webpCanvas.Compose(webpRecord);
+            StoreCacheFrame(cache, next, webpCanvas.Pixels());
+            cache.delays[next] = webpRecord.delayMs;
+            return true;
+        }
+
+        if (!reader.NextFrame(record)) return false;
+        canvas.Compose(record);
+        StoreCacheFrameBgra(cache, next, canvas.Pixels());
+        cache.delays[next] = record.delayMs;
+        return true;
+    }
+
+    void Finish(FrameCache& cache) {
+        finished = true;
+
+        // Keep whatever decoded cleanly from a truncated file
+        cache.frameCount = next;
+        cache.decodedCount = next;
+        cache.delays.resize(next);
+        cache.dirtyRects.resize(next);
+
+        // Looping back to the first frame
+        if (next > 1) {
+            cache.dirtyRects[0] = ComputeDirtyRect(
+                reinterpret_cast<const uint8_t*>(cache.Frame(next - 1)),
+                reinterpret_cast<const uint8_t*>(cache.Frame(0)), cache.stride,
+                PixelRect::Make(0, 0, cache.width, cache.height));
+        }
+    }
+
+    bool webp;
+    GifReader reader;
+    GifCanvas canvas;
+    GifFrameRecord record;
+    WebPReader webpReader;
+    WebPCanvas webpCanvas;
+    WebPFrameRecord webpRecord;
+    size_t next;
+    bool finished;
+};
+
+// Decodes every frame of a GIF or WebP held in memory straight into the cache
+inline bool BuildFrameCache(const uint8_t* data, size_t size, FrameCache& cache) {
+    FrameCacheBuilder builder;
+    if (!builder.Begin(data, size, cache)) {
+        return false;
+    }
+
+    while (builder.DecodeNext(cache)) {
+    }
+    return !cache.Empty();
+}
+
+} // namespace chibi
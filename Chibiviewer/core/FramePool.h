@@ -0,0 +1,173 @@
+// Content-addressed pool of encoded frames.
+//
+// Identical byte blobs are stored once and shared by handle with a
+// reference count, so frames that repeat across animations (a pose shared
+// by "sit" and "lying", or two files with the same frames) cost their
+// memory once. Blobs are looked up by HashBytes and compared byte for byte,
+// so hash collisions only cost a compare. Interning and releasing are
+// thread-safe; a blob's bytes stay put while it has references, so holders
+// can keep the pointer from Bytes.
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <mutex>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "Hash.h"
+
+namespace chibi {
+
+typedef uint32_t FrameHandle;
+const FrameHandle INVALID_FRAME_HANDLE = 0xFFFFFFFFu;
+
+struct FramePoolStats {
+    size_t references;       // Live handles held by users of the pool
+    size_t blobs;            // Distinct blobs stored
+    size_t referencedBytes;  // What the references would take unshared
+    size_t storedBytes;
+
+    // Fraction of referenced bytes saved by sharing
+    double DedupeRatio() const {
+        return referencedBytes > 0 ? 1.0 - static_cast<double>(storedBytes) / referencedBytes : 0.0;
+    }
+};
+
+class FramePool {
+public:
+    FramePool() {
+        std::memset(&stats, 0, sizeof(stats));
+    }
+
+    FramePool(const FramePool&) = delete;
+    FramePool& operator=(const FramePool&) = delete;
+
+    // Handle to a blob equal to bytes, adding a reference. The handle must
+    // be released once.
+    FrameHandle Intern(const uint8_t* bytes, size_t size) {
+        return Intern(bytes, size, HashBytes(bytes, size));
+    }
+
+    // Same, for callers that already have the bytes' HashBytes
+    FrameHandle Intern(const uint8_t* bytes, size_t size, uint64_t hash) {
+        std::lock_guard<std::mutex> lock(mutex);
+
+        std::pair<BlobIndex::iterator, BlobIndex::iterator> range = index.equal_range(hash);
+        for (BlobIndex::iterator it = range.first; it != range.second; ++it) {
+            Entry& entry = entries[it->second];
+            if (entry.bytes.size() == size && std::memcmp(entry.bytes.data(), bytes, size) == 0) {
+                entry.references++;
+                stats.references++;
+                stats.referencedBytes += size;
+                return it->second;
+            }
+        }
+
+        FrameHandle handle;
+        if (!freeHandles.empty()) {
+            handle = freeHandles.back();
+            freeHandles.pop_back();
+        } else {
+            handle = static_cast<FrameHandle>(entries.size());
+            entries.emplace_back();
+        }
+
+        Entry& entry = entries[handle];
+        entry.hash = hash;
+        entry.references = 1;
+        entry.bytes.assign(bytes, bytes + size);
+        index.emplace(hash, handle);
+
+        stats.references++;
+        stats.blobs++;
+        stats.referencedBytes += size;
+        stats.storedBytes += size;
+        return handle;
+    }
+
+    // Another reference to a live handle
+    void AddRef(FrameHandle handle) {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!Live(handle)) return;
+        entries[handle].references++;
+        stats.references++;
+        stats.referencedBytes += entries[handle].bytes.size();
+    }
+
+    // Drops a reference; the blob is freed with its last one
+    void Release(FrameHandle handle) {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!Live(handle)) return;
+
+        Entry& entry = entries[handle];
+        size_t size = entry.bytes.size();
+        stats.references--;
+        stats.referencedBytes -= size;
+        if (--entry.references > 0) return;
+
+        std::pair<BlobIndex::iterator, BlobIndex::iterator> range = index.equal_range(entry.hash);
+        for (BlobIndex::iterator it = range.first; it != range.second; ++it) {
+            if (it->second == handle) {
+                index.erase(it);
+                break;
+            }
+        }
+        std::vector<uint8_t>().swap(entry.bytes);
+        freeHandles.push_back(handle);
+        stats.blobs--;
+        stats.storedBytes -= size;
+    }
+
+    // The blob's bytes, valid while the handle has references
+    const uint8_t* Bytes(FrameHandle handle) const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return Live(handle) ? entries[handle].bytes.data() : nullptr;
+    }
+
+    size_t Size(FrameHandle handle) const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return Live(handle) ? entries[handle].bytes.size() : 0;
+    }
+
+    size_t References(FrameHandle handle) const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return Live(handle) ? entries[handle].references : 0;
+    }
+
+    FramePoolStats Stats() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return stats;
+    }
+
+    // No blob is referenced any more
+    bool Empty() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return stats.blobs == 0;
+    }
+
+private:
+    typedef std::unordered_multimap<uint64_t, FrameHandle> BlobIndex;
+
+    struct Entry {
+        uint64_t hash;
+        size_t references;  // 0 for a free handle
+        std::vector<uint8_t> bytes;
+
+        Entry() : hash(0), references(0) {}
+    };
+
+    bool Live(FrameHandle handle) const {
+        return handle < entries.size() && entries[handle].references > 0;
+    }
+
+    mutable std::mutex mutex;
+    std::vector<Entry> entries;  // Indexed by handle; moving an entry keeps its bytes in place
+    std::vector<FrameHandle> freeHandles;
+    BlobIndex index;
+    FramePoolStats stats;
+};
+
+} // namespace chibi
@@ -0,0 +1,129 @@
+// Deadline-based frame scheduler.
+//
+// Each frame's display time is measured from the previous frame's deadline,
+// not from when the previous frame happened to be shown, so late wakeups do
+// not push the rest of the animation back. A caller that wakes up late steps
+// over every frame whose deadline has already passed (those frames are
+// skipped, not shown late); one that wakes up very late (suspend, a blocked
+// message loop) restarts the timeline from now instead of racing through
+// frames. A frame that has not been decoded yet is never waited for: the
+// last decoded frame is held for another period instead.
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <cmath>
+#include <vector>
+#include <algorithm>
+
+#include "Clock.h"
+#include "PlaybackCursor.h"
+
+namespace chibi {
+
+// Anything later than this restarts the timeline instead of catching up
+const double MAX_CATCH_UP_MS = 250.0;
+
+struct SchedulerStats {
+    uint64_t framesPresented;  // Ticks that moved to a new frame
+    uint64_t framesSkipped;    // Frames stepped over because their time had passed
+    uint64_t resyncs;          // Times the timeline was restarted after a stall
+    uint64_t framesHeld;       // Periods a frame stayed up because the next was not decoded
+    double lastLatenessMs;     // How far past its deadline the last frame was shown
+    double maxLatenessMs;
+    double totalLatenessMs;
+    double totalLatenessSqMs;
+
+    // Average time frames are shown after their ideal time. With absolute
+    // deadlines this stays bounded instead of growing with every frame.
+    double MeanLatenessMs() const {
+        return framesPresented ? totalLatenessMs / framesPresented : 0.0;
+    }
+
+    // Standard deviation of the lateness
+    double JitterMs() const {
+        if (!framesPresented) return 0.0;
+        double mean = MeanLatenessMs();
+        double variance = totalLatenessSqMs / framesPresented - mean * mean;
+        return variance > 0.0 ? std::sqrt(variance) : 0.0;
+    }
+};
+
+class FrameScheduler {
+public:
+    explicit FrameScheduler(const IClock& clock, double maxCatchUpMs = MAX_CATCH_UP_MS)
+        : clock(clock), maxCatchUpMs(maxCatchUpMs), deadline(0.0), running(false) {
+        ResetStats();
+    }
+
+    // Starts timing the frame the cursor is on
+    void Start(const PlaybackCursor& cursor, const std::vector<unsigned>& delays, unsigned minDelayMs) {
+        deadline = clock.NowMs() + cursor.CurrentDelay(delays, minDelayMs);
+        running = true;
+    }
+
+    void Stop() { running = false; }
+
+    bool Running() const { return running; }
+
+    // Absolute time the current frame should be replaced
+    double Deadline() const { return deadline; }
+
+    // Time to sleep before the next frame is due; 0 if it is already due
+    double MsUntilDeadline() const {
+        return running ? std::max(0.0, deadline - clock.NowMs()) : 0.0;
+    }
+
+    // Moves the cursor to the frame that should be showing now, never past
+    // the first availableFrames frames. Returns true if the cursor moved.
+    bool Advance(PlaybackCursor& cursor, const std::vector<unsigned>& delays, unsigned minDelayMs,
+                 size_t availableFrames = SIZE_MAX) {
+        if (!running || !cursor.active || delays.empty()) return false;
+
+        double now = clock.NowMs();
+        if (now < deadline) return false;
+
+        double lateness = now - deadline;
+        if (lateness > maxCatchUpMs) {
+            // Too far behind to be worth catching up; carry on from here
+            deadline = now;
+            stats.resyncs++;
+        }
+
+        uint64_t steps = 0;
+        while (now >= deadline) {
+            size_t nextFrame = (cursor.frameIndex + 1) % delays.size();
+            if (nextFrame < availableFrames) {
+                cursor.Step(delays.size());
+                steps++;
+            } else {
+                stats.framesHeld++;
+            }
+            deadline += cursor.CurrentDelay(delays, minDelayMs);
+        }
+        if (steps == 0) return false;
+
+        stats.framesPresented++;
+        stats.framesSkipped += steps - 1;
+        stats.lastLatenessMs = lateness;
+        stats.maxLatenessMs = std::max(stats.maxLatenessMs, lateness);
+        stats.totalLatenessMs += lateness;
+        stats.totalLatenessSqMs += lateness * lateness;
+        return true;
+    }
+
+    const SchedulerStats& Stats() const { return stats; }
+
+    void ResetStats() {
+        stats = SchedulerStats();
+    }
+
+private:
+    const IClock& clock;
+    double maxCatchUpMs;
+    double deadline;
+    bool running;
+    SchedulerStats stats;
+};
+
+} // namespace chibi
@@ -0,0 +1,511 @@
+// Compressed in-memory frame store.
+//
+// Holds a FrameCache's frames in a compact form and decompresses
+// them on demand into a small set of hot buffers, evicting the least
+// recently used once a byte budget is reached. Frames are coded as runs:
+//   - keyframes (every keyframeInterval frames) as transparent runs and
+//     literal pixels,
+//   - every other frame as a delta against the frame before it, adding
+//     runs of unchanged pixels.
+// Sequential playback decodes each frame from the previous one with a copy
+// plus a few runs; a random jump replays at most keyframeInterval frames.
+// Mirrored frames are not stored; they are flipped from the decoded frame.
+// A frame identical to an earlier one (a hold, or the way back of a
+// ping-pong loop) is not coded again but refers to the first copy, and the
+// coded frames live in a FramePool shared with other animations, so runs
+// that repeat across files are stored once.
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "AlignedBuffer.h"
+#include "FrameCache.h"
+#include "FramePool.h"
+#include "Hash.h"
+#include "Mirror.h"
+#include "PixelRect.h"
+
+namespace chibi {
+
+const size_t DEFAULT_KEYFRAME_INTERVAL = 16;
+const size_t DEFAULT_FRAME_STORE_BUDGET = 4 * 1024 * 1024;
+const size_t MIN_HOT_FRAMES = 2;  // The frame being decoded and the one it is based on
+
+struct FrameStoreStats {
+    uint64_t hits;           // Frames served from a hot buffer
+    uint64_t misses;
+    uint64_t framesDecoded;  // Including frames replayed from a keyframe
+    uint64_t evictions;
+};
+
+namespace detail {
+
+enum FrameRunType {
+    FRAME_RUN_KEEP = 0,     // Same as the previous frame
+    FRAME_RUN_ZERO = 1,     // Transparent
+    FRAME_RUN_LITERAL = 2   // Followed by the pixels themselves
+};
+
+inline void WriteRun(std::vector<uint8_t>& out, size_t length, int type) {
+    uint64_t value = (static_cast<uint64_t>(length) << 2) | static_cast<uint64_t>(type);
+    while (value >= 0x80) {
+        out.push_back(static_cast<uint8_t>(value | 0x80));
+        value >>= 7;
+    }
+    out.push_back(static_cast<uint8_t>(value));
+}
+
+inline bool ReadRun(const uint8_t*& p, const uint8_t* end, size_t& length, int& type) {
+    uint64_t value = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+        if (p >= end) return false;
+        uint8_t byte = *p++;
+        value |= static_cast<uint64_t>(byte & 0x7f) << shift;
+        if (!(byte & 0x80)) {
+            length = static_cast<size_t>(value >> 2);
+            type = static_cast<int>(value & 3);
+            return true;
+        }
+    }
+    return false;
+}
+
+inline int ClassifyPixel(const uint32_t* cur, const uint32_t* prev, size_t i) {
+    if (prev && cur[i] == prev[i]) return FRAME_RUN_KEEP;
+    return cur[i] == 0 ? FRAME_RUN_ZERO : FRAME_RUN_LITERAL;
+}
+
+// Codes count pixels of cur as runs; prev is the frame before it, or null
+// for a keyframe
+inline void EncodeFrameRuns(const uint32_t* cur, const uint32_t* prev, size_t count, std::vector<uint8_t>& out) {
+    size_t i = 0;
+    while (i < count) {
+        int type = ClassifyPixel(cur, prev, i);
+        size_t start = i++;
+        while (i < count && ClassifyPixel(cur, prev, i) == type) i++;
+
+        WriteRun(out, i - start, type);
+        if (type == FRAME_RUN_LITERAL) {
+            const uint8_t* bytes = reinterpret_cast<const uint8_t*>(cur + start);
+            out.insert(out.end(), bytes, bytes + (i - start) * 4);
+        }
+    }
+}
+
+// Applies coded runs to dst, which must hold the previous frame unless the
+// runs are a keyframe's
+inline bool DecodeFrameRuns(const uint8_t* p, size_t size, uint32_t* dst, size_t count) {
+    const uint8_t* end = p + size;
+    size_t i = 0;
+    while (p < end) {
+        size_t length = 0;
+        int type = 0;
+        if (!ReadRun(p, end, length, type) || length > count - i) return false;
+
+        if (type == FRAME_RUN_ZERO) {
+            std::memset(dst + i, 0, length * 4);
+        } else if (type == FRAME_RUN_LITERAL) {
+            if (length * 4 > static_cast<size_t>(end - p)) return false;
+            std::memcpy(dst + i, p, length * 4);
+            p += length * 4;
+        } else if (type != FRAME_RUN_KEEP) {
+            return false;
+        }
+        i += length;
+    }
+    return i == count;
+}
+
+} // namespace detail
+
+class CompressedFrameStore {
+public:
+    CompressedFrameStore()
+        : pool(nullptr), width(0), height(0), stride(0), keyframeInterval(DEFAULT_KEYFRAME_INTERVAL),
+          budget(DEFAULT_FRAME_STORE_BUDGET), useCounter(0), encodedBytes(0), repeatedFrames(0) {
+        ResetStats();
+    }
+
+    CompressedFrameStore(CompressedFrameStore&& other) : CompressedFrameStore() {
+        Swap(other);
+    }
+
+    CompressedFrameStore& operator=(CompressedFrameStore&& other) {
+        if (this != &other) {
+            Clear();
+            Swap(other);
+        }
+        return *this;
+    }
+
+    CompressedFrameStore(const CompressedFrameStore&) = delete;
+    CompressedFrameStore& operator=(const CompressedFrameStore&) = delete;
+
+    ~CompressedFrameStore() {
+        Clear();
+    }
+
+    // Compresses every frame of a fully decoded cache into framePool, which
+    // must outlive the store. The cache is left untouched; release its
+    // pixels afterwards to get the memory back.
+    bool Build(const FrameCache& cache, FramePool& framePool, size_t interval = DEFAULT_KEYFRAME_INTERVAL) {
+        return Begin(cache, framePool, interval) && Append(cache) && Finish(cache);
+    }
+
+    // Incremental build, for caches that are still being decoded: Begin
+    // once, Append after each decoded frame, Finish when the cache is done
+    bool Begin(const FrameCache& cache, FramePool& framePool, size_t interval = DEFAULT_KEYFRAME_INTERVAL) {
+        if (cache.Empty() || !cache.HasPixels() || cache.stride != AlignedStride(cache.width)) {
+            Clear();
+            return false;
+        }
+        return Begin(framePool, cache.width, cache.height, interval);
+    }
+
+    // Same, for frames that arrive already coded through AppendCoded
+    bool Begin(FramePool& framePool, int frameWidth, int frameHeight, size_t interval) {
+        Clear();
+        if (frameWidth <= 0 || frameHeight <= 0) return false;
+
+        pool = &framePool;
+        width = frameWidth;
+        height = frameHeight;
+        stride = AlignedStride(frameWidth);
+        keyframeInterval = interval > 0 ? interval : 1;
+        slots.reserve(MaxHotFrames());
+        return true;
+    }
+
+    // Compresses the frames decoded since the last call
+    bool Append(const FrameCache& cache) {
+        if (!pool || cache.width != width || cache.height != height || !cache.HasPixels()) return false;
+
+        // Row padding is always zero, so whole strides code as one run
+        const size_t count = PixelsPerFrame();
+        for (size_t i = frames.size(); i < cache.decodedCount; i++) {
+            const uint32_t* pixels = cache.Frame(i);
+            uint64_t hash = HashBytes(pixels, FrameBytes());
+
+            EncodedFrame frame;
+            frame.handle = INVALID_FRAME_HANDLE;
+            frame.bytes = nullptr;
+            frame.size = 0;
+            frame.source = FindRepeat(cache, pixels, hash);
+            frame.keyframe = i % keyframeInterval == 0;
+
+            if (frame.source != i) {
+                repeatedFrames++;
+            } else {
+                scratch.clear();
+                detail::EncodeFrameRuns(pixels, frame.keyframe ? nullptr : cache.Frame(i - 1), count, scratch);
+                frame.handle = pool->Intern(scratch.data(), scratch.size());
+                frame.bytes = pool->Bytes(frame.handle);
+                frame.size = scratch.size();
+                if (!frame.bytes) return false;
+                encodedBytes += frame.size;
+                frameHashes.insert(std::make_pair(hash, i));
+            }
+            frames.push_back(frame);
+        }
+        return true;
+    }
+
+    // Adds the next frame as coded by an earlier store (see CodedFrame),
+    // e.g. read back from disk. A repeat has no bytes and names the earlier
+    // frame it repeats. The runs are checked when the frame is decoded.
+    bool AppendCoded(const uint8_t* bytes, size_t size, size_t source, bool keyframe) {
+        if (!pool) return false;
+
+        size_t index = frames.size();
+        EncodedFrame frame;
+        frame.handle = INVALID_FRAME_HANDLE;
+        frame.bytes = nullptr;
+        frame.size = 0;
+        frame.source = source;
+        frame.keyframe = keyframe;
+
+        if (source != index) {
+            // Repeats point at a coded frame, never at another repeat
+            if (source > index || frames[source].source != source) return false;
+            repeatedFrames++;
+        } else {
+            // Decoding walks back to a keyframe, so the first frame is one
+            if (!bytes || size == 0 || (index == 0 && !keyframe)) return false;
+            frame.handle = pool->Intern(bytes, size);
+            frame.bytes = pool->Bytes(frame.handle);
+            frame.size = size;
+            if (!frame.bytes) return false;
+            encodedBytes += size;
+        }
+        frames.push_back(frame);
+        return true;
+    }
+
+    // Takes the final dirty rects once every frame is in
+    bool Finish(const FrameCache& cache) {
+        if (!cache.Complete() || frames.size() != cache.frameCount) return false;
+        return Finish(cache.dirtyRects);
+    }
+
+    bool Finish(const std::vector<PixelRect>& rects) {
+        if (rects.size() != frames.size()) return false;
+        dirtyRects = rects;
+        frames.shrink_to_fit();
+        std::vector<uint8_t>().swap(scratch);
+        FrameHashes().swap(frameHashes);
+        return true;
+    }
+
+    // Bytes of decoded frames kept around. At least MIN_HOT_FRAMES are.
+    void SetBudget(size_t bytes) {
+        budget = bytes;
+        while (slots.size() > MaxHotFrames()) {
+            slots.erase(slots.begin() + LeastRecentlyUsed(nullptr));
+        }
+        slots.reserve(MaxHotFrames());
+    }
+
+    // Frees every decoded buffer, e.g. when the animation is not showing
+    // (the slot array keeps its reserved capacity so slots never move)
+    void ReleaseHot() {
+        slots.clear();
+    }
+
+    // Drops every frame and its references into the pool
+    void Clear() {
+        for (size_t i = 0; i < frames.size(); i++) {
+            if (frames[i].handle != INVALID_FRAME_HANDLE) pool->Release(frames[i].handle);
+        }
+        pool = nullptr;
+        width = 0;
+        height = 0;
+        stride = 0;
+        encodedBytes = 0;
+        repeatedFrames = 0;
+        std::vector<EncodedFrame>().swap(frames);
+        std::vector<uint8_t>().swap(scratch);
+        FrameHashes().swap(frameHashes);
+        dirtyRects.clear();
+        ReleaseHot();
+    }
+
+    // Decoded frame, valid until the next Frame call. Null if it could not
+    // be decoded.
+    const uint32_t* Frame(size_t index, bool flipped = false) {
+        if (index >= frames.size()) return nullptr;
+        index = frames[index].source;  // Repeats share the first copy's buffers
+
+        Slot* hit = Find(SlotKey(index, flipped));
+        if (hit) {
+            hit->lastUse = ++useCounter;
+            stats.hits++;
+            return Pixels(*hit);
+        }
+        stats.misses++;
+
+        Slot* plain = flipped ? Find(SlotKey(index, false)) : nullptr;
+        if (!plain) plain = Decode(index);
+        if (!plain) return nullptr;
+        if (!flipped) return Pixels(*plain);
+
+        Slot* target = Acquire(SlotKey(index, true), plain);
+        if (!target) return nullptr;
+        MirrorImage(plain->pixels.Data(), target->pixels.Data(), width, height, stride);
+        return Pixels(*target);
+    }
+
+    // Dirty box of a frame as shown, mirrored along with the pixels
+    PixelRect DirtyRect(size_t index, bool flipped) const {
+        if (index >= dirtyRects.size()) return PixelRect::Make(0, 0, width, height);
+        return flipped ? dirtyRects[index].Mirrored(width) : dirtyRects[index];
+    }
+
+    int Width() const { return width; }
+    int Height() const { return height; }
+    size_t Stride() const { return stride; }
+    size_t FrameCount() const { return frames.size(); }
+    bool Empty() const { return frames.empty(); }
+    size_t KeyframeInterval() const { return keyframeInterval; }
+    const std::vector<PixelRect>& DirtyRects() const { return dirtyRects; }
+
+    // A frame as coded, for saving: its runs (null for a repeat), whether
+    // it is a keyframe and the frame it repeats (itself if none)
+    const uint8_t* CodedFrame(size_t index, size_t& size, size_t& source, bool& keyframe) const {
+        const EncodedFrame& frame = frames[index];
+        size = frame.size;
+        source = frame.source;
+        keyframe = frame.keyframe;
+        return frame.bytes;
+    }
+
+    size_t FrameBytes() const { return stride * height; }
+
+    // What the frames would take fully decoded (not counting mirrored copies)
+    size_t RawBytes() const { return FrameBytes() * frames.size(); }
+    // Coded frames plus the index, before sharing with other stores in the
+    // pool (FramePoolStats has what the pool holds after sharing)
+    size_t CompressedBytes() const { return encodedBytes + frames.capacity() * sizeof(EncodedFrame); }
+    size_t HotBytes() const { return FrameBytes() * slots.size(); }
+    // Frames identical to an earlier frame, stored once
+    size_t RepeatedFrames() const { return repeatedFrames; }
+
+    const FrameStoreStats& Stats() const { return stats; }
+
+    void ResetStats() {
+        std::memset(&stats, 0, sizeof(stats));
+    }
+
+private:
+    struct EncodedFrame {
+        FrameHandle handle;   // Coded runs in the pool; invalid for a repeat
+        const uint8_t* bytes;
+        size_t size;
+        size_t source;        // This frame, or the earlier frame it repeats
+        bool keyframe;
+    };
+
+    typedef std::unordered_multimap<uint64_t, size_t> FrameHashes;
+
+    struct Slot {
+        size_t key;
+        uint64_t lastUse;
+        AlignedBuffer pixels;
+    };
+
+    void Swap(CompressedFrameStore& other) {
+        std::swap(pool, other.pool);
+        std::swap(width, other.width);
+        std::swap(height, other.height);
+        std::swap(stride, other.stride);
+        std::swap(keyframeInterval, other.keyframeInterval);
+        std::swap(budget, other.budget);
+        std::swap(useCounter, other.useCounter);
+        std::swap(encodedBytes, other.encodedBytes);
+        std::swap(repeatedFrames, other.repeatedFrames);
+        frames.swap(other.frames);
+        scratch.swap(other.scratch);
+        frameHashes.swap(other.frameHashes);
+        dirtyRects.swap(other.dirtyRects);
+        slots.swap(other.slots);
+        std::swap(stats, other.stats);
+    }
+
+    // Earliest coded frame with the same pixels, or the next frame's index
+    size_t FindRepeat(const FrameCache& cache, const uint32_t* pixels, uint64_t hash) const {
+        std::pair<FrameHashes::const_iterator, FrameHashes::const_iterator> range = frameHashes.equal_range(hash);
+        for (FrameHashes::const_iterator it = range.first; it != range.second; ++it) {
+            if (std::memcmp(cache.Frame(it->second), pixels, FrameBytes()) == 0) return it->second;
+        }
+        return frames.size();
+    }
+
+    static size_t SlotKey(size_t index, bool flipped) { return index * 2 + (flipped ? 1 : 0); }
+
+    size_t PixelsPerFrame() const { return stride / 4 * height; }
+
+    size_t MaxHotFrames() const {
+        size_t frameBytes = FrameBytes();
+        size_t fit = frameBytes > 0 ? budget / frameBytes : 0;
+        return fit > MIN_HOT_FRAMES ? fit : MIN_HOT_FRAMES;
+    }
+
+    static const uint32_t* Pixels(const Slot& slot) {
+        return reinterpret_cast<const uint32_t*>(slot.pixels.Data());
+    }
+
+    Slot* Find(size_t key) {
+        for (size_t i = 0; i < slots.size(); i++) {
+            if (slots[i].key == key) return &slots[i];
+        }
+        return nullptr;
+    }
+
+    size_t LeastRecentlyUsed(const Slot* keep) const {
+        size_t victim = slots.size();
+        for (size_t i = 0; i < slots.size(); i++) {
+            if (&slots[i] == keep) continue;
+            if (victim == slots.size() || slots[i].lastUse < slots[victim].lastUse) victim = i;
+        }
+        return victim;
+    }
+
+    // A buffer for key: a new one while under budget, else the least
+    // recently used one other than keep. Slots never move, since the
+    // vector is reserved up front.
+    Slot* Acquire(size_t key, const Slot* keep) {
+        Slot* slot = nullptr;
+        if (slots.size() < MaxHotFrames()) {
+            slots.emplace_back();
+            slot = &slots.back();
+            if (!slot->pixels.Allocate(FrameBytes())) {
+                slots.pop_back();
+                return nullptr;
+            }
+        } else {
+            size_t victim = LeastRecentlyUsed(keep);
+            if (victim == slots.size()) return nullptr;
+            slot = &slots[victim];
+            stats.evictions++;
+        }
+        slot->key = key;
+        slot->lastUse = ++useCounter;
+        return slot;
+    }
+
+    // Decodes frame index (unflipped, not a repeat) from the nearest hot
+    // predecessor, keyframe or repeated frame
+    Slot* Decode(size_t index) {
+        size_t first = index;
+        Slot* base = nullptr;
+        while (!frames[first].keyframe) {
+            size_t previous = frames[first - 1].source;
+            base = Find(SlotKey(previous, false));
+            if (base) break;
+            if (previous != first - 1) {
+                // A repeat: start from the frame it repeats
+                base = Decode(previous);
+                if (!base) return nullptr;
+                break;
+            }
+            first--;
+        }
+
+        Slot* target = Acquire(SlotKey(index, false), base);
+        if (!target) return nullptr;
+        uint32_t* pixels = reinterpret_cast<uint32_t*>(target->pixels.Data());
+        if (base) std::memcpy(pixels, Pixels(*base), FrameBytes());
+
+        for (size_t i = first; i <= index; i++) {
+            const EncodedFrame& frame = frames[i];
+            if (!detail::DecodeFrameRuns(frame.bytes, frame.size, pixels, PixelsPerFrame())) {
+                target->key = SIZE_MAX;  // Holds nothing usable
+                return nullptr;
+            }
+            stats.framesDecoded++;
+        }
+        return target;
+    }
+
+    FramePool* pool;
+    int width;
+    int height;
+    size_t stride;
+    size_t keyframeInterval;
+    size_t budget;
+    uint64_t useCounter;
+    size_t encodedBytes;
+    size_t repeatedFrames;
+    std::vector<EncodedFrame> frames;
+    std::vector<uint8_t> scratch;    // Coding buffer, only while building
+    FrameHashes frameHashes;         // Pixel hash to frame, only while building
+    std::vector<PixelRect> dirtyRects;
+    std::vector<Slot> slots;
+    FrameStoreStats stats;
+};
+
+} // namespace chibi
@@ -0,0 +1,579 @@
+// Portable GIF87a/89a decoder.
+//
+// Header-only and free of any OS headers so the same code runs inside the
+// Windows viewer and on Linux build machines. The decoder parses blocks
+// straight from a caller-owned byte range and never copies the file.
+//
+// Two levels of API are provided:
+//   - GifReader / GifCanvas: frame-at-a-time access to the raw sub-frames
+//     (palette indices, rectangle, delay, disposal) and a canvas that
+//     composes them the way browsers do.
+//   - DecodeGif: convenience wrapper returning every frame fully composed
+//     as straight-alpha RGBA plus its delay.
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <vector>
+#include <algorithm>
+
+#include "Palette.h"
+#include "PixelRect.h"
+
+namespace chibi {
+
+// Frame disposal methods from the Graphic Control Extension
+enum GifDisposal {
+    GIF_DISPOSE_UNSPECIFIED = 0,
+    GIF_DISPOSE_NONE = 1,        // Leave the frame in place
+    GIF_DISPOSE_BACKGROUND = 2,  // Clear the frame rectangle to transparent
+    GIF_DISPOSE_PREVIOUS = 3     // Restore the canvas to what it was before the frame
+};
+
+// One raw image block as stored in the file, after LZW decode and deinterlace
+struct GifFrameRecord {
+    int left;
+    int top;
+    int width;
+    int height;
+    unsigned delayMs;
+    int disposal;
+    int transparentIndex;  // -1 when the frame has no transparent colour
+    bool interlaced;
+    uint8_t palette[256 * 4];  // RGBA, transparent entry already has alpha 0
+    std::vector<uint8_t> indices;  // width * height palette indices, top-down
+
+    GifFrameRecord()
+        : left(0), top(0), width(0), height(0), delayMs(0),
+          disposal(GIF_DISPOSE_UNSPECIFIED), transparentIndex(-1), interlaced(false) {
+        std::memset(palette, 0, sizeof(palette));
+    }
+};
+
+// A fully composed frame
+struct GifFrame {
+    std::vector<uint8_t> rgba;  // canvas width * height * 4, straight alpha
+    unsigned delayMs;
+    int disposal;
+};
+
+struct GifImage {
+    int width;
+    int height;
+    unsigned loopCount;  // 0 = loop forever
+    std::vector<GifFrame> frames;
+
+    GifImage() : width(0), height(0), loopCount(0) {}
+};
+
+// Streams image blocks out of an in-memory GIF file
+class GifReader {
+public:
+    GifReader() : data(nullptr), size(0), pos(0), firstFramePos(0), canvasWidth(0),
+                  canvasHeight(0), loopCount(0), globalColorCount(0), failed(false) {
+        std::memset(globalPalette, 0, sizeof(globalPalette));
+    }
+
+    // Parses the header and global colour table. The data must outlive the reader.
+    bool Open(const uint8_t* bytes, size_t length) {
+        data = bytes;
+        size = length;
+        pos = 0;
+        failed = false;
+        loopCount = 0;
+
+        if (size < 13 || std::memcmp(data, "GIF", 3) != 0 ||
+            (std::memcmp(data + 3, "87a", 3) != 0 && std::memcmp(data + 3, "89a", 3) != 0)) {
+            failed = true;
+            return false;
+        }
+
+        canvasWidth = data[6] | (data[7] << 8);
+        canvasHeight = data[8] | (data[9] << 8);
+        uint8_t packed = data[10];
+        pos = 13;
+
+        globalColorCount = 0;
+        if (packed & 0x80) {
+            globalColorCount = 2 << (packed & 0x07);
+            if (!ReadPalette(globalPalette, globalColorCount)) {
+                failed = true;
+                return false;
+            }
+        }
+
+        if (canvasWidth <= 0 || canvasHeight <= 0) {
+            failed = true;
+            return false;
+        }
+
+        firstFramePos = pos;
+        return true;
+    }
+
+    // Goes back to the first frame without re-parsing the header
+    void Rewind() {
+        pos = firstFramePos;
+        failed = false;
+    }
+
+    // Decodes the next image block into frame. Returns false at the trailer
+    // or on malformed data (check Failed() to tell the two apart).
+    bool NextFrame(GifFrameRecord& frame) {
+        int disposal = GIF_DISPOSE_UNSPECIFIED;
+        int transparentIndex = -1;
+        unsigned delayMs = 0;
+
+        while (pos < size) {
+            uint8_t introducer = data[pos++];
+
+            if (introducer == 0x3B) {  // Trailer
+                return false;
+            }
+
+            if (introducer == 0x21) {  // Extension
+                if (pos >= size) break;
+                uint8_t label = data[pos++];
+
+                if (label == 0xF9 && pos < size && data[pos] >= 4 && pos + 5 <= size) {
+                    // Graphic Control Extension
+                    uint8_t packed = data[pos + 1];
+                    disposal = (packed >> 2) & 0x07;
+                    delayMs = (data[pos + 2] | (data[pos + 3] << 8)) * 10u;
+                    transparentIndex = (packed & 0x01) ? data[pos + 4] : -1;
+                } else if (label == 0xFF && pos + 12 <= size && data[pos] == 11 &&
+                           (std::memcmp(data + pos + 1, "NETSCAPE2.0", 11) == 0 ||
+                            std::memcmp(data + pos + 1, "ANIMEXTS1.0", 11) == 0)) {
+                    // Looping extension: sub-block 0x01 followed by a 16-bit count
+                    size_t sub = pos + 12;
+                    if (sub + 4 <= size && data[sub] >= 3 && data[sub + 1] == 0x01) {
+                        loopCount = data[sub + 2] | (data[sub + 3] << 8);
+                    }
+                }
+
+                if (!SkipSubBlocks()) break;
+                continue;
+            }
+
+            if (introducer == 0x2C) {  // Image descriptor
+                frame.disposal = disposal;
+                frame.delayMs = delayMs;
+                frame.transparentIndex = transparentIndex;
+                if (!ReadImage(frame)) break;
+                if (transparentIndex >= 0) {
+                    frame.palette[transparentIndex * 4 + 3] = 0;
+                }
+                return true;
+            }
+
+            // Unknown block type
+            break;
+        }
+
+        failed = true;
+        return false;
+    }
+
+    // Counts image blocks by walking the block structure without decoding
+    // any pixel data. Leaves the reader rewound to the first frame.
+    size_t CountFrames() {
+        size_t count = 0;
+        pos = firstFramePos;
+
+        while (pos < size) {
+            uint8_t introducer = data[pos++];
+            if (introducer == 0x3B) break;
+
+            if (introducer == 0x21) {
+                if (pos >= size) break;
+                pos++;
+                if (!SkipSubBlocks()) break;
+            } else if (introducer == 0x2C) {
+                if (pos + 9 > size) break;
+                uint8_t packed = data[pos + 8];
+                pos += 9;
+                if (packed & 0x80) pos += static_cast<size_t>(2 << (packed & 0x07)) * 3;
+                pos++;  // LZW minimum code size
+                if (!SkipSubBlocks()) break;
+                count++;
+            } else {
+                break;
+            }
+        }
+
+        Rewind();
+        return count;
+    }
+
+    int Width() const { return canvasWidth; }
+    int Height() const { return canvasHeight; }
+    unsigned LoopCount() const { return loopCount; }
+    bool Failed() const { return failed; }
+
+private:
+    bool ReadPalette(uint8_t* palette, int count) {
+        if (pos + static_cast<size_t>(count) * 3 > size) return false;
+        for (int i = 0; i < 256; i++) {
+            if (i < count) {
+                palette[i * 4 + 0] = data[pos + i * 3 + 0];
+                palette[i * 4 + 1] = data[pos + i * 3 + 1];
+                palette[i * 4 + 2] = data[pos + i * 3 + 2];
+            } else {
+                // Out-of-range indices render as opaque black
+                palette[i * 4 + 0] = 0;
+                palette[i * 4 + 1] = 0;
+                palette[i * 4 + 2] = 0;
+            }
+            palette[i * 4 + 3] = 255;
+        }
+        pos += static_cast<size_t>(count) * 3;
+        return true;
+    }
+
+    bool SkipSubBlocks() {
+        while (pos < size) {
+            uint8_t length = data[pos++];
+            if (length == 0) return true;
+            pos += length;
+        }
+        return false;
+    }
+
+    bool ReadImage(GifFrameRecord& frame) {
+        if (pos + 9 > size) return false;
+
+        frame.left = data[pos] | (data[pos + 1] << 8);
+        frame.top = data[pos + 2] | (data[pos + 3] << 8);
+        frame.width = data[pos + 4] | (data[pos + 5] << 8);
+        frame.height = data[pos + 6] | (data[pos + 7] << 8);
+        uint8_t packed = data[pos + 8];
+        pos += 9;
+
+        frame.interlaced = (packed & 0x40) != 0;
+
+        if (packed & 0x80) {
+            if (!ReadPalette(frame.palette, 2 << (packed & 0x07))) return false;
+        } else {
+            std::memcpy(frame.palette, globalPalette, sizeof(globalPalette));
+        }
+
+        if (pos >= size) return false;
+        int minCodeSize = data[pos++];
+        if (minCodeSize < 1 || minCodeSize > 11) return false;
+
+        size_t pixelCount = static_cast<size_t>(frame.width) * frame.height;
+        frame.indices.resize(pixelCount);
+
+        size_t decoded = DecodeLzw(minCodeSize, frame.indices.data(), pixelCount);
+
+        // Truncated data: leave the remainder transparent when possible
+        if (decoded < pixelCount) {
+            uint8_t fill = frame.transparentIndex >= 0 ? static_cast<uint8_t>(frame.transparentIndex) : 0;
+            std::fill(frame.indices.begin() + decoded, frame.indices.end(), fill);
+        }
+
+        if (frame.interlaced && frame.height > 1) {
+            Deinterlace(frame);
+        }
+
+        return true;
+    }
+
+    // Decodes the LZW stream that starts at pos, reading bits directly across
+    // data sub-blocks. Leaves pos after the block terminator.
+    //
+    // Every code's string is already somewhere in the output, so the table
+    // stores (start, length) pairs and a code expands with one memcpy instead
+    // of walking a prefix chain. Bits are refilled up to 56 at a time, which
+    // leaves several codes to decode per refill.
+    size_t DecodeLzw(int minCodeSize, uint8_t* out, size_t outSize) {
+        size_t start[4096];
+        uint16_t length[4096];
+
+        const int clearCode = 1 << minCodeSize;
+        const int endCode = clearCode + 1;
+        int codeSize = minCodeSize + 1;
+        int codeMask = (1 << codeSize) - 1;
+        int nextCode = clearCode + 2;
+        bool havePrev = false;
+        size_t prevStart = 0;
+        size_t prevLength = 0;
+
+        uint64_t bitBuffer = 0;
+        int bitCount = 0;
+        size_t blockRemaining = 0;
+        bool endOfData = false;
+        size_t written = 0;
+
+        for (;;) {
+            // Refill whole bytes while they fit, 8 at a time inside a sub-block
+            while (bitCount <= 56) {
+                if (blockRemaining == 0) {
+                    if (pos >= size || data[pos] == 0) {
+                        endOfData = true;
+                        break;
+                    }
+                    blockRemaining = data[pos++];
+                }
+                if (blockRemaining >= 8 && pos + 8 <= size) {
+                    uint64_t chunk;
+                    std::memcpy(&chunk, data + pos, 8);  // Little-endian
+                    size_t take = static_cast<size_t>(64 - bitCount) >> 3;
+                    if (take < 8) chunk &= (uint64_t(1) << (take * 8)) - 1;
+                    bitBuffer |= chunk << bitCount;
+                    bitCount += static_cast<int>(take) * 8;
+                    pos += take;
+                    blockRemaining -= take;
+                    continue;
+                }
+                if (pos >= size) {
+                    endOfData = true;
+                    break;
+                }
+                bitBuffer |= static_cast<uint64_t>(data[pos++]) << bitCount;
+                bitCount += 8;
+                blockRemaining--;
+            }
+            if (bitCount < codeSize) break;
+
+            bool stop = false;
+            while (bitCount >= codeSize) {
+                int code = static_cast<int>(bitBuffer & static_cast<uint64_t>(codeMask));
+                bitBuffer >>= codeSize;
+                bitCount -= codeSize;
+
+                if (code == clearCode) {
+                    codeSize = minCodeSize + 1;
+                    codeMask = (1 << codeSize) - 1;
+                    nextCode = clearCode + 2;
+                    havePrev = false;
+                    continue;
+                }
+                if (code == endCode || written >= outSize) {
+                    stop = true;
+                    break;
+                }
+
+                size_t codeStart = written;
+                size_t codeLength;
+                if (code < clearCode) {
+                    out[written++] = static_cast<uint8_t>(code);
+                    codeLength = 1;
+                } else if (!havePrev || code > nextCode) {
+                    stop = true;  // Corrupt stream
+                    break;
+                } else {
+                    // code == nextCode is the previous string plus its own first byte
+                    bool pending = code == nextCode;
+                    codeLength = pending ? prevLength + 1 : length[code];
+                    size_t from = pending ? prevStart : start[code];
+                    size_t copy = std::min(codeLength, outSize - written);
+                    if (pending) {
+                        size_t head = std::min(prevLength, copy);
+                        std::memcpy(out + written, out + from, head);
+                        if (copy > head) out[written + head] = out[from];
+                    } else {
+                        std::memcpy(out + written, out + from, copy);
+                    }
+                    written += copy;
+                    if (copy < codeLength) {
+                        stop = true;
+                        break;
+                    }
+                }
+
+                // The new entry is the previous string followed by this one's
+                // first byte, which sit next to each other in the output
+                if (havePrev && nextCode < 4096) {
+                    start[nextCode] = prevStart;
+                    length[nextCode] = static_cast<uint16_t>(prevLength + 1);
+                    nextCode++;
+                    if (nextCode > codeMask && codeSize < 12) {
+                        codeSize++;
+                        codeMask = (1 << codeSize) - 1;
+                    }
+                }
+                havePrev = true;
+                prevStart = codeStart;
+                prevLength = codeLength;
+            }
+            if (stop || endOfData) break;
+        }
+
+        // Skip whatever is left of the current sub-block and any trailing ones
+        pos = std::min(size, pos + blockRemaining);
+        SkipSubBlocks();
+
+        return written;
+    }
+
+    static void Deinterlace(GifFrameRecord& frame) {
+        static const int passStart[4] = { 0, 4, 2, 1 };
+        static const int passStep[4] = { 8, 8, 4, 2 };
+
+        std::vector<uint8_t> linear(frame.indices);
+        const size_t rowBytes = frame.width;
+        size_t srcRow = 0;
+
+        for (int pass = 0; pass < 4; pass++) {
+            for (int y = passStart[pass]; y < frame.height; y += passStep[pass]) {
+                std::memcpy(&frame.indices[y * rowBytes], &linear[srcRow * rowBytes], rowBytes);
+                srcRow++;
+            }
+        }
+    }
+
+    const uint8_t* data;
+    size_t size;
+    size_t pos;
+    size_t firstFramePos;
+    int canvasWidth;
+    int canvasHeight;
+    unsigned loopCount;
+    int globalColorCount;
+    uint8_t globalPalette[256 * 4];
+    bool failed;
+};
+
+// Byte order of the composed canvas
+enum GifPixelOrder {
+    GIF_ORDER_RGBA = 0,
+    GIF_ORDER_BGRA = 1  // Ready for a premultiplied BGRA surface as is
+};
+
+// Composes raw image blocks onto an RGBA canvas, honouring disposal methods.
+// The canvas starts fully transparent, matching what browsers display.
+// GIF alpha is either 0 or 255 and transparent pixels stay all zero, so a
+// BGRA canvas is already premultiplied.
+class GifCanvas {
+public:
+    GifCanvas() : width(0), height(0), order(GIF_ORDER_RGBA), pendingDisposal(GIF_DISPOSE_UNSPECIFIED),
+                  pendingLeft(0), pendingTop(0), pendingRight(0), pendingBottom(0),
+                  lastUpdate(PixelRect::EmptyRect()) {}
+
+    void Reset(int canvasWidth, int canvasHeight, GifPixelOrder pixelOrder = GIF_ORDER_RGBA) {
+        width = canvasWidth;
+        height = canvasHeight;
+        order = pixelOrder;
+        pixels.assign(static_cast<size_t>(width) * height * 4, 0);
+        saved.clear();
+        pendingDisposal = GIF_DISPOSE_UNSPECIFIED;
+        lastUpdate = PixelRect::Make(0, 0, width, height);
+    }
+
+    // Applies the previous frame's disposal, then draws frame on top
+    void Compose(const GifFrameRecord& frame) {
+        // Pixels touched: this frame's rectangle plus whatever the previous
+        // frame's disposal cleared or restored
+        lastUpdate = PixelRect::EmptyRect();
+        if (pendingDisposal == GIF_DISPOSE_BACKGROUND || pendingDisposal == GIF_DISPOSE_PREVIOUS) {
+            lastUpdate = PixelRect::Make(pendingLeft, pendingTop, pendingRight, pendingBottom);
+        }
+
+        ApplyPendingDisposal();
+
+        // Clipped to the logical screen; a frame entirely outside it draws
+        // (and later disposes) nothing
+        PixelRect clip = PixelRect::Intersect(PixelRect::Make(frame.left, frame.top, frame.left + frame.width, frame.top + frame.height),
+                                              PixelRect::Make(0, 0, width, height));
+        int left = clip.left;
+        int top = clip.top;
+        int right = clip.right;
+        int bottom = clip.bottom;
+        lastUpdate = PixelRect::Union(lastUpdate, clip);
+
+        if (frame.disposal == GIF_DISPOSE_PREVIOUS) {
+            saved = pixels;
+        }
+
+        // Palette as packed pixels in canvas order, opaque entries forced to 255
+        uint32_t colors[256];
+        for (int i = 0; i < 256; i++) {
+            const uint8_t* color = &frame.palette[i * 4];
+            uint8_t first = order == GIF_ORDER_BGRA ? color[2] : color[0];
+            uint8_t third = order == GIF_ORDER_BGRA ? color[0] : color[2];
+            uint8_t bytes[4] = { first, color[1], third, static_cast<uint8_t>(color[3] != 0 ? 255 : 0) };
+            std::memcpy(&colors[i], bytes, 4);
+        }
+
+        static const ExpandPaletteRowFunc expandRow = GetExpandPaletteRowFunc();
+        for (int y = top; y < bottom; y++) {
+            const uint8_t* src = &frame.indices[static_cast<size_t>(y - frame.top) * frame.width + (left - frame.left)];
+            uint32_t* dst = reinterpret_cast<uint32_t*>(&pixels[(static_cast<size_t>(y) * width + left) * 4]);
+            expandRow(src, colors, dst, right - left);
+        }
+
+        pendingDisposal = frame.disposal;
+        pendingLeft = left;
+        pendingTop = top;
+        pendingRight = right;
+        pendingBottom = bottom;
+    }
+
+    const uint8_t* Pixels() const { return pixels.data(); }
+
+    // Region that differs from the canvas before the last Compose call
+    PixelRect LastUpdate() const { return lastUpdate; }
+
+    int Width() const { return width; }
+    int Height() const { return height; }
+
+private:
+    void ApplyPendingDisposal() {
+        if (pendingDisposal == GIF_DISPOSE_BACKGROUND) {
+            for (int y = pendingTop; y < pendingBottom; y++) {
+                std::memset(&pixels[(static_cast<size_t>(y) * width + pendingLeft) * 4], 0,
+                            static_cast<size_t>(pendingRight - pendingLeft) * 4);
+            }
+        } else if (pendingDisposal == GIF_DISPOSE_PREVIOUS && !saved.empty()) {
+            pixels.swap(saved);
+        }
+        pendingDisposal = GIF_DISPOSE_UNSPECIFIED;
+    }
+
+    int width;
+    int height;
+    GifPixelOrder order;
+    std::vector<uint8_t> pixels;
+    std::vector<uint8_t> saved;
+    int pendingDisposal;
+    int pendingLeft;
+    int pendingTop;
+    int pendingRight;
+    int pendingBottom;
+    PixelRect lastUpdate;
+};
+
+// Decodes every frame of a GIF held in memory
+inline bool DecodeGif(const uint8_t* data, size_t size, GifImage& image) {
+    GifReader reader;
+    if (!reader.Open(data, size)) {
+        return false;
+    }
+
+    image.width = reader.Width();
+    image.height = reader.Height();
+    image.frames.clear();
+
+    GifCanvas canvas;
+    canvas.Reset(image.width, image.height);
+
+    GifFrameRecord record;
+    while (reader.NextFrame(record)) {
+        canvas.Compose(record);
+
+        GifFrame frame;
+        frame.rgba.assign(canvas.Pixels(), canvas.Pixels() + static_cast<size_t>(image.width) * image.height * 4);
+        frame.delayMs = record.delayMs;
+        frame.disposal = record.disposal;
+        image.frames.push_back(std::move(frame));
+    }
+
+    image.loopCount = reader.LoopCount();
+
+    // A truncated file still yields the frames decoded so far
+    return !image.frames.empty();
+}
+
+} // namespace chibi
@@ -0,0 +1,179 @@
+// Fast 64-bit content hash for frame deduplication.
+//
+// An xxHash3-style stripe hash: eight 64-bit accumulators each take one
+// 8-byte lane of every 64-byte stripe, mixed with a per-stripe slice of a
+// fixed secret through a 32x32->64 multiply, and are scrambled after every
+// 1 KB block. The AVX2 kernel handles four lanes per instruction and gives
+// the same result as the scalar loop, so hashes never depend on the CPU.
+// Not cryptographic; callers compare the bytes on a hash match.
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+
+#include "CpuFeatures.h"
+
+namespace chibi {
+
+namespace detail {
+
+const size_t HASH_LANES = 8;
+const size_t HASH_STRIPE_BYTES = 64;
+const size_t HASH_STRIPES_PER_BLOCK = 16;
+
+const uint64_t HASH_PRIME32_1 = 0x9E3779B1ULL;
+const uint64_t HASH_PRIME32_2 = 0x85EBCA77ULL;
+const uint64_t HASH_PRIME32_3 = 0xC2B2AE3DULL;
+const uint64_t HASH_PRIME64_1 = 0x9E3779B185EBCA87ULL;
+const uint64_t HASH_PRIME64_2 = 0xC2B2AE3D27D4EB4FULL;
+const uint64_t HASH_PRIME64_3 = 0x165667B19E3779F9ULL;
+const uint64_t HASH_PRIME64_4 = 0x85EBCA77C2B2AE63ULL;
+const uint64_t HASH_PRIME64_5 = 0x27D4EB2F165667C5ULL;
+
+// Stripe n of a block uses words [n, n + 8); the scramble uses the last 8.
+// Generated with splitmix64.
+const uint64_t HASH_SECRET[HASH_STRIPES_PER_BLOCK + HASH_LANES] = {
+    0x2CB0F69F4ABEA221ULL, 0x9417034723148989ULL, 0xDD555950609DFE03ULL,
+    0xDBAFB150DEB12800ULL, 0x7E789B2E6C442CB6ULL, 0xF41E5636C7E4F8C4ULL,
+    0x0959D150F8FBA7E4ULL, 0xA97316F13CDB9EEAULL, 0x74CD8258F9520068ULL,
+    0x55C74A62E116868BULL, 0xD2F4C799A2023CBDULL, 0xDF98CB79A37B51B9ULL,
+    0x396F5885524F3905ULL, 0xAF1D56386CA3B276ULL, 0xA9FFBE6B5104E85AULL,
+    0x6BD0C51B9FD533B3ULL, 0x980CE91C50AB4B56ULL, 0x28AC395780FE62C5ULL,
+    0x768912E3A6BCEDC7ULL, 0x50B3E8C9332C7C88ULL, 0xCE3BBFE520BD47DAULL,
+    0xCBA6C8E8E0BB7C4FULL, 0xBF194DB8434A346DULL, 0x7D8F2A7B60416D7FULL,
+};
+
+inline uint64_t ReadLe64(const uint8_t* p) {
+    uint64_t value;
+    std::memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+inline uint64_t RotateLeft64(uint64_t value, int bits) {
+    return (value << bits) | (value >> (64 - bits));
+}
+
+inline uint64_t HashAvalanche(uint64_t h) {
+    h ^= h >> 33;
+    h *= HASH_PRIME64_2;
+    h ^= h >> 29;
+    h *= HASH_PRIME64_3;
+    h ^= h >> 32;
+    return h;
+}
+
+inline void HashStripeScalar(uint64_t* acc, const uint8_t* p, const uint64_t* secret) {
+    for (size_t i = 0; i < HASH_LANES; i++) {
+        uint64_t value = ReadLe64(p + i * 8);
+        uint64_t keyed = value ^ secret[i];
+        acc[i ^ 1] += value;
+        acc[i] += (keyed & 0xFFFFFFFFu) * (keyed >> 32);
+    }
+}
+
+inline void HashScrambleScalar(uint64_t* acc) {
+    const uint64_t* secret = HASH_SECRET + HASH_STRIPES_PER_BLOCK;
+    for (size_t i = 0; i < HASH_LANES; i++) {
+        uint64_t a = acc[i];
+        a ^= a >> 47;
+        a ^= secret[i];
+        acc[i] = a * HASH_PRIME32_1;
+    }
+}
+
+// Hashes stripeCount whole stripes, the first being stripe 0 of a block
+inline void HashStripesScalar(uint64_t* acc, const uint8_t* p, size_t stripeCount) {
+    for (size_t n = 0; n < stripeCount; n++, p += HASH_STRIPE_BYTES) {
+        size_t inBlock = n % HASH_STRIPES_PER_BLOCK;
+        HashStripeScalar(acc, p, HASH_SECRET + inBlock);
+        if (inBlock == HASH_STRIPES_PER_BLOCK - 1) HashScrambleScalar(acc);
+    }
+}
+
+#if CHIBI_X86
+CHIBI_TARGET_AVX2 inline __m256i HashScrambleAvx2(__m256i a, const __m256i* secret) {
+    const __m256i prime = _mm256_set1_epi64x(static_cast<long long>(HASH_PRIME32_1));
+    a = _mm256_xor_si256(a, _mm256_srli_epi64(a, 47));
+    a = _mm256_xor_si256(a, _mm256_loadu_si256(secret));
+    // 64x32-bit multiply from two 32x32->64 halves
+    __m256i low = _mm256_mul_epu32(a, prime);
+    __m256i high = _mm256_mul_epu32(_mm256_srli_epi64(a, 32), prime);
+    return _mm256_add_epi64(low, _mm256_slli_epi64(high, 32));
+}
+
+CHIBI_TARGET_AVX2 inline void HashStripesAvx2(uint64_t* acc, const uint8_t* p, size_t stripeCount) {
+    __m256i acc0 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(acc));
+    __m256i acc1 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(acc + 4));
+    const __m256i* scrambleSecret = reinterpret_cast<const __m256i*>(HASH_SECRET + HASH_STRIPES_PER_BLOCK);
+
+    for (size_t n = 0; n < stripeCount; n++, p += HASH_STRIPE_BYTES) {
+        size_t inBlock = n % HASH_STRIPES_PER_BLOCK;
+        const __m256i* secret = reinterpret_cast<const __m256i*>(HASH_SECRET + inBlock);
+        for (int half = 0; half < 2; half++) {
+            __m256i value = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p) + half);
+            __m256i keyed = _mm256_xor_si256(value, _mm256_loadu_si256(secret + half));
+            __m256i product = _mm256_mul_epu32(keyed, _mm256_srli_epi64(keyed, 32));
+            // Each lane also takes its neighbour's value (lane i ^ 1)
+            __m256i swapped = _mm256_shuffle_epi32(value, _MM_SHUFFLE(1, 0, 3, 2));
+            __m256i sum = _mm256_add_epi64(product, swapped);
+            if (half == 0) {
+                acc0 = _mm256_add_epi64(acc0, sum);
+            } else {
+                acc1 = _mm256_add_epi64(acc1, sum);
+            }
+        }
+
+        if (inBlock == HASH_STRIPES_PER_BLOCK - 1) {
+            acc0 = HashScrambleAvx2(acc0, scrambleSecret);
+            acc1 = HashScrambleAvx2(acc1, scrambleSecret + 1);
+        }
+    }
+
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(acc), acc0);
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(acc + 4), acc1);
+}
+#endif
+
+typedef void (*HashStripesFunc)(uint64_t* acc, const uint8_t* p, size_t stripeCount);
+
+// Best kernel for this CPU, chosen once
+inline HashStripesFunc GetHashStripesFunc() {
+#if CHIBI_X86
+    if (GetCpuFeatures().avx2) return HashStripesAvx2;
+#endif
+    return HashStripesScalar;
+}
+
+} // namespace detail
+
+inline uint64_t HashBytes(const void* data, size_t size) {
+    static const detail::HashStripesFunc hashStripes = detail::GetHashStripesFunc();
+    const uint8_t* p = static_cast<const uint8_t*>(data);
+
+    uint64_t acc[detail::HASH_LANES] = {
+        detail::HASH_PRIME32_3, detail::HASH_PRIME64_1, detail::HASH_PRIME64_2, detail::HASH_PRIME64_3,
+        detail::HASH_PRIME64_4, detail::HASH_PRIME32_2, detail::HASH_PRIME64_5, detail::HASH_PRIME32_1
+    };
+
+    size_t stripeCount = size / detail::HASH_STRIPE_BYTES;
+    hashStripes(acc, p, stripeCount);
+
+    // The tail is zero-padded to a whole stripe; the length below tells
+    // padded inputs apart
+    size_t tail = size - stripeCount * detail::HASH_STRIPE_BYTES;
+    if (tail > 0) {
+        uint8_t last[detail::HASH_STRIPE_BYTES] = {};
+        std::memcpy(last, p + stripeCount * detail::HASH_STRIPE_BYTES, tail);
+        detail::HashStripeScalar(acc, last, detail::HASH_SECRET + stripeCount % detail::HASH_STRIPES_PER_BLOCK);
+    }
+
+    uint64_t h = static_cast<uint64_t>(size) * detail::HASH_PRIME64_1;
+    for (size_t i = 0; i < detail::HASH_LANES; i++) {
+        h ^= detail::HashAvalanche(acc[i] + detail::HASH_SECRET[i]);
+        h = detail::RotateLeft64(h, 27) * detail::HASH_PRIME64_1 + detail::HASH_PRIME64_4;
+    }
+    return detail::HashAvalanche(h);
+}
+
+} // namespace chibi
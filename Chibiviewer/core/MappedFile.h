@@ -0,0 +1,130 @@
+// Read-only memory-mapped file.
+//
+// Decoders parse straight out of the mapping, so a file is never copied into
+// an intermediate buffer; pages are faulted in by the OS as the parser walks
+// them. Close (or destroy) the mapping once its frames have been cached.
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace chibi {
+
+class MappedFile {
+public:
+    MappedFile() : data(nullptr), size(0) {}
+
+    ~MappedFile() {
+        Close();
+    }
+
+    MappedFile(MappedFile&& other) noexcept : data(other.data), size(other.size) {
+        other.data = nullptr;
+        other.size = 0;
+    }
+
+    MappedFile& operator=(MappedFile&& other) noexcept {
+        if (this != &other) {
+            Close();
+            data = other.data;
+            size = other.size;
+            other.data = nullptr;
+            other.size = 0;
+        }
+        return *this;
+    }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+#ifdef _WIN32
+    bool Open(const wchar_t* path) {
+        Close();
+
+        HANDLE file = CreateFileW(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+                                  FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+        if (file == INVALID_HANDLE_VALUE) return false;
+
+        // Empty files cannot be mapped
+        LARGE_INTEGER fileSize;
+        if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart <= 0 ||
+            static_cast<unsigned long long>(fileSize.QuadPart) > SIZE_MAX) {
+            CloseHandle(file);
+            return false;
+        }
+
+        // The view keeps the file mapped after both handles are closed
+        HANDLE mapping = CreateFileMappingW(file, NULL, PAGE_READONLY, 0, 0, NULL);
+        CloseHandle(file);
+        if (!mapping) return false;
+
+        void* view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+        CloseHandle(mapping);
+        if (!view) return false;
+
+        data = static_cast<const uint8_t*>(view);
+        size = static_cast<size_t>(fileSize.QuadPart);
+        return true;
+    }
+
+    void Close() {
+        if (data) UnmapViewOfFile(data);
+        data = nullptr;
+        size = 0;
+    }
+#else
+    bool Open(const char* path) {
+        Close();
+
+        int fd = open(path, O_RDONLY);
+        if (fd < 0) return false;
+
+        // Empty files cannot be mapped
+        struct stat info;
+        if (fstat(fd, &info) != 0 || info.st_size <= 0) {
+            close(fd);
+            return false;
+        }
+
+        // The mapping stays valid after the descriptor is closed
+        void* view = mmap(nullptr, static_cast<size_t>(info.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);
+        if (view == MAP_FAILED) return false;
+
+        // Parsers read front to back
+        madvise(view, static_cast<size_t>(info.st_size), MADV_SEQUENTIAL);
+
+        data = static_cast<const uint8_t*>(view);
+        size = static_cast<size_t>(info.st_size);
+        return true;
+    }
+
+    void Close() {
+        if (data) munmap(const_cast<uint8_t*>(data), size);
+        data = nullptr;
+        size = 0;
+    }
+#endif
+
+    const uint8_t* Data() const { return data; }
+    size_t Size() const { return size; }
+    bool IsOpen() const { return data != nullptr; }
+
+private:
+    const uint8_t* data;
+    size_t size;
+};
+
+} // namespace chibi
@@ -0,0 +1,256 @@
+// Frame-time instrumentation.
+//
+// LatencyHistogram is an HdrHistogram-style log-linear histogram of
+// microsecond values: exact below 64 us, then 32 buckets per power of two,
+// so any recorded value is off by at most about 3%. Recording is a few
+// relaxed atomic adds with no locks or allocation, so loader threads and
+// the UI thread can record into the same histogram. Reads walk the buckets
+// and may miss values recorded at the same moment, which is fine for
+// statistics.
+//
+// FrameMetrics groups the histograms the viewer keeps (frame interval,
+// decode, compose, present) with frame and entry counters per character
+// state, and formats them as summary lines or CSV rows.
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "Engine.h"
+
+namespace chibi {
+
+const int HISTOGRAM_SUB_BUCKET_BITS = 5;
+const uint64_t HISTOGRAM_SUB_BUCKETS = 1ULL << HISTOGRAM_SUB_BUCKET_BITS;
+const int HISTOGRAM_MAX_BIT = 40;  // Values clamp to 2^40 us (about 12 days)
+const size_t HISTOGRAM_BUCKETS = (HISTOGRAM_MAX_BIT - HISTOGRAM_SUB_BUCKET_BITS + 1) * HISTOGRAM_SUB_BUCKETS;
+
+class LatencyHistogram {
+public:
+    LatencyHistogram() { Reset(); }
+
+    LatencyHistogram(const LatencyHistogram&) = delete;
+    LatencyHistogram& operator=(const LatencyHistogram&) = delete;
+
+    void Record(uint64_t valueUs) { RecordMany(valueUs, 1); }
+
+    // count values of valueUs at once, e.g. a whole file's decode spread
+    // over its frames
+    void RecordMany(uint64_t valueUs, uint64_t count) {
+        if (count == 0) return;
+        const uint64_t limit = (1ULL << HISTOGRAM_MAX_BIT) - 1;
+        if (valueUs > limit) valueUs = limit;
+
+        counts[BucketIndex(valueUs)].fetch_add(count, std::memory_order_relaxed);
+        total.fetch_add(count, std::memory_order_relaxed);
+        sum.fetch_add(valueUs * count, std::memory_order_relaxed);
+
+        uint64_t seen = max.load(std::memory_order_relaxed);
+        while (valueUs > seen && !max.compare_exchange_weak(seen, valueUs, std::memory_order_relaxed)) {
+        }
+    }
+
+    void RecordMs(double ms) {
+        Record(ms <= 0.0 ? 0 : static_cast<uint64_t>(ms * 1000.0 + 0.5));
+    }
+
+    uint64_t Count() const { return total.load(std::memory_order_relaxed); }
+    uint64_t MaxUs() const { return max.load(std::memory_order_relaxed); }
+
+    double MeanUs() const {
+        uint64_t n = Count();
+        return n == 0 ? 0.0 : static_cast<double>(sum.load(std::memory_order_relaxed)) / n;
+    }
+
+    // Smallest bucketed value that at least percentile % of the recorded
+    // values are at or below (reported as the bucket's midpoint, except
+    // that the 100th is the exact maximum); 0 if empty
+    uint64_t PercentileUs(double percentile) const {
+        uint64_t n = Count();
+        if (n == 0) return 0;
+        if (percentile < 0.0) percentile = 0.0;
+        if (percentile > 100.0) percentile = 100.0;
+
+        uint64_t target = static_cast<uint64_t>(percentile / 100.0 * n + 0.5);
+        if (target == 0) target = 1;
+        if (target >= n) return MaxUs();
+
+        uint64_t seen = 0;
+        for (size_t i = 0; i < HISTOGRAM_BUCKETS; i++) {
+            seen += counts[i].load(std::memory_order_relaxed);
+            if (seen >= target) {
+                uint64_t value = BucketLow(i) + (BucketWidth(i) - 1) / 2;
+                uint64_t highest = MaxUs();
+                return value < highest ? value : highest;
+            }
+        }
+        return MaxUs();  // Counts raced ahead of the buckets
+    }
+
+    void Reset() {
+        for (size_t i = 0; i < HISTOGRAM_BUCKETS; i++) {
+            counts[i].store(0, std::memory_order_relaxed);
+        }
+        total.store(0, std::memory_order_relaxed);
+        sum.store(0, std::memory_order_relaxed);
+        max.store(0, std::memory_order_relaxed);
+    }
+
+    static size_t BucketIndex(uint64_t valueUs) {
+        if (valueUs < 2 * HISTOGRAM_SUB_BUCKETS) {
+            return static_cast<size_t>(valueUs);
+        }
+        int shift = HighestBit(valueUs) - HISTOGRAM_SUB_BUCKET_BITS;
+        return static_cast<size_t>((shift + 1) * HISTOGRAM_SUB_BUCKETS + ((valueUs >> shift) - HISTOGRAM_SUB_BUCKETS));
+    }
+
+    static uint64_t BucketLow(size_t index) {
+        if (index < 2 * HISTOGRAM_SUB_BUCKETS) return index;
+        int shift = static_cast<int>(index / HISTOGRAM_SUB_BUCKETS) - 1;
+        return (HISTOGRAM_SUB_BUCKETS + index % HISTOGRAM_SUB_BUCKETS) << shift;
+    }
+
+    static uint64_t BucketWidth(size_t index) {
+        if (index < 2 * HISTOGRAM_SUB_BUCKETS) return 1;
+        return 1ULL << (index / HISTOGRAM_SUB_BUCKETS - 1);
+    }
+
+private:
+    static int HighestBit(uint64_t value) {
+        int bit = 0;
+        while (value >>= 1) bit++;
+        return bit;
+    }
+
+    std::atomic<uint64_t> counts[HISTOGRAM_BUCKETS];
+    std::atomic<uint64_t> total;
+    std::atomic<uint64_t> sum;
+    std::atomic<uint64_t> max;
+};
+
+enum FrameMetric {
+    METRIC_FRAME_INTERVAL,  // Between two presented frames
+    METRIC_DECODE,          // Per decoded frame, on any thread
+    METRIC_COMPOSE,         // Writing a frame into the surface
+    METRIC_PRESENT,         // Pushing the surface to the screen
+    METRIC_COUNT
+};
+
+const size_t METRICS_STATE_COUNT = STATE_MISC + 1;
+
+inline const char* FrameMetricName(FrameMetric metric) {
+    switch (metric) {
+        case METRIC_FRAME_INTERVAL: return "interval";
+        case METRIC_DECODE: return "decode";
+        case METRIC_COMPOSE: return "compose";
+        case METRIC_PRESENT: return "present";
+        default: return "?";
+    }
+}
+
+class FrameMetrics {
+public:
+    FrameMetrics() : sinceMs(0.0) { Reset(0.0); }
+
+    LatencyHistogram& Histogram(FrameMetric metric) { return histograms[metric]; }
+    const LatencyHistogram& Histogram(FrameMetric metric) const { return histograms[metric]; }
+
+    void Record(FrameMetric metric, double ms) { histograms[metric].RecordMs(ms); }
+
+    // A frame presented while the character was in state
+    void CountFrame(CharacterState state) {
+        if (static_cast<size_t>(state) < METRICS_STATE_COUNT) {
+            stateFrames[state].fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+    // The character switched to state
+    void CountEntry(CharacterState state) {
+        if (static_cast<size_t>(state) < METRICS_STATE_COUNT) {
+            stateEntries[state].fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+    uint64_t StateFrames(CharacterState state) const { return stateFrames[state].load(std::memory_order_relaxed); }
+    uint64_t StateEntries(CharacterState state) const { return stateEntries[state].load(std::memory_order_relaxed); }
+
+    // Start a new period at nowMs
+    void Reset(double nowMs) {
+        for (int i = 0; i < METRIC_COUNT; i++) {
+            histograms[i].Reset();
+        }
+        for (size_t i = 0; i < METRICS_STATE_COUNT; i++) {
+            stateFrames[i].store(0, std::memory_order_relaxed);
+            stateEntries[i].store(0, std::memory_order_relaxed);
+        }
+        sinceMs = nowMs;
+    }
+
+    double SinceMs() const { return sinceMs; }
+
+    // One line per histogram ("compose  p50 0.02  p99 0.05  max 0.31 ms
+    // (n=600)") and one with the frames shown per state
+    void FormatSummary(std::vector<std::string>& lines) const {
+        lines.clear();
+        char line[160];
+        for (int i = 0; i < METRIC_COUNT; i++) {
+            const LatencyHistogram& histogram = histograms[i];
+            snprintf(line, sizeof(line), "%-8s p50 %7.2f  p99 %7.2f  max %7.2f ms  (n=%llu)",
+                     FrameMetricName(static_cast<FrameMetric>(i)),
+                     histogram.PercentileUs(50.0) / 1000.0, histogram.PercentileUs(99.0) / 1000.0,
+                     histogram.MaxUs() / 1000.0, static_cast<unsigned long long>(histogram.Count()));
+            lines.push_back(line);
+        }
+
+        std::string states = "frames  ";
+        for (size_t i = 0; i < METRICS_STATE_COUNT; i++) {
+            CharacterState state = static_cast<CharacterState>(i);
+            snprintf(line, sizeof(line), " %s %llu", CharacterStateName(state),
+                     static_cast<unsigned long long>(StateFrames(state)));
+            states += line;
+        }
+        lines.push_back(states);
+    }
+
+    static const char* CsvHeader() {
+        return "period_start_ms,period_end_ms,name,count,p50_us,p90_us,p99_us,max_us,mean_us,entries\n";
+    }
+
+    // Rows for the period from SinceMs() to nowMs: one per histogram, then
+    // one "state:<name>" row per state with the frames shown as its count
+    void AppendCsv(std::string& out, double nowMs) const {
+        char row[256];
+        for (int i = 0; i < METRIC_COUNT; i++) {
+            const LatencyHistogram& histogram = histograms[i];
+            snprintf(row, sizeof(row), "%.0f,%.0f,%s,%llu,%llu,%llu,%llu,%llu,%.1f,\n",
+                     sinceMs, nowMs, FrameMetricName(static_cast<FrameMetric>(i)),
+                     static_cast<unsigned long long>(histogram.Count()),
+                     static_cast<unsigned long long>(histogram.PercentileUs(50.0)),
+                     static_cast<unsigned long long>(histogram.PercentileUs(90.0)),
+                     static_cast<unsigned long long>(histogram.PercentileUs(99.0)),
+                     static_cast<unsigned long long>(histogram.MaxUs()),
+                     histogram.MeanUs());
+            out += row;
+        }
+        for (size_t i = 0; i < METRICS_STATE_COUNT; i++) {
+            CharacterState state = static_cast<CharacterState>(i);
+            snprintf(row, sizeof(row), "%.0f,%.0f,state:%s,%llu,,,,,,%llu\n",
+                     sinceMs, nowMs, CharacterStateName(state),
+                     static_cast<unsigned long long>(StateFrames(state)),
+                     static_cast<unsigned long long>(StateEntries(state)));
+            out += row;
+        }
+    }
+
+private:
+    LatencyHistogram histograms[METRIC_COUNT];
+    std::atomic<uint64_t> stateFrames[METRICS_STATE_COUNT];
+    std::atomic<uint64_t> stateEntries[METRICS_STATE_COUNT];
+    double sinceMs;
+};
+
+} // namespace chibi
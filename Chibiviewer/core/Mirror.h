@@ -0,0 +1,69 @@
+// Horizontal mirroring of 32-bit pixel rows.
+//
+// Used to build the left-facing variant of walk animations once, instead of
+// flipping on every paint. AVX2 and SSE2 kernels reverse 8 or 4 pixels per
+// shuffle; the scalar loop handles the tail and non-x86 builds.
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+
+#include "CpuFeatures.h"
+
+namespace chibi {
+
+inline void MirrorRowScalar(const uint32_t* src, uint32_t* dst, int width) {
+    for (int x = 0; x < width; x++) {
+        dst[width - 1 - x] = src[x];
+    }
+}
+
+#if CHIBI_X86
+CHIBI_TARGET_SSE2 inline void MirrorRowSse2(const uint32_t* src, uint32_t* dst, int width) {
+    int x = 0;
+    for (; x + 4 <= width; x += 4) {
+        __m128i pixels = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + x));
+        pixels = _mm_shuffle_epi32(pixels, _MM_SHUFFLE(0, 1, 2, 3));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + width - 4 - x), pixels);
+    }
+    for (; x < width; x++) {
+        dst[width - 1 - x] = src[x];
+    }
+}
+
+CHIBI_TARGET_AVX2 inline void MirrorRowAvx2(const uint32_t* src, uint32_t* dst, int width) {
+    const __m256i reverse = _mm256_set_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+    int x = 0;
+    for (; x + 8 <= width; x += 8) {
+        __m256i pixels = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + x));
+        pixels = _mm256_permutevar8x32_epi32(pixels, reverse);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + width - 8 - x), pixels);
+    }
+    for (; x < width; x++) {
+        dst[width - 1 - x] = src[x];
+    }
+}
+#endif
+
+typedef void (*MirrorRowFunc)(const uint32_t* src, uint32_t* dst, int width);
+
+// Best kernel for this CPU, chosen once
+inline MirrorRowFunc GetMirrorRowFunc() {
+#if CHIBI_X86
+    const CpuFeatures& cpu = GetCpuFeatures();
+    if (cpu.avx2) return MirrorRowAvx2;
+    if (cpu.sse2) return MirrorRowSse2;
+#endif
+    return MirrorRowScalar;
+}
+
+// Mirrors a whole image. src and dst must not overlap.
+inline void MirrorImage(const uint8_t* src, uint8_t* dst, int width, int height, size_t stride) {
+    static const MirrorRowFunc mirrorRow = GetMirrorRowFunc();
+    for (int y = 0; y < height; y++) {
+        mirrorRow(reinterpret_cast<const uint32_t*>(src + y * stride),
+                  reinterpret_cast<uint32_t*>(dst + y * stride), width);
+    }
+}
+
+} // namespace chibi
@@ -0,0 +1,58 @@
+// Palette expansion of 8-bit index rows into 32-bit pixels.
+//
+// Each index is looked up in a 256-entry table of packed pixels; entries
+// with alpha 0 are transparent and leave the destination pixel untouched.
+// The AVX2 kernel gathers 8 entries at once and blends them in with a mask;
+// the scalar loop handles the tail and every other CPU. A shuffle-based
+// lookup only covers 16-colour palettes, which GIFs rarely use, so there is
+// no SSSE3 variant.
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+
+#include "CpuFeatures.h"
+
+namespace chibi {
+
+// Palette entries in memory order: byte 3 is alpha on little-endian targets
+const uint32_t PALETTE_ALPHA_MASK = 0xFF000000u;
+
+inline void ExpandPaletteRowScalar(const uint8_t* indices, const uint32_t* palette, uint32_t* dst, int count) {
+    for (int x = 0; x < count; x++) {
+        uint32_t color = palette[indices[x]];
+        if (color & PALETTE_ALPHA_MASK) dst[x] = color;
+    }
+}
+
+#if CHIBI_X86
+CHIBI_TARGET_AVX2 inline void ExpandPaletteRowAvx2(const uint8_t* indices, const uint32_t* palette, uint32_t* dst, int count) {
+    const __m256i alphaMask = _mm256_set1_epi32(static_cast<int>(PALETTE_ALPHA_MASK));
+    const __m256i zero = _mm256_setzero_si256();
+    int x = 0;
+    for (; x + 8 <= count; x += 8) {
+        __m256i lanes = _mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(indices + x)));
+        __m256i colors = _mm256_i32gather_epi32(reinterpret_cast<const int*>(palette), lanes, 4);
+        __m256i transparent = _mm256_cmpeq_epi32(_mm256_and_si256(colors, alphaMask), zero);
+        __m256i* out = reinterpret_cast<__m256i*>(dst + x);
+        __m256i old = _mm256_loadu_si256(out);
+        _mm256_storeu_si256(out, _mm256_blendv_epi8(colors, old, transparent));
+    }
+    for (; x < count; x++) {
+        uint32_t color = palette[indices[x]];
+        if (color & PALETTE_ALPHA_MASK) dst[x] = color;
+    }
+}
+#endif
+
+typedef void (*ExpandPaletteRowFunc)(const uint8_t* indices, const uint32_t* palette, uint32_t* dst, int count);
+
+// Best kernel for this CPU, chosen once
+inline ExpandPaletteRowFunc GetExpandPaletteRowFunc() {
+#if CHIBI_X86
+    if (GetCpuFeatures().avx2) return ExpandPaletteRowAvx2;
+#endif
+    return ExpandPaletteRowScalar;
+}
+
+} // namespace chibi
@@ -0,0 +1,45 @@
+// Integer pixel rectangle, half-open: [left, right) x [top, bottom)
+#pragma once
+
+#include <algorithm>
+
+namespace chibi {
+
+struct PixelRect {
+    int left;
+    int top;
+    int right;
+    int bottom;
+
+    int Width() const { return right - left; }
+    int Height() const { return bottom - top; }
+    bool Empty() const { return right <= left || bottom <= top; }
+    long long Area() const { return Empty() ? 0 : static_cast<long long>(Width()) * Height(); }
+
+    static PixelRect Make(int left, int top, int right, int bottom) {
+        PixelRect rect = { left, top, right, bottom };
+        return rect;
+    }
+
+    static PixelRect EmptyRect() { return Make(0, 0, 0, 0); }
+
+    static PixelRect Union(const PixelRect& a, const PixelRect& b) {
+        if (a.Empty()) return b;
+        if (b.Empty()) return a;
+        return Make(std::min(a.left, b.left), std::min(a.top, b.top),
+                    std::max(a.right, b.right), std::max(a.bottom, b.bottom));
+    }
+
+    static PixelRect Intersect(const PixelRect& a, const PixelRect& b) {
+        PixelRect rect = Make(std::max(a.left, b.left), std::max(a.top, b.top),
+                              std::min(a.right, b.right), std::min(a.bottom, b.bottom));
+        return rect.Empty() ? EmptyRect() : rect;
+    }
+
+    // The same rectangle after mirroring an image of the given width
+    PixelRect Mirrored(int imageWidth) const {
+        return Empty() ? *this : Make(imageWidth - right, top, imageWidth - left, bottom);
+    }
+};
+
+} // namespace chibi
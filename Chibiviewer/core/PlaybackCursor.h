@@ -0,0 +1,51 @@
+// Playback position within an animation.
+//
+// Replaces the old replicated frame queue: instead of copying every frame
+// into a list, playback is just (animation, frame) read against the
+// animation's own delay table, and FrameScheduler decides when to step.
+// Switching animations is an O(1) reset and never allocates.
+#pragma once
+
+#include <cstddef>
+#include <vector>
+#include <algorithm>
+
+namespace chibi {
+
+struct PlaybackCursor {
+    size_t gifIndex;    // Animation being played
+    size_t frameIndex;  // Frame currently shown
+    bool active;
+
+    PlaybackCursor() : gifIndex(0), frameIndex(0), active(false) {}
+
+    void Start(size_t gif) {
+        gifIndex = gif;
+        frameIndex = 0;
+        active = true;
+    }
+
+    void Stop() {
+        active = false;
+        frameIndex = 0;
+    }
+
+    // Display time of a frame, never shorter than minDelayMs (or 1 ms)
+    static unsigned FrameDelay(const std::vector<unsigned>& delays, size_t index, unsigned minDelayMs) {
+        unsigned floor = std::max(minDelayMs, 1u);
+        if (index >= delays.size()) return floor;
+        return std::max(delays[index], floor);
+    }
+
+    unsigned CurrentDelay(const std::vector<unsigned>& delays, unsigned minDelayMs) const {
+        return FrameDelay(delays, frameIndex, minDelayMs);
+    }
+
+    // Moves to the next frame, wrapping after frameCount frames
+    void Step(size_t frameCount) {
+        if (!active || frameCount == 0) return;
+        frameIndex = (frameIndex + 1) % frameCount;
+    }
+};
+
+} // namespace chibi
@@ -0,0 +1,133 @@
+// Presentation backends.
+//
+// A presenter owns one persistent premultiplied-BGRA surface. The renderer
+// draws the next frame into it and then asks the presenter to show it. The
+// Windows viewer pushes the surface to a layered window; the headless
+// presenter below keeps it in memory and records what was shown, so the
+// render path can run without a desktop.
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <vector>
+
+#include "AlignedBuffer.h"
+#include "PixelRect.h"
+
+namespace chibi {
+
+// Writable view of a presenter's surface, premultiplied BGRA, top-down
+struct Surface {
+    uint8_t* pixels;
+    int width;
+    int height;
+    size_t stride;
+
+    uint32_t* Row(int y) { return reinterpret_cast<uint32_t*>(pixels + y * stride); }
+    const uint32_t* Row(int y) const { return reinterpret_cast<const uint32_t*>(pixels + y * stride); }
+};
+
+class IPresenter {
+public:
+    virtual ~IPresenter() {}
+
+    // Reallocates the surface for a new size. Contents become transparent.
+    virtual bool Resize(int width, int height) = 0;
+
+    // The surface the next frame should be drawn into. Stays valid until Resize.
+    virtual Surface GetSurface() = 0;
+
+    // Shows the current surface contents. Only pixels inside dirty are
+    // guaranteed to be refreshed; the rest may keep what was shown before.
+    virtual bool Present(const PixelRect& dirty) = 0;
+
+    // Shows the whole surface
+    bool Present() {
+        Surface surface = GetSurface();
+        return Present(PixelRect::Make(0, 0, surface.width, surface.height));
+    }
+};
+
+// FNV-1a over the visible pixels, used to compare presented frames
+inline uint64_t HashSurface(const Surface& surface) {
+    uint64_t hash = 14695981039346656037ull;
+    for (int y = 0; y < surface.height; y++) {
+        const uint8_t* row = surface.pixels + y * surface.stride;
+        for (size_t i = 0; i < static_cast<size_t>(surface.width) * 4; i++) {
+            hash ^= row[i];
+            hash *= 1099511628211ull;
+        }
+    }
+    return hash;
+}
+
+// In-memory presenter for tests, benchmarks and offscreen rendering
+class HeadlessPresenter : public IPresenter {
+public:
+    struct Record {
+        int width;
+        int height;
+        PixelRect dirty;
+        uint64_t hash;  // Only filled when hashing is enabled
+    };
+
+    explicit HeadlessPresenter(bool hashFrames = false)
+        : width(0), height(0), stride(0), hashFrames(hashFrames), keepFrames(false), presentCount(0) {}
+
+    bool Resize(int newWidth, int newHeight) override {
+        width = newWidth;
+        height = newHeight;
+        stride = AlignedStride(newWidth);
+        return pixels.Allocate(stride * height);
+    }
+
+    Surface GetSurface() override {
+        Surface surface = { pixels.Data(), width, height, stride };
+        return surface;
+    }
+
+    using IPresenter::Present;
+
+    bool Present(const PixelRect& dirty) override {
+        presentCount++;
+
+        Record record = { width, height, dirty, 0 };
+        if (hashFrames) {
+            record.hash = HashSurface(GetSurface());
+        }
+        records.push_back(record);
+
+        if (keepFrames) {
+            frames.emplace_back(pixels.Data(), pixels.Data() + pixels.Size());
+        }
+        return true;
+    }
+
+    // Keep a full copy of every presented surface (memory heavy)
+    void SetKeepFrames(bool keep) { keepFrames = keep; }
+
+    void ClearHistory() {
+        records.clear();
+        frames.clear();
+        presentCount = 0;
+    }
+
+    size_t PresentCount() const { return presentCount; }
+    const std::vector<Record>& Records() const { return records; }
+    const std::vector<std::vector<uint8_t>>& Frames() const { return frames; }
+    size_t Stride() const { return stride; }
+
+private:
+    AlignedBuffer pixels;
+    int width;
+    int height;
+    size_t stride;
+    bool hashFrames;
+    bool keepFrames;
+    size_t presentCount;
+    std::vector<Record> records;
+    std::vector<std::vector<uint8_t>> frames;
+};
+
+} // namespace chibi
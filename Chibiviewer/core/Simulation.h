@@ -0,0 +1,125 @@
+// Fixed-timestep simulation.
+//
+// Real elapsed time is fed into an accumulator and consumed in steps of a
+// fixed length, so movement depends only on speeds in pixels per second and
+// not on how often or how regularly the caller wakes up. Positions are
+// blended between the last two steps when read, so rendering between steps
+// stays smooth.
+#pragma once
+
+#include <cstdint>
+#include <cmath>
+#include <algorithm>
+
+#include "Clock.h"
+
+namespace chibi {
+
+const double SIMULATION_STEP_MS = 1000.0 / 60.0;
+const double MAX_SIMULATION_DELTA_MS = 250.0;  // Longer gaps are not simulated
+
+// Walking back and forth along a horizontal range, bouncing at the ends
+struct WalkState {
+    double x;          // Position after the last step
+    double previousX;  // Position before the last step
+    double minX;
+    double maxX;
+    double speed;      // Pixels per second
+    bool facingRight;
+    bool active;
+
+    WalkState() : x(0.0), previousX(0.0), minX(0.0), maxX(0.0), speed(0.0), facingRight(true), active(false) {}
+
+    void Step(double seconds) {
+        previousX = x;
+        if (!active) return;
+
+        x += (facingRight ? speed : -speed) * seconds;
+
+        // Reflect off the ends so no distance is lost on a bounce
+        if (facingRight && x > maxX) {
+            x = std::max(minX, maxX - (x - maxX));
+            facingRight = false;
+        } else if (!facingRight && x < minX) {
+            x = std::min(maxX, minX + (minX - x));
+            facingRight = true;
+        }
+    }
+
+    double Interpolated(double alpha) const {
+        return previousX + (x - previousX) * alpha;
+    }
+};
+
+class Simulation {
+public:
+    explicit Simulation(const IClock& clock, double stepMs = SIMULATION_STEP_MS,
+                        double maxDeltaMs = MAX_SIMULATION_DELTA_MS)
+        : clock(clock), stepMs(stepMs), maxDeltaMs(maxDeltaMs), lastMs(clock.NowMs()),
+          accumulatorMs(0.0), steps(0) {}
+
+    // Forgets time that passed while nothing needed simulating
+    void Reset() {
+        lastMs = clock.NowMs();
+        accumulatorMs = 0.0;
+    }
+
+    // Runs every whole step that fits in the time since the last update.
+    // Returns the number of steps run.
+    int Update() {
+        double now = clock.NowMs();
+        double delta = std::min(std::max(now - lastMs, 0.0), maxDeltaMs);
+        lastMs = now;
+
+        accumulatorMs += delta;
+        int count = 0;
+        while (accumulatorMs >= stepMs) {
+            walk.Step(stepMs / 1000.0);
+            accumulatorMs -= stepMs;
+            count++;
+        }
+        steps += count;
+        return count;
+    }
+
+    void StartWalk(double x, double minX, double maxX, bool facingRight, double speed) {
+        walk.x = std::min(std::max(x, minX), maxX);
+        walk.previousX = walk.x;
+        walk.minX = minX;
+        walk.maxX = std::max(minX, maxX);
+        walk.facingRight = facingRight;
+        walk.speed = speed;
+        walk.active = true;
+        Reset();
+    }
+
+    void StopWalk() { walk.active = false; }
+
+    bool Walking() const { return walk.active; }
+    bool FacingRight() const { return walk.facingRight; }
+
+    // Walk position blended between the last two steps
+    double WalkX() const { return walk.Interpolated(Alpha()); }
+
+    // How far the current time is between the last step and the next one
+    double Alpha() const { return accumulatorMs / stepMs; }
+
+    // Time until the next step is due
+    double MsUntilNextStep() const {
+        return std::max(0.0, stepMs - accumulatorMs - (clock.NowMs() - lastMs));
+    }
+
+    double StepMs() const { return stepMs; }
+    uint64_t Steps() const { return steps; }
+
+private:
+    const IClock& clock;
+    double stepMs;
+    double maxDeltaMs;
+    double lastMs;
+    double accumulatorMs;
+    uint64_t steps;
+    WalkState walk;
+};
+
+} // namespace chibi
@@ -0,0 +1,317 @@
+// Scoped trace spans, exported as Chrome trace-event JSON.
+//
+// Each thread records into its own fixed-size ring buffer, so recording
+// takes no lock and never allocates once the buffer exists; when a ring
+// fills, its oldest events are overwritten. While tracing is off a span
+// costs one relaxed atomic load. The JSON opens in Perfetto
+// (ui.perfetto.dev) or chrome://tracing.
+//
+// Event and argument names are stored as pointers, so they must be string
+// literals (or otherwise outlive the trace). Start, Stop and export belong
+// to one controlling thread; export after Stop, since a span ending on
+// another thread at that moment may be cut short. Threads remember their
+// ring for one tracer, which must outlive them: in practice the
+// process-wide GlobalTracer().
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstddef>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace chibi {
+
+const size_t TRACE_EVENTS_PER_THREAD = 1 << 16;
+
+struct TraceEvent {
+    const char* name;
+    const char* category;
+    const char* argName;   // No argument if null
+    int64_t argValue;
+    double startUs;        // From Tracer::Start
+    double durationUs;     // Negative for an instant event
+    uint32_t threadId;
+};
+
+class Tracer {
+public:
+    Tracer() : enabled(false), originNs(0), capacity(TRACE_EVENTS_PER_THREAD), nextThreadId(1) {}
+
+    Tracer(const Tracer&) = delete;
+    Tracer& operator=(const Tracer&) = delete;
+
+    // Starts a new trace. Events from earlier traces are dropped. Rings
+    // that already exist keep their size; eventsPerThread applies to
+    // threads that record for the first time.
+    void Start(size_t eventsPerThread = TRACE_EVENTS_PER_THREAD) {
+        std::lock_guard<std::mutex> lock(mutex);
+        capacity = std::max<size_t>(eventsPerThread, 1);
+        for (size_t i = 0; i < rings.size(); i++) {
+            rings[i]->first = rings[i]->written.load(std::memory_order_acquire);
+        }
+        originNs.store(SteadyNs(), std::memory_order_relaxed);
+        enabled.store(true, std::memory_order_release);
+    }
+
+    void Stop() { enabled.store(false, std::memory_order_release); }
+
+    bool Enabled() const { return enabled.load(std::memory_order_relaxed); }
+
+    // Microseconds since Start
+    double NowUs() const {
+        return (SteadyNs() - originNs.load(std::memory_order_relaxed)) / 1000.0;
+    }
+
+    // A span from startUs until now
+    void Complete(const char* name, const char* category, double startUs,
+                  const char* argName = nullptr, int64_t argValue = 0) {
+        if (!Enabled()) return;
+        TraceEvent event = { name, category, argName, argValue, startUs, NowUs() - startUs, 0 };
+        Record(event);
+    }
+
+    // A point in time, such as a state change
+    void Instant(const char* name, const char* category, const char* argName = nullptr, int64_t argValue = 0) {
+        if (!Enabled()) return;
+        TraceEvent event = { name, category, argName, argValue, NowUs(), -1.0, 0 };
+        Record(event);
+    }
+
+    // Labels the calling thread in the trace viewer. The name stays with
+    // the thread's id after the thread exits and its ring is reused.
+    void NameThread(const char* name) {
+        if (!Enabled()) return;
+        Ring* ring = ThreadRing();
+        if (!ring) return;
+
+        std::lock_guard<std::mutex> lock(mutex);
+        for (size_t i = 0; i < threadNames.size(); i++) {
+            if (threadNames[i].first == ring->threadId) {
+                threadNames[i].second = name;
+                return;
+            }
+        }
+        threadNames.push_back(std::make_pair(ring->threadId, name));
+    }
+
+    // Events recorded since Start that have not been overwritten
+    size_t EventCount() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        size_t count = 0;
+        for (size_t i = 0; i < rings.size(); i++) {
+            count += static_cast<size_t>(Kept(*rings[i]));
+        }
+        return count;
+    }
+
+    // Events lost to full rings since Start
+    size_t DroppedCount() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        size_t dropped = 0;
+        for (size_t i = 0; i < rings.size(); i++) {
+            const Ring& ring = *rings[i];
+            dropped += static_cast<size_t>(ring.written.load(std::memory_order_acquire) - ring.first - Kept(ring));
+        }
+        return dropped;
+    }
+
+    // The trace as {"traceEvents": [...]}, events sorted by start time
+    void AppendChromeJson(std::string& out) const {
+        std::vector<TraceEvent> events;
+        std::vector<std::pair<uint32_t, const char*> > names;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            for (size_t i = 0; i < rings.size(); i++) {
+                const Ring& ring = *rings[i];
+                uint64_t end = ring.written.load(std::memory_order_acquire);
+                for (uint64_t n = end - Kept(ring); n < end; n++) {
+                    events.push_back(ring.events[n % ring.events.size()]);
+                }
+            }
+            names = threadNames;
+        }
+        std::stable_sort(events.begin(), events.end(), [](const TraceEvent& a, const TraceEvent& b) {
+            return a.startUs < b.startUs;
+        });
+
+        out += "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+        bool first = true;
+        char number[64];
+        for (size_t i = 0; i < names.size(); i++) {
+            out += first ? "" : ",\n";
+            first = false;
+            std::snprintf(number, sizeof(number), "%u", names[i].first);
+            out += "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":";
+            out += number;
+            out += ",\"args\":{\"name\":";
+            AppendJsonString(out, names[i].second);
+            out += "}}";
+        }
+        for (size_t i = 0; i < events.size(); i++) {
+            const TraceEvent& event = events[i];
+            out += first ? "" : ",\n";
+            first = false;
+            out += "{\"name\":";
+            AppendJsonString(out, event.name);
+            out += ",\"cat\":";
+            AppendJsonString(out, event.category ? event.category : "");
+            if (event.durationUs >= 0.0) {
+                std::snprintf(number, sizeof(number), ",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f", event.startUs, event.durationUs);
+            } else {
+                std::snprintf(number, sizeof(number), ",\"ph\":\"i\",\"s\":\"t\",\"ts\":%.3f", event.startUs);
+            }
+            out += number;
+            std::snprintf(number, sizeof(number), ",\"pid\":1,\"tid\":%u", event.threadId);
+            out += number;
+            if (event.argName) {
+                out += ",\"args\":{";
+                AppendJsonString(out, event.argName);
+                std::snprintf(number, sizeof(number), ":%lld}", static_cast<long long>(event.argValue));
+                out += number;
+            }
+            out += "}";
+        }
+        out += "\n]}\n";
+    }
+
+private:
+    struct Ring {
+        std::vector<TraceEvent> events;
+        std::atomic<uint64_t> written;  // Events ever pushed
+        uint64_t first;                 // Value of written when the trace started
+        uint32_t threadId;
+        bool inUse;                     // Owned by a live thread
+
+        explicit Ring(size_t size) : events(size), written(0), first(0), threadId(0), inUse(true) {}
+    };
+
+    // Hands a thread's ring back when the thread exits, for the next new
+    // thread to reuse (events carry their own thread id)
+    struct ThreadSlot {
+        Tracer* tracer;
+        Ring* ring;
+
+        ThreadSlot() : tracer(nullptr), ring(nullptr) {}
+        ~ThreadSlot() {
+            if (tracer && ring) tracer->Release(ring);
+        }
+    };
+
+    static int64_t SteadyNs() {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    static uint64_t Kept(const Ring& ring) {
+        uint64_t recorded = ring.written.load(std::memory_order_acquire) - ring.first;
+        return std::min<uint64_t>(recorded, ring.events.size());
+    }
+
+    static void AppendJsonString(std::string& out, const char* text) {
+        out += '"';
+        for (const char* c = text; *c; c++) {
+            unsigned char ch = static_cast<unsigned char>(*c);
+            if (ch == '"' || ch == '\\') {
+                out += '\\';
+                out += *c;
+            } else if (ch < 0x20) {
+                char escaped[8];
+                std::snprintf(escaped, sizeof(escaped), "\\u%04x", ch);
+                out += escaped;
+            } else {
+                out += *c;
+            }
+        }
+        out += '"';
+    }
+
+    void Record(TraceEvent& event) {
+        Ring* ring = ThreadRing();
+        if (!ring) return;
+        event.threadId = ring->threadId;
+
+        // Only this thread writes to its ring
+        uint64_t n = ring->written.load(std::memory_order_relaxed);
+        ring->events[n % ring->events.size()] = event;
+        ring->written.store(n + 1, std::memory_order_release);
+    }
+
+    // The calling thread's ring, set up the first time it records: a free
+    // ring of the current size, or a new one
+    Ring* ThreadRing() {
+        static thread_local ThreadSlot slot;
+        if (slot.ring && slot.tracer == this) return slot.ring;
+
+        std::lock_guard<std::mutex> lock(mutex);
+        Ring* ring = nullptr;
+        for (size_t i = 0; i < rings.size() && !ring; i++) {
+            if (!rings[i]->inUse && rings[i]->events.size() == capacity) ring = rings[i].get();
+        }
+        if (!ring) {
+            rings.push_back(std::unique_ptr<Ring>(new Ring(capacity)));
+            ring = rings.back().get();
+        }
+        ring->inUse = true;
+        ring->threadId = nextThreadId++;
+        slot.tracer = this;
+        slot.ring = ring;
+        return ring;
+    }
+
+    void Release(Ring* ring) {
+        std::lock_guard<std::mutex> lock(mutex);
+        ring->inUse = false;
+    }
+
+    std::atomic<bool> enabled;
+    std::atomic<int64_t> originNs;
+    mutable std::mutex mutex;  // Guards the ring list, not the events
+    std::vector<std::unique_ptr<Ring> > rings;
+    std::vector<std::pair<uint32_t, const char*> > threadNames;  // By thread id
+    size_t capacity;
+    uint32_t nextThreadId;
+};
+
+// The process-wide tracer every span records into
+inline Tracer& GlobalTracer() {
+    static Tracer tracer;
+    return tracer;
+}
+
+// Records a span from construction to destruction, if tracing was on when
+// it began
+class TraceScope {
+public:
+    TraceScope(const char* name, const char* category, const char* argName = nullptr, int64_t argValue = 0)
+        : name(name), category(category), argName(argName), argValue(argValue), startUs(-1.0) {
+        if (GlobalTracer().Enabled()) startUs = GlobalTracer().NowUs();
+    }
+
+    ~TraceScope() {
+        if (startUs >= 0.0) GlobalTracer().Complete(name, category, startUs, argName, argValue);
+    }
+
+    TraceScope(const TraceScope&) = delete;
+    TraceScope& operator=(const TraceScope&) = delete;
+
+    // For values only known at the end, such as frames decoded
+    void SetArg(const char* newArgName, int64_t newArgValue) {
+        argName = newArgName;
+        argValue = newArgValue;
+    }
+
+private:
+    const char* name;
+    const char* category;
+    const char* argName;
+    int64_t argValue;
+    double startUs;
+};
+
+} // namespace chibi
@@ -0,0 +1,79 @@
+// Transparent-border trimming.
+//
+// Animations are drawn on canvases with wide empty margins. At load time
+// every frame's non-transparent pixels are folded into one box per
+// animation, so the window only has to cover (and compose, present and
+// hit-test) the part of the canvas the character ever draws on. The view
+// is kept symmetric about the canvas centre line, so a walk cycle mirrored
+// to face left fits the same window. Placement goes through the feet (the
+// bottom centre of the canvas): it stays put on screen while the window
+// switches between differently trimmed animations.
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+#include "DirtyRect.h"
+#include "PixelRect.h"
+
+namespace chibi {
+
+// Grows bounds to hold every pixel of the frame that is not fully
+// transparent. Premultiplied transparent pixels are all zero, so this is a
+// diff against a blank row; rows inside the box only need the columns
+// outside it scanned.
+inline void ExpandOpaqueBounds(const uint32_t* frame, int width, int height, size_t stride, PixelRect& bounds,
+                               const DiffKernels& kernels = GetDiffKernels()) {
+    if (width <= 0 || height <= 0) return;
+
+    std::vector<uint32_t> blank(width, 0);
+    const uint8_t* base = reinterpret_cast<const uint8_t*>(frame);
+    for (int y = 0; y < height; y++) {
+        const uint32_t* row = reinterpret_cast<const uint32_t*>(base + y * stride);
+        if (bounds.Empty() || y < bounds.top || y >= bounds.bottom) {
+            int first = kernels.firstDiff(blank.data(), row, 0, width);
+            if (first == width) continue;
+            int last = kernels.lastDiff(blank.data(), row, first, width);
+            bounds = PixelRect::Union(bounds, PixelRect::Make(first, y, last + 1, y + 1));
+            continue;
+        }
+
+        if (bounds.left > 0) {
+            int first = kernels.firstDiff(blank.data(), row, 0, bounds.left);
+            if (first < bounds.left) bounds.left = first;
+        }
+        if (bounds.right < width) {
+            int last = kernels.lastDiff(blank.data(), row, bounds.right, width);
+            if (last >= bounds.right) bounds.right = last + 1;
+        }
+    }
+}
+
+// Box around a single frame's non-transparent pixels; empty for a blank frame
+inline PixelRect OpaqueBounds(const uint32_t* frame, int width, int height, size_t stride) {
+    PixelRect bounds = PixelRect::EmptyRect();
+    ExpandOpaqueBounds(frame, width, height, stride, bounds);
+    return bounds;
+}
+
+// Part of the canvas shown for an animation whose frames all draw inside
+// opaque: that box, widened to be symmetric about the centre line so the
+// mirrored frames fit it too. The whole canvas if nothing is ever drawn.
+inline PixelRect TrimView(const PixelRect& opaque, int canvasWidth, int canvasHeight) {
+    if (opaque.Empty()) return PixelRect::Make(0, 0, canvasWidth, canvasHeight);
+
+    int left = std::min(opaque.left, canvasWidth - opaque.right);
+    if (left < 0) left = 0;
+    return PixelRect::Make(left, opaque.top, canvasWidth - left, opaque.bottom);
+}
+
+// Feet, relative to the top-left corner of the window showing view: the
+// point kept in place when the window changes to another view
+inline void FeetOffset(const PixelRect& view, int canvasWidth, int canvasHeight, int& x, int& y) {
+    x = canvasWidth / 2 - view.left;
+    y = canvasHeight - view.top;
+}
+
+} // namespace chibi
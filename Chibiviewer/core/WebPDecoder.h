@@ -0,0 +1,1031 @@
+// Portable animated WebP decoder.
+//
+// Header-only and free of any OS headers, like GifDecoder.h. Parses the RIFF
+// container (VP8X, ANIM, ANMF) straight from a caller-owned byte range and
+// decodes lossless VP8L bitstreams, which is what the character packs use.
+// Lossy VP8 frames (and their ALPH chunks) are reported as unsupported.
+//
+//   - WebPReader: frame-at-a-time access to the raw sub-frames (ARGB pixels,
+//     rectangle, duration, blending and disposal).
+//   - WebPCanvas: composes them into straight-alpha RGBA the way libwebp's
+//     animation decoder does, disposing to transparent.
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+#include <algorithm>
+
+#include "PixelRect.h"
+
+namespace chibi {
+
+const uint64_t MAX_WEBP_CANVAS_PIXELS = 16384ull * 16384ull;
+
+// One ANMF frame (or the single image of a still file), decoded
+struct WebPFrameRecord {
+    int left;
+    int top;
+    int width;
+    int height;
+    unsigned delayMs;
+    bool blend;                 // Alpha-blend over the canvas instead of replacing it
+    bool disposeToBackground;   // Clear the rectangle before the next frame
+    std::vector<uint32_t> argb; // width * height pixels, 0xAARRGGBB, top-down
+
+    WebPFrameRecord()
+        : left(0), top(0), width(0), height(0), delayMs(0), blend(false), disposeToBackground(false) {}
+};
+
+namespace detail {
+
+const int VP8L_MAX_CODE_LENGTH = 15;
+const int VP8L_ROOT_BITS = 8;  // First-level Huffman lookup width
+const int VP8L_NUM_LITERAL_CODES = 256;
+const int VP8L_NUM_LENGTH_CODES = 24;
+const int VP8L_NUM_DISTANCE_CODES = 40;
+const int VP8L_CODE_LENGTH_CODES = 19;
+
+enum Vp8lTransformType {
+    VP8L_PREDICTOR = 0,
+    VP8L_CROSS_COLOR = 1,
+    VP8L_SUBTRACT_GREEN = 2,
+    VP8L_COLOR_INDEXING = 3
+};
+
+// Order of the five codes in a Huffman group
+enum Vp8lCodeIndex {
+    VP8L_GREEN = 0,
+    VP8L_RED = 1,
+    VP8L_BLUE = 2,
+    VP8L_ALPHA = 3,
+    VP8L_DISTANCE = 4
+};
+
+inline uint32_t ReadLe24(const uint8_t* p) {
+    return p[0] | (p[1] << 8) | (static_cast<uint32_t>(p[2]) << 16);
+}
+
+inline uint32_t ReadLe32(const uint8_t* p) {
+    return ReadLe24(p) | (static_cast<uint32_t>(p[3]) << 24);
+}
+
+// Image size from the first bytes of a VP8L bitstream
+inline bool ReadVp8lSize(const uint8_t* bytes, size_t length, int& width, int& height) {
+    if (length < 5 || bytes[0] != 0x2f) return false;
+    uint32_t header = ReadLe32(bytes + 1);
+    width = static_cast<int>(header & 0x3fff) + 1;
+    height = static_cast<int>((header >> 14) & 0x3fff) + 1;
+    return true;
+}
+
+inline int DivRoundUp(int value, int bits) {
+    return (value + (1 << bits) - 1) >> bits;
+}
+
+// LSB-first bit reader. Reading past the end yields zeros and sets Overrun().
+class Vp8lBitReader {
+public:
+    Vp8lBitReader(const uint8_t* bytes, size_t length)
+        : data(bytes), size(length), pos(0), value(0), bitCount(0), padding(0) {
+        Fill();
+    }
+
+    // Tops the window up to at least 57 bits
+    void Fill() {
+        if (bitCount <= 56 && pos + 8 <= size) {
+            uint64_t chunk;
+            std::memcpy(&chunk, data + pos, 8);  // Little-endian
+            size_t take = static_cast<size_t>(64 - bitCount) >> 3;
+            if (take < 8) chunk &= (uint64_t(1) << (take * 8)) - 1;
+            value |= chunk << bitCount;
+            bitCount += static_cast<int>(take) * 8;
+            pos += take;
+        }
+        while (bitCount <= 56) {
+            if (pos < size) {
+                value |= static_cast<uint64_t>(data[pos++]) << bitCount;
+            } else {
+                padding += 8;
+            }
+            bitCount += 8;
+        }
+    }
+
+    // n <= 32
+    uint32_t ReadBits(int n) {
+        if (bitCount < 32) Fill();
+        uint32_t bits = static_cast<uint32_t>(value & ((uint64_t(1) << n) - 1));
+        Skip(n);
+        return bits;
+    }
+
+    // Low bits of the window; Fill first
+    uint32_t Peek() const { return static_cast<uint32_t>(value); }
+
+    void Skip(int n) {
+        value >>= n;
+        bitCount -= n;
+    }
+
+    bool NeedsFill() const { return bitCount < 32; }
+    bool Overrun() const { return bitCount < padding; }
+
+private:
+    const uint8_t* data;
+    size_t size;
+    size_t pos;
+    uint64_t value;
+    int bitCount;
+    int padding;  // Zero bits appended past the end of the data
+};
+
+// Root entries with bits > VP8L_ROOT_BITS point at a second-level table:
+// value is its offset and bits - VP8L_ROOT_BITS its width. Everywhere else
+// bits is the number of bits to consume and value the symbol.
+struct Vp8lHuffmanEntry {
+    uint8_t bits;
+    uint16_t value;
+};
+
+class Vp8lHuffmanTable {
+public:
+    // Builds the canonical code for the given code lengths. Fails on an
+    // empty, over-subscribed or incomplete code.
+    bool Build(const uint8_t* lengths, int count) {
+        int lengthCount[VP8L_MAX_CODE_LENGTH + 1] = { 0 };
+        int symbols = 0;
+        int lastSymbol = 0;
+        for (int s = 0; s < count; s++) {
+            if (lengths[s] > VP8L_MAX_CODE_LENGTH) return false;
+            if (lengths[s] != 0) {
+                lengthCount[lengths[s]]++;
+                symbols++;
+                lastSymbol = s;
+            }
+        }
+        if (symbols == 0) return false;
+
+        const Vp8lHuffmanEntry empty = { 0, 0 };
+        entries.assign(1 << VP8L_ROOT_BITS, empty);
+
+        // A lone symbol takes no bits at all
+        if (symbols == 1) {
+            for (size_t i = 0; i < entries.size(); i++) {
+                entries[i].value = static_cast<uint16_t>(lastSymbol);
+            }
+            return true;
+        }
+
+        int left = 1;
+        for (int len = 1; len <= VP8L_MAX_CODE_LENGTH; len++) {
+            left = (left << 1) - lengthCount[len];
+            if (left < 0) return false;
+        }
+        if (left != 0) return false;
+
+        int nextCode[VP8L_MAX_CODE_LENGTH + 1];
+        int code = 0;
+        nextCode[0] = 0;
+        for (int len = 1; len <= VP8L_MAX_CODE_LENGTH; len++) {
+            code = (code + lengthCount[len - 1]) << 1;
+            nextCode[len] = code;
+        }
+
+        // Codes are read LSB-first, so tables are indexed by reversed codes
+        reversed.resize(count);
+        int subBits[1 << VP8L_ROOT_BITS] = { 0 };
+        for (int s = 0; s < count; s++) {
+            int len = lengths[s];
+            if (len == 0) continue;
+            reversed[s] = ReverseBits(nextCode[len]++, len);
+            if (len > VP8L_ROOT_BITS) {
+                int prefix = reversed[s] & ((1 << VP8L_ROOT_BITS) - 1);
+                subBits[prefix] = std::max(subBits[prefix], len - VP8L_ROOT_BITS);
+            }
+        }
+
+        size_t total = entries.size();
+        for (int prefix = 0; prefix < (1 << VP8L_ROOT_BITS); prefix++) {
+            if (subBits[prefix] == 0) continue;
+            entries[prefix].bits = static_cast<uint8_t>(VP8L_ROOT_BITS + subBits[prefix]);
+            entries[prefix].value = static_cast<uint16_t>(total);
+            total += static_cast<size_t>(1) << subBits[prefix];
+        }
+        entries.resize(total, empty);
+
+        for (int s = 0; s < count; s++) {
+            int len = lengths[s];
+            if (len == 0) continue;
+            Vp8lHuffmanEntry entry;
+            entry.value = static_cast<uint16_t>(s);
+            if (len <= VP8L_ROOT_BITS) {
+                entry.bits = static_cast<uint8_t>(len);
+                for (int i = reversed[s]; i < (1 << VP8L_ROOT_BITS); i += 1 << len) {
+                    entries[i] = entry;
+                }
+            } else {
+                int prefix = reversed[s] & ((1 << VP8L_ROOT_BITS) - 1);
+                int subLen = len - VP8L_ROOT_BITS;
+                size_t base = entries[prefix].value;
+                entry.bits = static_cast<uint8_t>(subLen);
+                for (int i = reversed[s] >> VP8L_ROOT_BITS; i < (1 << subBits[prefix]); i += 1 << subLen) {
+                    entries[base + i] = entry;
+                }
+            }
+        }
+        return true;
+    }
+
+    int ReadSymbol(Vp8lBitReader& reader) const {
+        if (reader.NeedsFill()) reader.Fill();
+        uint32_t bits = reader.Peek();
+        const Vp8lHuffmanEntry* entry = &entries[bits & ((1 << VP8L_ROOT_BITS) - 1)];
+        if (entry->bits > VP8L_ROOT_BITS) {
+            reader.Skip(VP8L_ROOT_BITS);
+            int subBits = entry->bits - VP8L_ROOT_BITS;
+            entry = &entries[entry->value + ((bits >> VP8L_ROOT_BITS) & ((1u << subBits) - 1))];
+        }
+        reader.Skip(entry->bits);
+        return entry->value;
+    }
+
+private:
+    static int ReverseBits(int code, int length) {
+        int result = 0;
+        for (int i = 0; i < length; i++) {
+            result = (result << 1) | ((code >> i) & 1);
+        }
+        return result;
+    }
+
+    std::vector<Vp8lHuffmanEntry> entries;
+    std::vector<int> reversed;
+};
+
+struct Vp8lHuffmanGroup {
+    Vp8lHuffmanTable codes[5];
+};
+
+struct Vp8lTransform {
+    int type;
+    int bits;
+    int xsize;  // Width the inverse transform produces
+    std::vector<uint32_t> data;
+};
+
+// Per-channel helpers on packed ARGB
+inline uint32_t AddPixels(uint32_t a, uint32_t b) {
+    uint32_t alphaGreen = (a & 0xff00ff00u) + (b & 0xff00ff00u);
+    uint32_t redBlue = (a & 0x00ff00ffu) + (b & 0x00ff00ffu);
+    return (alphaGreen & 0xff00ff00u) | (redBlue & 0x00ff00ffu);
+}
+
+inline uint32_t Average2(uint32_t a, uint32_t b) {
+    return (((a ^ b) & 0xfefefefeu) >> 1) + (a & b);
+}
+
+inline int Clip255(int value) {
+    return value < 0 ? 0 : (value > 255 ? 255 : value);
+}
+
+inline int Channel(uint32_t pixel, int shift) {
+    return static_cast<int>((pixel >> shift) & 0xff);
+}
+
+inline uint32_t Select(uint32_t left, uint32_t top, uint32_t topLeft) {
+    int leftScore = 0;
+    int topScore = 0;
+    for (int shift = 0; shift < 32; shift += 8) {
+        leftScore += std::abs(Channel(top, shift) - Channel(topLeft, shift));
+        topScore += std::abs(Channel(left, shift) - Channel(topLeft, shift));
+    }
+    return leftScore < topScore ? left : top;
+}
+
+inline uint32_t ClampedAddSubtractFull(uint32_t a, uint32_t b, uint32_t c) {
+    uint32_t result = 0;
+    for (int shift = 0; shift < 32; shift += 8) {
+        int value = Clip255(Channel(a, shift) + Channel(b, shift) - Channel(c, shift));
+        result |= static_cast<uint32_t>(value) << shift;
+    }
+    return result;
+}
+
+inline uint32_t ClampedAddSubtractHalf(uint32_t a, uint32_t b) {
+    uint32_t result = 0;
+    for (int shift = 0; shift < 32; shift += 8) {
+        int ca = Channel(a, shift);
+        int value = Clip255(ca + (ca - Channel(b, shift)) / 2);
+        result |= static_cast<uint32_t>(value) << shift;
+    }
+    return result;
+}
+
+inline uint32_t Predict(int mode, uint32_t left, uint32_t top, uint32_t topRight, uint32_t topLeft) {
+    switch (mode) {
+        case 1: return left;
+        case 2: return top;
+        case 3: return topRight;
+        case 4: return topLeft;
+        case 5: return Average2(Average2(left, topRight), top);
+        case 6: return Average2(left, topLeft);
+        case 7: return Average2(left, top);
+        case 8: return Average2(topLeft, top);
+        case 9: return Average2(top, topRight);
+        case 10: return Average2(Average2(left, topLeft), Average2(top, topRight));
+        case 11: return Select(left, top, topLeft);
+        case 12: return ClampedAddSubtractFull(left, top, topLeft);
+        case 13: return ClampedAddSubtractHalf(Average2(left, top), topLeft);
+        default: return 0xff000000u;  // 0, and the unused 14 and 15
+    }
+}
+
+// Decodes one VP8L bitstream (the payload of a VP8L chunk) to ARGB
+class Vp8lDecoder {
+public:
+    Vp8lDecoder() : reader(nullptr) {}
+
+    bool Decode(const uint8_t* bytes, size_t length, int& width, int& height, std::vector<uint32_t>& argb) {
+        if (length < 5 || bytes[0] != 0x2f) return false;
+
+        Vp8lBitReader bits(bytes + 1, length - 1);
+        reader = &bits;
+        width = static_cast<int>(ReadBits(14)) + 1;
+        height = static_cast<int>(ReadBits(14)) + 1;
+        ReadBits(1);  // alpha_is_used: only a hint
+        if (ReadBits(3) != 0) return false;  // Version
+
+        bool ok = DecodeImageStream(width, height, true, argb) && !bits.Overrun();
+        reader = nullptr;
+        return ok;
+    }
+
+private:
+    uint32_t ReadBits(int n) { return reader->ReadBits(n); }
+
+    bool DecodeImageStream(int xsize, int ysize, bool isLevel0, std::vector<uint32_t>& out) {
+        int codedWidth = xsize;
+        std::vector<Vp8lTransform> transforms;
+        if (isLevel0) {
+            bool seen[4] = { false, false, false, false };
+            while (ReadBits(1)) {
+                Vp8lTransform transform;
+                transform.type = static_cast<int>(ReadBits(2));
+                if (seen[transform.type]) return false;
+                seen[transform.type] = true;
+                if (!ReadTransform(transform, codedWidth, ysize)) return false;
+                transforms.push_back(std::move(transform));
+            }
+        }
+
+        int cacheBits = 0;
+        if (ReadBits(1)) {
+            cacheBits = static_cast<int>(ReadBits(4));
+            if (cacheBits < 1 || cacheBits > 11) return false;
+        }
+
+        // Optional entropy image choosing a Huffman group per tile
+        int groupBits = 0;
+        int groupWidth = 0;
+        std::vector<uint32_t> groupImage;
+        size_t groupCount = 1;
+        if (isLevel0 && ReadBits(1)) {
+            groupBits = static_cast<int>(ReadBits(3)) + 2;
+            groupWidth = DivRoundUp(codedWidth, groupBits);
+            if (!DecodeImageStream(groupWidth, DivRoundUp(ysize, groupBits), false, groupImage)) return false;
+            for (size_t i = 0; i < groupImage.size(); i++) {
+                groupImage[i] = (groupImage[i] >> 8) & 0xffff;
+                groupCount = std::max<size_t>(groupCount, groupImage[i] + 1);
+            }
+        }
+
+        const int cacheSize = cacheBits > 0 ? 1 << cacheBits : 0;
+        std::vector<Vp8lHuffmanGroup> groups(groupCount);
+        const int alphabetSizes[5] = {
+            VP8L_NUM_LITERAL_CODES + VP8L_NUM_LENGTH_CODES + cacheSize,
+            VP8L_NUM_LITERAL_CODES, VP8L_NUM_LITERAL_CODES, VP8L_NUM_LITERAL_CODES,
+            VP8L_NUM_DISTANCE_CODES
+        };
+        for (size_t g = 0; g < groupCount; g++) {
+            for (int i = 0; i < 5; i++) {
+                if (!ReadHuffmanCode(alphabetSizes[i], groups[g].codes[i])) return false;
+            }
+            if (reader->Overrun()) return false;
+        }
+
+        if (!DecodePixels(codedWidth, ysize, cacheBits, groups, groupBits, groupWidth, groupImage, out)) {
+            return false;
+        }
+
+        // Undo the transforms, last one read first
+        int currentWidth = codedWidth;
+        for (size_t i = transforms.size(); i-- > 0;) {
+            ApplyInverseTransform(transforms[i], currentWidth, ysize, out);
+            currentWidth = transforms[i].xsize;
+        }
+        return true;
+    }
+
+    bool ReadTransform(Vp8lTransform& transform, int& xsize, int ysize) {
+        transform.xsize = xsize;
+        transform.bits = 0;
+        switch (transform.type) {
+            case VP8L_PREDICTOR:
+            case VP8L_CROSS_COLOR:
+                transform.bits = static_cast<int>(ReadBits(3)) + 2;
+                return DecodeImageStream(DivRoundUp(xsize, transform.bits), DivRoundUp(ysize, transform.bits),
+                                         false, transform.data);
+            case VP8L_COLOR_INDEXING: {
+                int colorCount = static_cast<int>(ReadBits(8)) + 1;
+                transform.bits = colorCount > 16 ? 0 : (colorCount > 4 ? 1 : (colorCount > 2 ? 2 : 3));
+                if (!DecodeImageStream(colorCount, 1, false, transform.data)) return false;
+
+                // Palette entries are delta-coded; indices past the end are transparent black
+                for (int i = 1; i < colorCount; i++) {
+                    transform.data[i] = AddPixels(transform.data[i], transform.data[i - 1]);
+                }
+                transform.data.resize(256, 0);
+                xsize = DivRoundUp(xsize, transform.bits);
+                return true;
+            }
+            default:
+                return true;  // Subtract green has no data
+        }
+    }
+
+    bool ReadHuffmanCode(int alphabetSize, Vp8lHuffmanTable& table) {
+        lengths.assign(alphabetSize, 0);
+
+        if (ReadBits(1)) {
+            // Simple code: one or two symbols
+            int symbolCount = static_cast<int>(ReadBits(1)) + 1;
+            int firstSymbol = static_cast<int>(ReadBits(ReadBits(1) ? 8 : 1));
+            if (firstSymbol >= alphabetSize) return false;
+            lengths[firstSymbol] = 1;
+            if (symbolCount == 2) {
+                int secondSymbol = static_cast<int>(ReadBits(8));
+                if (secondSymbol >= alphabetSize) return false;
+                lengths[secondSymbol] = 1;
+            }
+            return table.Build(lengths.data(), alphabetSize);
+        }
+
+        static const int codeLengthOrder[VP8L_CODE_LENGTH_CODES] = {
+            17, 18, 0, 1, 2, 3, 4, 5, 16, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15
+        };
+        uint8_t codeLengthLengths[VP8L_CODE_LENGTH_CODES] = { 0 };
+        int codeLengthCount = static_cast<int>(ReadBits(4)) + 4;
+        for (int i = 0; i < codeLengthCount; i++) {
+            codeLengthLengths[codeLengthOrder[i]] = static_cast<uint8_t>(ReadBits(3));
+        }
+
+        Vp8lHuffmanTable codeLengthTable;
+        if (!codeLengthTable.Build(codeLengthLengths, VP8L_CODE_LENGTH_CODES)) return false;
+
+        int maxSymbol = alphabetSize;
+        if (ReadBits(1)) {
+            int lengthBits = 2 + 2 * static_cast<int>(ReadBits(3));
+            maxSymbol = 2 + static_cast<int>(ReadBits(lengthBits));
+            if (maxSymbol > alphabetSize) return false;
+        }
+
+        // 0-15 are literal lengths; 16 repeats the previous non-zero length,
+        // 17 and 18 emit runs of zeros
+        int previous = 8;
+        int symbol = 0;
+        while (symbol < alphabetSize) {
+            if (maxSymbol-- == 0) break;
+            int code = codeLengthTable.ReadSymbol(*reader);
+            if (code < 16) {
+                lengths[symbol++] = static_cast<uint8_t>(code);
+                if (code != 0) previous = code;
+            } else {
+                static const int extraBits[3] = { 2, 3, 7 };
+                static const int repeatOffsets[3] = { 3, 3, 11 };
+                int slot = code - 16;
+                int repeat = static_cast<int>(ReadBits(extraBits[slot])) + repeatOffsets[slot];
+                if (symbol + repeat > alphabetSize) return false;
+                uint8_t length = static_cast<uint8_t>(code == 16 ? previous : 0);
+                while (repeat-- > 0) lengths[symbol++] = length;
+            }
+        }
+        if (reader->Overrun()) return false;
+
+        return table.Build(lengths.data(), alphabetSize);
+    }
+
+    // Length or distance prefix code plus its extra bits
+    int ReadCopyValue(int symbol) {
+        if (symbol < 4) return symbol + 1;
+        int extraBits = (symbol - 2) >> 1;
+        int offset = (2 + (symbol & 1)) << extraBits;
+        return offset + static_cast<int>(ReadBits(extraBits)) + 1;
+    }
+
+    // The first 120 distance codes are (dx, dy) neighbours in the 2D plane
+    static int PlaneCodeToDistance(int xsize, int code) {
+        static const int8_t offsets[120][2] = {
+            { 0, 1 }, { 1, 0 }, { 1, 1 }, { -1, 1 }, { 0, 2 }, { 2, 0 }, { 1, 2 }, { -1, 2 },
+            { 2, 1 }, { -2, 1 }, { 2, 2 }, { -2, 2 }, { 0, 3 }, { 3, 0 }, { 1, 3 }, { -1, 3 },
+            { 3, 1 }, { -3, 1 }, { 2, 3 }, { -2, 3 }, { 3, 2 }, { -3, 2 }, { 0, 4 }, { 4, 0 },
+            { 1, 4 }, { -1, 4 }, { 4, 1 }, { -4, 1 }, { 3, 3 }, { -3, 3 }, { 2, 4 }, { -2, 4 },
+            { 4, 2 }, { -4, 2 }, { 0, 5 }, { 3, 4 }, { -3, 4 }, { 4, 3 }, { -4, 3 }, { 5, 0 },
+            { 1, 5 }, { -1, 5 }, { 5, 1 }, { -5, 1 }, { 2, 5 }, { -2, 5 }, { 5, 2 }, { -5, 2 },
+            { 4, 4 }, { -4, 4 }, { 3, 5 }, { -3, 5 }, { 5, 3 }, { -5, 3 }, { 0, 6 }, { 6, 0 },
+            { 1, 6 }, { -1, 6 }, { 6, 1 }, { -6, 1 }, { 2, 6 }, { -2, 6 }, { 6, 2 }, { -6, 2 },
+            { 4, 5 }, { -4, 5 }, { 5, 4 }, { -5, 4 }, { 3, 6 }, { -3, 6 }, { 6, 3 }, { -6, 3 },
+            { 0, 7 }, { 7, 0 }, { 1, 7 }, { -1, 7 }, { 5, 5 }, { -5, 5 }, { 7, 1 }, { -7, 1 },
+            { 4, 6 }, { -4, 6 }, { 6, 4 }, { -6, 4 }, { 2, 7 }, { -2, 7 }, { 7, 2 }, { -7, 2 },
+            { 3, 7 }, { -3, 7 }, { 7, 3 }, { -7, 3 }, { 5, 6 }, { -5, 6 }, { 6, 5 }, { -6, 5 },
+            { 8, 0 }, { 4, 7 }, { -4, 7 }, { 7, 4 }, { -7, 4 }, { 8, 1 }, { 8, 2 }, { 6, 6 },
+            { -6, 6 }, { 8, 3 }, { 5, 7 }, { -5, 7 }, { 7, 5 }, { -7, 5 }, { 8, 4 }, { 6, 7 },
+            { -6, 7 }, { 7, 6 }, { -7, 6 }, { 8, 5 }, { 7, 7 }, { -7, 7 }, { 8, 6 }, { 8, 7 }
+        };
+        if (code > 120) return code - 120;
+        int distance = offsets[code - 1][0] + offsets[code - 1][1] * xsize;
+        return distance >= 1 ? distance : 1;
+    }
+
+    bool DecodePixels(int xsize, int ysize, int cacheBits, const std::vector<Vp8lHuffmanGroup>& groups,
+                      int groupBits, int groupWidth, const std::vector<uint32_t>& groupImage,
+                      std::vector<uint32_t>& out) {
+        const size_t total = static_cast<size_t>(xsize) * ysize;
+        out.resize(total);
+        uint32_t* pixels = out.data();
+
+        std::vector<uint32_t> cache(cacheBits > 0 ? static_cast<size_t>(1) << cacheBits : 0, 0);
+        const int cacheShift = 32 - cacheBits;
+
+        // Without an entropy image the group only needs looking up once
+        const int groupMask = groupBits > 0 ? (1 << groupBits) - 1 : -1;
+        const Vp8lHuffmanGroup* group = &groups[0];
+
+        size_t pos = 0;
+        int x = 0;
+        int y = 0;
+        while (pos < total) {
+            if ((x & groupMask) == 0 && groupBits > 0) {
+                group = &groups[groupImage[(y >> groupBits) * groupWidth + (x >> groupBits)]];
+            }
+
+            int green = group->codes[VP8L_GREEN].ReadSymbol(*reader);
+            if (green < VP8L_NUM_LITERAL_CODES) {
+                int red = group->codes[VP8L_RED].ReadSymbol(*reader);
+                int blue = group->codes[VP8L_BLUE].ReadSymbol(*reader);
+                int alpha = group->codes[VP8L_ALPHA].ReadSymbol(*reader);
+                uint32_t pixel = (static_cast<uint32_t>(alpha) << 24) | (red << 16) | (green << 8) | blue;
+                pixels[pos++] = pixel;
+                if (cacheBits > 0) cache[(0x1e35a7bdu * pixel) >> cacheShift] = pixel;
+                if (++x == xsize) {
+                    x = 0;
+                    y++;
+                }
+            } else if (green < VP8L_NUM_LITERAL_CODES + VP8L_NUM_LENGTH_CODES) {
+                int length = ReadCopyValue(green - VP8L_NUM_LITERAL_CODES);
+                int distanceSymbol = group->codes[VP8L_DISTANCE].ReadSymbol(*reader);
+                size_t distance = static_cast<size_t>(PlaneCodeToDistance(xsize, ReadCopyValue(distanceSymbol)));
+                if (reader->Overrun() || distance > pos || static_cast<size_t>(length) > total - pos) return false;
+
+                // Source and destination may overlap, so copy forwards one at a time
+                for (int i = 0; i < length; i++, pos++) {
+                    uint32_t pixel = pixels[pos - distance];
+                    pixels[pos] = pixel;
+                    if (cacheBits > 0) cache[(0x1e35a7bdu * pixel) >> cacheShift] = pixel;
+                }
+                x += length;
+                while (x >= xsize) {
+                    x -= xsize;
+                    y++;
+                }
+                if (pos < total && groupBits > 0 && (x & groupMask) != 0) {
+                    group = &groups[groupImage[(y >> groupBits) * groupWidth + (x >> groupBits)]];
+                }
+            } else {
+                int key = green - (VP8L_NUM_LITERAL_CODES + VP8L_NUM_LENGTH_CODES);
+                if (key >= static_cast<int>(cache.size())) return false;
+                uint32_t pixel = cache[key];
+                pixels[pos++] = pixel;
+                cache[(0x1e35a7bdu * pixel) >> cacheShift] = pixel;
+                if (++x == xsize) {
+                    x = 0;
+                    y++;
+                }
+            }
+
+            if (reader->Overrun()) return false;
+        }
+        return true;
+    }
+
+    static void ApplyInverseTransform(const Vp8lTransform& transform, int width, int height,
+                                      std::vector<uint32_t>& pixels) {
+        switch (transform.type) {
+            case VP8L_PREDICTOR:
+                InversePredictor(transform, width, height, pixels.data());
+                break;
+            case VP8L_CROSS_COLOR:
+                InverseCrossColor(transform, width, height, pixels.data());
+                break;
+            case VP8L_SUBTRACT_GREEN:
+                for (size_t i = 0; i < pixels.size(); i++) {
+                    uint32_t green = (pixels[i] >> 8) & 0xff;
+                    pixels[i] = AddPixels(pixels[i], (green << 16) | green);
+                }
+                break;
+            case VP8L_COLOR_INDEXING:
+                InverseColorIndexing(transform, width, height, pixels);
+                break;
+        }
+    }
+
+    static void InversePredictor(const Vp8lTransform& transform, int width, int height, uint32_t* pixels) {
+        // Top row: black for the first pixel, then the left neighbour
+        pixels[0] = AddPixels(pixels[0], 0xff000000u);
+        for (int x = 1; x < width; x++) {
+            pixels[x] = AddPixels(pixels[x], pixels[x - 1]);
+        }
+
+        const int tilesPerRow = DivRoundUp(width, transform.bits);
+        for (int y = 1; y < height; y++) {
+            uint32_t* row = pixels + static_cast<size_t>(y) * width;
+            const uint32_t* up = row - width;
+            const uint32_t* modes = &transform.data[(y >> transform.bits) * tilesPerRow];
+
+            // Left column predicts from above
+            row[0] = AddPixels(row[0], up[0]);
+            for (int x = 1; x < width; x++) {
+                int mode = (modes[x >> transform.bits] >> 8) & 0xf;
+                // For the last column, up[x + 1] is this row's first pixel, as the format expects
+                row[x] = AddPixels(row[x], Predict(mode, row[x - 1], up[x], up[x + 1], up[x - 1]));
+            }
+        }
+    }
+
+    static void InverseCrossColor(const Vp8lTransform& transform, int width, int height, uint32_t* pixels) {
+        const int tilesPerRow = DivRoundUp(width, transform.bits);
+        for (int y = 0; y < height; y++) {
+            uint32_t* row = pixels + static_cast<size_t>(y) * width;
+            const uint32_t* elements = &transform.data[(y >> transform.bits) * tilesPerRow];
+            for (int x = 0; x < width; x++) {
+                uint32_t element = elements[x >> transform.bits];
+                int greenToRed = static_cast<int8_t>(element & 0xff);
+                int greenToBlue = static_cast<int8_t>((element >> 8) & 0xff);
+                int redToBlue = static_cast<int8_t>((element >> 16) & 0xff);
+
+                uint32_t argb = row[x];
+                int green = static_cast<int8_t>((argb >> 8) & 0xff);
+                int red = static_cast<int>((argb >> 16) & 0xff);
+                int blue = static_cast<int>(argb & 0xff);
+                red = (red + ((greenToRed * green) >> 5)) & 0xff;
+                blue += (greenToBlue * green) >> 5;
+                blue += (redToBlue * static_cast<int8_t>(red)) >> 5;
+                row[x] = (argb & 0xff00ff00u) | (static_cast<uint32_t>(red) << 16) | (blue & 0xff);
+            }
+        }
+    }
+
+    static void InverseColorIndexing(const Vp8lTransform& transform, int width, int height,
+                                     std::vector<uint32_t>& pixels) {
+        const int packedWidth = width;
+        const int bitsPerIndex = 8 >> transform.bits;
+        const int indexMask = (1 << bitsPerIndex) - 1;
+        const int perPixelMask = (1 << transform.bits) - 1;
+
+        std::vector<uint32_t> expanded(static_cast<size_t>(transform.xsize) * height);
+        for (int y = 0; y < height; y++) {
+            const uint32_t* src = &pixels[static_cast<size_t>(y) * packedWidth];
+            uint32_t* dst = &expanded[static_cast<size_t>(y) * transform.xsize];
+            for (int x = 0; x < transform.xsize; x++) {
+                uint32_t packed = (src[x >> transform.bits] >> 8) & 0xff;
+                int index = (packed >> ((x & perPixelMask) * bitsPerIndex)) & indexMask;
+                dst[x] = transform.data[index];
+            }
+        }
+        pixels.swap(expanded);
+    }
+
+    Vp8lBitReader* reader;
+    std::vector<uint8_t> lengths;
+};
+
+} // namespace detail
+
+// Streams frames out of an in-memory WebP file
+class WebPReader {
+public:
+    WebPReader() : data(nullptr), size(0), pos(0), firstChunkPos(0), canvasWidth(0),
+                   canvasHeight(0), loopCount(0), failed(false), unsupported(false) {}
+
+    // Parses the RIFF header and the canvas size. The data must outlive the reader.
+    bool Open(const uint8_t* bytes, size_t length) {
+        data = bytes;
+        size = length;
+        pos = 0;
+        failed = false;
+        unsupported = false;
+        loopCount = 0;
+
+        if (!IsWebP(data, size)) {
+            failed = true;
+            return false;
+        }
+
+        // Chunks end where the RIFF payload says, or at the end of the data
+        size = std::min<size_t>(size, 8 + static_cast<size_t>(detail::ReadLe32(data + 4)));
+        firstChunkPos = 12;
+
+        uint32_t fourcc = 0;
+        const uint8_t* payload = nullptr;
+        size_t payloadSize = 0;
+        pos = firstChunkPos;
+        if (!NextChunk(fourcc, payload, payloadSize)) {
+            failed = true;
+            return false;
+        }
+
+        if (fourcc == FourCC("VP8X")) {
+            if (payloadSize < 10) {
+                failed = true;
+                return false;
+            }
+            canvasWidth = static_cast<int>(detail::ReadLe24(payload + 4)) + 1;
+            canvasHeight = static_cast<int>(detail::ReadLe24(payload + 7)) + 1;
+            firstChunkPos = pos;
+        } else if (fourcc == FourCC("VP8L")) {
+            // Simple format: the canvas is the one image
+            if (!detail::ReadVp8lSize(payload, payloadSize, canvasWidth, canvasHeight)) {
+                failed = true;
+                return false;
+            }
+        } else {
+            // Lossy VP8
+            unsupported = true;
+            failed = true;
+            return false;
+        }
+
+        // VP8X allows 2^24 on each side; nothing real comes close to VP8L's own limit
+        if (static_cast<uint64_t>(canvasWidth) * canvasHeight > MAX_WEBP_CANVAS_PIXELS) {
+            failed = true;
+            return false;
+        }
+
+        // Loop count lives in ANIM, which comes before the frames
+        pos = firstChunkPos;
+        while (NextChunk(fourcc, payload, payloadSize)) {
+            if (fourcc == FourCC("ANIM") && payloadSize >= 6) {
+                loopCount = payload[4] | (payload[5] << 8);
+                break;
+            }
+            if (fourcc == FourCC("ANMF")) break;
+        }
+
+        pos = firstChunkPos;
+        return true;
+    }
+
+    // Goes back to the first frame without re-parsing the header
+    void Rewind() {
+        pos = firstChunkPos;
+        failed = false;
+    }
+
+    // Decodes the next frame. Returns false after the last one or on
+    // malformed or unsupported data (check Failed() to tell them apart).
+    bool NextFrame(WebPFrameRecord& frame) {
+        uint32_t fourcc = 0;
+        const uint8_t* payload = nullptr;
+        size_t payloadSize = 0;
+
+        while (NextChunk(fourcc, payload, payloadSize)) {
+            if (fourcc == FourCC("ANMF")) {
+                if (payloadSize < 16) break;
+                frame.left = static_cast<int>(detail::ReadLe24(payload)) * 2;
+                frame.top = static_cast<int>(detail::ReadLe24(payload + 3)) * 2;
+                frame.width = static_cast<int>(detail::ReadLe24(payload + 6)) + 1;
+                frame.height = static_cast<int>(detail::ReadLe24(payload + 9)) + 1;
+                frame.delayMs = detail::ReadLe24(payload + 12);
+                frame.blend = (payload[15] & 0x02) == 0;
+                frame.disposeToBackground = (payload[15] & 0x01) != 0;
+                if (!DecodeFrameData(payload + 16, payloadSize - 16, frame)) {
+                    failed = true;
+                    return false;
+                }
+                return true;
+            }
+
+            if (fourcc == FourCC("VP8L")) {
+                // Still image
+                frame.left = 0;
+                frame.top = 0;
+                frame.width = canvasWidth;
+                frame.height = canvasHeight;
+                frame.delayMs = 0;
+                frame.blend = false;
+                frame.disposeToBackground = false;
+                if (!DecodeImage(payload, payloadSize, frame)) {
+                    failed = true;
+                    return false;
+                }
+                return true;
+            }
+
+            if (fourcc == FourCC("VP8 ") || fourcc == FourCC("ALPH")) {
+                unsupported = true;
+                failed = true;
+                return false;
+            }
+
+            // ANIM, ICCP, EXIF, XMP and unknown chunks carry no pixels
+        }
+
+        // A chunk header that does not fit means the file was cut short
+        if (pos + 8 <= size) failed = true;
+        return false;
+    }
+
+    // Counts frames by walking the chunk list without decoding anything.
+    // Leaves the reader rewound to the first frame.
+    size_t CountFrames() {
+        size_t count = 0;
+        uint32_t fourcc = 0;
+        const uint8_t* payload = nullptr;
+        size_t payloadSize = 0;
+
+        pos = firstChunkPos;
+        while (NextChunk(fourcc, payload, payloadSize)) {
+            if (fourcc == FourCC("ANMF") || fourcc == FourCC("VP8L")) count++;
+        }
+
+        Rewind();
+        return count;
+    }
+
+    int Width() const { return canvasWidth; }
+    int Height() const { return canvasHeight; }
+    unsigned LoopCount() const { return loopCount; }
+    bool Failed() const { return failed; }
+
+    // The file uses lossy VP8 compression, which this decoder does not handle
+    bool Unsupported() const { return unsupported; }
+
+    static bool IsWebP(const uint8_t* bytes, size_t length) {
+        return length >= 12 && std::memcmp(bytes, "RIFF", 4) == 0 && std::memcmp(bytes + 8, "WEBP", 4) == 0;
+    }
+
+private:
+    static uint32_t FourCC(const char* tag) {
+        return detail::ReadLe32(reinterpret_cast<const uint8_t*>(tag));
+    }
+
+    // Reads the chunk header at pos and moves past the (padded) payload
+    bool NextChunk(uint32_t& fourcc, const uint8_t*& payload, size_t& payloadSize) {
+        return ReadChunk(data, size, pos, fourcc, payload, payloadSize);
+    }
+
+    static bool ReadChunk(const uint8_t* bytes, size_t length, size_t& offset, uint32_t& fourcc,
+                          const uint8_t*& payload, size_t& payloadSize) {
+        if (offset + 8 > length) return false;
+        fourcc = detail::ReadLe32(bytes + offset);
+        payloadSize = detail::ReadLe32(bytes + offset + 4);
+        if (payloadSize > length - offset - 8) return false;
+        payload = bytes + offset + 8;
+        offset += 8 + payloadSize + (payloadSize & 1);
+        return true;
+    }
+
+    // The sub-chunks of an ANMF: an image plus optional unknown chunks
+    bool DecodeFrameData(const uint8_t* bytes, size_t length, WebPFrameRecord& frame) {
+        size_t offset = 0;
+        uint32_t fourcc = 0;
+        const uint8_t* payload = nullptr;
+        size_t payloadSize = 0;
+
+        while (ReadChunk(bytes, length, offset, fourcc, payload, payloadSize)) {
+            if (fourcc == FourCC("VP8L")) return DecodeImage(payload, payloadSize, frame);
+            if (fourcc == FourCC("VP8 ") || fourcc == FourCC("ALPH")) {
+                unsupported = true;
+                return false;
+            }
+        }
+        return false;
+    }
+
+    bool DecodeImage(const uint8_t* bytes, size_t length, WebPFrameRecord& frame) {
+        // The bitstream must match the frame, and the frame fit the canvas
+        int width = 0;
+        int height = 0;
+        if (!detail::ReadVp8lSize(bytes, length, width, height) || width != frame.width ||
+            height != frame.height || frame.left + frame.width > canvasWidth ||
+            frame.top + frame.height > canvasHeight) {
+            return false;
+        }
+        return decoder.Decode(bytes, length, width, height, frame.argb);
+    }
+
+    const uint8_t* data;
+    size_t size;
+    size_t pos;
+    size_t firstChunkPos;
+    int canvasWidth;
+    int canvasHeight;
+    unsigned loopCount;
+    bool failed;
+    bool unsupported;
+    detail::Vp8lDecoder decoder;
+};
+
+// Composes WebP frames onto a straight-alpha RGBA canvas. The canvas starts
+// transparent and frames disposed to background are cleared to transparent.
+class WebPCanvas {
+public:
+    WebPCanvas() : width(0), height(0), pendingDispose(false),
+                   pendingRect(PixelRect::EmptyRect()), lastUpdate(PixelRect::EmptyRect()) {}
+
+    void Reset(int canvasWidth, int canvasHeight) {
+        width = canvasWidth;
+        height = canvasHeight;
+        pixels.assign(static_cast<size_t>(width) * height * 4, 0);
+        pendingDispose = false;
+        pendingRect = PixelRect::EmptyRect();
+        lastUpdate = PixelRect::Make(0, 0, width, height);
+    }
+
+    // Disposes the previous frame if it asked for it, then draws frame
+    void Compose(const WebPFrameRecord& frame) {
+        lastUpdate = PixelRect::EmptyRect();
+        if (pendingDispose) {
+            lastUpdate = pendingRect;
+            for (int y = pendingRect.top; y < pendingRect.bottom; y++) {
+                std::memset(&pixels[(static_cast<size_t>(y) * width + pendingRect.left) * 4], 0,
+                            static_cast<size_t>(pendingRect.Width()) * 4);
+            }
+        }
+
+        int left = std::max(frame.left, 0);
+        int top = std::max(frame.top, 0);
+        int right = std::min(frame.left + frame.width, width);
+        int bottom = std::min(frame.top + frame.height, height);
+        PixelRect rect = PixelRect::Make(left, top, right, bottom);
+        lastUpdate = PixelRect::Union(lastUpdate, rect);
+
+        for (int y = top; y < bottom; y++) {
+            const uint32_t* src = &frame.argb[static_cast<size_t>(y - frame.top) * frame.width + (left - frame.left)];
+            uint8_t* dst = &pixels[(static_cast<size_t>(y) * width + left) * 4];
+            for (int x = left; x < right; x++, src++, dst += 4) {
+                uint32_t argb = *src;
+                uint32_t alpha = argb >> 24;
+                if (frame.blend && alpha != 255) {
+                    BlendPixel(argb, dst);
+                } else {
+                    dst[0] = static_cast<uint8_t>(argb >> 16);
+                    dst[1] = static_cast<uint8_t>(argb >> 8);
+                    dst[2] = static_cast<uint8_t>(argb);
+                    dst[3] = static_cast<uint8_t>(alpha);
+                }
+            }
+        }
+
+        pendingDispose = frame.disposeToBackground;
+        pendingRect = rect;
+    }
+
+    const uint8_t* Pixels() const { return pixels.data(); }
+
+    // Region that differs from the canvas before the last Compose call
+    PixelRect LastUpdate() const { return lastUpdate; }
+
+    int Width() const { return width; }
+    int Height() const { return height; }
+
+private:
+    // Non-premultiplied "over", with libwebp's integer approximation
+    static void BlendPixel(uint32_t argb, uint8_t* dst) {
+        uint32_t srcAlpha = argb >> 24;
+        if (srcAlpha == 0) return;
+
+        uint32_t dstFactor = (dst[3] * (256 - srcAlpha)) >> 8;
+        uint32_t blendAlpha = srcAlpha + dstFactor;
+        uint32_t scale = (1u << 24) / blendAlpha;
+
+        const int shifts[3] = { 16, 8, 0 };
+        for (int c = 0; c < 3; c++) {
+            uint32_t srcChannel = (argb >> shifts[c]) & 0xff;
+            uint32_t blended = srcChannel * srcAlpha + dst[c] * dstFactor;
+            dst[c] = static_cast<uint8_t>((blended * scale) >> 24);
+        }
+        dst[3] = static_cast<uint8_t>(blendAlpha);
+    }
+
+    int width;
+    int height;
+    std::vector<uint8_t> pixels;
+    bool pendingDispose;
+    PixelRect pendingRect;
+    PixelRect lastUpdate;
+};
+
+} // namespace chibi
@@ -0,0 +1,140 @@
+// AnimationRegistry: lookups by state and tag, and weighted picks that
+// follow the weights, with a handful of animations and with thousands.
+#include <cmath>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "../core/AnimationRegistry.h"
+#include "TestSupport.h"
+
+using namespace chibi;
+
+namespace {
+
+void TestLookups() {
+    AnimationRegistry registry;
+    AnimationId id = 99;
+    CHECK(!registry.First(0, id));
+    CHECK(registry.ForState(3).empty());
+    CHECK(registry.ForState(-1).empty());
+
+    registry.Add(10, 2);
+    registry.Add(11, 2);
+    registry.Add(12, 0);
+    registry.Add(13, -1);  // Ignored
+    registry.AddTag(11, "blink");
+    registry.AddTag(12, "blink");
+
+    CHECK(registry.Size() == 3);
+    CHECK(registry.StateCount() == 3);
+    CHECK(registry.ForState(2).size() == 2);
+    CHECK(registry.ForState(1).empty());
+    CHECK(registry.First(2, id) && id == 10);
+    CHECK(registry.First(0, id) && id == 12);
+    CHECK(registry.ForTag("blink").size() == 2);
+    CHECK(registry.ForTag("none").empty());
+
+    std::mt19937 rng(1);
+    CHECK(registry.Pick(0, rng, id) && id == 12);
+    CHECK(!registry.Pick(1, rng, id));
+    CHECK(!registry.Pick(7, rng, id));
+
+    registry.Clear();
+    CHECK(registry.Size() == 0);
+    CHECK(registry.ForState(2).empty());
+    CHECK(registry.ForTag("blink").empty());
+}
+
+// Weights 1, 3, 0 and 6: picked about 10%, 30%, never and 60% of the time
+void TestWeightedPick() {
+    AnimationRegistry registry;
+    registry.Add(0, 1, 1.0);
+    registry.Add(1, 1, 3.0);
+    registry.Add(2, 1, 0.0);
+    registry.Add(3, 1, 6.0);
+
+    std::mt19937 rng(5);
+    const int picks = 200000;
+    int counts[4] = { 0, 0, 0, 0 };
+    for (int i = 0; i < picks; i++) {
+        AnimationId id = 0;
+        REQUIRE(registry.Pick(1, rng, id));
+        REQUIRE(id < 4);
+        counts[id]++;
+    }
+    CHECK(counts[2] == 0);
+    CHECK(std::fabs(counts[0] / static_cast<double>(picks) - 0.1) < 0.01);
+    CHECK(std::fabs(counts[1] / static_cast<double>(picks) - 0.3) < 0.01);
+    CHECK(std::fabs(counts[3] / static_cast<double>(picks) - 0.6) < 0.01);
+
+    // Adding a variant after picking rebuilds the table
+    registry.Add(4, 1, 10.0);
+    int added = 0;
+    for (int i = 0; i < picks; i++) {
+        AnimationId id = 0;
+        registry.Pick(1, rng, id);
+        if (id == 4) added++;
+    }
+    CHECK(std::fabs(added / static_cast<double>(picks) - 0.5) < 0.01);
+}
+
+void TestZeroWeightsAreUniform() {
+    AnimationRegistry registry;
+    registry.Add(0, 0, 0.0);
+    registry.Add(1, 0, 0.0);
+    std::mt19937 rng(2);
+    int first = 0;
+    for (int i = 0; i < 10000; i++) {
+        AnimationId id = 0;
+        registry.Pick(0, rng, id);
+        if (id == 0) first++;
+    }
+    CHECK(first > 4500 && first < 5500);
+}
+
+// 20000 animations over 5 states and 100 tags. Weights cycle through 1..7
+// within each state, so each weight class gets its share of the picks.
+void TestThousandsOfAnimations() {
+    const size_t COUNT = 20000;
+    AnimationRegistry registry;
+    for (size_t i = 0; i < COUNT; i++) {
+        registry.Add(i, static_cast<int>(i % 5), 1.0 + (i / 5) % 7);
+        registry.AddTag(i, "tag" + std::to_string(i % 100));
+    }
+    CHECK(registry.Size() == COUNT);
+    CHECK(registry.ForState(3).size() == COUNT / 5);
+    CHECK(registry.ForTag("tag42").size() == COUNT / 100);
+    CHECK(registry.ForState(3)[1] == 8);
+
+    std::mt19937 rng(9);
+    const int picks = 1000000;
+    std::vector<int> byWeight(8, 0);
+    size_t wrongState = 0;
+    for (int i = 0; i < picks; i++) {
+        AnimationId id = 0;
+        registry.Pick(2, rng, id);
+        if (id % 5 != 2) wrongState++;
+        byWeight[1 + (id / 5) % 7]++;
+    }
+    CHECK(wrongState == 0);
+
+    // Weight w's share is w / 28 (there are about as many of each weight)
+    for (int weight = 1; weight <= 7; weight++) {
+        double share = byWeight[weight] / static_cast<double>(picks);
+        if (std::fabs(share - weight / 28.0) >= 0.005) {
+            std::fprintf(stderr, "weight %d picked %.4f of the time, expected %.4f\n", weight, share, weight / 28.0);
+        }
+        CHECK(std::fabs(share - weight / 28.0) < 0.005);
+    }
+}
+
+} // namespace
+
+int main() {
+    TestLookups();
+    TestWeightedPick();
+    TestZeroWeightsAreUniform();
+    TestThousandsOfAnimations();
+    return chibi_test::Finish("AnimationRegistryTest");
+}
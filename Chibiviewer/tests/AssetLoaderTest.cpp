@@ -0,0 +1,122 @@
+// AssetLoader: the pool hands back every asset once, failures included;
+// LoadTimings only marks each milestone once, after Start; and the viewer's
+// lazy start on the bundled pack shows WAIT's first frame no later than the
+// pack is fully loaded.
+#include <algorithm>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "../core/AssetLoader.h"
+#include "../core/Clock.h"
+#include "../core/Presenter.h"
+#include "../tools/LazyStartup.h"
+#include "../tools/PackFiles.h"
+#include "TestSupport.h"
+
+using namespace chibi;
+
+namespace {
+
+// Odd assets fail; even ones get a 1x1 cache with as many frames as their
+// index plus one
+void TestEveryAssetDelivered() {
+    const size_t COUNT = 37;
+    AssetLoader loader;
+    loader.Start(COUNT,
+                 [](size_t index, FrameCache& cache, CompressedFrameStore& store) {
+                     (void)store;
+                     return index % 2 == 0 && cache.Allocate(1, 1, index + 1);
+                 },
+                 AssetLoader::NotifyFunc(), 4);
+    loader.Wait();
+
+    std::vector<AssetLoadResult> results;
+    loader.Poll(results);
+    CHECK(loader.Finished());
+    CHECK(results.size() == COUNT);
+    std::vector<int> seen(COUNT, 0);
+    size_t wrong = 0;
+    for (size_t i = 0; i < results.size(); i++) {
+        const AssetLoadResult& result = results[i];
+        if (result.index >= COUNT) {
+            wrong++;
+            continue;
+        }
+        seen[result.index]++;
+        bool expected = result.index % 2 == 0;
+        if (result.ok != expected) wrong++;
+        if (result.ok && result.cache.frameCount != result.index + 1) wrong++;
+        if (!result.ok && !result.cache.Empty()) wrong++;
+    }
+    CHECK(wrong == 0);
+    CHECK(std::count(seen.begin(), seen.end(), 1) == static_cast<long>(COUNT));
+}
+
+void TestTimingsMarkOnce() {
+    LoadTimings timings;
+    timings.MarkFirstPixel(5.0);  // Not started: ignored
+    CHECK(timings.TimeToFirstPixelMs() < 0.0 && !timings.FullyLoaded());
+
+    timings.Start(100.0);
+    timings.MarkFirstPixel(112.5);
+    timings.MarkFirstPixel(150.0);
+    timings.MarkFullyLoaded(340.0);
+    timings.MarkFullyLoaded(400.0);
+    CHECK(timings.TimeToFirstPixelMs() == 12.5);
+    CHECK(timings.TimeToFullyLoadedMs() == 240.0);
+    CHECK(timings.FullyLoaded());
+
+    timings.Start(1000.0);  // A reload starts over
+    CHECK(timings.TimeToFirstPixelMs() < 0.0 && timings.TimeToFullyLoadedMs() < 0.0);
+}
+
+// Every bundled pack, on the real clock
+void TestLazyStartup(const std::string& pack, size_t expectedAnimations) {
+    std::vector<std::string> files = ListAnimations(chibi_test::AssetPath(pack));
+    REQUIRE(files.size() == expectedAnimations);
+    CHECK(files[FindWaitAnimation(files)].find("wait") != std::string::npos);
+
+    SteadyClock clock;
+    LoadTimings timings;
+    HeadlessPresenter presenter(true);
+    LazyStartupResult result;
+    REQUIRE(RunLazyStartup(files, clock, timings, presenter, result));
+
+    double firstPixel = timings.TimeToFirstPixelMs();
+    double loaded = timings.TimeToFullyLoadedMs();
+    CHECK(firstPixel >= 0.0);
+    CHECK(loaded >= 0.0);
+    CHECK(firstPixel <= loaded);
+    CHECK(result.loaded == files.size());
+    CHECK(presenter.PresentCount() == 1);
+
+    // What was presented is WAIT's first frame, whole
+    std::vector<uint8_t> bytes;
+    REQUIRE(ReadWholeFile(files[FindWaitAnimation(files)], bytes));
+    FrameCache wait;
+    REQUIRE(BuildFrameCache(bytes.data(), bytes.size(), wait));
+    CHECK(result.streamedFrames == wait.frameCount);
+    Surface surface = presenter.GetSurface();
+    REQUIRE(surface.width == wait.width && surface.height == wait.height);
+    size_t differing = 0;
+    for (int y = 0; y < wait.height; y++) {
+        if (std::memcmp(surface.Row(y), reinterpret_cast<const uint8_t*>(wait.Frame(0)) + y * wait.stride,
+                        wait.width * 4) != 0) {
+            differing++;
+        }
+    }
+    CHECK(differing == 0);
+    std::printf("%s: first pixel %.2f ms, fully loaded %.2f ms (%zu animations)\n", pack.c_str(), firstPixel, loaded,
+                result.loaded);
+}
+
+} // namespace
+
+int main() {
+    TestEveryAssetDelivered();
+    TestTimingsMarkOnce();
+    TestLazyStartup(".", 5);
+    TestLazyStartup("../vectorviewer", 5);
+    return chibi_test::Finish("AssetLoaderTest");
+}
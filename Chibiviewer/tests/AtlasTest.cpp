@@ -0,0 +1,176 @@
+// Atlas: the skyline packer never overlaps rectangles or places them
+// outside the page, also once the page is full or cut down; packing the
+// bundled GIFs keeps every pixel and takes far less memory than full
+// canvases.
+#include <cstring>
+#include <random>
+#include <vector>
+
+#include "../core/Atlas.h"
+#include "../core/FrameCache.h"
+#include "TestSupport.h"
+
+using namespace chibi;
+
+namespace {
+
+struct Placed {
+    int x;
+    int y;
+    int width;
+    int height;
+};
+
+bool Overlap(const Placed& a, const Placed& b) {
+    return a.x < b.x + b.width && b.x < a.x + a.width && a.y < b.y + b.height && b.y < a.y + a.height;
+}
+
+// Rectangles that overlap each other or leave the page
+size_t BadPlacements(const std::vector<Placed>& placed, int width, int height) {
+    size_t bad = 0;
+    for (size_t i = 0; i < placed.size(); i++) {
+        const Placed& p = placed[i];
+        if (p.x < 0 || p.y < 0 || p.x + p.width > width || p.y + p.height > height) bad++;
+        for (size_t j = i + 1; j < placed.size(); j++) {
+            if (Overlap(p, placed[j])) bad++;
+        }
+    }
+    return bad;
+}
+
+// Random sizes until the page turns down a long run of them
+void TestRandomRectsFillPage() {
+    const int PAGE = 512;
+    std::mt19937 rng(3);
+    std::uniform_int_distribution<int> size(1, 96);
+    SkylinePacker packer;
+    packer.Reset(PAGE, PAGE);
+
+    std::vector<Placed> placed;
+    size_t area = 0;
+    int failuresInARow = 0;
+    while (failuresInARow < 200) {
+        Placed rect = { 0, 0, size(rng), size(rng) };
+        int used = packer.UsedHeight();
+        if (packer.Insert(rect.width, rect.height, rect.x, rect.y)) {
+            placed.push_back(rect);
+            area += static_cast<size_t>(rect.width) * rect.height;
+            failuresInARow = 0;
+        } else {
+            CHECK(packer.UsedHeight() == used);  // A failed insert changes nothing
+            failuresInARow++;
+        }
+    }
+    CHECK(BadPlacements(placed, PAGE, PAGE) == 0);
+    CHECK(packer.UsedHeight() <= PAGE);
+    double filled = static_cast<double>(area) / (PAGE * PAGE);
+    CHECK(filled > 0.6);
+    std::printf("packer: %zu random rectangles fill %.1f%% of the page\n", placed.size(), filled * 100.0);
+}
+
+// Sixteen 64x64 squares tile a 256x256 page exactly; nothing fits after
+void TestExactTiling() {
+    SkylinePacker packer;
+    packer.Reset(256, 256);
+    std::vector<Placed> placed;
+    for (int i = 0; i < 16; i++) {
+        Placed rect = { 0, 0, 64, 64 };
+        REQUIRE(packer.Insert(rect.width, rect.height, rect.x, rect.y));
+        placed.push_back(rect);
+    }
+    CHECK(BadPlacements(placed, 256, 256) == 0);
+    CHECK(packer.UsedHeight() == 256);
+
+    int x = -1;
+    int y = -1;
+    CHECK(!packer.Insert(1, 1, x, y));
+    CHECK(!packer.Insert(257, 1, x, y));
+    SkylinePacker empty;
+    empty.Reset(256, 256);
+    CHECK(!empty.Insert(1, 257, x, y));
+    CHECK(empty.Insert(256, 256, x, y) && x == 0 && y == 0);
+}
+
+// Once cut down to the rows in use, the page only takes what still fits
+// below the cut
+void TestShrink() {
+    SkylinePacker packer;
+    packer.Reset(128, 128);
+    std::vector<Placed> placed;
+    Placed tall = { 0, 0, 32, 100 };
+    Placed wide = { 0, 0, 96, 20 };
+    REQUIRE(packer.Insert(tall.width, tall.height, tall.x, tall.y));
+    REQUIRE(packer.Insert(wide.width, wide.height, wide.x, wide.y));
+    placed.push_back(tall);
+    placed.push_back(wide);
+    packer.Shrink(packer.UsedHeight());
+    CHECK(packer.Height() == 100);
+
+    for (;;) {
+        Placed rect = { 0, 0, 24, 30 };
+        if (!packer.Insert(rect.width, rect.height, rect.x, rect.y)) break;
+        placed.push_back(rect);
+    }
+    CHECK(placed.size() == 2 + 4 * 2);  // Two rows of four beside the tall one
+    CHECK(BadPlacements(placed, 128, 100) == 0);
+}
+
+// Every bundled GIF in one atlas: sprites stay apart inside their pages,
+// hold their frames' pixels, and beat one canvas per frame
+void TestBundledPack() {
+    const char* const FILES[] = { "vectormove.gif", "vectorwait.gif", "vectorsit.gif", "vectorpick.gif",
+                                  "vectorlying.gif" };
+    const size_t COUNT = sizeof(FILES) / sizeof(FILES[0]);
+    FrameAtlas atlas;
+    std::vector<FrameCache> caches(COUNT);
+    std::vector<AtlasAnimation> animations(COUNT);
+    size_t canvasBytes = 0;
+    for (size_t f = 0; f < COUNT; f++) {
+        std::vector<uint8_t> file;
+        REQUIRE(chibi_test::ReadAsset(FILES[f], file));
+        REQUIRE(BuildFrameCache(file.data(), file.size(), caches[f]));
+        REQUIRE(animations[f].Build(atlas, caches[f]));
+        canvasBytes += caches[f].FrameBytes() * caches[f].frameCount;
+    }
+    REQUIRE(atlas.Compact());
+
+    std::vector<std::vector<Placed> > pages(atlas.PageCount());
+    size_t wrongPixels = 0;
+    for (size_t f = 0; f < COUNT; f++) {
+        const FrameCache& cache = caches[f];
+        for (size_t i = 0; i < cache.frameCount; i++) {
+            const AtlasSprite& sprite = animations[f].sprites[i];
+            if (sprite.source.Empty()) continue;
+            REQUIRE(sprite.page < pages.size());
+            Placed rect = { sprite.x, sprite.y, sprite.source.Width(), sprite.source.Height() };
+            pages[sprite.page].push_back(rect);
+            for (int row = 0; row < sprite.source.Height(); row++) {
+                const uint8_t* frameRow = reinterpret_cast<const uint8_t*>(cache.Frame(i)) +
+                                          (sprite.source.top + row) * cache.stride + sprite.source.left * 4;
+                if (std::memcmp(atlas.SpriteRow(sprite, row), frameRow, sprite.source.Width() * 4) != 0) {
+                    wrongPixels++;
+                }
+            }
+        }
+    }
+    CHECK(wrongPixels == 0);
+    size_t bad = 0;
+    for (size_t p = 0; p < pages.size(); p++) bad += BadPlacements(pages[p], ATLAS_PAGE_SIZE, ATLAS_PAGE_SIZE);
+    CHECK(bad == 0);
+
+    CHECK(atlas.SpriteBytes() <= atlas.AllocatedBytes());
+    CHECK(atlas.Occupancy() > 0.5);
+    CHECK(atlas.AllocatedBytes() * 2 < canvasBytes);
+    std::printf("atlas: %zu pages, %.1f MB against %.1f MB of canvases, %.1f%% occupied\n", atlas.PageCount(),
+                atlas.AllocatedBytes() / 1048576.0, canvasBytes / 1048576.0, atlas.Occupancy() * 100.0);
+}
+
+} // namespace
+
+int main() {
+    TestRandomRectsFillPage();
+    TestExactTiling();
+    TestShrink();
+    TestBundledPack();
+    return chibi_test::Finish("AtlasTest");
+}
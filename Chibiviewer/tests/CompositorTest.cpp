@@ -0,0 +1,201 @@
+// Compositor: whatever path a frame takes onto the surface (full copy, dirty
+// box, compressed store, atlas, flipped, cropped), the surface ends up byte
+// for byte equal to the frame, while touching far fewer bytes than the old
+// four-pass layer pipeline.
+#include <cstring>
+#include <vector>
+
+#include "../core/Atlas.h"
+#include "../core/Compositor.h"
+#include "../core/FrameCache.h"
+#include "../core/FramePool.h"
+#include "../core/FrameStore.h"
+#include "../core/Trim.h"
+#include "TestSupport.h"
+
+using namespace chibi;
+
+namespace {
+
+const char* const ASSETS[] = { "vectormove.gif", "vectorwait.gif", "vectorsit.gif", "vectorpick.gif",
+                                "vectorlying.gif" };
+
+// The old WM_PAINT made four full-surface passes per frame: clear the top
+// layer, draw the GIF into it, draw both layers to the screen, copy the top
+// layer into the bottom one. Only their writes are counted here.
+const int LEGACY_PASSES = 4;
+
+struct TestSurface {
+    std::vector<uint8_t> pixels;
+    Surface surface;
+
+    TestSurface(int width, int height) : pixels(static_cast<size_t>(width) * height * 4, 0xAB) {
+        Surface view = { pixels.data(), width, height, static_cast<size_t>(width) * 4 };
+        surface = view;
+    }
+};
+
+bool LoadCache(const char* asset, FrameCache& cache) {
+    std::vector<uint8_t> file;
+    if (!chibi_test::ReadAsset(asset, file)) return false;
+    return BuildFrameCache(file.data(), file.size(), cache) && cache.EnsureMirrored();
+}
+
+// Does the surface show frame index (as shown, flipped or not), cropped to
+// view?
+bool ShowsFrame(const TestSurface& target, const FrameCache& cache, size_t index, bool flipped,
+                const PixelRect& view) {
+    const uint8_t* frame = reinterpret_cast<const uint8_t*>(cache.Frame(index, flipped));
+    for (int y = 0; y < target.surface.height; y++) {
+        const uint8_t* expected = frame + (y + view.top) * cache.stride + view.left * 4;
+        if (std::memcmp(target.surface.pixels + y * target.surface.stride, expected,
+                        static_cast<size_t>(target.surface.width) * 4) != 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Two loops forward, a loop facing the other way, a few jumps and repeats
+std::vector<std::pair<size_t, bool> > Playback(size_t frameCount) {
+    std::vector<std::pair<size_t, bool> > steps;
+    for (size_t i = 0; i < frameCount * 2; i++) steps.push_back(std::make_pair(i % frameCount, false));
+    for (size_t i = 0; i < frameCount; i++) steps.push_back(std::make_pair(i, true));
+    steps.push_back(std::make_pair(frameCount / 2, true));
+    steps.push_back(std::make_pair(frameCount / 2, true));
+    steps.push_back(std::make_pair(frameCount / 3, false));
+    steps.push_back(std::make_pair(frameCount / 3 + 1, false));
+    steps.push_back(std::make_pair(0, false));
+    return steps;
+}
+
+void TestCacheOutputIsExact() {
+    for (size_t a = 0; a < sizeof(ASSETS) / sizeof(ASSETS[0]); a++) {
+        FrameCache cache;
+        REQUIRE(LoadCache(ASSETS[a], cache));
+        TestSurface target(cache.width, cache.height);
+        Compositor compositor;
+        PixelRect whole = PixelRect::Make(0, 0, cache.width, cache.height);
+
+        std::vector<std::pair<size_t, bool> > steps = Playback(cache.frameCount);
+        size_t wrong = 0;
+        for (size_t i = 0; i < steps.size(); i++) {
+            compositor.Compose(target.surface, cache, steps[i].first, steps[i].second);
+            if (!ShowsFrame(target, cache, steps[i].first, steps[i].second, whole)) wrong++;
+        }
+        if (wrong != 0) std::fprintf(stderr, "%s: %zu frames differ\n", ASSETS[a], wrong);
+        CHECK(wrong == 0);
+        CHECK(compositor.Stats().framesReused == 1);
+        CHECK(compositor.Stats().partialCopies > compositor.Stats().fullCopies);
+    }
+}
+
+// Cropped to the trimmed view, the surface holds exactly that box
+void TestViewOutputIsExact() {
+    FrameCache cache;
+    REQUIRE(LoadCache("vectorwait.gif", cache));
+    PixelRect view = TrimView(cache.opaqueBounds, cache.width, cache.height);
+    REQUIRE(!view.Empty());
+    TestSurface target(view.Width(), view.Height());
+    Compositor compositor;
+    compositor.SetView(view);
+
+    std::vector<std::pair<size_t, bool> > steps = Playback(cache.frameCount);
+    size_t wrong = 0;
+    for (size_t i = 0; i < steps.size(); i++) {
+        compositor.Compose(target.surface, cache, steps[i].first, steps[i].second);
+        if (!ShowsFrame(target, cache, steps[i].first, steps[i].second, view)) wrong++;
+    }
+    CHECK(wrong == 0);
+}
+
+// Switching between animations is a full copy of the new one
+void TestSwitchingAnimations() {
+    FrameCache first;
+    FrameCache second;
+    REQUIRE(LoadCache("vectorwait.gif", first));
+    REQUIRE(LoadCache("vectorsit.gif", second));
+    REQUIRE(first.width == second.width && first.height == second.height);
+    TestSurface target(first.width, first.height);
+    Compositor compositor;
+    PixelRect whole = PixelRect::Make(0, 0, first.width, first.height);
+
+    size_t wrong = 0;
+    for (size_t i = 0; i < 40; i++) {
+        const FrameCache& cache = (i / 5) % 2 == 0 ? first : second;
+        size_t frame = i % cache.frameCount;
+        compositor.Compose(target.surface, cache, frame, false);
+        if (!ShowsFrame(target, cache, frame, false, whole)) wrong++;
+    }
+    CHECK(wrong == 0);
+    CHECK(compositor.Stats().fullCopies == 8);
+}
+
+// Frames decoded from the compressed store, or expanded from atlas
+// sprites, give the same surface as the cache
+void TestStoreAndAtlasOutputIsExact() {
+    FrameCache cache;
+    REQUIRE(LoadCache("vectormove.gif", cache));
+    FramePool pool;
+    CompressedFrameStore store;
+    REQUIRE(store.Build(cache, pool));
+    FrameAtlas atlas;
+    AtlasAnimation animation;
+    REQUIRE(animation.Build(atlas, cache));
+
+    TestSurface fromStore(cache.width, cache.height);
+    TestSurface fromAtlas(cache.width, cache.height);
+    Compositor storeCompositor;
+    Compositor atlasCompositor;
+    PixelRect whole = PixelRect::Make(0, 0, cache.width, cache.height);
+
+    std::vector<std::pair<size_t, bool> > steps = Playback(cache.frameCount);
+    size_t wrongStore = 0;
+    size_t wrongAtlas = 0;
+    for (size_t i = 0; i < steps.size(); i++) {
+        storeCompositor.Compose(fromStore.surface, store, steps[i].first, steps[i].second);
+        atlasCompositor.Compose(fromAtlas.surface, atlas, animation, steps[i].first, steps[i].second);
+        if (!ShowsFrame(fromStore, cache, steps[i].first, steps[i].second, whole)) wrongStore++;
+        if (!ShowsFrame(fromAtlas, cache, steps[i].first, steps[i].second, whole)) wrongAtlas++;
+    }
+    CHECK(wrongStore == 0);
+    CHECK(wrongAtlas == 0);
+}
+
+// Playing every bundled animation through twice reads and writes at least
+// three times fewer bytes than the old pipeline only wrote
+void TestBytesTouched() {
+    uint64_t touched = 0;
+    uint64_t legacy = 0;
+    for (size_t a = 0; a < sizeof(ASSETS) / sizeof(ASSETS[0]); a++) {
+        FrameCache cache;
+        REQUIRE(LoadCache(ASSETS[a], cache));
+        TestSurface target(cache.width, cache.height);
+        Compositor compositor;
+
+        size_t frames = cache.frameCount * 2;
+        for (size_t i = 0; i < frames; i++) {
+            compositor.Compose(target.surface, cache, i % cache.frameCount, false);
+        }
+        const CompositorStats& stats = compositor.Stats();
+        uint64_t assetTouched = stats.bytesRead + stats.bytesWritten;
+        uint64_t assetLegacy = static_cast<uint64_t>(LEGACY_PASSES) * cache.width * cache.height * 4 * frames;
+        std::printf("%-16s %6.1f KB touched per frame, old pipeline %6.1f KB (%.1fx fewer)\n", ASSETS[a],
+                    assetTouched / 1024.0 / frames, assetLegacy / 1024.0 / frames,
+                    static_cast<double>(assetLegacy) / assetTouched);
+        touched += assetTouched;
+        legacy += assetLegacy;
+    }
+    CHECK(touched * 3 <= legacy);
+}
+
+} // namespace
+
+int main() {
+    TestCacheOutputIsExact();
+    TestViewOutputIsExact();
+    TestSwitchingAnimations();
+    TestStoreAndAtlasOutputIsExact();
+    TestBytesTouched();
+    return chibi_test::Finish("CompositorTest");
+}
@@ -0,0 +1,144 @@
+// DirtyRect: every kernel set finds exactly the box a pixel-by-pixel scan
+// finds, and the frame cache's dirty boxes for the bundled animations are
+// exact. Prints the average dirty area per animation.
+#include <algorithm>
+#include <random>
+#include <vector>
+
+#include "../core/DirtyRect.h"
+#include "../core/FrameCache.h"
+#include "TestSupport.h"
+
+using namespace chibi;
+
+namespace {
+
+const char* const ASSETS[] = { "vectormove.gif", "vectorwait.gif", "vectorsit.gif", "vectorpick.gif",
+                                "vectorlying.gif" };
+
+// Box of differing pixels by brute force
+PixelRect ReferenceDirtyRect(const uint8_t* a, const uint8_t* b, size_t stride, const PixelRect& bounds) {
+    PixelRect box = PixelRect::EmptyRect();
+    for (int y = bounds.top; y < bounds.bottom; y++) {
+        const uint32_t* rowA = reinterpret_cast<const uint32_t*>(a + y * stride);
+        const uint32_t* rowB = reinterpret_cast<const uint32_t*>(b + y * stride);
+        for (int x = bounds.left; x < bounds.right; x++) {
+            if (rowA[x] != rowB[x]) box = PixelRect::Union(box, PixelRect::Make(x, y, x + 1, y + 1));
+        }
+    }
+    return box;
+}
+
+bool SameRect(const PixelRect& a, const PixelRect& b) {
+    if (a.Empty() || b.Empty()) return a.Empty() && b.Empty();
+    return a.left == b.left && a.top == b.top && a.right == b.right && a.bottom == b.bottom;
+}
+
+// Random images with a few changed pixels (or none), random sizes and
+// bounds, checked against the brute-force box
+void CheckKernels(const char* name, const DiffKernels& kernels) {
+    std::mt19937 rng(11);
+    size_t wrong = 0;
+    for (int trial = 0; trial < 2000; trial++) {
+        int width = 1 + static_cast<int>(rng() % 70);
+        int height = 1 + static_cast<int>(rng() % 20);
+        size_t stride = static_cast<size_t>(width) * 4 + (rng() % 3) * 4;
+        std::vector<uint8_t> a(stride * height);
+        for (size_t i = 0; i < a.size(); i++) a[i] = static_cast<uint8_t>(rng());
+        std::vector<uint8_t> b = a;
+
+        int changes = static_cast<int>(rng() % 4);
+        for (int c = 0; c < changes; c++) {
+            size_t x = rng() % width;
+            size_t y = rng() % height;
+            b[y * stride + x * 4 + rng() % 4] ^= static_cast<uint8_t>(1 + rng() % 255);
+        }
+
+        int left = static_cast<int>(rng() % width);
+        int top = static_cast<int>(rng() % height);
+        PixelRect bounds = trial % 2 == 0 ? PixelRect::Make(0, 0, width, height)
+                                          : PixelRect::Make(left, top, left + 1 + static_cast<int>(rng() % (width - left)),
+                                                            top + 1 + static_cast<int>(rng() % (height - top)));
+
+        PixelRect expected = ReferenceDirtyRect(a.data(), b.data(), stride, bounds);
+        PixelRect actual = ComputeDirtyRect(a.data(), b.data(), stride, bounds, kernels);
+        if (!SameRect(expected, actual)) wrong++;
+    }
+    if (wrong != 0) std::fprintf(stderr, "%s: %zu of 2000 boxes wrong\n", name, wrong);
+    CHECK(wrong == 0);
+}
+
+void TestKernelsMatchReference() {
+    DiffKernels scalar = { FirstDiffScalar, LastDiffScalar };
+    CheckKernels("scalar", scalar);
+    CheckKernels("selected", GetDiffKernels());
+#if CHIBI_X86
+    const CpuFeatures& cpu = GetCpuFeatures();
+    DiffKernels sse2 = { FirstDiffSse2, LastDiffSse2 };
+    DiffKernels avx2 = { FirstDiffAvx2, LastDiffAvx2 };
+    if (cpu.sse2) CheckKernels("sse2", sse2);
+    if (cpu.avx2) CheckKernels("avx2", avx2);
+#endif
+}
+
+void TestCornersAndEmpty() {
+    const int width = 9;
+    const int height = 5;
+    const size_t stride = width * 4;
+    std::vector<uint8_t> a(stride * height, 0);
+    std::vector<uint8_t> b = a;
+    PixelRect whole = PixelRect::Make(0, 0, width, height);
+
+    CHECK(ComputeDirtyRect(a.data(), b.data(), stride, whole).Empty());
+    CHECK(ComputeDirtyRect(a.data(), b.data(), stride, PixelRect::EmptyRect()).Empty());
+
+    b[0] = 1;
+    b[(height - 1) * stride + (width - 1) * 4 + 3] = 1;
+    CHECK(SameRect(ComputeDirtyRect(a.data(), b.data(), stride, whole), whole));
+
+    // Changes outside the bounds are not seen
+    CHECK(ComputeDirtyRect(a.data(), b.data(), stride, PixelRect::Make(1, 1, width - 1, height - 1)).Empty());
+}
+
+// Each cached frame's box is exactly what changed from the frame before
+// (the last frame for frame 0)
+void TestBundledAnimations() {
+    for (size_t a = 0; a < sizeof(ASSETS) / sizeof(ASSETS[0]); a++) {
+        std::vector<uint8_t> file;
+        REQUIRE(chibi_test::ReadAsset(ASSETS[a], file));
+        FrameCache cache;
+        REQUIRE(BuildFrameCache(file.data(), file.size(), cache));
+        REQUIRE(cache.dirtyRects.size() == cache.frameCount);
+
+        PixelRect whole = PixelRect::Make(0, 0, cache.width, cache.height);
+        size_t wrong = 0;
+        double smallest = 1.0;
+        double largest = 0.0;
+        for (size_t i = 0; i < cache.frameCount; i++) {
+            size_t previous = (i + cache.frameCount - 1) % cache.frameCount;
+            PixelRect expected = ReferenceDirtyRect(reinterpret_cast<const uint8_t*>(cache.Frame(previous)),
+                                                    reinterpret_cast<const uint8_t*>(cache.Frame(i)),
+                                                    cache.stride, whole);
+            if (!SameRect(expected, cache.dirtyRects[i])) wrong++;
+            double fraction = static_cast<double>(cache.dirtyRects[i].Area()) / whole.Area();
+            smallest = std::min(smallest, fraction);
+            largest = std::max(largest, fraction);
+        }
+        if (wrong != 0) std::fprintf(stderr, "%s: %zu dirty boxes wrong\n", ASSETS[a], wrong);
+        CHECK(wrong == 0);
+
+        double average = cache.AverageDirtyFraction();
+        std::printf("%-16s dirty area per frame: average %5.1f%%, min %5.1f%%, max %5.1f%% (%zu frames)\n",
+                    ASSETS[a], average * 100.0, smallest * 100.0, largest * 100.0, cache.frameCount);
+        CHECK(average < 1.0);
+    }
+}
+
+} // namespace
+
+int main() {
+    TestKernelsMatchReference();
+    TestCornersAndEmpty();
+    TestBundledAnimations();
+    return chibi_test::Finish("DirtyRectTest");
+}
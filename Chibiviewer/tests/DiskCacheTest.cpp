@@ -0,0 +1,182 @@
+// DiskCache: an entry saved for a bundled GIF loads back as the same coded
+// frames, a source with an unchanged size and time is taken without being
+// read, a touched but unchanged one is hashed, kept and restamped, and a
+// changed source or a damaged entry is stale.
+#include <cstring>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/time.h>
+#endif
+
+#include "../core/DiskCache.h"
+#include "../tools/PackFiles.h"
+#include "TestSupport.h"
+
+using namespace chibi;
+
+namespace {
+
+NativePath Native(const std::string& path) {
+    return NativePath(path.begin(), path.end());
+}
+
+bool WriteBytes(const std::string& path, const std::vector<uint8_t>& bytes) {
+    return detail::WriteFileAtomically(Native(path), bytes);
+}
+
+// Moves a file's modification time, as touching or restoring it would
+bool SetModifiedTime(const std::string& path, int64_t seconds) {
+#ifdef _WIN32
+    HANDLE file = CreateFileA(path.c_str(), FILE_WRITE_ATTRIBUTES, 0, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE) return false;
+    uint64_t ticks = (static_cast<uint64_t>(seconds) + 11644473600ull) * 10000000ull;
+    FILETIME time;
+    time.dwLowDateTime = static_cast<DWORD>(ticks);
+    time.dwHighDateTime = static_cast<DWORD>(ticks >> 32);
+    bool ok = SetFileTime(file, NULL, NULL, &time) != 0;
+    CloseHandle(file);
+    return ok;
+#else
+    timeval times[2];
+    times[0].tv_sec = times[1].tv_sec = static_cast<time_t>(seconds);
+    times[0].tv_usec = times[1].tv_usec = 0;
+    return utimes(path.c_str(), times) == 0;
+#endif
+}
+
+// Decodes a GIF file and saves its entry, as the loader does on a miss
+bool DecodeAndSave(DiskCache& diskCache, const std::string& path, FramePool& pool) {
+    std::vector<uint8_t> file;
+    if (!ReadWholeFile(path, file)) return false;
+    FrameCache cache;
+    CompressedFrameStore store;
+    AssetStamp stamp;
+    return BuildFrameCache(file.data(), file.size(), cache) && store.Build(cache, pool) &&
+           MakeAssetStamp(Native(path), file.data(), file.size(), stamp) &&
+           diskCache.Save(Native(path), stamp, cache, store);
+}
+
+// Loads an entry and checks it against a fresh decode, frame by frame
+void CheckLoadsAsDecoded(DiskCache& diskCache, const std::string& path, FramePool& pool) {
+    FrameCache loaded;
+    CompressedFrameStore store;
+    REQUIRE(diskCache.Load(Native(path), pool, loaded, store) == DISK_CACHE_HIT);
+
+    std::vector<uint8_t> file;
+    REQUIRE(ReadWholeFile(path, file));
+    FrameCache decoded;
+    REQUIRE(BuildFrameCache(file.data(), file.size(), decoded));
+    CHECK(loaded.width == decoded.width && loaded.height == decoded.height);
+    CHECK(loaded.frameCount == decoded.frameCount);
+    CHECK(loaded.delays == decoded.delays);
+    CHECK(store.FrameCount() == decoded.frameCount);
+
+    size_t mismatched = 0;
+    for (size_t i = 0; i < decoded.frameCount; i++) {
+        const uint32_t* pixels = store.Frame(i);
+        if (!pixels || std::memcmp(pixels, decoded.Frame(i), decoded.FrameBytes()) != 0) mismatched++;
+    }
+    CHECK(mismatched == 0);
+}
+
+void TestRoundTripAndStamps(const std::string& folder) {
+    const std::string source = folder + "/vectorwait.gif";
+    std::vector<uint8_t> original;
+    REQUIRE(chibi_test::ReadAsset("vectorwait.gif", original));
+    REQUIRE(WriteBytes(source, original));
+    REQUIRE(SetModifiedTime(source, 1000000000));
+
+    FramePool pool;
+    DiskCache diskCache;
+    diskCache.SetDirectory(Native(folder + "/cache"));
+    FrameCache cache;
+    CompressedFrameStore store;
+    CHECK(diskCache.Load(Native(source), pool, cache, store) == DISK_CACHE_MISS);
+    CHECK(store.Empty());
+
+    REQUIRE(DecodeAndSave(diskCache, source, pool));
+    CheckLoadsAsDecoded(diskCache, source, pool);
+    CHECK(diskCache.Stats().hits == 1 && diskCache.Stats().restamped == 0);
+
+    // Touched but the same bytes: a hit, and the entry takes the new time
+    REQUIRE(SetModifiedTime(source, 1100000000));
+    CheckLoadsAsDecoded(diskCache, source, pool);
+    CHECK(diskCache.Stats().hits == 2 && diskCache.Stats().restamped == 1);
+    CheckLoadsAsDecoded(diskCache, source, pool);
+    CHECK(diskCache.Stats().hits == 3 && diskCache.Stats().restamped == 1);
+
+    // Same size, other bytes, new time: the hash catches it
+    std::vector<uint8_t> changed = original;
+    changed[changed.size() / 2] ^= 0x55;
+    REQUIRE(WriteBytes(source, changed));
+    REQUIRE(SetModifiedTime(source, 1200000000));
+    CHECK(diskCache.Load(Native(source), pool, cache, store) == DISK_CACHE_STALE);
+    CHECK(store.Empty() && cache.frameCount == 0);
+
+    // A different size is stale without hashing
+    REQUIRE(WriteBytes(source, original));
+    REQUIRE(DecodeAndSave(diskCache, source, pool));
+    std::vector<uint8_t> longer = original;
+    longer.push_back(0x3B);
+    REQUIRE(WriteBytes(source, longer));
+    CHECK(diskCache.Load(Native(source), pool, cache, store) == DISK_CACHE_STALE);
+    CHECK(diskCache.Stats().stale == 2);
+
+    store.Clear();
+    CHECK(pool.Empty());
+}
+
+// A flipped byte in the coded runs fails the payload hash, and a cut
+// short entry fails its header checks
+void TestDamagedEntry(const std::string& folder) {
+    const std::string source = folder + "/vectorpick.gif";
+    std::vector<uint8_t> original;
+    REQUIRE(chibi_test::ReadAsset("vectorpick.gif", original));
+    REQUIRE(WriteBytes(source, original));
+
+    FramePool pool;
+    DiskCache diskCache;
+    diskCache.SetDirectory(Native(folder + "/cache"));
+    REQUIRE(DecodeAndSave(diskCache, source, pool));
+    std::string entryPath;
+    NativePath nativeEntry = diskCache.EntryPath(Native(source));
+    entryPath.assign(nativeEntry.begin(), nativeEntry.end());
+    std::vector<uint8_t> entry;
+    REQUIRE(ReadWholeFile(entryPath, entry));
+    REQUIRE(entry.size() > 100);
+
+    std::vector<uint8_t> flipped = entry;
+    flipped[flipped.size() - 10] ^= 0x01;
+    REQUIRE(WriteBytes(entryPath, flipped));
+    FrameCache cache;
+    CompressedFrameStore store;
+    CHECK(diskCache.Load(Native(source), pool, cache, store) == DISK_CACHE_STALE);
+
+    std::vector<uint8_t> cut(entry.begin(), entry.begin() + entry.size() / 2);
+    REQUIRE(WriteBytes(entryPath, cut));
+    CHECK(diskCache.Load(Native(source), pool, cache, store) == DISK_CACHE_STALE);
+
+    REQUIRE(WriteBytes(entryPath, entry));
+    CHECK(diskCache.Load(Native(source), pool, cache, store) == DISK_CACHE_HIT);
+    store.Clear();
+    CHECK(pool.Empty());
+}
+
+} // namespace
+
+int main() {
+    std::string folder;
+    if (!MakeTempDirectory(folder)) {
+        std::fprintf(stderr, "DiskCacheTest: no temporary directory\n");
+        return 1;
+    }
+    TestRoundTripAndStamps(folder);
+    TestDamagedEntry(folder);
+    RemoveDirectoryAndFiles(folder + "/cache");
+    RemoveDirectoryAndFiles(folder);
+    return chibi_test::Finish("DiskCacheTest");
+}
@@ -0,0 +1,190 @@
+// Engine: window placement, streaming, automatic and manual states and
+// dragging, all under the engine's own clock with no window.
+#include <algorithm>
+#include <vector>
+
+#include "../core/Engine.h"
+#include "TestSupport.h"
+
+using namespace chibi;
+
+namespace {
+
+const PixelRect FULL_VIEW = PixelRect::Make(0, 0, 400, 400);
+const PixelRect TRIMMED_VIEW = PixelRect::Make(120, 150, 280, 400);
+
+// Waiting with one decoded frame, then one of every other type
+void AddAnimations(Engine& engine, const std::vector<unsigned>& delays) {
+    engine.AddAnimation(ANIMATION_WAIT, "wait", 400, 400, delays, 1, FULL_VIEW);
+    engine.AddAnimation(ANIMATION_MOVE, "move", 400, 400, delays, delays.size(), TRIMMED_VIEW);
+    engine.AddAnimation(ANIMATION_PICK, "pick", 400, 400, delays, delays.size(), TRIMMED_VIEW);
+    engine.AddAnimation(ANIMATION_SIT, "sit", 400, 400, delays, delays.size(), TRIMMED_VIEW);
+    engine.AddAnimation(ANIMATION_MISC, "misc", 400, 400, delays, delays.size(), TRIMMED_VIEW);
+}
+
+// A 200x200 window at (100, 100) on a 1920x1080 screen
+void PlaceOnScreen(Engine& engine) {
+    engine.SetWindow(PixelRect::Make(100, 100, 300, 300));
+    engine.SetScreen(1920, 1080);
+}
+
+// The feet (bottom centre of the canvas) stay where the window's bottom
+// centre was, whichever view the animation uses
+void TestFeetStayAnchored() {
+    Engine engine(EngineConfig(), 42);
+    PlaceOnScreen(engine);
+    std::vector<unsigned> delays(8, 100);
+    AddAnimations(engine, delays);
+
+    std::vector<EngineCommand> commands;
+    engine.TakeCommands(commands);
+    REQUIRE(!commands.empty());
+    CHECK(commands.front().type == ENGINE_PLACE_WINDOW);
+    CHECK(commands.back().type == ENGINE_SHOW_FRAME);
+    CHECK(engine.Window().left + 200 == 200);
+    CHECK(engine.Window().top + 400 == 300);
+
+    engine.UpdateAnimation(0, delays, delays.size(), TRIMMED_VIEW);
+    CHECK(engine.Window().Width() == TRIMMED_VIEW.Width());
+    CHECK(engine.Window().left + 200 - TRIMMED_VIEW.left == 200);
+    CHECK(engine.Window().top + 400 - TRIMMED_VIEW.top == 300);
+}
+
+// Playback holds the last decoded frame until more arrive
+void TestStreamingHoldsLastFrame() {
+    Engine engine(EngineConfig(), 42);
+    PlaceOnScreen(engine);
+    std::vector<unsigned> delays(8, 100);
+    AddAnimations(engine, delays);
+    engine.SetMode(MODE_MANUAL);
+
+    for (int i = 0; i < 5; i++) engine.Tick(100);
+    CHECK(engine.CurrentFrame() == 0);
+
+    engine.UpdateAnimation(0, delays, 3, FULL_VIEW);
+    for (int i = 0; i < 10; i++) engine.Tick(100);
+    CHECK(engine.CurrentFrame() == 2);
+
+    engine.UpdateAnimation(0, delays, delays.size(), FULL_VIEW);
+    engine.Tick(100);
+    CHECK(engine.CurrentFrame() == 3);
+}
+
+// Automatic mode leaves waiting for a walk within the longest state time,
+// and walking moves the window and turns at the screen edges
+void TestAutomaticModeWalks() {
+    Engine engine(EngineConfig(), 42);
+    PlaceOnScreen(engine);
+    std::vector<unsigned> delays(8, 100);
+    AddAnimations(engine, delays);
+    engine.UpdateAnimation(0, delays, delays.size(), TRIMMED_VIEW);
+    engine.SetMode(MODE_AUTOMATIC);
+
+    std::vector<EngineCommand> commands;
+    int frames = 0;
+    bool walked = false;
+    bool turned = false;
+    bool startedFacingRight = true;
+    double elapsed = 0.0;
+    while (elapsed < 60000.0) {
+        double wait = engine.MsUntilNextUpdate();
+        CHECK(wait >= 0.0);
+        double step = std::min(std::max(wait, 1.0), 50.0);
+        engine.Tick(step);
+        elapsed += step;
+
+        engine.TakeCommands(commands);
+        for (size_t i = 0; i < commands.size(); i++) {
+            if (commands[i].type == ENGINE_SHOW_FRAME) frames++;
+        }
+        if (engine.State() == STATE_MOVE) {
+            if (!walked) startedFacingRight = engine.FacingRight();
+            walked = true;
+            turned = turned || engine.FacingRight() != startedFacingRight;
+            CHECK(engine.Window().left >= 0 && engine.Window().right <= 1920);
+        }
+    }
+    CHECK(walked);
+    CHECK(turned);
+    CHECK(frames > 500);  // 100 ms frames for a minute
+}
+
+// Picking up plays PICK, the window follows the pointer but stays on the
+// screen, and letting go returns to the previous state
+void TestDragStaysOnScreen() {
+    Engine engine(EngineConfig(), 42);
+    PlaceOnScreen(engine);
+    std::vector<unsigned> delays(8, 100);
+    AddAnimations(engine, delays);
+    engine.SetMode(MODE_AUTOMATIC);
+
+    engine.PointerDown();
+    CHECK(engine.Picking());
+    CHECK(engine.State() == STATE_PICK);
+
+    engine.PointerMove(5000, 5000);
+    CHECK(engine.Window().right == 1920);
+    CHECK(engine.Window().bottom == 1080);
+    engine.PointerMove(-5000, -5000);
+    CHECK(engine.Window().left == 0);
+    CHECK(engine.Window().top == 0);
+
+    engine.Tick(30000);  // No state ends while held
+    CHECK(engine.State() == STATE_PICK);
+
+    engine.PointerUp();
+    CHECK(!engine.Picking());
+    CHECK(engine.State() == STATE_WAIT);
+}
+
+// Manual mode only changes state on request, in the order wait, sit,
+// misc, move
+void TestManualCycle() {
+    Engine engine(EngineConfig(), 42);
+    PlaceOnScreen(engine);
+    std::vector<unsigned> delays(8, 100);
+    AddAnimations(engine, delays);
+    engine.SetMode(MODE_MANUAL);
+
+    const CharacterState order[] = { STATE_SIT, STATE_MISC, STATE_MOVE, STATE_WAIT };
+    for (size_t i = 0; i < sizeof(order) / sizeof(order[0]); i++) {
+        engine.CycleState();
+        CHECK(engine.State() == order[i]);
+    }
+
+    engine.Tick(60000);
+    CHECK(engine.State() == STATE_WAIT);
+    CHECK(engine.MsUntilNextUpdate() <= 100.0);
+}
+
+void TestClearStopsEverything() {
+    Engine engine(EngineConfig(), 42);
+    PlaceOnScreen(engine);
+    std::vector<unsigned> delays(8, 100);
+    AddAnimations(engine, delays);
+    engine.SetMode(MODE_AUTOMATIC);
+    CHECK(engine.Playing());
+
+    engine.Clear();
+    CHECK(!engine.Playing());
+    CHECK(engine.AnimationCount() == 0);
+    CHECK(engine.MsUntilNextUpdate() < 0.0);
+    CHECK(!engine.Tick(1000));
+
+    // Input with nothing loaded is ignored
+    engine.PointerDown();
+    engine.CycleState();
+    CHECK(!engine.Picking());
+}
+
+} // namespace
+
+int main() {
+    TestFeetStayAnchored();
+    TestStreamingHoldsLastFrame();
+    TestAutomaticModeWalks();
+    TestDragStaysOnScreen();
+    TestManualCycle();
+    TestClearStopsEverything();
+    return chibi_test::Finish("EngineTest");
+}
@@ -0,0 +1,197 @@
+// FramePool: identical blobs are stored once, blobs whose hashes collide
+// stay apart, and reference counts go back to zero when the stores that
+// hold them are torn down the way CleanupGifs does it.
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../core/FrameCache.h"
+#include "../core/FramePool.h"
+#include "../core/FrameStore.h"
+#include "TestSupport.h"
+
+using namespace chibi;
+
+namespace {
+
+const char* const ASSETS[] = { "vectormove.gif", "vectorwait.gif", "vectorsit.gif", "vectorpick.gif",
+                                "vectorlying.gif" };
+
+std::vector<uint8_t> Blob(const std::string& text) {
+    return std::vector<uint8_t>(text.begin(), text.end());
+}
+
+bool Holds(const FramePool& pool, FrameHandle handle, const std::vector<uint8_t>& bytes) {
+    const uint8_t* stored = pool.Bytes(handle);
+    return stored && pool.Size(handle) == bytes.size() && std::memcmp(stored, bytes.data(), bytes.size()) == 0;
+}
+
+void TestIdenticalBlobsShared() {
+    FramePool pool;
+    std::vector<uint8_t> a = Blob("first frame");
+    std::vector<uint8_t> b = Blob("second frame");
+    FrameHandle a1 = pool.Intern(a.data(), a.size());
+    FrameHandle a2 = pool.Intern(a.data(), a.size());
+    FrameHandle b1 = pool.Intern(b.data(), b.size());
+    CHECK(a1 == a2);
+    CHECK(a1 != b1);
+    CHECK(pool.References(a1) == 2);
+    CHECK(Holds(pool, a1, a) && Holds(pool, b1, b));
+
+    FramePoolStats stats = pool.Stats();
+    CHECK(stats.references == 3 && stats.blobs == 2);
+    CHECK(stats.referencedBytes == 2 * a.size() + b.size());
+    CHECK(stats.storedBytes == a.size() + b.size());
+    CHECK(stats.DedupeRatio() > 0.0);
+
+    pool.AddRef(b1);
+    pool.Release(a1);
+    pool.Release(a2);
+    CHECK(pool.Bytes(a1) == nullptr);  // Freed with its last reference
+    pool.Release(b1);
+    CHECK(Holds(pool, b1, b));
+    pool.Release(b1);
+    CHECK(pool.Empty());
+    CHECK(pool.Stats().references == 0 && pool.Stats().referencedBytes == 0 && pool.Stats().storedBytes == 0);
+
+    // Releasing a dead or invalid handle changes nothing
+    pool.Release(a1);
+    pool.Release(INVALID_FRAME_HANDLE);
+    CHECK(pool.Empty() && pool.Stats().references == 0);
+}
+
+// Different blobs under one hash (forced through the hash overload) get
+// their own handles and are found again by their bytes, not their hash
+void TestHashCollisions() {
+    const uint64_t HASH = 42;
+    FramePool pool;
+    std::vector<uint8_t> a = Blob("aaaa");
+    std::vector<uint8_t> b = Blob("bbbb");
+    std::vector<uint8_t> prefix = Blob("aaa");  // Same leading bytes, shorter
+    FrameHandle ha = pool.Intern(a.data(), a.size(), HASH);
+    FrameHandle hb = pool.Intern(b.data(), b.size(), HASH);
+    FrameHandle hp = pool.Intern(prefix.data(), prefix.size(), HASH);
+    CHECK(ha != hb && hb != hp && ha != hp);
+    CHECK(Holds(pool, ha, a) && Holds(pool, hb, b) && Holds(pool, hp, prefix));
+    CHECK(pool.Stats().blobs == 3);
+
+    CHECK(pool.Intern(b.data(), b.size(), HASH) == hb);
+    CHECK(pool.References(hb) == 2);
+
+    // Freeing one blob in the chain leaves the others findable
+    pool.Release(ha);
+    CHECK(pool.Intern(prefix.data(), prefix.size(), HASH) == hp);
+    CHECK(Holds(pool, hb, b));
+
+    // The freed handle is reused for the next new blob, under any hash
+    std::vector<uint8_t> c = Blob("cccc");
+    FrameHandle hc = pool.Intern(c.data(), c.size(), HASH);
+    CHECK(hc == ha);
+    CHECK(Holds(pool, hc, c));
+    FrameHandle again = pool.Intern(a.data(), a.size(), HASH);
+    CHECK(again != hc && Holds(pool, again, a));
+
+    pool.Release(hb);
+    pool.Release(hb);
+    pool.Release(hp);
+    pool.Release(hp);
+    pool.Release(hc);
+    CHECK(pool.Stats().blobs == 1);
+    pool.Release(again);
+    CHECK(pool.Empty());
+}
+
+// Threads interning and releasing overlapping blobs leave nothing behind
+void TestConcurrentInternAndRelease() {
+    FramePool pool;
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; t++) {
+        threads.emplace_back([&pool, t]() {
+            for (int round = 0; round < 200; round++) {
+                std::vector<FrameHandle> held;
+                for (int i = 0; i < 20; i++) {
+                    std::vector<uint8_t> blob = Blob("blob " + std::to_string((i + t) % 25));
+                    held.push_back(pool.Intern(blob.data(), blob.size()));
+                }
+                for (size_t i = 0; i < held.size(); i++) pool.Release(held[i]);
+            }
+        });
+    }
+    for (size_t t = 0; t < threads.size(); t++) threads[t].join();
+    CHECK(pool.Empty());
+    CHECK(pool.Stats().references == 0);
+}
+
+// What the viewer holds per GIF that matters to the pool
+struct LoadedGif {
+    FrameCache cache;
+    CompressedFrameStore store;
+};
+
+// Every bundled GIF, one of them twice (as two files with the same frames
+// would be), a store moved around like AddGif does and a half-built
+// streaming store. Clearing them the way CleanupGifs does frees every blob.
+void TestTeardownReleasesEverything() {
+    FramePool pool;
+    std::vector<LoadedGif> gifs;
+    size_t totalFrames = 0;
+    size_t repeatedFrames = 0;
+    for (size_t a = 0; a <= sizeof(ASSETS) / sizeof(ASSETS[0]); a++) {
+        const char* asset = ASSETS[a % (sizeof(ASSETS) / sizeof(ASSETS[0]))];
+        std::vector<uint8_t> file;
+        REQUIRE(chibi_test::ReadAsset(asset, file));
+        LoadedGif gif;
+        REQUIRE(BuildFrameCache(file.data(), file.size(), gif.cache));
+        REQUIRE(gif.store.Build(gif.cache, pool));
+        totalFrames += gif.store.FrameCount();
+        repeatedFrames += gif.store.RepeatedFrames();
+        gif.cache.ReleasePixels();
+        gifs.push_back(std::move(gif));  // Reallocates along the way
+    }
+
+    FramePoolStats loaded = pool.Stats();
+    CHECK(loaded.blobs > 0);
+    CHECK(loaded.references + repeatedFrames == totalFrames);  // One per coded frame
+    // The second copy of vectormove.gif costs no blob of its own
+    CHECK(loaded.storedBytes < loaded.referencedBytes);
+    std::printf("pool: %zu references to %zu blobs, %.1f%% deduplicated\n", loaded.references, loaded.blobs,
+                loaded.DedupeRatio() * 100.0);
+
+    // Moved-from stores hold nothing, so only the moved-to ones release
+    CompressedFrameStore moved = std::move(gifs.back().store);
+    CHECK(gifs.back().store.Empty());
+    CHECK(pool.Stats().references == loaded.references);
+    gifs.back().store = std::move(moved);
+
+    // A streaming store abandoned halfway, like g_streaming on a reload
+    std::vector<uint8_t> file;
+    REQUIRE(chibi_test::ReadAsset("vectorwait.gif", file));
+    FrameCache partial;
+    FrameCacheBuilder builder;
+    REQUIRE(builder.Begin(file.data(), file.size(), partial));
+    for (int i = 0; i < 5; i++) builder.DecodeNext(partial);
+    CompressedFrameStore streaming;
+    REQUIRE(streaming.Begin(partial, pool));
+    REQUIRE(streaming.Append(partial));
+    CHECK(pool.Stats().references > loaded.references);
+
+    streaming.Clear();
+    for (size_t i = 0; i < gifs.size(); i++) {
+        gifs[i].cache.Clear();
+        gifs[i].store.Clear();
+    }
+    gifs.clear();
+    CHECK(pool.Empty());
+    CHECK(pool.Stats().references == 0 && pool.Stats().referencedBytes == 0 && pool.Stats().storedBytes == 0);
+}
+
+} // namespace
+
+int main() {
+    TestIdenticalBlobsShared();
+    TestHashCollisions();
+    TestConcurrentInternAndRelease();
+    TestTeardownReleasesEverything();
+    return chibi_test::Finish("FramePoolTest");
+}
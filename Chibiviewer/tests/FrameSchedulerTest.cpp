@@ -0,0 +1,191 @@
+// FrameScheduler: driven by a ManualClock ticking like the 15.6 ms Windows
+// timer, deadlines stay on the ideal timeline however late each wakeup is,
+// late wakeups skip frames, long stalls restart the timeline, undecoded
+// frames are held, and the lateness statistics match the wakeups.
+#include <cmath>
+#include <cstddef>
+#include <vector>
+
+#include "../core/Clock.h"
+#include "../core/FrameScheduler.h"
+#include "../core/PlaybackCursor.h"
+#include "TestSupport.h"
+
+using namespace chibi;
+
+namespace {
+
+const double TICK_MS = 15.6;
+const unsigned MIN_DELAY = 10;
+
+// Over many frames of 40 ms, every tick shows the frame the ideal timeline
+// calls for, each frame is shown less than a tick late, and the deadline is
+// an exact multiple of the delay. A timer re-armed from each frame's actual
+// display time falls behind by the lateness of every frame.
+void TestNoDrift() {
+    const size_t FRAMES = 12;
+    const double DELAY = 40.0;
+    std::vector<unsigned> delays(FRAMES, static_cast<unsigned>(DELAY));
+    ManualClock clock;
+    FrameScheduler scheduler(clock);
+    PlaybackCursor cursor;
+    cursor.Start(0);
+    scheduler.Start(cursor, delays, MIN_DELAY);
+
+    const int TICKS = 20000;
+    uint64_t shown = 0;
+    uint64_t ideal = 0;
+    size_t offTimeline = 0;
+    double rearmedDue = DELAY;
+    uint64_t rearmedShown = 0;
+    for (int tick = 1; tick <= TICKS; tick++) {
+        double now = tick * TICK_MS;
+        clock.Set(now);
+        if (scheduler.Advance(cursor, delays, MIN_DELAY)) shown++;
+        ideal = static_cast<uint64_t>(std::floor(now / DELAY));
+        if (cursor.frameIndex != ideal % FRAMES || scheduler.Deadline() != (ideal + 1) * DELAY) offTimeline++;
+
+        if (now >= rearmedDue) {
+            rearmedShown++;
+            rearmedDue = now + DELAY;
+        }
+    }
+    const SchedulerStats& stats = scheduler.Stats();
+    CHECK(offTimeline == 0);
+    CHECK(stats.framesPresented == shown);
+    CHECK(shown == ideal);
+    CHECK(stats.framesSkipped == 0 && stats.resyncs == 0 && stats.framesHeld == 0);
+    CHECK(stats.maxLatenessMs < TICK_MS);
+    CHECK(rearmedShown < shown);
+    std::printf("scheduler: %llu frames in %.0f s, mean lateness %.2f ms, jitter %.2f ms; "
+                "a re-armed timer showed %llu\n",
+                static_cast<unsigned long long>(shown), TICKS * TICK_MS / 1000.0, stats.MeanLatenessMs(),
+                stats.JitterMs(), static_cast<unsigned long long>(rearmedShown));
+}
+
+// A wakeup 90 ms late steps over the frames whose time passed and keeps
+// the timeline
+void TestLateWakeupSkips() {
+    std::vector<unsigned> delays(8, 40);
+    ManualClock clock(1000.0);
+    FrameScheduler scheduler(clock);
+    PlaybackCursor cursor;
+    cursor.Start(0);
+    scheduler.Start(cursor, delays, MIN_DELAY);
+    CHECK(scheduler.Deadline() == 1040.0);
+    CHECK(scheduler.MsUntilDeadline() == 40.0);
+
+    clock.Set(1039.0);
+    CHECK(!scheduler.Advance(cursor, delays, MIN_DELAY));
+
+    clock.Set(1130.0);
+    CHECK(scheduler.MsUntilDeadline() == 0.0);
+    CHECK(scheduler.Advance(cursor, delays, MIN_DELAY));
+    CHECK(cursor.frameIndex == 3);
+    CHECK(scheduler.Deadline() == 1160.0);
+    CHECK(scheduler.Stats().framesPresented == 1);
+    CHECK(scheduler.Stats().framesSkipped == 2);
+    CHECK(scheduler.Stats().lastLatenessMs == 90.0);
+    CHECK(scheduler.Stats().resyncs == 0);
+}
+
+// Anything later than MAX_CATCH_UP_MS restarts the timeline from now and
+// moves on by one frame instead of racing through the ones missed
+void TestStallResyncs() {
+    std::vector<unsigned> delays(8, 40);
+    ManualClock clock;
+    FrameScheduler scheduler(clock);
+    PlaybackCursor cursor;
+    cursor.Start(0);
+    scheduler.Start(cursor, delays, MIN_DELAY);
+
+    clock.Set(40.0 + MAX_CATCH_UP_MS);  // Exactly the limit still catches up
+    CHECK(scheduler.Advance(cursor, delays, MIN_DELAY));
+    CHECK(scheduler.Stats().resyncs == 0);
+    CHECK(cursor.frameIndex == 7);
+    CHECK(scheduler.Deadline() == 320.0);
+
+    clock.Set(320.0 + MAX_CATCH_UP_MS + 30.0);
+    CHECK(scheduler.Advance(cursor, delays, MIN_DELAY));
+    CHECK(scheduler.Stats().resyncs == 1);
+    CHECK(cursor.frameIndex == 0);
+    CHECK(scheduler.Deadline() == 320.0 + MAX_CATCH_UP_MS + 30.0 + 40.0);
+    CHECK(scheduler.Stats().framesSkipped == 6);  // All from the first catch-up
+
+    // A stopped scheduler never moves the cursor
+    scheduler.Stop();
+    clock.AdvanceMs(1000.0);
+    CHECK(!scheduler.Advance(cursor, delays, MIN_DELAY));
+    CHECK(scheduler.MsUntilDeadline() == 0.0);
+}
+
+// While only the first frames have been decoded, the last of them stays
+// up for another period each time the next one falls due
+void TestUndecodedFramesHeld() {
+    std::vector<unsigned> delays(4, 40);
+    ManualClock clock;
+    FrameScheduler scheduler(clock);
+    PlaybackCursor cursor;
+    cursor.Start(0);
+    scheduler.Start(cursor, delays, MIN_DELAY);
+
+    clock.Set(40.0);
+    CHECK(scheduler.Advance(cursor, delays, MIN_DELAY, 2));
+    CHECK(cursor.frameIndex == 1);
+    clock.Set(80.0);
+    CHECK(!scheduler.Advance(cursor, delays, MIN_DELAY, 2));
+    clock.Set(150.0);  // Late as well: one hold per period that passed
+    CHECK(!scheduler.Advance(cursor, delays, MIN_DELAY, 2));
+    CHECK(cursor.frameIndex == 1);
+    CHECK(scheduler.Stats().framesHeld == 2);
+    CHECK(scheduler.Deadline() == 160.0);
+
+    clock.Set(160.0);
+    CHECK(scheduler.Advance(cursor, delays, MIN_DELAY));
+    CHECK(cursor.frameIndex == 2);
+    CHECK(scheduler.Stats().framesHeld == 2 && scheduler.Stats().framesPresented == 2);
+}
+
+// Frames shown 2, 4 and 6 ms late: mean 4 ms, standard deviation
+// sqrt(8/3) ms. The 0 ms frame lasts the 10 ms floor.
+void TestLatenessStats() {
+    std::vector<unsigned> delays;
+    delays.push_back(40);
+    delays.push_back(40);
+    delays.push_back(0);
+    delays.push_back(40);
+    ManualClock clock;
+    FrameScheduler scheduler(clock);
+    PlaybackCursor cursor;
+    cursor.Start(0);
+    scheduler.Start(cursor, delays, MIN_DELAY);
+
+    const double wakeups[] = { 42.0, 84.0, 96.0 };
+    for (size_t i = 0; i < sizeof(wakeups) / sizeof(wakeups[0]); i++) {
+        clock.Set(wakeups[i]);
+        CHECK(scheduler.Advance(cursor, delays, MIN_DELAY));
+    }
+    CHECK(cursor.frameIndex == 3);
+    CHECK(scheduler.Deadline() == 130.0);
+
+    const SchedulerStats& stats = scheduler.Stats();
+    CHECK(stats.framesPresented == 3 && stats.framesSkipped == 0);
+    CHECK(std::fabs(stats.MeanLatenessMs() - 4.0) < 1e-9);
+    CHECK(std::fabs(stats.JitterMs() - std::sqrt(8.0 / 3.0)) < 1e-9);
+    CHECK(stats.maxLatenessMs == 6.0 && stats.lastLatenessMs == 6.0);
+
+    scheduler.ResetStats();
+    CHECK(scheduler.Stats().framesPresented == 0 && scheduler.Stats().MeanLatenessMs() == 0.0 &&
+          scheduler.Stats().JitterMs() == 0.0);
+}
+
+} // namespace
+
+int main() {
+    TestNoDrift();
+    TestLateWakeupSkips();
+    TestStallResyncs();
+    TestUndecodedFramesHeld();
+    TestLatenessStats();
+    return chibi_test::Finish("FrameSchedulerTest");
+}
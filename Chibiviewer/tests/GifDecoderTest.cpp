@@ -0,0 +1,276 @@
+// GifDecoder: the bundled animations decode to the same pixels as a plain
+// reference decoder, and frames outside the logical screen are harmless.
+#include <cstring>
+
+#include "../core/GifDecoder.h"
+#include "TestSupport.h"
+
+using namespace chibi;
+
+namespace {
+
+// Deliberately simple GIF decoder to compare against: textbook LZW with a
+// (prefix, suffix) dictionary and a byte-by-byte compositor
+struct ReferenceGif {
+    int width;
+    int height;
+    std::vector<std::vector<uint8_t> > frames;  // RGBA, straight alpha
+};
+
+bool ReferenceLzw(const std::vector<uint8_t>& data, int minCodeSize, size_t pixelCount, std::vector<uint8_t>& out) {
+    const int clearCode = 1 << minCodeSize;
+    const int endCode = clearCode + 1;
+    std::vector<int> prefix(4096, -1);
+    std::vector<uint8_t> suffix(4096, 0);
+    for (int i = 0; i < clearCode; i++) suffix[i] = static_cast<uint8_t>(i);
+
+    int codeSize = minCodeSize + 1;
+    int next = endCode + 1;
+    int previous = -1;
+    size_t bit = 0;
+    out.clear();
+
+    while (out.size() < pixelCount && bit + codeSize <= data.size() * 8) {
+        int code = 0;
+        for (int i = 0; i < codeSize; i++, bit++) {
+            code |= ((data[bit / 8] >> (bit % 8)) & 1) << i;
+        }
+
+        if (code == clearCode) {
+            codeSize = minCodeSize + 1;
+            next = endCode + 1;
+            previous = -1;
+            continue;
+        }
+        if (code == endCode) break;
+
+        std::vector<uint8_t> entry;
+        int walk = code < next ? code : previous;
+        if (code > next || walk < 0) return false;
+        for (; walk >= 0; walk = prefix[walk]) entry.insert(entry.begin(), suffix[walk]);
+        if (code == next) entry.push_back(entry[0]);
+
+        if (previous >= 0 && next < 4096) {
+            prefix[next] = previous;
+            suffix[next] = entry[0];
+            next++;
+            if (next == (1 << codeSize) && codeSize < 12) codeSize++;
+        }
+        previous = code;
+        out.insert(out.end(), entry.begin(), entry.end());
+    }
+
+    out.resize(pixelCount, 0);
+    return true;
+}
+
+bool ReferenceDecode(const std::vector<uint8_t>& file, ReferenceGif& gif) {
+    if (file.size() < 13 || std::memcmp(file.data(), "GIF", 3) != 0) return false;
+    gif.width = file[6] | (file[7] << 8);
+    gif.height = file[8] | (file[9] << 8);
+    gif.frames.clear();
+
+    size_t pos = 13;
+    std::vector<uint8_t> globalPalette;
+    if (file[10] & 0x80) {
+        size_t count = static_cast<size_t>(2) << (file[10] & 0x07);
+        globalPalette.assign(file.begin() + pos, file.begin() + pos + count * 3);
+        pos += count * 3;
+    }
+
+    std::vector<uint8_t> canvas(static_cast<size_t>(gif.width) * gif.height * 4, 0);
+    std::vector<uint8_t> saved;
+    int disposal = 0;
+    int transparent = -1;
+    int previousDisposal = 0;
+    int previousLeft = 0, previousTop = 0, previousWidth = 0, previousHeight = 0;
+
+    while (pos < file.size()) {
+        uint8_t introducer = file[pos++];
+        if (introducer == 0x3B) return true;
+
+        if (introducer == 0x21) {
+            uint8_t label = file[pos++];
+            if (label == 0xF9) {
+                disposal = (file[pos + 1] >> 2) & 0x07;
+                transparent = (file[pos + 1] & 0x01) ? file[pos + 4] : -1;
+            }
+            while (file[pos] != 0) pos += file[pos] + 1;
+            pos++;
+            continue;
+        }
+
+        if (introducer != 0x2C) return false;
+        int left = file[pos] | (file[pos + 1] << 8);
+        int top = file[pos + 2] | (file[pos + 3] << 8);
+        int width = file[pos + 4] | (file[pos + 5] << 8);
+        int height = file[pos + 6] | (file[pos + 7] << 8);
+        uint8_t packed = file[pos + 8];
+        pos += 9;
+
+        std::vector<uint8_t> palette = globalPalette;
+        if (packed & 0x80) {
+            size_t count = static_cast<size_t>(2) << (packed & 0x07);
+            palette.assign(file.begin() + pos, file.begin() + pos + count * 3);
+            pos += count * 3;
+        }
+
+        int minCodeSize = file[pos++];
+        std::vector<uint8_t> lzw;
+        while (file[pos] != 0) {
+            lzw.insert(lzw.end(), file.begin() + pos + 1, file.begin() + pos + 1 + file[pos]);
+            pos += file[pos] + 1;
+        }
+        pos++;
+
+        std::vector<uint8_t> indices;
+        if (!ReferenceLzw(lzw, minCodeSize, static_cast<size_t>(width) * height, indices)) return false;
+
+        // Row order of an interlaced image: every 8th row from 0, every
+        // 8th from 4, every 4th from 2, every 2nd from 1
+        std::vector<int> rows;
+        if (packed & 0x40) {
+            const int starts[4] = { 0, 4, 2, 1 };
+            const int steps[4] = { 8, 8, 4, 2 };
+            for (int pass = 0; pass < 4; pass++) {
+                for (int y = starts[pass]; y < height; y += steps[pass]) rows.push_back(y);
+            }
+        } else {
+            for (int y = 0; y < height; y++) rows.push_back(y);
+        }
+
+        // The previous frame's disposal
+        if (previousDisposal == GIF_DISPOSE_BACKGROUND) {
+            for (int y = previousTop; y < previousTop + previousHeight; y++) {
+                for (int x = previousLeft; x < previousLeft + previousWidth; x++) {
+                    if (x < gif.width && y < gif.height) {
+                        std::memset(&canvas[(static_cast<size_t>(y) * gif.width + x) * 4], 0, 4);
+                    }
+                }
+            }
+        } else if (previousDisposal == GIF_DISPOSE_PREVIOUS && !saved.empty()) {
+            canvas = saved;
+        }
+        if (disposal == GIF_DISPOSE_PREVIOUS) saved = canvas;
+
+        for (int row = 0; row < height; row++) {
+            int y = top + rows[row];
+            for (int x = 0; x < width; x++) {
+                int index = indices[static_cast<size_t>(row) * width + x];
+                if (index == transparent || static_cast<size_t>(index) * 3 >= palette.size()) continue;
+                if (left + x >= gif.width || y >= gif.height) continue;
+                uint8_t* pixel = &canvas[(static_cast<size_t>(y) * gif.width + left + x) * 4];
+                pixel[0] = palette[index * 3];
+                pixel[1] = palette[index * 3 + 1];
+                pixel[2] = palette[index * 3 + 2];
+                pixel[3] = 255;
+            }
+        }
+        gif.frames.push_back(canvas);
+
+        previousDisposal = disposal;
+        previousLeft = left;
+        previousTop = top;
+        previousWidth = width;
+        previousHeight = height;
+        disposal = 0;
+        transparent = -1;
+    }
+    return false;
+}
+
+void CheckMatchesReference(const char* asset) {
+    std::vector<uint8_t> file;
+    REQUIRE(chibi_test::ReadAsset(asset, file));
+
+    GifImage image;
+    REQUIRE(DecodeGif(file.data(), file.size(), image));
+    ReferenceGif reference;
+    REQUIRE(ReferenceDecode(file, reference));
+
+    CHECK(image.width == reference.width);
+    CHECK(image.height == reference.height);
+    REQUIRE(image.frames.size() == reference.frames.size());
+    CHECK(image.frames.size() > 1);
+
+    size_t mismatched = 0;
+    for (size_t i = 0; i < image.frames.size(); i++) {
+        if (image.frames[i].rgba != reference.frames[i]) mismatched++;
+    }
+    if (mismatched != 0) std::fprintf(stderr, "%s: %zu frames differ\n", asset, mismatched);
+    CHECK(mismatched == 0);
+}
+
+void TestBundledAnimationsMatchReference() {
+    CheckMatchesReference("vectormove.gif");
+    CheckMatchesReference("vectorwait.gif");
+    CheckMatchesReference("vectorsit.gif");
+    CheckMatchesReference("vectorpick.gif");
+    CheckMatchesReference("vectorlying.gif");
+}
+
+GifFrameRecord SolidFrame(int left, int top, int width, int height, int disposal, uint8_t red) {
+    GifFrameRecord frame;
+    frame.left = left;
+    frame.top = top;
+    frame.width = width;
+    frame.height = height;
+    frame.disposal = disposal;
+    frame.palette[0] = red;
+    frame.palette[3] = 255;
+    frame.indices.assign(static_cast<size_t>(width) * height, 0);
+    return frame;
+}
+
+uint8_t RedAt(const GifCanvas& canvas, int x, int y) {
+    return canvas.Pixels()[(static_cast<size_t>(y) * canvas.Width() + x) * 4];
+}
+
+// A frame entirely outside the logical screen draws nothing, and disposing
+// it to the background clears nothing
+void TestOffscreenFrameDisposal() {
+    GifCanvas canvas;
+    canvas.Reset(4, 4);
+    canvas.Compose(SolidFrame(0, 0, 4, 4, GIF_DISPOSE_NONE, 10));
+
+    canvas.Compose(SolidFrame(10, 0, 2, 2, GIF_DISPOSE_BACKGROUND, 20));
+    CHECK(canvas.LastUpdate().Empty());
+    CHECK(RedAt(canvas, 3, 0) == 10);
+
+    canvas.Compose(SolidFrame(0, 10, 2, 2, GIF_DISPOSE_BACKGROUND, 30));
+    CHECK(canvas.LastUpdate().Empty());
+
+    canvas.Compose(SolidFrame(1, 1, 1, 1, GIF_DISPOSE_NONE, 40));
+    CHECK(canvas.LastUpdate().left == 1 && canvas.LastUpdate().right == 2);
+    for (int y = 0; y < 4; y++) {
+        for (int x = 0; x < 4; x++) {
+            CHECK(RedAt(canvas, x, y) == (x == 1 && y == 1 ? 40 : 10));
+        }
+    }
+}
+
+// Only the part of a frame on the screen is drawn and later cleared
+void TestPartlyOffscreenFrameIsClipped() {
+    GifCanvas canvas;
+    canvas.Reset(4, 4);
+    canvas.Compose(SolidFrame(0, 0, 4, 4, GIF_DISPOSE_NONE, 10));
+
+    canvas.Compose(SolidFrame(3, 3, 2, 2, GIF_DISPOSE_BACKGROUND, 20));
+    PixelRect update = canvas.LastUpdate();
+    CHECK(update.left == 3 && update.top == 3 && update.right == 4 && update.bottom == 4);
+    CHECK(RedAt(canvas, 3, 3) == 20);
+
+    canvas.Compose(SolidFrame(0, 0, 1, 1, GIF_DISPOSE_NONE, 30));
+    CHECK(RedAt(canvas, 3, 3) == 0);
+    CHECK(RedAt(canvas, 2, 3) == 10);
+    CHECK(RedAt(canvas, 0, 0) == 30);
+}
+
+} // namespace
+
+int main() {
+    TestBundledAnimationsMatchReference();
+    TestOffscreenFrameDisposal();
+    TestPartlyOffscreenFrameIsClipped();
+    return chibi_test::Finish("GifDecoderTest");
+}
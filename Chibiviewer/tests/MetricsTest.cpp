@@ -0,0 +1,205 @@
+// Metrics: the histogram's buckets tile every value with at most 1/32
+// relative width, percentiles stay within a bucket of the exact ones,
+// concurrent recording loses nothing, and FrameMetrics formats one CSV row
+// per histogram and per state.
+#include <algorithm>
+#include <cmath>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../core/Metrics.h"
+#include "TestSupport.h"
+
+using namespace chibi;
+
+namespace {
+
+const uint64_t LIMIT = (1ULL << HISTOGRAM_MAX_BIT) - 1;
+
+// Each bucket starts where the previous one ends, values below 64 have
+// their own, and the rest are at most 1/32 of their lowest value wide
+void TestBucketsTile() {
+    CHECK(LatencyHistogram::BucketLow(0) == 0);
+    for (size_t i = 0; i + 1 < HISTOGRAM_BUCKETS; i++) {
+        if (LatencyHistogram::BucketLow(i + 1) != LatencyHistogram::BucketLow(i) + LatencyHistogram::BucketWidth(i)) {
+            std::fprintf(stderr, "bucket %zu does not end where %zu starts\n", i, i + 1);
+            CHECK(false);
+            return;
+        }
+        if (i >= 2 * HISTOGRAM_SUB_BUCKETS) {
+            CHECK(LatencyHistogram::BucketWidth(i) * HISTOGRAM_SUB_BUCKETS <= LatencyHistogram::BucketLow(i));
+        }
+    }
+    size_t last = HISTOGRAM_BUCKETS - 1;
+    CHECK(LatencyHistogram::BucketLow(last) + LatencyHistogram::BucketWidth(last) - 1 == LIMIT);
+}
+
+bool InBucket(uint64_t value) {
+    size_t index = LatencyHistogram::BucketIndex(value);
+    return index < HISTOGRAM_BUCKETS && LatencyHistogram::BucketLow(index) <= value &&
+           value - LatencyHistogram::BucketLow(index) < LatencyHistogram::BucketWidth(index);
+}
+
+void TestValuesLandInTheirBucket() {
+    size_t misplaced = 0;
+    for (uint64_t value = 0; value < 100000; value++) {
+        if (!InBucket(value)) misplaced++;
+    }
+    // Around every power of two up to the limit
+    for (int bit = 6; bit < HISTOGRAM_MAX_BIT; bit++) {
+        uint64_t power = 1ULL << bit;
+        const uint64_t values[] = { power - 1, power, power + 1, power + power / 2, 2 * power - 1 };
+        for (size_t v = 0; v < sizeof(values) / sizeof(values[0]); v++) {
+            if (!InBucket(values[v])) misplaced++;
+        }
+    }
+    CHECK(misplaced == 0);
+    CHECK(LatencyHistogram::BucketIndex(LIMIT) == HISTOGRAM_BUCKETS - 1);
+}
+
+void TestSmallValuesExact() {
+    LatencyHistogram histogram;
+    CHECK(histogram.Count() == 0 && histogram.PercentileUs(50.0) == 0 && histogram.MeanUs() == 0.0);
+    for (uint64_t value = 1; value <= 60; value++) histogram.Record(value);
+    CHECK(histogram.Count() == 60);
+    CHECK(histogram.MaxUs() == 60);
+    CHECK(histogram.MeanUs() == 30.5);
+    CHECK(histogram.PercentileUs(0.0) == 1);
+    CHECK(histogram.PercentileUs(50.0) == 30);
+    CHECK(histogram.PercentileUs(90.0) == 54);
+    CHECK(histogram.PercentileUs(100.0) == 60);
+    CHECK(histogram.PercentileUs(150.0) == 60);  // Clamped to 100
+
+    histogram.Reset();
+    CHECK(histogram.Count() == 0 && histogram.MaxUs() == 0 && histogram.PercentileUs(99.0) == 0);
+}
+
+// Frame times spread over six orders of magnitude, against the exact
+// nearest-rank percentiles of the same values
+void TestPercentilesAgainstExact() {
+    std::mt19937 rng(11);
+    std::uniform_real_distribution<double> exponent(0.0, 6.0);
+    LatencyHistogram histogram;
+    std::vector<uint64_t> values;
+    for (int i = 0; i < 20000; i++) {
+        uint64_t value = static_cast<uint64_t>(std::pow(10.0, exponent(rng)));
+        values.push_back(value);
+        histogram.Record(value);
+    }
+    std::sort(values.begin(), values.end());
+
+    const double percentiles[] = { 1.0, 10.0, 50.0, 90.0, 99.0, 99.9, 100.0 };
+    double worst = 0.0;
+    for (size_t p = 0; p < sizeof(percentiles) / sizeof(percentiles[0]); p++) {
+        size_t rank = static_cast<size_t>(percentiles[p] / 100.0 * values.size() + 0.5);
+        uint64_t exact = values[std::max<size_t>(rank, 1) - 1];
+        uint64_t reported = histogram.PercentileUs(percentiles[p]);
+        double error = std::fabs(static_cast<double>(reported) - static_cast<double>(exact)) / exact;
+        worst = std::max(worst, error);
+        CHECK(error <= 1.0 / HISTOGRAM_SUB_BUCKETS);
+    }
+    std::printf("histogram: worst percentile error %.2f%%\n", worst * 100.0);
+    CHECK(histogram.MaxUs() == values.back());
+    CHECK(histogram.PercentileUs(100.0) == values.back());
+}
+
+void TestRecordManyAndClamping() {
+    LatencyHistogram histogram;
+    histogram.RecordMany(500, 0);
+    CHECK(histogram.Count() == 0);
+    histogram.RecordMany(500, 99);
+    histogram.Record(LIMIT + 12345);
+    CHECK(histogram.Count() == 100);
+    CHECK(histogram.MaxUs() == LIMIT);
+    CHECK(histogram.PercentileUs(99.0) <= 500 && histogram.PercentileUs(99.0) + 8 >= 500);
+    CHECK(histogram.PercentileUs(100.0) == LIMIT);
+
+    // Milliseconds round to the nearest microsecond; nothing goes below 0
+    LatencyHistogram ms;
+    ms.RecordMs(1.2346);
+    ms.RecordMs(-3.0);
+    CHECK(ms.Count() == 2);
+    CHECK(ms.MaxUs() == 1235);
+    CHECK(ms.PercentileUs(50.0) == 0);
+}
+
+// Loader threads and the UI thread record into one histogram
+void TestConcurrentRecording() {
+    const int THREADS = 4;
+    const uint64_t PER_THREAD = 50000;
+    LatencyHistogram histogram;
+    std::vector<std::thread> threads;
+    for (int t = 0; t < THREADS; t++) {
+        threads.emplace_back([&histogram, t, PER_THREAD]() {
+            for (uint64_t i = 0; i < PER_THREAD; i++) histogram.Record((i % 1000) + static_cast<uint64_t>(t));
+        });
+    }
+    for (size_t t = 0; t < threads.size(); t++) threads[t].join();
+
+    CHECK(histogram.Count() == THREADS * PER_THREAD);
+    CHECK(histogram.MaxUs() == 999 + THREADS - 1);
+    double expectedMean = 0.0;
+    for (int t = 0; t < THREADS; t++) expectedMean += 499.5 + t;
+    expectedMean /= THREADS;
+    CHECK(std::fabs(histogram.MeanUs() - expectedMean) < 1e-9);
+}
+
+size_t CountOf(const std::string& text, char c) {
+    return static_cast<size_t>(std::count(text.begin(), text.end(), c));
+}
+
+void TestFrameMetricsFormatting() {
+    FrameMetrics metrics;
+    metrics.Reset(1000.0);
+    metrics.Record(METRIC_COMPOSE, 0.02);
+    metrics.Record(METRIC_COMPOSE, 0.05);
+    metrics.Record(METRIC_PRESENT, 1.5);
+    metrics.CountEntry(STATE_MOVE);
+    metrics.CountFrame(STATE_MOVE);
+    metrics.CountFrame(STATE_MOVE);
+    metrics.CountFrame(STATE_SIT);
+    metrics.CountFrame(static_cast<CharacterState>(METRICS_STATE_COUNT));  // Ignored
+    CHECK(metrics.StateFrames(STATE_MOVE) == 2 && metrics.StateEntries(STATE_MOVE) == 1);
+    CHECK(metrics.Histogram(METRIC_COMPOSE).Count() == 2);
+
+    std::vector<std::string> lines;
+    metrics.FormatSummary(lines);
+    CHECK(lines.size() == METRIC_COUNT + 1);
+    CHECK(lines[METRIC_COMPOSE].find("compose") == 0 && lines[METRIC_COMPOSE].find("(n=2)") != std::string::npos);
+    CHECK(lines.back().find("move 2") != std::string::npos);
+
+    std::string csv;
+    metrics.AppendCsv(csv, 2000.0);
+    CHECK(CountOf(csv, '\n') == METRIC_COUNT + METRICS_STATE_COUNT);
+    const size_t columns = CountOf(FrameMetrics::CsvHeader(), ',');
+    size_t start = 0;
+    size_t badRows = 0;
+    while (start < csv.size()) {
+        size_t end = csv.find('\n', start);
+        std::string row = csv.substr(start, end - start);
+        if (CountOf(row, ',') != columns || row.find("1000,2000,") != 0) badRows++;
+        start = end + 1;
+    }
+    CHECK(badRows == 0);
+    CHECK(csv.find("1000,2000,compose,2,20,50,50,50,35.0,\n") != std::string::npos);
+    CHECK(csv.find("1000,2000,state:move,2,,,,,,1\n") != std::string::npos);
+
+    metrics.Reset(2000.0);
+    CHECK(metrics.SinceMs() == 2000.0);
+    CHECK(metrics.Histogram(METRIC_PRESENT).Count() == 0 && metrics.StateFrames(STATE_MOVE) == 0);
+}
+
+} // namespace
+
+int main() {
+    TestBucketsTile();
+    TestValuesLandInTheirBucket();
+    TestSmallValuesExact();
+    TestPercentilesAgainstExact();
+    TestRecordManyAndClamping();
+    TestConcurrentRecording();
+    TestFrameMetricsFormatting();
+    return chibi_test::Finish("MetricsTest");
+}
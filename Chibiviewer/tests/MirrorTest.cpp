@@ -0,0 +1,85 @@
+// Mirror: every SIMD kernel flips rows exactly like the scalar one, at
+// every width, and the frame cache's mirrored walk frames are true flips.
+#include <cstring>
+#include <random>
+#include <vector>
+
+#include "../core/FrameCache.h"
+#include "../core/Mirror.h"
+#include "TestSupport.h"
+
+using namespace chibi;
+
+namespace {
+
+const uint32_t GUARD = 0xDEADBEEFu;
+
+// Mirrors rows of 0..70 pixels with kernel and compares them with the
+// scalar loop; the pixels around the row must stay untouched
+void CheckKernel(const char* name, MirrorRowFunc kernel) {
+    std::mt19937 rng(3);
+    size_t mismatched = 0;
+    for (int width = 0; width <= 70; width++) {
+        std::vector<uint32_t> src(width);
+        for (int x = 0; x < width; x++) src[x] = static_cast<uint32_t>(rng());
+
+        std::vector<uint32_t> expected(width);
+        MirrorRowScalar(src.data(), expected.data(), width);
+        std::vector<uint32_t> actual(width + 2, GUARD);
+        kernel(src.data(), actual.data() + 1, width);
+
+        bool same = actual.front() == GUARD && actual.back() == GUARD;
+        for (int x = 0; x < width && same; x++) same = actual[x + 1] == expected[x];
+        if (!same) mismatched++;
+    }
+    if (mismatched != 0) std::fprintf(stderr, "%s: %zu widths differ from the scalar kernel\n", name, mismatched);
+    CHECK(mismatched == 0);
+}
+
+void TestScalarReverses() {
+    uint32_t src[5] = { 1, 2, 3, 4, 5 };
+    uint32_t dst[5] = { 0, 0, 0, 0, 0 };
+    MirrorRowScalar(src, dst, 5);
+    CHECK(dst[0] == 5 && dst[1] == 4 && dst[2] == 3 && dst[3] == 2 && dst[4] == 1);
+}
+
+void TestKernelsMatchScalar() {
+    CheckKernel("selected", GetMirrorRowFunc());
+#if CHIBI_X86
+    const CpuFeatures& cpu = GetCpuFeatures();
+    if (cpu.sse2) CheckKernel("sse2", MirrorRowSse2);
+    if (cpu.avx2) CheckKernel("avx2", MirrorRowAvx2);
+#endif
+}
+
+// Every mirrored walk frame is the original with each row reversed
+void TestMirroredFramesOfBundledGif() {
+    std::vector<uint8_t> file;
+    REQUIRE(chibi_test::ReadAsset("vectormove.gif", file));
+    FrameCache cache;
+    REQUIRE(BuildFrameCache(file.data(), file.size(), cache));
+    cache.EnsureMirrored();
+
+    size_t mismatched = 0;
+    std::vector<uint32_t> row(cache.width);
+    for (size_t frame = 0; frame < cache.frameCount; frame++) {
+        const uint8_t* original = reinterpret_cast<const uint8_t*>(cache.Frame(frame));
+        const uint8_t* mirrored = reinterpret_cast<const uint8_t*>(cache.MirroredFrame(frame));
+        for (int y = 0; y < cache.height; y++) {
+            MirrorRowScalar(reinterpret_cast<const uint32_t*>(original + y * cache.stride), row.data(), cache.width);
+            if (std::memcmp(row.data(), mirrored + y * cache.stride, static_cast<size_t>(cache.width) * 4) != 0) {
+                mismatched++;
+            }
+        }
+    }
+    CHECK(mismatched == 0);
+}
+
+} // namespace
+
+int main() {
+    TestScalarReverses();
+    TestKernelsMatchScalar();
+    TestMirroredFramesOfBundledGif();
+    return chibi_test::Finish("MirrorTest");
+}
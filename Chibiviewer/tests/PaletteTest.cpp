@@ -0,0 +1,95 @@
+// Palette: every SIMD kernel expands index rows exactly like the scalar
+// loop, at every width, leaving transparent entries' destination pixels
+// and the pixels around the row untouched.
+#include <random>
+#include <vector>
+
+#include "../core/Palette.h"
+#include "TestSupport.h"
+
+using namespace chibi;
+
+namespace {
+
+const uint32_t GUARD = 0xDEADBEEFu;
+
+// A palette with every fourth entry transparent: alpha 0 but colour bits
+// set, so a kernel that tests the wrong byte shows up. The rest have any
+// non-zero alpha.
+void RandomPalette(std::mt19937& rng, uint32_t* palette) {
+    for (int i = 0; i < 256; i++) {
+        uint32_t color = static_cast<uint32_t>(rng()) & 0x00FFFFFFu;
+        uint32_t alpha = rng() % 4 == 0 ? 0u : 1u + static_cast<uint32_t>(rng() % 255);
+        palette[i] = color | (alpha << 24);
+    }
+}
+
+// Expands rows of 0..70 indices onto random existing pixels and compares
+// them with the scalar loop
+void CheckKernel(const char* name, ExpandPaletteRowFunc kernel) {
+    std::mt19937 rng(7);
+    uint32_t palette[256];
+    size_t mismatched = 0;
+    for (int trial = 0; trial < 20; trial++) {
+        RandomPalette(rng, palette);
+        for (int width = 0; width <= 70; width++) {
+            std::vector<uint8_t> indices(width);
+            for (int x = 0; x < width; x++) indices[x] = static_cast<uint8_t>(rng());
+
+            std::vector<uint32_t> expected(width + 2, GUARD);
+            for (int x = 0; x < width; x++) expected[x + 1] = static_cast<uint32_t>(rng());
+            std::vector<uint32_t> actual = expected;
+
+            ExpandPaletteRowScalar(indices.data(), palette, expected.data() + 1, width);
+            kernel(indices.data(), palette, actual.data() + 1, width);
+            if (actual != expected) mismatched++;
+        }
+    }
+    if (mismatched != 0) std::fprintf(stderr, "%s: %zu rows differ from the scalar kernel\n", name, mismatched);
+    CHECK(mismatched == 0);
+}
+
+void TestScalarSkipsTransparent() {
+    uint32_t palette[256] = { 0 };
+    palette[1] = 0xFF112233u;
+    palette[2] = 0x00445566u;  // Transparent
+    palette[3] = 0x01778899u;  // Barely opaque still counts
+    uint8_t indices[4] = { 1, 2, 3, 0 };
+    uint32_t dst[4] = { 7, 8, 9, 10 };
+    ExpandPaletteRowScalar(indices, palette, dst, 4);
+    CHECK(dst[0] == 0xFF112233u);
+    CHECK(dst[1] == 8);
+    CHECK(dst[2] == 0x01778899u);
+    CHECK(dst[3] == 10);
+}
+
+void TestKernelsMatchScalar() {
+    CheckKernel("selected", GetExpandPaletteRowFunc());
+#if CHIBI_X86
+    if (GetCpuFeatures().avx2) CheckKernel("avx2", ExpandPaletteRowAvx2);
+#endif
+}
+
+// Every index value, in a row long enough for the vector loop
+void TestEveryIndex() {
+    std::mt19937 rng(8);
+    uint32_t palette[256];
+    RandomPalette(rng, palette);
+    std::vector<uint8_t> indices(256);
+    for (int i = 0; i < 256; i++) indices[i] = static_cast<uint8_t>(255 - i);
+
+    std::vector<uint32_t> expected(256, GUARD);
+    std::vector<uint32_t> actual(256, GUARD);
+    ExpandPaletteRowScalar(indices.data(), palette, expected.data(), 256);
+    GetExpandPaletteRowFunc()(indices.data(), palette, actual.data(), 256);
+    CHECK(actual == expected);
+}
+
+} // namespace
+
+int main() {
+    TestScalarSkipsTransparent();
+    TestKernelsMatchScalar();
+    TestEveryIndex();
+    return chibi_test::Finish("PaletteTest");
+}
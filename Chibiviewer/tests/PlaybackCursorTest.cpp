@@ -0,0 +1,108 @@
+// PlaybackCursor: frame delays with their floor, stepping, and state changes
+// that allocate nothing once the engine has warmed up.
+#include <vector>
+
+#include "../core/Engine.h"
+#include "../core/PlaybackCursor.h"
+#include "../tools/AllocationCounter.h"
+#include "TestSupport.h"
+
+using namespace chibi;
+
+namespace {
+
+// Delays of 20, 20, 40 and 0 ms with a 16 ms floor: 20, 20, 40, 16
+const unsigned MIN_DELAY = 16;
+
+std::vector<unsigned> Delays() {
+    std::vector<unsigned> delays;
+    delays.push_back(20);
+    delays.push_back(20);
+    delays.push_back(40);
+    delays.push_back(0);
+    return delays;
+}
+
+void TestDelays() {
+    std::vector<unsigned> delays = Delays();
+    CHECK(PlaybackCursor::FrameDelay(delays, 0, MIN_DELAY) == 20);
+    CHECK(PlaybackCursor::FrameDelay(delays, 2, MIN_DELAY) == 40);
+    CHECK(PlaybackCursor::FrameDelay(delays, 3, MIN_DELAY) == MIN_DELAY);
+    CHECK(PlaybackCursor::FrameDelay(delays, 9, MIN_DELAY) == MIN_DELAY);  // Past the table
+    CHECK(PlaybackCursor::FrameDelay(delays, 3, 0) == 1);
+
+    PlaybackCursor cursor;
+    cursor.Start(1);
+    CHECK(cursor.gifIndex == 1 && cursor.frameIndex == 0);
+    cursor.Step(delays.size());
+    cursor.Step(delays.size());
+    CHECK(cursor.CurrentDelay(delays, MIN_DELAY) == 40);
+}
+
+void TestStepAndStop() {
+    PlaybackCursor cursor;
+    cursor.Start(0);
+    cursor.Step(3);
+    cursor.Step(3);
+    cursor.Step(3);
+    CHECK(cursor.frameIndex == 0);
+
+    cursor.Step(3);
+    cursor.Stop();
+    CHECK(!cursor.active);
+    CHECK(cursor.frameIndex == 0);
+    cursor.Step(3);
+    CHECK(cursor.frameIndex == 0);
+}
+
+void TestCursorAllocatesNothing() {
+    std::vector<unsigned> delays = Delays();
+    PlaybackCursor cursor;
+    size_t before = chibi_alloc::Allocations();
+    for (int i = 0; i < 1000; i++) {
+        cursor.Start(i % 5);
+        for (int step = 0; step < i % 7; step++) cursor.Step(delays.size());
+    }
+    CHECK(chibi_alloc::Allocations() == before);
+}
+
+// Once every state has been shown, switching states only resets the
+// cursor: no frame list is rebuilt and nothing is allocated
+void TestStateChangesAllocateNothing() {
+    Engine engine(EngineConfig(), 7);
+    engine.SetWindow(PixelRect::Make(100, 100, 300, 300));
+    engine.SetScreen(1920, 1080);
+    std::vector<unsigned> delays(54, 40);
+    PixelRect view = PixelRect::Make(0, 0, 400, 400);
+    engine.AddAnimation(ANIMATION_WAIT, "wait", 400, 400, delays, delays.size(), view);
+    engine.AddAnimation(ANIMATION_MOVE, "move", 400, 400, delays, delays.size(), view);
+    engine.AddAnimation(ANIMATION_SIT, "sit", 400, 400, delays, delays.size(), view);
+    engine.AddAnimation(ANIMATION_MISC, "misc", 400, 400, delays, delays.size(), view);
+    engine.SetMode(MODE_MANUAL);
+
+    std::vector<EngineCommand> commands;
+    for (int i = 0; i < 8; i++) {
+        engine.CycleState();
+        engine.TakeCommands(commands);
+    }
+
+    size_t before = chibi_alloc::Allocations();
+    for (int i = 0; i < 1000; i++) {
+        engine.CycleState();
+        engine.Tick(10.0);
+        engine.TakeCommands(commands);
+    }
+    size_t allocations = chibi_alloc::Allocations() - before;
+    if (allocations != 0) std::fprintf(stderr, "%zu allocations in 1000 state changes\n", allocations);
+    CHECK(allocations == 0);
+}
+
+} // namespace
+
+int main() {
+    TestDelays();
+    TestStepAndStop();
+    TestCursorAllocatesNothing();
+    TestStateChangesAllocateNothing();
+    return chibi_test::Finish("PlaybackCursorTest");
+}
@@ -0,0 +1,144 @@
+// Simulation: how far the character walks depends only on the time that
+// passed, not on how regular the updates were; bounces keep the distance;
+// rendering between steps blends the last two positions; and a long stall
+// is clamped to MAX_SIMULATION_DELTA_MS.
+#include <cmath>
+#include <random>
+
+#include "../core/Clock.h"
+#include "../core/Simulation.h"
+#include "TestSupport.h"
+
+using namespace chibi;
+
+namespace {
+
+const double SPEED = 120.0;  // Pixels per second
+
+// Walks right from 0 with nothing in the way for totalMs, in updates of
+// 16 ms or of 1 to 30 ms at random
+double WalkFor(double totalMs, bool jittered, uint64_t& steps) {
+    ManualClock clock;
+    Simulation simulation(clock);
+    simulation.StartWalk(0.0, 0.0, 1e9, true, SPEED);
+    std::mt19937 rng(5);
+    std::uniform_int_distribution<int> tick(1, 30);
+    double now = 0.0;
+    while (now < totalMs) {
+        now = std::min(totalMs, now + (jittered ? tick(rng) : 16.0));
+        clock.Set(now);
+        simulation.Update();
+    }
+    steps = simulation.Steps();
+    return simulation.WalkX();
+}
+
+void TestDistanceIndependentOfTicks() {
+    const double TOTAL_MS = 16.0 * 3000;
+    uint64_t steadySteps = 0;
+    uint64_t jitteredSteps = 0;
+    double steady = WalkFor(TOTAL_MS, false, steadySteps);
+    double jittered = WalkFor(TOTAL_MS, true, jitteredSteps);
+    CHECK(steadySteps == jitteredSteps);
+    CHECK(std::fabs(steady - jittered) < 1e-6);
+    // The position read trails the last step by one step's worth of time
+    CHECK(std::fabs(steady - SPEED * (TOTAL_MS - SIMULATION_STEP_MS) / 1000.0) < 1e-6);
+    std::printf("simulation: %.6f px steady, %.6f px jittered after %.0f s\n", steady, jittered, TOTAL_MS / 1000.0);
+}
+
+// With 10 ms steps and updates the position read is exactly the one before
+// the last step. Unfolding the bounces, it has gone speed * time along a
+// path that turns at 0 and 500.
+void TestBounceKeepsDistance() {
+    const double STEP_MS = 10.0;
+    const double MIN_X = 0.0;
+    const double MAX_X = 500.0;
+    const double START_X = 400.0;
+    const double BOUNCE_SPEED = 230.0;
+    ManualClock clock;
+    Simulation simulation(clock, STEP_MS);
+    simulation.StartWalk(START_X, MIN_X, MAX_X, true, BOUNCE_SPEED);
+
+    size_t wrong = 0;
+    for (int i = 1; i <= 2000; i++) {
+        clock.Set(i * STEP_MS);
+        simulation.Update();
+        double shown = std::fmod(START_X + BOUNCE_SPEED * (i - 1) * STEP_MS / 1000.0, 2.0 * MAX_X);
+        double walked = std::fmod(START_X + BOUNCE_SPEED * i * STEP_MS / 1000.0, 2.0 * MAX_X);
+        double expected = shown <= MAX_X ? shown : 2.0 * MAX_X - shown;
+        bool facingRight = walked < MAX_X;
+        if (std::fabs(simulation.WalkX() - expected) > 1e-6 || simulation.FacingRight() != facingRight) wrong++;
+        if (simulation.WalkX() < MIN_X || simulation.WalkX() > MAX_X) wrong++;
+    }
+    CHECK(wrong == 0);
+    CHECK(simulation.Steps() == 2000);
+}
+
+// Between steps, the position read lies Alpha() of the way from the
+// position before the last step to the one after it
+void TestInterpolation() {
+    ManualClock clock;
+    Simulation simulation(clock);
+    simulation.StartWalk(0.0, 0.0, 1e9, true, SPEED);
+    const double stepPixels = SPEED * simulation.StepMs() / 1000.0;
+    std::mt19937 rng(9);
+    std::uniform_real_distribution<double> tick(0.5, 40.0);
+
+    size_t outOfRange = 0;
+    double previous = 0.0;
+    for (int i = 0; i < 5000; i++) {
+        clock.AdvanceMs(tick(rng));
+        simulation.Update();
+        double alpha = simulation.Alpha();
+        double x = simulation.WalkX();
+        double last = simulation.Steps() * stepPixels;
+        if (alpha < 0.0 || alpha >= 1.0) outOfRange++;
+        if (simulation.Steps() > 0 && std::fabs(x - (last - stepPixels + alpha * stepPixels)) > 1e-6) outOfRange++;
+        if (x < previous) outOfRange++;  // Walking right never moves back
+        previous = x;
+    }
+    CHECK(outOfRange == 0);
+    CHECK(simulation.MsUntilNextStep() > 0.0 && simulation.MsUntilNextStep() <= simulation.StepMs());
+}
+
+// A 10 s stall runs no more steps than MAX_SIMULATION_DELTA_MS holds, and
+// time running backwards or passing while idle runs none
+void TestHugeDeltaClamped() {
+    ManualClock clock(500.0);
+    Simulation simulation(clock);
+    simulation.StartWalk(0.0, 0.0, 1e9, true, SPEED);
+
+    clock.AdvanceMs(10000.0);
+    int steps = simulation.Update();
+    CHECK(steps * SIMULATION_STEP_MS <= MAX_SIMULATION_DELTA_MS + 1e-9);
+    CHECK((steps + 1) * SIMULATION_STEP_MS > MAX_SIMULATION_DELTA_MS);
+    CHECK(simulation.Alpha() >= 0.0 && simulation.Alpha() < 1.0);
+    double clamped = SPEED * (MAX_SIMULATION_DELTA_MS - SIMULATION_STEP_MS) / 1000.0;
+    CHECK(std::fabs(simulation.WalkX() - clamped) < 1e-6);
+
+    clock.AdvanceMs(-100.0);
+    CHECK(simulation.Update() == 0);
+
+    clock.AdvanceMs(60000.0);
+    simulation.Reset();
+    CHECK(simulation.Update() == 0);
+    CHECK(std::fabs(simulation.WalkX() - clamped) < 1e-6);
+
+    // Steps still run while stopped; the position read catches up with
+    // the last step and stays there
+    simulation.StopWalk();
+    clock.AdvanceMs(100.0);
+    CHECK(simulation.Update() >= 5);
+    CHECK(!simulation.Walking());
+    CHECK(std::fabs(simulation.WalkX() - SPEED * MAX_SIMULATION_DELTA_MS / 1000.0) < 1e-6);
+}
+
+} // namespace
+
+int main() {
+    TestDistanceIndependentOfTicks();
+    TestBounceKeepsDistance();
+    TestInterpolation();
+    TestHugeDeltaClamped();
+    return chibi_test::Finish("SimulationTest");
+}
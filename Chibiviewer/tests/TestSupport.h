@@ -0,0 +1,72 @@
+// Shared helpers for the core tests.
+//
+// There is no test framework: every test is a small program whose checks
+// print where they failed and make it exit with status 1. The bundled
+// sample animations are found through CHIBI_SOURCE_DIR, the Chibiviewer
+// folder, which the build defines.
+#pragma once
+
+#include <cstdio>
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#ifndef CHIBI_SOURCE_DIR
+#define CHIBI_SOURCE_DIR "."
+#endif
+
+namespace chibi_test {
+
+inline int& FailureCount() {
+    static int failures = 0;
+    return failures;
+}
+
+inline void ReportFailure(const char* file, int line, const char* expression) {
+    std::fprintf(stderr, "%s:%d: check failed: %s\n", file, line, expression);
+    FailureCount()++;
+}
+
+// Exit status for main: 0 if every check passed
+inline int Finish(const char* name) {
+    if (FailureCount() > 0) {
+        std::fprintf(stderr, "%s: %d check%s failed\n", name, FailureCount(), FailureCount() == 1 ? "" : "s");
+        return 1;
+    }
+    std::printf("%s: all checks passed\n", name);
+    return 0;
+}
+
+// Path of a file relative to the Chibiviewer folder, e.g. "vectormove.gif"
+// or "../vectorviewer/vectormove.webp"
+inline std::string AssetPath(const std::string& relative) {
+    return std::string(CHIBI_SOURCE_DIR) + "/" + relative;
+}
+
+inline bool ReadAsset(const std::string& relative, std::vector<uint8_t>& bytes) {
+    FILE* file = std::fopen(AssetPath(relative).c_str(), "rb");
+    if (!file) return false;
+    bytes.clear();
+    uint8_t buffer[65536];
+    size_t read;
+    while ((read = std::fread(buffer, 1, sizeof(buffer), file)) > 0) bytes.insert(bytes.end(), buffer, buffer + read);
+    std::fclose(file);
+    return true;
+}
+
+} // namespace chibi_test
+
+#define CHECK(expression) \
+    do { \
+        if (!(expression)) chibi_test::ReportFailure(__FILE__, __LINE__, #expression); \
+    } while (0)
+
+// Stops the current test function when a check it depends on fails
+#define REQUIRE(expression) \
+    do { \
+        if (!(expression)) { \
+            chibi_test::ReportFailure(__FILE__, __LINE__, #expression); \
+            return; \
+        } \
+    } while (0)
@@ -0,0 +1,298 @@
+// Trace: spans and instants are only recorded while tracing is on, full
+// rings keep their newest events and count the rest as dropped, threads get
+// their own ids and keep their names after exiting, and the export is valid
+// JSON in start order with names escaped. Everything records into
+// GlobalTracer(), as threads may only record into a tracer that outlives
+// them; each Start begins a new trace.
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../core/Trace.h"
+#include "TestSupport.h"
+
+using namespace chibi;
+
+namespace {
+
+// A strict JSON syntax check, enough to tell whether a trace viewer would
+// load the file
+class JsonChecker {
+public:
+    explicit JsonChecker(const std::string& text) : p(text.c_str()), end(text.c_str() + text.size()) {}
+
+    bool Valid() {
+        SkipSpace();
+        if (!Value()) return false;
+        SkipSpace();
+        return p == end;
+    }
+
+private:
+    void SkipSpace() {
+        while (p < end && (*p == ' ' || *p == '\n' || *p == '\r' || *p == '\t')) p++;
+    }
+
+    bool Literal(const char* word) {
+        size_t length = std::strlen(word);
+        if (static_cast<size_t>(end - p) < length || std::strncmp(p, word, length) != 0) return false;
+        p += length;
+        return true;
+    }
+
+    bool String() {
+        if (p == end || *p != '"') return false;
+        for (p++; p < end; p++) {
+            unsigned char c = static_cast<unsigned char>(*p);
+            if (c == '"') {
+                p++;
+                return true;
+            }
+            if (c < 0x20) return false;
+            if (c == '\\') {
+                if (++p == end) return false;
+                if (*p == 'u') {
+                    for (int i = 0; i < 4; i++) {
+                        if (++p == end || !std::strchr("0123456789abcdefABCDEF", *p)) return false;
+                    }
+                } else if (!std::strchr("\"\\/bfnrt", *p)) {
+                    return false;
+                }
+            }
+        }
+        return false;
+    }
+
+    bool Number() {
+        const char* start = p;
+        if (p < end && *p == '-') p++;
+        size_t digits = 0;
+        while (p < end && *p >= '0' && *p <= '9') p++, digits++;
+        if (digits == 0) return false;
+        if (p < end && *p == '.') {
+            p++;
+            digits = 0;
+            while (p < end && *p >= '0' && *p <= '9') p++, digits++;
+            if (digits == 0) return false;
+        }
+        return p > start;
+    }
+
+    // Comma-separated items between open and close; object items are
+    // "key": value pairs
+    bool Sequence(char close, bool object) {
+        p++;
+        SkipSpace();
+        if (p < end && *p == close) {
+            p++;
+            return true;
+        }
+        while (p < end) {
+            SkipSpace();
+            if (object) {
+                if (!String()) return false;
+                SkipSpace();
+                if (p == end || *p++ != ':') return false;
+                SkipSpace();
+            }
+            if (!Value()) return false;
+            SkipSpace();
+            if (p < end && *p == ',') {
+                p++;
+            } else {
+                return p < end && *p++ == close;
+            }
+        }
+        return false;
+    }
+
+    bool Value() {
+        if (p == end) return false;
+        switch (*p) {
+            case '{': return Sequence('}', true);
+            case '[': return Sequence(']', false);
+            case '"': return String();
+            case 't': return Literal("true");
+            case 'f': return Literal("false");
+            case 'n': return Literal("null");
+            default: return Number();
+        }
+    }
+
+    const char* p;
+    const char* end;
+};
+
+bool ValidJson(const std::string& text) {
+    return JsonChecker(text).Valid();
+}
+
+size_t Occurrences(const std::string& text, const std::string& pattern) {
+    size_t count = 0;
+    for (size_t at = text.find(pattern); at != std::string::npos; at = text.find(pattern, at + 1)) count++;
+    return count;
+}
+
+void TestCheckerRejectsBadJson() {
+    CHECK(ValidJson("{\"a\":[1,-2.5,\"x\\u0001\",true,null],\"b\":{}}"));
+    CHECK(!ValidJson("{\"a\":1,}"));
+    CHECK(!ValidJson("{\"a\":\"unterminated}"));
+    CHECK(!ValidJson("{\"a\":\"raw\ncontrol\"}"));
+    CHECK(!ValidJson("[1 2]"));
+}
+
+void TestOnlyWhileEnabled() {
+    Tracer& tracer = GlobalTracer();
+    tracer.Instant("before", "test");
+    tracer.Complete("before", "test", 0.0);
+    CHECK(tracer.EventCount() == 0);
+
+    tracer.Start();
+    double start = tracer.NowUs();
+    tracer.Complete("span", "test", start, "frame", 7);
+    tracer.Instant("state", "test");
+    tracer.Stop();
+    tracer.Instant("after", "test");
+    CHECK(tracer.EventCount() == 2 && tracer.DroppedCount() == 0);
+
+    std::string json;
+    tracer.AppendChromeJson(json);
+    CHECK(ValidJson(json));
+    CHECK(json.find("\"name\":\"span\",\"cat\":\"test\",\"ph\":\"X\"") != std::string::npos);
+    CHECK(json.find("\"args\":{\"frame\":7}") != std::string::npos);
+    CHECK(json.find("\"name\":\"state\",\"cat\":\"test\",\"ph\":\"i\",\"s\":\"t\"") != std::string::npos);
+    CHECK(json.find("before") == std::string::npos && json.find("after") == std::string::npos);
+
+    // A new trace starts empty
+    tracer.Start();
+    CHECK(tracer.EventCount() == 0);
+    tracer.Stop();
+}
+
+// The newest events survive a full ring, in order. Only a thread that
+// records for the first time gets a ring of the new size.
+void TestRingOverwritesOldest() {
+    Tracer& tracer = GlobalTracer();
+    tracer.Start(8);
+    std::thread small([&tracer]() {
+        for (int i = 0; i < 20; i++) tracer.Instant("tick", "test", "i", i);
+    });
+    small.join();
+    tracer.Stop();
+    CHECK(tracer.EventCount() == 8);
+    CHECK(tracer.DroppedCount() == 12);
+
+    std::string json;
+    tracer.AppendChromeJson(json);
+    CHECK(ValidJson(json));
+    CHECK(Occurrences(json, "\"name\":\"tick\"") == 8);
+    CHECK(json.find("{\"i\":11}") == std::string::npos);
+    size_t previous = 0;
+    bool ordered = true;
+    for (int i = 12; i < 20; i++) {
+        std::string arg = "{\"i\":" + std::to_string(i) + "}";
+        size_t at = json.find(arg);
+        if (at == std::string::npos || at < previous) ordered = false;
+        previous = at;
+    }
+    CHECK(ordered);
+}
+
+void TestNamesEscaped() {
+    Tracer& tracer = GlobalTracer();
+    tracer.Start();
+    tracer.NameThread("main \"ui\"");
+    tracer.Instant("quote\" back\\slash\ttab", "cat\negory");
+    tracer.Stop();
+
+    std::string json;
+    tracer.AppendChromeJson(json);
+    CHECK(ValidJson(json));
+    CHECK(json.find("\"quote\\\" back\\\\slash\\u0009tab\"") != std::string::npos);
+    CHECK(json.find("\"cat\\u000aegory\"") != std::string::npos);
+    CHECK(json.find("\"thread_name\",\"ph\":\"M\"") != std::string::npos);
+    CHECK(json.find("\"main \\\"ui\\\"\"") != std::string::npos);
+}
+
+// Threads record at once into their own rings; a thread started after they
+// exit reuses a ring under a new id, and the exited threads keep their names
+void TestThreads() {
+    Tracer& tracer = GlobalTracer();
+    tracer.Start();
+    tracer.NameThread("main");
+    tracer.Instant("main_event", "test");
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; t++) {
+        threads.emplace_back([&tracer]() {
+            tracer.NameThread("worker");
+            for (int i = 0; i < 1000; i++) {
+                double start = tracer.NowUs();
+                tracer.Complete("work", "test", start, "i", i);
+            }
+        });
+    }
+    for (size_t t = 0; t < threads.size(); t++) threads[t].join();
+    std::thread late([&tracer]() { tracer.Instant("late", "test"); });
+    late.join();
+    tracer.Stop();
+
+    CHECK(tracer.EventCount() == 1 + 4 * 1000 + 1);
+    CHECK(tracer.DroppedCount() == 0);
+
+    std::string json;
+    tracer.AppendChromeJson(json);
+    CHECK(ValidJson(json));
+    CHECK(Occurrences(json, "\"name\":\"work\"") == 4000);
+    CHECK(Occurrences(json, "\"args\":{\"name\":\"worker\"}") == 4);
+    CHECK(json.find("\"args\":{\"name\":\"main\"}") != std::string::npos);
+    CHECK(json.find("\"name\":\"late\",\"cat\":\"test\",\"ph\":\"i\"") != std::string::npos);
+
+    // Sorted by start time across threads
+    size_t at = 0;
+    double previous = -1.0;
+    bool sorted = true;
+    while ((at = json.find("\"ts\":", at)) != std::string::npos) {
+        at += 5;
+        double ts = std::strtod(json.c_str() + at, nullptr);
+        if (ts < previous) sorted = false;
+        previous = ts;
+    }
+    CHECK(sorted);
+}
+
+// TraceScope records into the global tracer only if tracing was on when
+// the scope began
+void TestScopes() {
+    Tracer& tracer = GlobalTracer();
+    {
+        TraceScope off("off", "test");
+    }
+    tracer.Start();
+    {
+        TraceScope span("decode", "load");
+        span.SetArg("frames", 80);
+    }
+    tracer.Stop();
+    CHECK(tracer.EventCount() == 1);
+
+    std::string json;
+    tracer.AppendChromeJson(json);
+    CHECK(ValidJson(json));
+    CHECK(json.find("\"name\":\"decode\",\"cat\":\"load\",\"ph\":\"X\"") != std::string::npos);
+    CHECK(json.find("\"args\":{\"frames\":80}") != std::string::npos);
+    CHECK(json.find("\"off\"") == std::string::npos);
+}
+
+} // namespace
+
+int main() {
+    TestCheckerRejectsBadJson();
+    TestOnlyWhileEnabled();
+    TestNamesEscaped();
+    TestThreads();
+    TestScopes();
+    TestRingOverwritesOldest();
+    return chibi_test::Finish("TraceTest");
+}
@@ -0,0 +1,139 @@
+// Trim: opaque bounds match a pixel-by-pixel scan, on made-up frames and on
+// every bundled GIF and WebP, the trimmed view holds every frame and its
+// mirror, and the feet stay in place on screen across views.
+#include <vector>
+
+#include "../core/FrameCache.h"
+#include "../core/Trim.h"
+#include "TestSupport.h"
+
+using namespace chibi;
+
+namespace {
+
+const char* const ASSETS[] = {
+    "vectormove.gif", "vectorwait.gif", "vectorsit.gif", "vectorpick.gif", "vectorlying.gif",
+    "../vectorviewer/vectormove.webp", "../vectorviewer/vectorwait.webp", "../vectorviewer/vectorsit.webp",
+    "../vectorviewer/vectorpick.webp", "../vectorviewer/vectorlying.webp",
+};
+
+// The box every non-zero pixel falls in, one pixel at a time
+PixelRect ScanBounds(const uint32_t* frame, int width, int height, size_t stride, PixelRect bounds) {
+    const uint8_t* base = reinterpret_cast<const uint8_t*>(frame);
+    for (int y = 0; y < height; y++) {
+        const uint32_t* row = reinterpret_cast<const uint32_t*>(base + y * stride);
+        for (int x = 0; x < width; x++) {
+            if (row[x] != 0) bounds = PixelRect::Union(bounds, PixelRect::Make(x, y, x + 1, y + 1));
+        }
+    }
+    return bounds;
+}
+
+bool Same(const PixelRect& a, const PixelRect& b) {
+    return a.left == b.left && a.top == b.top && a.right == b.right && a.bottom == b.bottom;
+}
+
+bool Contains(const PixelRect& outer, const PixelRect& inner) {
+    return inner.Empty() || (inner.left >= outer.left && inner.top >= outer.top && inner.right <= outer.right &&
+                             inner.bottom <= outer.bottom);
+}
+
+void TestMadeUpFrames() {
+    const int width = 37;
+    const int height = 23;
+    const size_t stride = 48 * 4;  // Padding past the width is never looked at
+    std::vector<uint32_t> frame(stride / 4 * height, 0);
+    for (int y = 0; y < height; y++) {
+        for (int x = width; x < static_cast<int>(stride / 4); x++) frame[y * stride / 4 + x] = 0xFFFFFFFFu;
+    }
+    CHECK(OpaqueBounds(frame.data(), width, height, stride).Empty());
+
+    frame[5 * stride / 4 + 9] = 0x01000000u;  // Faint alpha still counts
+    PixelRect one = OpaqueBounds(frame.data(), width, height, stride);
+    CHECK(Same(one, PixelRect::Make(9, 5, 10, 6)));
+
+    frame[0] = 0xFF000000u;
+    frame[(height - 1) * stride / 4 + width - 1] = 0xFF102030u;
+    CHECK(Same(OpaqueBounds(frame.data(), width, height, stride), PixelRect::Make(0, 0, width, height)));
+
+    // Growing an existing box only widens it, with every kernel
+    std::vector<uint32_t> second(stride / 4 * height, 0);
+    second[10 * stride / 4 + 30] = 0xFFFFFFFFu;
+    second[20 * stride / 4 + 2] = 0x80000000u;
+    const DiffKernels scalar = { FirstDiffScalar, LastDiffScalar };
+    PixelRect start = PixelRect::Make(9, 5, 10, 6);
+    PixelRect selected = start;
+    PixelRect reference = start;
+    ExpandOpaqueBounds(second.data(), width, height, stride, selected);
+    ExpandOpaqueBounds(second.data(), width, height, stride, reference, scalar);
+    CHECK(Same(selected, reference));
+    CHECK(Same(selected, PixelRect::Make(2, 5, 31, 21)));
+}
+
+// What the loader computed while decoding, against a full scan, and the
+// view built from it
+void TestBundledAssets() {
+    for (size_t a = 0; a < sizeof(ASSETS) / sizeof(ASSETS[0]); a++) {
+        std::vector<uint8_t> file;
+        REQUIRE(chibi_test::ReadAsset(ASSETS[a], file));
+        FrameCache cache;
+        REQUIRE(BuildFrameCache(file.data(), file.size(), cache));
+
+        PixelRect scanned = PixelRect::EmptyRect();
+        for (size_t i = 0; i < cache.frameCount; i++) {
+            scanned = ScanBounds(cache.Frame(i), cache.width, cache.height, cache.stride, scanned);
+        }
+        if (!Same(cache.opaqueBounds, scanned)) {
+            std::fprintf(stderr, "%s: opaque bounds differ from a scan\n", ASSETS[a]);
+        }
+        CHECK(Same(cache.opaqueBounds, scanned));
+
+        PixelRect canvas = PixelRect::Make(0, 0, cache.width, cache.height);
+        PixelRect view = TrimView(cache.opaqueBounds, cache.width, cache.height);
+        CHECK(Contains(view, cache.opaqueBounds));
+        CHECK(Contains(view, cache.opaqueBounds.Mirrored(cache.width)));
+        CHECK(view.left + view.right == cache.width);  // Symmetric about the centre line
+        CHECK(view.Area() < canvas.Area());  // Every bundled animation has margins
+        std::printf("%s: view %dx%d of %dx%d (%.0f%% of the pixels)\n", ASSETS[a], view.Width(), view.Height(),
+                    cache.width, cache.height, 100.0 * view.Area() / canvas.Area());
+    }
+}
+
+void TestTrimViewEdges() {
+    CHECK(Same(TrimView(PixelRect::EmptyRect(), 100, 80), PixelRect::Make(0, 0, 100, 80)));
+    CHECK(Same(TrimView(PixelRect::Make(0, 10, 5, 20), 100, 80), PixelRect::Make(0, 10, 100, 20)));
+    CHECK(Same(TrimView(PixelRect::Make(40, 10, 70, 20), 100, 80), PixelRect::Make(30, 10, 70, 20)));
+    CHECK(Same(TrimView(PixelRect::Make(20, 0, 55, 80), 100, 80), PixelRect::Make(20, 0, 80, 80)));
+}
+
+// Placing each window so its feet land on one screen point puts the
+// canvas in the same place whatever the view
+void TestFeetStayInPlace() {
+    const int width = 340;
+    const int height = 340;
+    const int feetX = 900;
+    const int feetY = 1000;
+    const PixelRect views[] = { PixelRect::Make(0, 0, width, height),
+                                TrimView(PixelRect::Make(120, 60, 210, 330), width, height),
+                                TrimView(PixelRect::Make(100, 200, 260, 340), width, height) };
+    for (size_t v = 0; v < sizeof(views) / sizeof(views[0]); v++) {
+        int x = 0;
+        int y = 0;
+        FeetOffset(views[v], width, height, x, y);
+        int windowX = feetX - x;
+        int windowY = feetY - y;
+        // Where the canvas's top-left corner ends up
+        CHECK(windowX - views[v].left == feetX - width / 2);
+        CHECK(windowY - views[v].top == feetY - height);
+    }
+}
+
+} // namespace
+
+int main() {
+    TestMadeUpFrames();
+    TestBundledAssets();
+    TestTrimViewEdges();
+    TestFeetStayInPlace();
+    return chibi_test::Finish("TrimTest");
+}
@@ -0,0 +1,99 @@
+// WebPDecoder: the bundled animated WebPs decode into the frame cache with
+// their frame counts, delays and premultiplied pixels, and damaged files
+// fail or stop early instead of reading past the end.
+#include <cstring>
+#include <vector>
+
+#include "../core/FrameCache.h"
+#include "TestSupport.h"
+
+using namespace chibi;
+
+namespace {
+
+struct WebPAsset {
+    const char* path;
+    size_t frameCount;
+};
+
+const WebPAsset ASSETS[] = {
+    { "../vectorviewer/vectormove.webp", 80 },
+    { "../vectorviewer/vectorwait.webp", 80 },
+    { "../vectorviewer/vectorsit.webp", 80 },
+    { "../vectorviewer/vectorpick.webp", 80 },
+    { "../vectorviewer/vectorlying.webp", 140 },
+};
+
+// No colour channel above alpha, as premultiplied BGRA must be
+size_t CountBadPixels(const FrameCache& cache, size_t index) {
+    size_t bad = 0;
+    for (int y = 0; y < cache.height; y++) {
+        const uint8_t* row = reinterpret_cast<const uint8_t*>(cache.Frame(index)) + y * cache.stride;
+        for (int x = 0; x < cache.width; x++) {
+            const uint8_t* pixel = row + x * 4;
+            if (pixel[0] > pixel[3] || pixel[1] > pixel[3] || pixel[2] > pixel[3]) bad++;
+        }
+    }
+    return bad;
+}
+
+void TestBundledWebPs() {
+    for (size_t a = 0; a < sizeof(ASSETS) / sizeof(ASSETS[0]); a++) {
+        std::vector<uint8_t> file;
+        REQUIRE(chibi_test::ReadAsset(ASSETS[a].path, file));
+        FrameCache cache;
+        REQUIRE(BuildFrameCache(file.data(), file.size(), cache));
+
+        CHECK(cache.width == 340 && cache.height == 340);
+        CHECK(cache.frameCount == ASSETS[a].frameCount);
+        CHECK(cache.Complete());
+        CHECK(cache.delays.size() == cache.frameCount);
+        size_t zeroDelays = 0;
+        size_t badPixels = 0;
+        size_t repeats = 0;
+        for (size_t i = 0; i < cache.frameCount; i++) {
+            if (cache.delays[i] == 0) zeroDelays++;
+            badPixels += CountBadPixels(cache, i);
+            if (i > 0 && std::memcmp(cache.Frame(i), cache.Frame(i - 1), cache.FrameBytes()) == 0) repeats++;
+        }
+        if (badPixels != 0) std::fprintf(stderr, "%s: %zu pixels not premultiplied\n", ASSETS[a].path, badPixels);
+        CHECK(zeroDelays == 0);
+        CHECK(badPixels == 0);
+        CHECK(repeats < cache.frameCount - 1);  // It animates
+
+        // A character on a transparent background
+        PixelRect whole = PixelRect::Make(0, 0, cache.width, cache.height);
+        CHECK(!cache.opaqueBounds.Empty());
+        CHECK(cache.opaqueBounds.Area() < whole.Area());
+    }
+}
+
+// Cut short anywhere, a file decodes to no frames or fewer, never more
+void TestTruncatedFile() {
+    std::vector<uint8_t> file;
+    REQUIRE(chibi_test::ReadAsset("../vectorviewer/vectorwait.webp", file));
+    const size_t cuts[] = { 0, 11, 12, 30, 100, 4096, file.size() / 3, file.size() / 2, file.size() - 1 };
+    for (size_t c = 0; c < sizeof(cuts) / sizeof(cuts[0]); c++) {
+        std::vector<uint8_t> truncated(file.begin(), file.begin() + cuts[c]);
+        FrameCache cache;
+        bool ok = BuildFrameCache(truncated.data(), truncated.size(), cache);
+        CHECK(!ok || cache.frameCount <= 80);
+        CHECK(cache.decodedCount <= cache.frameCount);
+    }
+}
+
+void TestNotAWebP() {
+    const char text[] = "RIFF\x10\x00\x00\x00WEBPJUNKJUNKJUNK";
+    std::vector<uint8_t> bytes(text, text + sizeof(text) - 1);
+    FrameCache cache;
+    CHECK(!BuildFrameCache(bytes.data(), bytes.size(), cache));
+}
+
+} // namespace
+
+int main() {
+    TestBundledWebPs();
+    TestTruncatedFile();
+    TestNotAWebP();
+    return chibi_test::Finish("WebPDecoderTest");
+}
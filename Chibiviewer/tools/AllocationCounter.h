@@ -0,0 +1,53 @@
+// Counts heap allocations made through operator new, for checking that a
+// hot path allocates nothing.
+//
+// Including this replaces the global operator new and delete, so include it
+// from exactly one source file of a program (the benchmark tool or a test).
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+
+namespace chibi_alloc {
+
+inline std::atomic<size_t>& AllocationCount() {
+    static std::atomic<size_t> count(0);
+    return count;
+}
+
+// Allocations made so far by any thread
+inline size_t Allocations() { return AllocationCount().load(std::memory_order_relaxed); }
+
+// Kept out of line so GCC does not see free() inlined against operator new
+// and warn about a mismatched pair
+#if defined(__GNUC__) || defined(__clang__)
+__attribute__((noinline))
+#endif
+inline void Release(void* block) { std::free(block); }
+
+} // namespace chibi_alloc
+
+void* operator new(std::size_t size) {
+    chibi_alloc::AllocationCount().fetch_add(1, std::memory_order_relaxed);
+    void* block = std::malloc(size != 0 ? size : 1);
+    if (!block) throw std::bad_alloc();
+    return block;
+}
+
+void* operator new[](std::size_t size) { return operator new(size); }
+
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept {
+    chibi_alloc::AllocationCount().fetch_add(1, std::memory_order_relaxed);
+    return std::malloc(size != 0 ? size : 1);
+}
+
+void* operator new[](std::size_t size, const std::nothrow_t& tag) noexcept { return operator new(size, tag); }
+
+void operator delete(void* block) noexcept { chibi_alloc::Release(block); }
+void operator delete[](void* block) noexcept { chibi_alloc::Release(block); }
+void operator delete(void* block, std::size_t) noexcept { chibi_alloc::Release(block); }
+void operator delete[](void* block, std::size_t) noexcept { chibi_alloc::Release(block); }
+void operator delete(void* block, const std::nothrow_t&) noexcept { chibi_alloc::Release(block); }
+void operator delete[](void* block, const std::nothrow_t&) noexcept { chibi_alloc::Release(block); }
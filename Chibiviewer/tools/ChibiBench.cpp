@@ -0,0 +1,1445 @@
+// Micro-benchmarks for the hot paths.
+//
+// Each benchmark times one small operation (decoding a file, painting or
+// composing a frame, mirroring a frame, one walk step, one state change, one
+// animation lookup, loading or reading a whole pack) on fixed inputs taken
+// from the bundled sample animations, in the manner of Google Benchmark: the
+// iteration count grows until a run lasts --min-time, the run is repeated
+// and the median is reported. Results can be written as JSON and checked
+// against a saved baseline; anything slower than the baseline by more than
+// --threshold fails the run. Needs no display.
+//
+// Build:           the chibi_bench target in CMakeLists.txt
+// Example:         ./build/chibi_bench --json bench.json
+//                  ./build/chibi_bench --baseline bench.json
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cstdint>
+#include <cmath>
+#include <ctime>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <map>
+#include <random>
+#ifndef _WIN32
+#include <sys/resource.h>
+#endif
+#include <condition_variable>
+#include <mutex>
+
+#include "../core/AnimationRegistry.h"
+#include "../core/AssetLoader.h"
+#include "../core/Atlas.h"
+#include "../core/Clock.h"
+#include "../core/Compositor.h"
+#include "../core/CpuFeatures.h"
+#include "../core/DirtyRect.h"
+#include "../core/DiskCache.h"
+#include "../core/Engine.h"
+#include "../core/FrameCache.h"
+#include "../core/FramePool.h"
+#include "../core/FrameStore.h"
+#include "../core/GifDecoder.h"
+#include "../core/Hash.h"
+#include "../core/MappedFile.h"
+#include "../core/Mirror.h"
+#include "../core/Palette.h"
+#include "../core/Simulation.h"
+#include "../core/Trim.h"
+#include "AllocationCounter.h"
+#include "LazyStartup.h"
+#include "PackFiles.h"
+
+// Keeps the compiler from dropping work whose result is never read
+template <typename T>
+inline void DoNotOptimize(const T& value) {
+#if defined(__GNUC__) || defined(__clang__)
+    asm volatile("" : : "r,m"(value) : "memory");
+#else
+    static volatile const void* sink;
+    sink = &value;
+#endif
+}
+
+// What a benchmark gets: how many times to run its operation, and where to
+// say how much work one run is. Setup before ResetTimer is not timed.
+class BenchState {
+public:
+    BenchState(const chibi::IClock& clock, size_t iterations)
+        : clock(clock), iterations(iterations), itemsPerIteration(0), bytesPerIteration(0),
+          startMs(clock.NowMs()), pausedMs(0.0) {}
+
+    void ResetTimer() { startMs = clock.NowMs(); }
+
+    // Leaves the time between the two calls out, e.g. per-iteration setup
+    void PauseTiming() { pausedMs = clock.NowMs(); }
+    void ResumeTiming() { startMs += clock.NowMs() - pausedMs; }
+    double ElapsedMs() const { return clock.NowMs() - startMs; }
+
+    void SetItemsPerIteration(double items) { itemsPerIteration = items; }
+    void SetBytesPerIteration(double bytes) { bytesPerIteration = bytes; }
+
+    // A figure reported next to the time, such as allocations per
+    // iteration; written to the JSON as an extra field
+    void SetCounter(const std::string& name, double value) { counters[name] = value; }
+
+    const chibi::IClock& clock;
+    const size_t iterations;
+    double itemsPerIteration;
+    double bytesPerIteration;
+    std::map<std::string, double> counters;
+
+private:
+    double startMs;
+    double pausedMs;
+};
+
+// Fixed inputs, loaded once before any benchmark runs
+struct BenchInputs {
+    std::vector<uint8_t> gifBytes;
+    std::vector<uint8_t> webpBytes;
+    std::vector<uint8_t> largeGifBytes;
+    chibi::FrameCache cache;  // The GIF, decoded, with mirrored copies
+    chibi::FramePool pool;
+    chibi::CompressedFrameStore store;
+    chibi::FrameAtlas atlas;
+    chibi::AtlasAnimation atlasAnimation;
+    std::vector<std::string> packFiles;  // Every animation in --pack
+    std::vector<chibi::FrameCache> packCaches;  // Decoded on first use
+    std::vector<std::string> webpPackFiles;  // Every animation in --webp-pack
+    std::vector<std::string> characterGifs;   // GIFs in --pack with a WebP of the same name
+    std::vector<std::string> characterWebPs;  // next to --webp, in the same order
+};
+
+typedef void (*BenchFunc)(BenchState& state, BenchInputs& inputs);
+
+// What a benchmark needs to run; it is skipped otherwise
+enum BenchNeeds {
+    NEEDS_NOTHING,
+    NEEDS_WEBP,  // A WebP input
+    NEEDS_LARGE_GIF,  // The --large-gif input
+    NEEDS_PACK,  // Animations in --pack
+    NEEDS_COLD,  // Animations in --pack, and a way to drop them from the page cache
+    NEEDS_WEBP_PACK,  // Animations in --webp-pack
+    NEEDS_CHARACTER,  // The same animations as GIF and as WebP
+    NEEDS_SSE2,  // A CPU with the instructions its kernel uses
+    NEEDS_AVX2
+};
+
+struct Benchmark {
+    const char* name;
+    BenchFunc func;
+    BenchNeeds needs;
+};
+
+struct BenchResult {
+    std::string name;
+    size_t iterations;
+    double nsPerIteration;  // Median over the repetitions
+    double minNsPerIteration;
+    double itemsPerSecond;
+    double bytesPerSecond;
+    std::map<std::string, double> counters;  // From the last repetition
+};
+
+// A canvas-sized surface to compose into
+struct BenchSurface {
+    chibi::AlignedBuffer pixels;
+    chibi::Surface surface;
+
+    explicit BenchSurface(const chibi::FrameCache& cache) {
+        pixels.Allocate(cache.stride * cache.height);
+        std::memset(pixels.Data(), 0, pixels.Size());
+        chibi::Surface view = { pixels.Data(), cache.width, cache.height, cache.stride };
+        surface = view;
+    }
+};
+
+double FrameBytes(const chibi::FrameCache& cache) {
+    return static_cast<double>(cache.width) * cache.height * 4;
+}
+
+bool LoadPackFile(const std::string& path, chibi::FrameCache& cache) {
+    chibi::MappedFile file;
+    return OpenMapped(file, path) && chibi::BuildFrameCache(file.Data(), file.Size(), cache);
+}
+
+// Every animation in --pack, decoded the first time a benchmark asks
+const std::vector<chibi::FrameCache>& PackCaches(BenchInputs& inputs) {
+    if (inputs.packCaches.empty()) {
+        inputs.packCaches.resize(inputs.packFiles.size());
+        for (size_t f = 0; f < inputs.packFiles.size(); f++) LoadPackFile(inputs.packFiles[f], inputs.packCaches[f]);
+    }
+    return inputs.packCaches;
+}
+
+// ---------------------------------------------------------------------------
+// Decoding
+
+// Parse, LZW decode and compose every frame with its disposal
+void BenchDecodeGif(BenchState& state, BenchInputs& inputs) {
+    chibi::GifImage image;
+    for (size_t i = 0; i < state.iterations; i++) {
+        image = chibi::GifImage();
+        chibi::DecodeGif(inputs.gifBytes.data(), inputs.gifBytes.size(), image);
+        DoNotOptimize(image.frames.size());
+    }
+    state.SetItemsPerIteration(static_cast<double>(inputs.cache.frameCount));
+    state.SetBytesPerIteration(static_cast<double>(inputs.gifBytes.size()));
+}
+
+// The whole load path: decode, premultiply, dirty rects, opaque bounds
+void BenchLoadGif(BenchState& state, BenchInputs& inputs) {
+    for (size_t i = 0; i < state.iterations; i++) {
+        chibi::FrameCache cache;
+        chibi::BuildFrameCache(inputs.gifBytes.data(), inputs.gifBytes.size(), cache);
+        DoNotOptimize(cache.frameCount);
+    }
+    state.SetItemsPerIteration(static_cast<double>(inputs.cache.frameCount));
+    state.SetBytesPerIteration(static_cast<double>(inputs.gifBytes.size()));
+}
+
+// LZW decode of every image block of the large GIF, without composing;
+// items are decoded pixels
+void BenchDecodeLzwLarge(BenchState& state, BenchInputs& inputs) {
+    chibi::GifReader reader;
+    chibi::GifFrameRecord record;
+    double pixels = 0.0;
+    for (size_t i = 0; i < state.iterations; i++) {
+        reader.Open(inputs.largeGifBytes.data(), inputs.largeGifBytes.size());
+        while (reader.NextFrame(record)) {
+            pixels += static_cast<double>(record.width) * record.height;
+            DoNotOptimize(record.indices[0]);
+        }
+    }
+    state.SetItemsPerIteration(pixels / state.iterations);
+    state.SetBytesPerIteration(static_cast<double>(inputs.largeGifBytes.size()));
+}
+
+// The large GIF decoded and composed; items are canvas pixels
+void BenchDecodeGifLarge(BenchState& state, BenchInputs& inputs) {
+    chibi::GifImage image;
+    for (size_t i = 0; i < state.iterations; i++) {
+        image = chibi::GifImage();
+        chibi::DecodeGif(inputs.largeGifBytes.data(), inputs.largeGifBytes.size(), image);
+        DoNotOptimize(image.frames.size());
+    }
+    state.SetItemsPerIteration(static_cast<double>(image.width) * image.height * image.frames.size());
+    state.SetBytesPerIteration(static_cast<double>(inputs.largeGifBytes.size()));
+}
+
+// The same character's animations loaded from GIF and from WebP. Items are
+// frames, so the time per item is the load time per frame; us_per_frame
+// says the same directly.
+void LoadCharacter(BenchState& state, const std::vector<std::string>& paths) {
+    std::vector<std::vector<uint8_t> > files(paths.size());
+    for (size_t f = 0; f < paths.size(); f++) ReadWholeFile(paths[f], files[f]);
+
+    size_t frames = 0;
+    state.ResetTimer();
+    for (size_t i = 0; i < state.iterations; i++) {
+        frames = 0;
+        for (size_t f = 0; f < files.size(); f++) {
+            chibi::FrameCache cache;
+            chibi::BuildFrameCache(files[f].data(), files[f].size(), cache);
+            frames += cache.frameCount;
+            DoNotOptimize(cache.frameCount);
+        }
+    }
+    double elapsedMs = state.ElapsedMs();
+    state.SetItemsPerIteration(static_cast<double>(frames));
+    state.SetCounter("us_per_frame", frames > 0 ? elapsedMs * 1000.0 / state.iterations / frames : 0.0);
+}
+
+void BenchLoadCharacterGif(BenchState& state, BenchInputs& inputs) {
+    LoadCharacter(state, inputs.characterGifs);
+}
+
+void BenchLoadCharacterWebP(BenchState& state, BenchInputs& inputs) {
+    LoadCharacter(state, inputs.characterWebPs);
+}
+
+void BenchLoadWebP(BenchState& state, BenchInputs& inputs) {
+    size_t frames = 0;
+    for (size_t i = 0; i < state.iterations; i++) {
+        chibi::FrameCache cache;
+        chibi::BuildFrameCache(inputs.webpBytes.data(), inputs.webpBytes.size(), cache);
+        frames = cache.frameCount;
+        DoNotOptimize(frames);
+    }
+    state.SetItemsPerIteration(static_cast<double>(frames));
+    state.SetBytesPerIteration(static_cast<double>(inputs.webpBytes.size()));
+}
+
+// One row of palette indices to pixels
+void ExpandPaletteRowWith(BenchState& state, const BenchInputs& inputs, chibi::ExpandPaletteRowFunc expandRow) {
+    int width = inputs.cache.width;
+    std::vector<uint8_t> indices(width);
+    std::vector<uint32_t> palette(256);
+    std::vector<uint32_t> row(width);
+    std::mt19937 rng(1);
+    for (int x = 0; x < width; x++) indices[x] = static_cast<uint8_t>(rng());
+    for (size_t c = 0; c < palette.size(); c++) palette[c] = 0xFF000000u | static_cast<uint32_t>(rng());
+
+    state.ResetTimer();
+    for (size_t i = 0; i < state.iterations; i++) {
+        expandRow(indices.data(), palette.data(), row.data(), width);
+        DoNotOptimize(row[0]);
+    }
+    state.SetItemsPerIteration(width);
+    state.SetBytesPerIteration(static_cast<double>(width) * 4);
+}
+
+void BenchExpandPaletteRow(BenchState& state, BenchInputs& inputs) {
+    ExpandPaletteRowWith(state, inputs, chibi::GetExpandPaletteRowFunc());
+}
+
+void BenchExpandPaletteRowScalar(BenchState& state, BenchInputs& inputs) {
+    ExpandPaletteRowWith(state, inputs, chibi::ExpandPaletteRowScalar);
+}
+
+#if CHIBI_X86
+void BenchExpandPaletteRowAvx2(BenchState& state, BenchInputs& inputs) {
+    ExpandPaletteRowWith(state, inputs, chibi::ExpandPaletteRowAvx2);
+}
+#endif
+
+// Straight RGBA to premultiplied BGRA for one frame (alpha blending setup)
+void BenchPremultiplyFrame(BenchState& state, BenchInputs& inputs) {
+    const chibi::FrameCache& cache = inputs.cache;
+    size_t pixels = static_cast<size_t>(cache.width) * cache.height;
+    std::vector<uint8_t> rgba(pixels * 4);
+    const uint8_t* frame = reinterpret_cast<const uint8_t*>(cache.Frame(cache.frameCount / 2));
+    for (int y = 0; y < cache.height; y++) {
+        std::memcpy(&rgba[static_cast<size_t>(y) * cache.width * 4], frame + y * cache.stride,
+                    static_cast<size_t>(cache.width) * 4);
+    }
+    std::vector<uint32_t> bgra(pixels);
+
+    state.ResetTimer();
+    for (size_t i = 0; i < state.iterations; i++) {
+        chibi::PremultiplyRgbaToBgra(rgba.data(), bgra.data(), pixels);
+        DoNotOptimize(bgra[0]);
+    }
+    state.SetBytesPerIteration(FrameBytes(cache));
+}
+
+// ---------------------------------------------------------------------------
+// Painting one frame, before and after the frame cache
+
+// Before: each paint decoded the next frame out of the LZW data and composed
+// it with its disposal (what SelectActiveFrame did), then converted it for
+// drawing
+void BenchPaintDecodeFrame(BenchState& state, BenchInputs& inputs) {
+    const chibi::FrameCache& cache = inputs.cache;
+    BenchSurface target(cache);
+    chibi::GifReader reader;
+    chibi::GifCanvas canvas;
+    chibi::GifFrameRecord record;
+    reader.Open(inputs.gifBytes.data(), inputs.gifBytes.size());
+    canvas.Reset(reader.Width(), reader.Height());
+
+    state.ResetTimer();
+    for (size_t i = 0; i < state.iterations; i++) {
+        if (!reader.NextFrame(record)) {
+            reader.Rewind();
+            canvas.Reset(reader.Width(), reader.Height());
+            reader.NextFrame(record);
+        }
+        canvas.Compose(record);
+        for (int y = 0; y < cache.height; y++) {
+            chibi::PremultiplyRgbaToBgra(canvas.Pixels() + static_cast<size_t>(y) * cache.width * 4,
+                                         reinterpret_cast<uint32_t*>(target.pixels.Data() + y * cache.stride),
+                                         cache.width);
+        }
+        DoNotOptimize(target.pixels.Data()[0]);
+    }
+    state.SetBytesPerIteration(FrameBytes(cache));
+}
+
+// After: each paint copies a frame that was composed once at load time
+void BenchPaintCachedFrame(BenchState& state, BenchInputs& inputs) {
+    const chibi::FrameCache& cache = inputs.cache;
+    BenchSurface target(cache);
+
+    state.ResetTimer();
+    for (size_t i = 0; i < state.iterations; i++) {
+        std::memcpy(target.pixels.Data(), cache.Frame(i % cache.frameCount), cache.FrameBytes());
+        DoNotOptimize(target.pixels.Data()[0]);
+    }
+    state.SetBytesPerIteration(FrameBytes(cache));
+}
+
+// ---------------------------------------------------------------------------
+// Load-time frame analysis
+
+void BenchDirtyRect(BenchState& state, BenchInputs& inputs) {
+    const chibi::FrameCache& cache = inputs.cache;
+    chibi::PixelRect bounds = chibi::PixelRect::Make(0, 0, cache.width, cache.height);
+    for (size_t i = 0; i < state.iterations; i++) {
+        size_t frame = i % cache.frameCount;
+        chibi::PixelRect dirty = chibi::ComputeDirtyRect(
+            reinterpret_cast<const uint8_t*>(cache.Frame(frame)),
+            reinterpret_cast<const uint8_t*>(cache.Frame((frame + 1) % cache.frameCount)), cache.stride, bounds);
+        DoNotOptimize(dirty);
+    }
+    state.SetBytesPerIteration(FrameBytes(cache) * 2);
+}
+
+void BenchOpaqueBounds(BenchState& state, BenchInputs& inputs) {
+    const chibi::FrameCache& cache = inputs.cache;
+    for (size_t i = 0; i < state.iterations; i++) {
+        chibi::PixelRect bounds = chibi::OpaqueBounds(cache.Frame(i % cache.frameCount), cache.width, cache.height,
+                                                      cache.stride);
+        DoNotOptimize(bounds);
+    }
+    state.SetBytesPerIteration(FrameBytes(cache));
+}
+
+void BenchHashFrame(BenchState& state, BenchInputs& inputs) {
+    const chibi::FrameCache& cache = inputs.cache;
+    size_t bytes = cache.stride * cache.height;
+    for (size_t i = 0; i < state.iterations; i++) {
+        DoNotOptimize(chibi::HashBytes(cache.Frame(i % cache.frameCount), bytes));
+    }
+    state.SetBytesPerIteration(static_cast<double>(bytes));
+}
+
+// Horizontal flip of a whole frame with the kernel MirrorImage picks
+void BenchMirrorFrame(BenchState& state, BenchInputs& inputs) {
+    const chibi::FrameCache& cache = inputs.cache;
+    chibi::AlignedBuffer mirrored;
+    mirrored.Allocate(cache.stride * cache.height);
+
+    state.ResetTimer();
+    for (size_t i = 0; i < state.iterations; i++) {
+        chibi::MirrorImage(reinterpret_cast<const uint8_t*>(cache.Frame(i % cache.frameCount)), mirrored.Data(),
+                           cache.width, cache.height, cache.stride);
+        DoNotOptimize(mirrored.Data()[0]);
+    }
+    state.SetItemsPerIteration(static_cast<double>(cache.width) * cache.height);
+    state.SetBytesPerIteration(FrameBytes(cache));
+}
+
+// One frame flipped over and over with a given row kernel, so the kernels
+// are compared in cache rather than on memory bandwidth. Items are pixels:
+// the items column reads as pixels per second.
+void MirrorFrameWith(BenchState& state, const BenchInputs& inputs, chibi::MirrorRowFunc mirrorRow) {
+    const chibi::FrameCache& cache = inputs.cache;
+    chibi::AlignedBuffer mirrored;
+    mirrored.Allocate(cache.stride * cache.height);
+
+    state.ResetTimer();
+    for (size_t i = 0; i < state.iterations; i++) {
+        const uint8_t* frame = reinterpret_cast<const uint8_t*>(cache.Frame(0));
+        for (int y = 0; y < cache.height; y++) {
+            mirrorRow(reinterpret_cast<const uint32_t*>(frame + y * cache.stride),
+                      reinterpret_cast<uint32_t*>(mirrored.Data() + y * cache.stride), cache.width);
+        }
+        DoNotOptimize(mirrored.Data()[0]);
+    }
+    state.SetItemsPerIteration(static_cast<double>(cache.width) * cache.height);
+    state.SetBytesPerIteration(FrameBytes(cache));
+}
+
+void BenchMirrorFrameScalar(BenchState& state, BenchInputs& inputs) {
+    MirrorFrameWith(state, inputs, chibi::MirrorRowScalar);
+}
+
+#if CHIBI_X86
+void BenchMirrorFrameSse2(BenchState& state, BenchInputs& inputs) {
+    MirrorFrameWith(state, inputs, chibi::MirrorRowSse2);
+}
+
+void BenchMirrorFrameAvx2(BenchState& state, BenchInputs& inputs) {
+    MirrorFrameWith(state, inputs, chibi::MirrorRowAvx2);
+}
+#endif
+
+void BenchStoreBuild(BenchState& state, BenchInputs& inputs) {
+    for (size_t i = 0; i < state.iterations; i++) {
+        chibi::FramePool pool;
+        chibi::CompressedFrameStore store;
+        store.Build(inputs.cache, pool);
+        DoNotOptimize(store.CompressedBytes());
+        store.Clear();
+    }
+    state.SetItemsPerIteration(static_cast<double>(inputs.cache.frameCount));
+    state.SetBytesPerIteration(FrameBytes(inputs.cache) * inputs.cache.frameCount);
+}
+
+// Memory saved against the cost of decoding frames back: every animation in
+// --pack played through its store, in order or at random, with keyframes
+// every 4, 16 or 64 frames. Switching animations drops the hot frames.
+// Items are frames. saved_pct is how much smaller the pooled coded frames
+// are than decoded ones; frames_decoded is how many frames one access
+// decodes on average, counting replays from a keyframe.
+void PlayPackStores(BenchState& state, BenchInputs& inputs, size_t interval, bool random) {
+    const std::vector<chibi::FrameCache>& caches = PackCaches(inputs);
+    chibi::FramePool pool;
+    std::vector<chibi::CompressedFrameStore> stores(caches.size());
+    double rawBytes = 0.0;
+    double frames = 0.0;
+    for (size_t s = 0; s < stores.size(); s++) {
+        stores[s].Build(caches[s], pool, interval);
+        rawBytes += static_cast<double>(stores[s].RawBytes());
+        frames += static_cast<double>(stores[s].FrameCount());
+    }
+    double storedBytes = static_cast<double>(pool.Stats().storedBytes);
+
+    std::mt19937 rng(1);
+    state.ResetTimer();
+    for (size_t i = 0; i < state.iterations; i++) {
+        for (size_t s = 0; s < stores.size(); s++) {
+            chibi::CompressedFrameStore& store = stores[s];
+            size_t count = store.FrameCount();
+            for (size_t f = 0; f < count; f++) {
+                DoNotOptimize(store.Frame(random ? rng() % count : f));
+            }
+            store.ReleaseHot();
+        }
+    }
+    state.PauseTiming();
+    double decoded = 0.0;
+    for (size_t s = 0; s < stores.size(); s++) {
+        decoded += static_cast<double>(stores[s].Stats().framesDecoded);
+        stores[s].Clear();
+    }
+    state.ResumeTiming();
+
+    state.SetItemsPerIteration(frames);
+    state.SetBytesPerIteration(rawBytes);
+    state.SetCounter("raw_mb", rawBytes / 1048576.0);
+    state.SetCounter("stored_mb", storedBytes / 1048576.0);
+    state.SetCounter("saved_pct", rawBytes > 0.0 ? (1.0 - storedBytes / rawBytes) * 100.0 : 0.0);
+    state.SetCounter("frames_decoded", frames > 0.0 ? decoded / (frames * state.iterations) : 0.0);
+}
+
+void BenchStoreSequentialK16(BenchState& state, BenchInputs& inputs) {
+    PlayPackStores(state, inputs, 16, false);
+}
+
+void BenchStoreRandomK4(BenchState& state, BenchInputs& inputs) {
+    PlayPackStores(state, inputs, 4, true);
+}
+
+void BenchStoreRandomK16(BenchState& state, BenchInputs& inputs) {
+    PlayPackStores(state, inputs, 16, true);
+}
+
+void BenchStoreRandomK64(BenchState& state, BenchInputs& inputs) {
+    PlayPackStores(state, inputs, 64, true);
+}
+
+// Every animation in --pack packed into one atlas and compacted. Items are
+// frames. canvas_mb is what one untrimmed canvas per frame would take,
+// allocated_mb what the atlas pages take, and occupied_pct how much of the
+// pages the sprites fill.
+void BenchAtlasPack(BenchState& state, BenchInputs& inputs) {
+    const std::vector<chibi::FrameCache>& caches = PackCaches(inputs);
+    double frames = 0.0;
+    double canvasBytes = 0.0;
+    for (size_t c = 0; c < caches.size(); c++) {
+        frames += static_cast<double>(caches[c].frameCount);
+        canvasBytes += static_cast<double>(caches[c].FrameBytes()) * caches[c].frameCount;
+    }
+
+    chibi::FrameAtlas atlas;
+    state.ResetTimer();
+    for (size_t i = 0; i < state.iterations; i++) {
+        state.PauseTiming();
+        atlas.Clear();
+        std::vector<chibi::AtlasAnimation> animations(caches.size());
+        state.ResumeTiming();
+        for (size_t c = 0; c < caches.size(); c++) animations[c].Build(atlas, caches[c]);
+        atlas.Compact();
+        DoNotOptimize(atlas.PageCount());
+    }
+
+    double allocated = static_cast<double>(atlas.AllocatedBytes());
+    state.SetItemsPerIteration(frames);
+    state.SetCounter("pages", static_cast<double>(atlas.PageCount()));
+    state.SetCounter("allocated_mb", allocated / 1048576.0);
+    state.SetCounter("canvas_mb", canvasBytes / 1048576.0);
+    state.SetCounter("saved_pct", canvasBytes > 0.0 ? (1.0 - allocated / canvasBytes) * 100.0 : 0.0);
+    state.SetCounter("occupied_pct", atlas.Occupancy() * 100.0);
+}
+
+// ---------------------------------------------------------------------------
+// Composition: one frame onto the surface per iteration
+
+// A different animation every time: the whole canvas is copied
+void BenchComposeFull(BenchState& state, BenchInputs& inputs) {
+    const chibi::FrameCache& cache = inputs.cache;
+    BenchSurface target(cache);
+    chibi::Compositor compositor;
+
+    state.ResetTimer();
+    for (size_t i = 0; i < state.iterations; i++) {
+        compositor.Invalidate();
+        compositor.Compose(target.surface, cache, i % cache.frameCount, false);
+    }
+    state.SetBytesPerIteration(FrameBytes(cache));
+}
+
+// Playback: each frame only copies its dirty box
+void BenchComposeSequential(BenchState& state, BenchInputs& inputs) {
+    const chibi::FrameCache& cache = inputs.cache;
+    BenchSurface target(cache);
+    chibi::Compositor compositor;
+
+    state.ResetTimer();
+    for (size_t i = 0; i < state.iterations; i++) {
+        compositor.Compose(target.surface, cache, i % cache.frameCount, false);
+    }
+    state.SetBytesPerIteration(static_cast<double>(compositor.Stats().bytesWritten) / state.iterations);
+}
+
+void BenchComposeSequentialFlipped(BenchState& state, BenchInputs& inputs) {
+    const chibi::FrameCache& cache = inputs.cache;
+    BenchSurface target(cache);
+    chibi::Compositor compositor;
+
+    state.ResetTimer();
+    for (size_t i = 0; i < state.iterations; i++) {
+        compositor.Compose(target.surface, cache, i % cache.frameCount, true);
+    }
+    state.SetBytesPerIteration(static_cast<double>(compositor.Stats().bytesWritten) / state.iterations);
+}
+
+// Playback out of the compressed store, decoding frames as they come up
+void BenchComposeStore(BenchState& state, BenchInputs& inputs) {
+    BenchSurface target(inputs.cache);
+    chibi::Compositor compositor;
+    inputs.store.ReleaseHot();
+
+    state.ResetTimer();
+    for (size_t i = 0; i < state.iterations; i++) {
+        compositor.Compose(target.surface, inputs.store, i % inputs.store.FrameCount(), false);
+    }
+    state.SetBytesPerIteration(static_cast<double>(compositor.Stats().bytesWritten) / state.iterations);
+}
+
+// Playback out of the atlas, facing left: sprites are flipped while copied
+void BenchComposeAtlasFlipped(BenchState& state, BenchInputs& inputs) {
+    BenchSurface target(inputs.cache);
+    chibi::Compositor compositor;
+
+    state.ResetTimer();
+    for (size_t i = 0; i < state.iterations; i++) {
+        compositor.Compose(target.surface, inputs.atlas, inputs.atlasAnimation,
+                           i % inputs.atlasAnimation.FrameCount(), true);
+    }
+    state.SetBytesPerIteration(static_cast<double>(compositor.Stats().bytesWritten) / state.iterations);
+}
+
+// ---------------------------------------------------------------------------
+// Engine: state changes, animation lookup, movement
+
+// An engine with one animation of every type, all sharing the GIF's timing
+void AddBenchAnimations(chibi::Engine& engine, const chibi::FrameCache& cache) {
+    static const chibi::AnimationType types[] = { chibi::ANIMATION_WAIT, chibi::ANIMATION_MOVE,
+                                                  chibi::ANIMATION_SIT, chibi::ANIMATION_PICK,
+                                                  chibi::ANIMATION_MISC };
+    chibi::PixelRect view = chibi::TrimView(cache.opaqueBounds, cache.width, cache.height);
+    for (size_t i = 0; i < sizeof(types) / sizeof(types[0]); i++) {
+        engine.AddAnimation(types[i], "bench", cache.width, cache.height, cache.delays, cache.frameCount, view);
+    }
+}
+
+// Before: every state change cleared the frame queue and pushed each frame
+// of the new animation five times (QueueFramesFromGif). Changes alternate
+// between the GIF and one half its length, as the bundled animations differ.
+struct LegacyQueuedFrame {
+    const void* image;
+    unsigned frameIndex;
+    unsigned delay;
+    bool flipped;
+};
+
+void BenchLegacyQueueFrames(BenchState& state, BenchInputs& inputs) {
+    const int LEGACY_FRAME_BUFFER_SIZE = 5;
+    const unsigned LEGACY_MIN_FRAME_DELAY = 16;
+    const chibi::FrameCache& cache = inputs.cache;
+    std::vector<LegacyQueuedFrame> queue;
+    size_t queued = 0;
+    size_t allocations = chibi_alloc::Allocations();
+
+    state.ResetTimer();
+    for (size_t i = 0; i < state.iterations; i++) {
+        size_t frameCount = i % 2 == 0 ? cache.frameCount : cache.frameCount / 2;
+        queue.clear();
+        for (int pass = 0; pass < LEGACY_FRAME_BUFFER_SIZE; pass++) {
+            for (size_t frame = 0; frame < frameCount; frame++) {
+                LegacyQueuedFrame entry = { &cache, static_cast<unsigned>(frame),
+                                            std::max(cache.delays[frame], LEGACY_MIN_FRAME_DELAY), false };
+                queue.push_back(entry);
+            }
+        }
+        queued += queue.size();
+        DoNotOptimize(queue.size());
+    }
+    state.SetCounter("allocs_per_iter", static_cast<double>(chibi_alloc::Allocations() - allocations) / state.iterations);
+    state.SetCounter("entries_per_iter", static_cast<double>(queued) / state.iterations);
+}
+
+// After: switching to the next state's animation resets a playback cursor
+void BenchStateTransition(BenchState& state, BenchInputs& inputs) {
+    chibi::Engine engine(chibi::EngineConfig(), 1);
+    engine.SetScreen(1920, 1080);
+    engine.SetWindow(chibi::PixelRect::Make(800, 880, 1000, 1080));
+    AddBenchAnimations(engine, inputs.cache);
+    engine.SetMode(chibi::MODE_MANUAL);
+    std::vector<chibi::EngineCommand> commands;
+    size_t allocations = chibi_alloc::Allocations();
+
+    state.ResetTimer();
+    for (size_t i = 0; i < state.iterations; i++) {
+        engine.CycleState();
+        engine.TakeCommands(commands);
+        DoNotOptimize(commands.size());
+    }
+    state.SetCounter("allocs_per_iter", static_cast<double>(chibi_alloc::Allocations() - allocations) / state.iterations);
+}
+
+// A registry of count animations spread over 5 states with weights 1 to 3
+void FillRegistry(chibi::AnimationRegistry& registry, size_t count) {
+    for (chibi::AnimationId id = 0; id < count; id++) {
+        registry.Add(id, static_cast<int>(id % 5), 1.0 + (id % 3));
+    }
+}
+
+// Picking one of several variants of a type by weight
+void BenchAnimationLookup(BenchState& state, BenchInputs& inputs) {
+    (void)inputs;
+    chibi::AnimationRegistry registry;
+    FillRegistry(registry, 40);
+    std::mt19937 rng(1);
+
+    state.ResetTimer();
+    for (size_t i = 0; i < state.iterations; i++) {
+        chibi::AnimationId id = 0;
+        registry.Pick(static_cast<int>(i % 5), rng, id);
+        DoNotOptimize(id);
+    }
+}
+
+// The same pick among 20000 registered animations; should cost the same
+void BenchAnimationLookupLarge(BenchState& state, BenchInputs& inputs) {
+    (void)inputs;
+    chibi::AnimationRegistry registry;
+    FillRegistry(registry, 20000);
+    std::mt19937 rng(1);
+    chibi::AnimationId id = 0;
+    for (int s = 0; s < 5; s++) registry.Pick(s, rng, id);  // Build the alias tables
+
+    state.ResetTimer();
+    for (size_t i = 0; i < state.iterations; i++) {
+        registry.Pick(static_cast<int>(i % 5), rng, id);
+        DoNotOptimize(id);
+    }
+}
+
+// Finding the variants of a state among 20000 animations (what the old code
+// did by scanning every GIF)
+void BenchStateVariantsLarge(BenchState& state, BenchInputs& inputs) {
+    (void)inputs;
+    chibi::AnimationRegistry registry;
+    FillRegistry(registry, 20000);
+
+    state.ResetTimer();
+    for (size_t i = 0; i < state.iterations; i++) {
+        DoNotOptimize(registry.ForState(static_cast<int>(i % 5)).size());
+    }
+}
+
+// One fixed-rate walk step
+void BenchWalkStep(BenchState& state, BenchInputs& inputs) {
+    (void)inputs;
+    chibi::ManualClock clock;
+    chibi::Simulation simulation(clock);
+    simulation.StartWalk(0, 0, 1720, true, 125.0);
+
+    state.ResetTimer();
+    for (size_t i = 0; i < state.iterations; i++) {
+        clock.AdvanceMs(simulation.StepMs());
+        simulation.Update();
+        DoNotOptimize(simulation.WalkX());
+    }
+}
+
+// One engine update while walking: step, frame deadline, window move
+void BenchEngineTick(BenchState& state, BenchInputs& inputs) {
+    chibi::Engine engine(chibi::EngineConfig(), 1);
+    engine.SetScreen(1920, 1080);
+    engine.SetWindow(chibi::PixelRect::Make(800, 880, 1000, 1080));
+    AddBenchAnimations(engine, inputs.cache);
+    engine.SetMode(chibi::MODE_MANUAL);
+    engine.CycleState();  // Wait to sit
+    engine.CycleState();  // Misc
+    engine.CycleState();  // Move
+    engine.SetMode(chibi::MODE_AUTOMATIC);
+    std::vector<chibi::EngineCommand> commands;
+
+    state.ResetTimer();
+    for (size_t i = 0; i < state.iterations; i++) {
+        double wait = engine.MsUntilNextUpdate();
+        engine.Tick(wait < 0.0 ? 16.0 : std::ceil(wait));
+        engine.TakeCommands(commands);
+        DoNotOptimize(commands.size());
+    }
+}
+
+// ---------------------------------------------------------------------------
+// Startup: every animation in the pack mapped and decoded, one after another
+// as the viewer used to before the message loop, or on the loader's worker
+// pool. Cold runs drop the files from the page cache before each iteration
+// (not timed), so the reads come from the disk. first_ms is how long the
+// first animation took to arrive.
+
+void DropPack(BenchState& state, const BenchInputs& inputs) {
+    state.PauseTiming();
+    for (size_t f = 0; f < inputs.packFiles.size(); f++) DropFromPageCache(inputs.packFiles[f]);
+    state.ResumeTiming();
+}
+
+void LoadPackSerial(BenchState& state, const BenchInputs& inputs, bool cold) {
+    double firstMs = 0.0;
+    for (size_t i = 0; i < state.iterations; i++) {
+        if (cold) DropPack(state, inputs);
+        double startMs = state.clock.NowMs();
+        std::vector<chibi::FrameCache> caches(inputs.packFiles.size());  // All kept, as the viewer does
+        for (size_t f = 0; f < inputs.packFiles.size(); f++) {
+            LoadPackFile(inputs.packFiles[f], caches[f]);
+            DoNotOptimize(caches[f].frameCount);
+            if (f == 0) firstMs += state.clock.NowMs() - startMs;
+        }
+    }
+    state.SetItemsPerIteration(static_cast<double>(inputs.packFiles.size()));
+    state.SetCounter("first_ms", firstMs / state.iterations);
+}
+
+void LoadPackPool(BenchState& state, const BenchInputs& inputs, bool cold) {
+    const std::vector<std::string>& files = inputs.packFiles;
+    std::mutex mutex;
+    std::condition_variable wake;
+    size_t finished = 0;
+    double firstMs = 0.0;
+    for (size_t i = 0; i < state.iterations; i++) {
+        if (cold) DropPack(state, inputs);
+        double startMs = state.clock.NowMs();
+        chibi::AssetLoader loader;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            finished = 0;
+        }
+        // The notify callback stands in for the viewer's PostMessageW
+        loader.Start(files.size(),
+                     [&files](size_t index, chibi::FrameCache& cache, chibi::CompressedFrameStore& store) {
+                         (void)store;
+                         return LoadPackFile(files[index], cache);
+                     },
+                     [&mutex, &wake, &finished]() {
+                         std::lock_guard<std::mutex> lock(mutex);
+                         finished++;
+                         wake.notify_one();
+                     });
+
+        std::vector<chibi::AssetLoadResult> results;
+        bool first = true;
+        while (!loader.Finished()) {
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                wake.wait(lock, [&]() { return finished > results.size(); });
+            }
+            loader.Poll(results);
+            if (first && !results.empty()) {
+                firstMs += state.clock.NowMs() - startMs;
+                first = false;
+            }
+        }
+        loader.Wait();
+        DoNotOptimize(results.size());
+    }
+    state.SetItemsPerIteration(static_cast<double>(files.size()));
+    state.SetCounter("first_ms", firstMs / state.iterations);
+}
+
+void BenchStartupSerialWarm(BenchState& state, BenchInputs& inputs) {
+    LoadPackSerial(state, inputs, false);
+}
+
+void BenchStartupPoolWarm(BenchState& state, BenchInputs& inputs) {
+    LoadPackPool(state, inputs, false);
+}
+
+void BenchStartupSerialCold(BenchState& state, BenchInputs& inputs) {
+    LoadPackSerial(state, inputs, true);
+}
+
+void BenchStartupPoolCold(BenchState& state, BenchInputs& inputs) {
+    LoadPackPool(state, inputs, true);
+}
+
+// The same starts with every animation already in the disk cache: one entry
+// mapped and checked per file, and no decoding. The entries are written to
+// a scratch folder first (not timed); cold runs drop them along with the
+// sources, whose size and time are all a hit reads of them.
+void LoadPackDiskCache(BenchState& state, BenchInputs& inputs, bool cold) {
+    const std::vector<std::string>& files = inputs.packFiles;
+    const std::vector<chibi::FrameCache>& decoded = PackCaches(inputs);
+    std::string folder;
+    if (!MakeTempDirectory(folder)) return;
+    chibi::DiskCache diskCache;
+    diskCache.SetDirectory(chibi::NativePath(folder.begin(), folder.end()));
+    std::vector<std::string> entries;
+    {
+        chibi::FramePool pool;
+        for (size_t f = 0; f < files.size(); f++) {
+            chibi::NativePath source(files[f].begin(), files[f].end());
+            chibi::MappedFile file;
+            chibi::CompressedFrameStore store;
+            chibi::AssetStamp stamp;
+            if (OpenMapped(file, files[f]) && store.Build(decoded[f], pool) &&
+                chibi::MakeAssetStamp(source, file.Data(), file.Size(), stamp)) {
+                diskCache.Save(source, stamp, decoded[f], store);
+            }
+            chibi::NativePath entry = diskCache.EntryPath(source);
+            entries.push_back(std::string(entry.begin(), entry.end()));
+        }
+    }
+
+    double firstMs = 0.0;
+    diskCache.ResetStats();
+    state.ResetTimer();
+    for (size_t i = 0; i < state.iterations; i++) {
+        if (cold) {
+            DropPack(state, inputs);
+            state.PauseTiming();
+            for (size_t e = 0; e < entries.size(); e++) DropFromPageCache(entries[e]);
+            state.ResumeTiming();
+        }
+        double startMs = state.clock.NowMs();
+        chibi::FramePool pool;
+        std::vector<chibi::FrameCache> caches(files.size());
+        std::vector<chibi::CompressedFrameStore> stores(files.size());
+        for (size_t f = 0; f < files.size(); f++) {
+            diskCache.Load(chibi::NativePath(files[f].begin(), files[f].end()), pool, caches[f], stores[f]);
+            DoNotOptimize(stores[f].FrameCount());
+            if (f == 0) firstMs += state.clock.NowMs() - startMs;
+        }
+        state.PauseTiming();
+        for (size_t f = 0; f < stores.size(); f++) stores[f].Clear();
+        state.ResumeTiming();
+    }
+    state.SetItemsPerIteration(static_cast<double>(files.size()));
+    state.SetCounter("first_ms", firstMs / state.iterations);
+    state.SetCounter("hit_pct", 100.0 * diskCache.Stats().hits / (state.iterations * files.size()));
+    RemoveDirectoryAndFiles(folder);
+}
+
+void BenchStartupDiskCacheWarm(BenchState& state, BenchInputs& inputs) {
+    LoadPackDiskCache(state, inputs, false);
+}
+
+void BenchStartupDiskCacheCold(BenchState& state, BenchInputs& inputs) {
+    LoadPackDiskCache(state, inputs, true);
+}
+
+// The viewer's lazy start: WAIT's first frame decoded and presented before
+// the loader pool starts on the rest. first_pixel_ms is how long the first
+// frame took to reach the presenter, loaded_ms how long until every frame
+// of the pack was decoded.
+void BenchStartupFirstPixel(BenchState& state, BenchInputs& inputs) {
+    double firstPixelMs = 0.0;
+    double loadedMs = 0.0;
+    size_t loaded = 0;
+    for (size_t i = 0; i < state.iterations; i++) {
+        chibi::LoadTimings timings;
+        chibi::HeadlessPresenter presenter;
+        LazyStartupResult result;
+        if (!RunLazyStartup(inputs.packFiles, state.clock, timings, presenter, result)) return;
+        firstPixelMs += timings.TimeToFirstPixelMs();
+        loadedMs += timings.TimeToFullyLoadedMs();
+        loaded = result.loaded;
+    }
+    state.SetItemsPerIteration(static_cast<double>(loaded));
+    state.SetCounter("first_pixel_ms", firstPixelMs / state.iterations);
+    state.SetCounter("loaded_ms", loadedMs / state.iterations);
+}
+
+// ---------------------------------------------------------------------------
+// File reading: the WebP pack (about 16 MB) decoded out of a copy read with
+// stdio, against straight out of a read-only mapping. The hash variants
+// only read every byte once instead of decoding, which leaves the cost of
+// getting the bytes without the frames' allocations. On Linux each run also
+// reports its page faults, and rss_mb: the most the resident set grew while
+// one file (and its frames) were held.
+
+struct ProcessCounters {
+    double minorFaults;
+    double majorFaults;
+    double rssBytes;
+};
+
+ProcessCounters ReadProcessCounters() {
+    ProcessCounters counters = { 0.0, 0.0, 0.0 };
+#ifndef _WIN32
+    rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) == 0) {
+        counters.minorFaults = static_cast<double>(usage.ru_minflt);
+        counters.majorFaults = static_cast<double>(usage.ru_majflt);
+    }
+    FILE* statm = std::fopen("/proc/self/statm", "r");
+    if (statm) {
+        unsigned long pages = 0;
+        unsigned long resident = 0;
+        if (std::fscanf(statm, "%lu %lu", &pages, &resident) == 2) {
+            counters.rssBytes = static_cast<double>(resident) * sysconf(_SC_PAGESIZE);
+        }
+        std::fclose(statm);
+    }
+#endif
+    return counters;
+}
+
+void ReadWebPPack(BenchState& state, const BenchInputs& inputs, bool mapped, bool decode) {
+    const std::vector<std::string>& files = inputs.webpPackFiles;
+    ProcessCounters before = ReadProcessCounters();
+    double rssGrowth = 0.0;
+    double bytes = 0.0;
+    for (size_t i = 0; i < state.iterations; i++) {
+        for (size_t f = 0; f < files.size(); f++) {
+            state.PauseTiming();
+            double rssBefore = ReadProcessCounters().rssBytes;
+            state.ResumeTiming();
+
+            chibi::FrameCache cache;
+            chibi::MappedFile file;
+            std::vector<uint8_t> copy;
+            const uint8_t* data = nullptr;
+            size_t size = 0;
+            if (mapped && OpenMapped(file, files[f])) {
+                data = file.Data();
+                size = file.Size();
+            } else if (!mapped && ReadBuffered(files[f], copy)) {
+                data = copy.data();
+                size = copy.size();
+            }
+            if (decode) {
+                chibi::BuildFrameCache(data, size, cache);
+                DoNotOptimize(cache.frameCount);
+            } else {
+                DoNotOptimize(chibi::HashBytes(data, size));
+            }
+            bytes += static_cast<double>(size);
+
+            state.PauseTiming();
+            rssGrowth = std::max(rssGrowth, ReadProcessCounters().rssBytes - rssBefore);
+            state.ResumeTiming();
+        }
+    }
+    ProcessCounters after = ReadProcessCounters();
+    state.SetItemsPerIteration(static_cast<double>(files.size()));
+    state.SetBytesPerIteration(bytes / state.iterations);
+#ifndef _WIN32
+    state.SetCounter("minor_faults", (after.minorFaults - before.minorFaults) / state.iterations);
+    state.SetCounter("major_faults", (after.majorFaults - before.majorFaults) / state.iterations);
+    state.SetCounter("rss_mb", rssGrowth / 1048576.0);
+#else
+    (void)before;
+    (void)after;
+#endif
+}
+
+void BenchReadHashWebPPack(BenchState& state, BenchInputs& inputs) {
+    ReadWebPPack(state, inputs, false, false);
+}
+
+void BenchMapHashWebPPack(BenchState& state, BenchInputs& inputs) {
+    ReadWebPPack(state, inputs, true, false);
+}
+
+void BenchReadDecodeWebPPack(BenchState& state, BenchInputs& inputs) {
+    ReadWebPPack(state, inputs, false, true);
+}
+
+void BenchMapDecodeWebPPack(BenchState& state, BenchInputs& inputs) {
+    ReadWebPPack(state, inputs, true, true);
+}
+
+const Benchmark BENCHMARKS[] = {
+    { "decode/gif", BenchDecodeGif, NEEDS_NOTHING },
+    { "decode/lzw_large", BenchDecodeLzwLarge, NEEDS_LARGE_GIF },
+    { "decode/gif_large", BenchDecodeGifLarge, NEEDS_LARGE_GIF },
+    { "load/gif", BenchLoadGif, NEEDS_NOTHING },
+    { "load/webp", BenchLoadWebP, NEEDS_WEBP },
+    { "load/character_gif", BenchLoadCharacterGif, NEEDS_CHARACTER },
+    { "load/character_webp", BenchLoadCharacterWebP, NEEDS_CHARACTER },
+    { "palette/expand_row", BenchExpandPaletteRow, NEEDS_NOTHING },
+    { "palette/expand_row_scalar", BenchExpandPaletteRowScalar, NEEDS_NOTHING },
+#if CHIBI_X86
+    { "palette/expand_row_avx2", BenchExpandPaletteRowAvx2, NEEDS_AVX2 },
+#endif
+    { "premultiply/frame", BenchPremultiplyFrame, NEEDS_NOTHING },
+    { "paint/decode_frame", BenchPaintDecodeFrame, NEEDS_NOTHING },
+    { "paint/cached_frame", BenchPaintCachedFrame, NEEDS_NOTHING },
+    { "analyze/dirty_rect", BenchDirtyRect, NEEDS_NOTHING },
+    { "analyze/opaque_bounds", BenchOpaqueBounds, NEEDS_NOTHING },
+    { "analyze/hash_frame", BenchHashFrame, NEEDS_NOTHING },
+    { "mirror/frame", BenchMirrorFrame, NEEDS_NOTHING },
+    { "mirror/frame_scalar", BenchMirrorFrameScalar, NEEDS_NOTHING },
+#if CHIBI_X86
+    { "mirror/frame_sse2", BenchMirrorFrameSse2, NEEDS_SSE2 },
+    { "mirror/frame_avx2", BenchMirrorFrameAvx2, NEEDS_AVX2 },
+#endif
+    { "store/build", BenchStoreBuild, NEEDS_NOTHING },
+    { "store/sequential_k16", BenchStoreSequentialK16, NEEDS_PACK },
+    { "store/random_k4", BenchStoreRandomK4, NEEDS_PACK },
+    { "store/random_k16", BenchStoreRandomK16, NEEDS_PACK },
+    { "store/random_k64", BenchStoreRandomK64, NEEDS_PACK },
+    { "atlas/pack", BenchAtlasPack, NEEDS_PACK },
+    { "compose/full", BenchComposeFull, NEEDS_NOTHING },
+    { "compose/sequential", BenchComposeSequential, NEEDS_NOTHING },
+    { "compose/sequential_flipped", BenchComposeSequentialFlipped, NEEDS_NOTHING },
+    { "compose/store", BenchComposeStore, NEEDS_NOTHING },
+    { "compose/atlas_flipped", BenchComposeAtlasFlipped, NEEDS_NOTHING },
+    { "engine/legacy_queue_frames", BenchLegacyQueueFrames, NEEDS_NOTHING },
+    { "engine/state_transition", BenchStateTransition, NEEDS_NOTHING },
+    { "engine/animation_lookup", BenchAnimationLookup, NEEDS_NOTHING },
+    { "engine/animation_lookup_20000", BenchAnimationLookupLarge, NEEDS_NOTHING },
+    { "engine/state_variants_20000", BenchStateVariantsLarge, NEEDS_NOTHING },
+    { "engine/walk_step", BenchWalkStep, NEEDS_NOTHING },
+    { "engine/tick", BenchEngineTick, NEEDS_NOTHING },
+    { "startup/serial_warm", BenchStartupSerialWarm, NEEDS_PACK },
+    { "startup/pool_warm", BenchStartupPoolWarm, NEEDS_PACK },
+    { "startup/serial_cold", BenchStartupSerialCold, NEEDS_COLD },
+    { "startup/pool_cold", BenchStartupPoolCold, NEEDS_COLD },
+    { "startup/disk_cache_warm", BenchStartupDiskCacheWarm, NEEDS_PACK },
+    { "startup/disk_cache_cold", BenchStartupDiskCacheCold, NEEDS_COLD },
+    { "startup/first_pixel", BenchStartupFirstPixel, NEEDS_PACK },
+    { "io/read_hash_webp_pack", BenchReadHashWebPPack, NEEDS_WEBP_PACK },
+    { "io/mmap_hash_webp_pack", BenchMapHashWebPPack, NEEDS_WEBP_PACK },
+    { "io/read_decode_webp_pack", BenchReadDecodeWebPPack, NEEDS_WEBP_PACK },
+    { "io/mmap_decode_webp_pack", BenchMapDecodeWebPPack, NEEDS_WEBP_PACK },
+};
+
+// ---------------------------------------------------------------------------
+
+struct BenchOptions {
+    std::string gif;
+    std::string webp;
+    std::string largeGif;
+    std::string pack;
+    std::string webpPack;
+    std::string filter;
+    double minTimeMs;
+    int repetitions;
+    std::string json;
+    std::string baseline;
+    double threshold;  // Allowed slowdown against the baseline, as a fraction
+
+    BenchOptions()
+        : gif("vectormove.gif"), webp("../vectorviewer/vectormove.webp"), largeGif("vectorlying.gif"), pack("."),
+          webpPack("../Kalinaviewer"), minTimeMs(200.0), repetitions(3), threshold(0.10) {}
+};
+
+// Runs a benchmark with more and more iterations until one run lasts
+// minTimeMs, then repeats it at that count
+BenchResult RunBenchmark(const Benchmark& benchmark, BenchInputs& inputs, const BenchOptions& options) {
+    chibi::SteadyClock clock;
+    size_t iterations = 1;
+    for (;;) {
+        BenchState state(clock, iterations);
+        benchmark.func(state, inputs);
+        double elapsed = state.ElapsedMs();
+        if (elapsed >= options.minTimeMs || iterations >= (static_cast<size_t>(1) << 40)) break;
+
+        // Aim a little past the target, growing at most tenfold per round
+        double scale = elapsed > 0.0 ? options.minTimeMs * 1.2 / elapsed : 10.0;
+        scale = std::min(std::max(scale, 2.0), 10.0);
+        iterations = static_cast<size_t>(std::ceil(iterations * scale));
+    }
+
+    std::vector<double> times;
+    BenchResult result;
+    result.name = benchmark.name;
+    result.iterations = iterations;
+    result.itemsPerSecond = 0.0;
+    result.bytesPerSecond = 0.0;
+    double items = 0.0;
+    double bytes = 0.0;
+    for (int r = 0; r < std::max(options.repetitions, 1); r++) {
+        BenchState state(clock, iterations);
+        benchmark.func(state, inputs);
+        times.push_back(state.ElapsedMs() * 1e6 / iterations);
+        items = state.itemsPerIteration;
+        bytes = state.bytesPerIteration;
+        result.counters = state.counters;
+    }
+
+    std::sort(times.begin(), times.end());
+    result.nsPerIteration = times[times.size() / 2];
+    result.minNsPerIteration = times[0];
+    if (result.nsPerIteration > 0.0) {
+        result.itemsPerSecond = items * 1e9 / result.nsPerIteration;
+        result.bytesPerSecond = bytes * 1e9 / result.nsPerIteration;
+    }
+    return result;
+}
+
+// JSON in Google Benchmark's layout, one benchmark per line
+bool WriteJson(const std::string& path, const BenchOptions& options, const std::vector<BenchResult>& results) {
+    FILE* file = std::fopen(path.c_str(), "w");
+    if (!file) return false;
+
+    char date[64];
+    std::time_t now = std::time(nullptr);
+    std::strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%S", std::localtime(&now));
+    const chibi::CpuFeatures& cpu = chibi::GetCpuFeatures();
+
+    std::fprintf(file, "{\n  \"context\": {\"date\": \"%s\", \"executable\": \"chibi_bench\", \"min_time_ms\": %.0f, "
+                       "\"repetitions\": %d, \"sse2\": %s, \"ssse3\": %s, \"avx2\": %s},\n  \"benchmarks\": [\n",
+                 date, options.minTimeMs, options.repetitions, cpu.sse2 ? "true" : "false",
+                 cpu.ssse3 ? "true" : "false", cpu.avx2 ? "true" : "false");
+    for (size_t i = 0; i < results.size(); i++) {
+        const BenchResult& result = results[i];
+        std::fprintf(file, "    {\"name\": \"%s\", \"iterations\": %zu, \"real_time\": %.3f, \"min_time\": %.3f, "
+                           "\"time_unit\": \"ns\", \"items_per_second\": %.1f, \"bytes_per_second\": %.1f",
+                     result.name.c_str(), result.iterations, result.nsPerIteration, result.minNsPerIteration,
+                     result.itemsPerSecond, result.bytesPerSecond);
+        for (std::map<std::string, double>::const_iterator counter = result.counters.begin();
+             counter != result.counters.end(); ++counter) {
+            std::fprintf(file, ", \"%s\": %.3f", counter->first.c_str(), counter->second);
+        }
+        std::fprintf(file, "}%s\n", i + 1 < results.size() ? "," : "");
+    }
+    std::fprintf(file, "  ]\n}\n");
+    return std::fclose(file) == 0;
+}
+
+// Reads the name and real_time of every benchmark in a file WriteJson wrote
+bool ReadBaseline(const std::string& path, std::map<std::string, double>& times) {
+    FILE* file = std::fopen(path.c_str(), "r");
+    if (!file) return false;
+
+    char line[1024];
+    while (std::fgets(line, sizeof(line), file)) {
+        const char* name = std::strstr(line, "\"name\": \"");
+        const char* time = std::strstr(line, "\"real_time\": ");
+        if (!name || !time) continue;
+
+        name += std::strlen("\"name\": \"");
+        const char* nameEnd = std::strchr(name, '"');
+        if (!nameEnd) continue;
+        times[std::string(name, nameEnd)] = std::strtod(time + std::strlen("\"real_time\": "), nullptr);
+    }
+    std::fclose(file);
+    return true;
+}
+
+std::string FormatRate(double perSecond, const char* unit) {
+    static const char* const prefixes[] = { "", "k", "M", "G", "T" };
+    size_t prefix = 0;
+    while (perSecond >= 1000.0 && prefix + 1 < sizeof(prefixes) / sizeof(prefixes[0])) {
+        perSecond /= 1000.0;
+        prefix++;
+    }
+    char text[32];
+    std::snprintf(text, sizeof(text), "%.1f %s%s/s", perSecond, prefixes[prefix], unit);
+    return text;
+}
+
+std::string FormatTime(double ns) {
+    char text[32];
+    if (ns >= 1e6) {
+        std::snprintf(text, sizeof(text), "%.2f ms", ns / 1e6);
+    } else if (ns >= 1e3) {
+        std::snprintf(text, sizeof(text), "%.2f us", ns / 1e3);
+    } else {
+        std::snprintf(text, sizeof(text), "%.1f ns", ns);
+    }
+    return text;
+}
+
+void PrintUsage() {
+    std::printf(
+        "usage: chibi_bench [options]\n"
+        "  --gif FILE         GIF input (default vectormove.gif)\n"
+        "  --webp FILE        WebP input (default ../vectorviewer/vectormove.webp)\n"
+        "  --large-gif FILE   GIF for the decode throughput benchmarks (default vectorlying.gif)\n"
+        "  --pack DIR         folder of animations for the startup benchmarks (default .)\n"
+        "  --webp-pack DIR    folder of WebPs for the file reading benchmarks (default ../Kalinaviewer)\n"
+        "  --filter TEXT      only run benchmarks whose name contains TEXT\n"
+        "  --min-time MS      shortest timed run (default 200)\n"
+        "  --repetitions N    timed runs per benchmark; the median is reported (default 3)\n"
+        "  --json FILE        write the results as JSON\n"
+        "  --baseline FILE    compare with results saved by --json; exit 1 on a regression\n"
+        "  --threshold PCT    slowdown allowed against the baseline (default 10)\n");
+}
+
+bool ParseOptions(int argc, char** argv, BenchOptions& options) {
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--help" || i + 1 >= argc) {
+            if (arg != "--help") std::fprintf(stderr, "chibi_bench: %s needs a value\n", arg.c_str());
+            return false;
+        }
+
+        const char* value = argv[++i];
+        if (arg == "--gif") {
+            options.gif = value;
+        } else if (arg == "--webp") {
+            options.webp = value;
+        } else if (arg == "--large-gif") {
+            options.largeGif = value;
+        } else if (arg == "--pack") {
+            options.pack = value;
+        } else if (arg == "--webp-pack") {
+            options.webpPack = value;
+        } else if (arg == "--filter") {
+            options.filter = value;
+        } else if (arg == "--min-time") {
+            options.minTimeMs = std::strtod(value, nullptr);
+        } else if (arg == "--repetitions") {
+            options.repetitions = std::atoi(value);
+        } else if (arg == "--json") {
+            options.json = value;
+        } else if (arg == "--baseline") {
+            options.baseline = value;
+        } else if (arg == "--threshold") {
+            options.threshold = std::strtod(value, nullptr) / 100.0;
+        } else {
+            std::fprintf(stderr, "chibi_bench: unknown option %s\n", arg.c_str());
+            return false;
+        }
+    }
+    return true;
+}
+
+int main(int argc, char** argv) {
+    BenchOptions options;
+    if (!ParseOptions(argc, argv, options)) {
+        PrintUsage();
+        return 2;
+    }
+
+    std::map<std::string, double> baseline;
+    if (!options.baseline.empty() && (!ReadBaseline(options.baseline, baseline) || baseline.empty())) {
+        std::fprintf(stderr, "chibi_bench: cannot read %s, or it holds no results\n", options.baseline.c_str());
+        return 2;
+    }
+
+    BenchInputs inputs;
+    if (!ReadWholeFile(options.gif, inputs.gifBytes) ||
+        !chibi::BuildFrameCache(inputs.gifBytes.data(), inputs.gifBytes.size(), inputs.cache)) {
+        std::fprintf(stderr, "chibi_bench: cannot load %s\n", options.gif.c_str());
+        return 2;
+    }
+    inputs.cache.EnsureMirrored();
+    inputs.store.Build(inputs.cache, inputs.pool);
+    inputs.atlasAnimation.Build(inputs.atlas, inputs.cache);
+    bool haveWebP = ReadWholeFile(options.webp, inputs.webpBytes);
+    if (!haveWebP) {
+        std::fprintf(stderr, "chibi_bench: no WebP input at %s, skipping WebP benchmarks\n", options.webp.c_str());
+    }
+    bool haveLargeGif = ReadWholeFile(options.largeGif, inputs.largeGifBytes);
+    if (!haveLargeGif) {
+        std::fprintf(stderr, "chibi_bench: no GIF at %s, skipping decode throughput benchmarks\n",
+                     options.largeGif.c_str());
+    }
+    inputs.packFiles = ListAnimations(options.pack);
+    bool havePack = !inputs.packFiles.empty();
+    if (!havePack) {
+        std::fprintf(stderr, "chibi_bench: no animations in %s, skipping startup benchmarks\n", options.pack.c_str());
+    }
+    std::string webpFolder = options.webp.substr(0, options.webp.find_last_of("/\\") + 1);
+    for (size_t f = 0; f < inputs.packFiles.size(); f++) {
+        const std::string& gif = inputs.packFiles[f];
+        size_t name = gif.find_last_of("/\\") + 1;
+        size_t dot = gif.find_last_of('.');
+        if (gif.compare(dot, std::string::npos, ".gif") != 0) continue;
+        std::string webp = webpFolder + gif.substr(name, dot - name) + ".webp";
+        std::vector<uint8_t> probe;
+        if (ReadWholeFile(webp, probe)) {
+            inputs.characterGifs.push_back(gif);
+            inputs.characterWebPs.push_back(webp);
+        }
+    }
+    bool haveCharacter = !inputs.characterGifs.empty();
+    inputs.webpPackFiles = ListAnimations(options.webpPack);
+    bool haveWebPPack = !inputs.webpPackFiles.empty();
+    if (!haveWebPPack) {
+        std::fprintf(stderr, "chibi_bench: no animations in %s, skipping file reading benchmarks\n",
+                     options.webpPack.c_str());
+    }
+
+    std::printf("%s: %dx%d, %zu frames\n", options.gif.c_str(), inputs.cache.width, inputs.cache.height,
+                inputs.cache.frameCount);
+    std::printf("%-30s %14s %12s %16s %16s %10s\n", "benchmark", "time", "iterations", "items", "bytes",
+                baseline.empty() ? "" : "vs base");
+
+    const chibi::CpuFeatures& cpu = chibi::GetCpuFeatures();
+    std::vector<BenchResult> results;
+    size_t regressions = 0;
+    size_t compared = 0;
+    for (size_t i = 0; i < sizeof(BENCHMARKS) / sizeof(BENCHMARKS[0]); i++) {
+        const Benchmark& benchmark = BENCHMARKS[i];
+        if (!options.filter.empty() && std::string(benchmark.name).find(options.filter) == std::string::npos) {
+            continue;
+        }
+        if ((benchmark.needs == NEEDS_WEBP && !haveWebP) || (benchmark.needs == NEEDS_LARGE_GIF && !haveLargeGif) ||
+            (benchmark.needs == NEEDS_PACK && !havePack) ||
+            (benchmark.needs == NEEDS_COLD && (!havePack || !CanDropFromPageCache())) ||
+            (benchmark.needs == NEEDS_WEBP_PACK && !haveWebPPack) ||
+            (benchmark.needs == NEEDS_CHARACTER && !haveCharacter) ||
+            (benchmark.needs == NEEDS_SSE2 && !cpu.sse2) || (benchmark.needs == NEEDS_AVX2 && !cpu.avx2)) {
+            continue;
+        }
+
+        BenchResult result = RunBenchmark(benchmark, inputs, options);
+        results.push_back(result);
+
+        char change[32] = "";
+        const char* verdict = "";
+        std::map<std::string, double>::const_iterator base = baseline.find(result.name);
+        if (base != baseline.end() && base->second > 0.0) {
+            compared++;
+            double ratio = result.nsPerIteration / base->second;
+            std::snprintf(change, sizeof(change), "%+.1f%%", (ratio - 1.0) * 100.0);
+            if (ratio > 1.0 + options.threshold) {
+                verdict = "  REGRESSION";
+                regressions++;
+            }
+        }
+
+        std::printf("%-30s %14s %12zu %16s %16s %10s%s\n", result.name.c_str(),
+                    FormatTime(result.nsPerIteration).c_str(), result.iterations,
+                    result.itemsPerSecond > 0.0 ? FormatRate(result.itemsPerSecond, "").c_str() : "",
+                    result.bytesPerSecond > 0.0 ? FormatRate(result.bytesPerSecond, "B").c_str() : "",
+                    change, verdict);
+        for (std::map<std::string, double>::const_iterator counter = result.counters.begin();
+             counter != result.counters.end(); ++counter) {
+            std::printf("%-30s %14s %s %g\n", "", "", counter->first.c_str(), counter->second);
+        }
+    }
+
+    if (!options.json.empty() && !WriteJson(options.json, options, results)) {
+        std::fprintf(stderr, "chibi_bench: cannot write %s\n", options.json.c_str());
+        return 2;
+    }
+    // A baseline that matches nothing (renamed benchmarks, a wrong --filter)
+    // would pass without checking anything
+    if (!baseline.empty() && compared == 0) {
+        std::fprintf(stderr, "chibi_bench: no benchmark run is in %s\n", options.baseline.c_str());
+        return 1;
+    }
+    if (regressions > 0) {
+        std::fprintf(stderr, "chibi_bench: %zu benchmark%s slower than the baseline by more than %.0f%%\n",
+                     regressions, regressions == 1 ? "" : "s", options.threshold * 100.0);
+        return 1;
+    }
+    return 0;
+}
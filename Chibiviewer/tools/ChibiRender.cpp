@@ -0,0 +1,588 @@
+// Offscreen renderer.
+//
+// Runs the viewer's frame pipeline without a window: decode a pack, keep its
+// frames the way the viewer does (compressed store, atlas or plain cache),
+// then let the engine play it on its own clock as fast as frames can be
+// composed and presented into memory. Walk cycles bounce off the screen
+// edges, so flipped frames are covered too. Reports load time, frames per
+// second and time per frame; can dump sampled frames as PNG or PPM and
+// record or check their hashes against a golden file, and can write a
+// Chrome trace of the run.
+//
+// Build:           the chibi_render target in CMakeLists.txt
+// Example:         ./build/chibi_render --pack . --frames 10000
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cstdint>
+#include <cmath>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <map>
+
+#include "../core/Atlas.h"
+#include "../core/Clock.h"
+#include "../core/Compositor.h"
+#include "../core/Engine.h"
+#include "../core/FrameCache.h"
+#include "../core/FramePool.h"
+#include "../core/FrameStore.h"
+#include "../core/MappedFile.h"
+#include "../core/Presenter.h"
+#include "../core/Trace.h"
+#include "../core/Trim.h"
+#include "PackFiles.h"
+
+// How loaded frames are kept, as in the viewer
+enum FrameMode {
+    FRAMES_STORE,  // Compressed store with a decoded hot set (FRAME_STORE_BUDGET > 0)
+    FRAMES_ATLAS,  // Trimmed sprites in shared pages (FRAME_STORE_BUDGET == 0)
+    FRAMES_CACHE   // Full canvases plus mirrored copies (before packing)
+};
+
+struct RenderOptions {
+    std::string pack;
+    size_t frames;
+    FrameMode mode;
+    size_t budget;        // Store budget in bytes
+    bool trim;
+    size_t switchEvery;   // Frames between state changes; 0 never changes state
+    size_t sampleEvery;   // Frames between sampled frames; 0 samples none
+    std::string dumpDir;
+    bool dumpPng;
+    std::string golden;       // Check sampled hashes against this file
+    std::string writeGolden;  // Or record them to this one
+    std::string trace;        // Chrome trace-event JSON of the run
+    uint32_t seed;
+    int screenWidth;
+    int screenHeight;
+
+    RenderOptions()
+        : pack("."), frames(10000), mode(FRAMES_STORE), budget(4 * 1024 * 1024), trim(true), switchEvery(250),
+          sampleEvery(0), dumpPng(true), seed(1), screenWidth(1920), screenHeight(1080) {}
+};
+
+struct RenderAnimation {
+    std::string path;
+    std::string tag;
+    chibi::AnimationType type;
+    chibi::FrameCache cache;
+    chibi::CompressedFrameStore store;
+    chibi::AtlasAnimation atlas;
+};
+
+// Lower-case file name without extension
+std::string TagFromPath(const std::string& path) {
+    size_t nameStart = path.find_last_of("\\/");
+    nameStart = (nameStart == std::string::npos) ? 0 : nameStart + 1;
+    size_t nameEnd = path.find_last_of('.');
+    if (nameEnd == std::string::npos || nameEnd < nameStart) {
+        nameEnd = path.size();
+    }
+
+    std::string name = path.substr(nameStart, nameEnd - nameStart);
+    std::transform(name.begin(), name.end(), name.begin(), ::tolower);
+    return name;
+}
+
+// Same rules as the viewer's GetGifTypeFromFilename
+chibi::AnimationType TypeFromTag(const std::string& tag) {
+    if (tag.find("move") != std::string::npos) return chibi::ANIMATION_MOVE;
+    if (tag.find("wait") != std::string::npos) return chibi::ANIMATION_WAIT;
+    if (tag.find("sit") != std::string::npos) return chibi::ANIMATION_SIT;
+    if (tag.find("pick") != std::string::npos) return chibi::ANIMATION_PICK;
+    return chibi::ANIMATION_MISC;
+}
+
+// Decodes an animation and keeps its frames the way options.mode says
+bool LoadAnimation(const RenderOptions& options, chibi::FramePool& pool, chibi::FrameAtlas& atlas,
+                   RenderAnimation& animation) {
+    chibi::TraceScope span("load_animation", "load");
+    chibi::MappedFile file;
+    if (!OpenMapped(file, animation.path)) return false;
+    if (!chibi::BuildFrameCache(file.Data(), file.Size(), animation.cache) || animation.cache.Empty()) return false;
+
+    switch (options.mode) {
+        case FRAMES_STORE:
+            if (!animation.store.Build(animation.cache, pool)) return false;
+            animation.store.SetBudget(options.budget);
+            animation.cache.ReleasePixels();
+            break;
+        case FRAMES_ATLAS:
+            if (!animation.atlas.Build(atlas, animation.cache)) return false;
+            animation.cache.ReleasePixels();
+            break;
+        case FRAMES_CACHE:
+            if (animation.type == chibi::ANIMATION_MOVE) animation.cache.EnsureMirrored();
+            break;
+    }
+    return true;
+}
+
+chibi::PixelRect AnimationView(const RenderOptions& options, const chibi::FrameCache& cache) {
+    if (!options.trim) return chibi::PixelRect::Make(0, 0, cache.width, cache.height);
+    return chibi::TrimView(cache.opaqueBounds, cache.width, cache.height);
+}
+
+// ---------------------------------------------------------------------------
+// Image output. PNG is written uncompressed (stored deflate blocks), which
+// every reader accepts and needs no zlib.
+
+void PutBe32(std::vector<uint8_t>& out, uint32_t value) {
+    out.push_back(static_cast<uint8_t>(value >> 24));
+    out.push_back(static_cast<uint8_t>(value >> 16));
+    out.push_back(static_cast<uint8_t>(value >> 8));
+    out.push_back(static_cast<uint8_t>(value));
+}
+
+uint32_t Crc32(const uint8_t* data, size_t size, uint32_t crc = 0) {
+    static uint32_t table[256];
+    static bool tableReady = false;
+    if (!tableReady) {
+        for (uint32_t i = 0; i < 256; i++) {
+            uint32_t c = i;
+            for (int k = 0; k < 8; k++) c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+            table[i] = c;
+        }
+        tableReady = true;
+    }
+
+    crc = ~crc;
+    for (size_t i = 0; i < size; i++) crc = table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+    return ~crc;
+}
+
+void PutPngChunk(std::vector<uint8_t>& out, const char* type, const std::vector<uint8_t>& data) {
+    PutBe32(out, static_cast<uint32_t>(data.size()));
+    size_t start = out.size();
+    out.insert(out.end(), type, type + 4);
+    out.insert(out.end(), data.begin(), data.end());
+    PutBe32(out, Crc32(&out[start], out.size() - start));
+}
+
+// Straight (not premultiplied) RGBA rows, each led by PNG filter byte 0
+std::vector<uint8_t> UnpremultipliedRows(const chibi::Surface& surface, bool alpha) {
+    size_t channels = alpha ? 4 : 3;
+    std::vector<uint8_t> rows;
+    rows.reserve((static_cast<size_t>(surface.width) * channels + 1) * surface.height);
+    for (int y = 0; y < surface.height; y++) {
+        if (alpha) rows.push_back(0);
+        const uint32_t* row = surface.Row(y);
+        for (int x = 0; x < surface.width; x++) {
+            uint32_t pixel = row[x];
+            uint32_t a = pixel >> 24;
+            uint32_t r = (pixel >> 16) & 0xFF;
+            uint32_t g = (pixel >> 8) & 0xFF;
+            uint32_t b = pixel & 0xFF;
+            if (alpha && a != 0 && a != 255) {
+                r = std::min(255u, (r * 255 + a / 2) / a);
+                g = std::min(255u, (g * 255 + a / 2) / a);
+                b = std::min(255u, (b * 255 + a / 2) / a);
+            }
+            rows.push_back(static_cast<uint8_t>(r));
+            rows.push_back(static_cast<uint8_t>(g));
+            rows.push_back(static_cast<uint8_t>(b));
+            if (alpha) rows.push_back(static_cast<uint8_t>(a));
+        }
+    }
+    return rows;
+}
+
+bool WriteFile(const std::string& path, const std::vector<uint8_t>& bytes) {
+    FILE* file = std::fopen(path.c_str(), "wb");
+    if (!file) return false;
+    bool ok = std::fwrite(bytes.data(), 1, bytes.size(), file) == bytes.size();
+    return std::fclose(file) == 0 && ok;
+}
+
+bool WritePng(const std::string& path, const chibi::Surface& surface) {
+    std::vector<uint8_t> raw = UnpremultipliedRows(surface, true);
+
+    // zlib stream of stored blocks of at most 65535 bytes
+    std::vector<uint8_t> zlib;
+    zlib.push_back(0x78);
+    zlib.push_back(0x01);
+    size_t offset = 0;
+    do {
+        size_t length = std::min<size_t>(raw.size() - offset, 65535);
+        bool last = offset + length == raw.size();
+        zlib.push_back(last ? 1 : 0);
+        zlib.push_back(static_cast<uint8_t>(length));
+        zlib.push_back(static_cast<uint8_t>(length >> 8));
+        zlib.push_back(static_cast<uint8_t>(~length));
+        zlib.push_back(static_cast<uint8_t>(~length >> 8));
+        zlib.insert(zlib.end(), raw.begin() + offset, raw.begin() + offset + length);
+        offset += length;
+    } while (offset < raw.size());
+
+    uint32_t a = 1;
+    uint32_t b = 0;
+    for (size_t i = 0; i < raw.size(); i++) {
+        a = (a + raw[i]) % 65521;
+        b = (b + a) % 65521;
+    }
+    PutBe32(zlib, (b << 16) | a);
+
+    std::vector<uint8_t> header;
+    PutBe32(header, static_cast<uint32_t>(surface.width));
+    PutBe32(header, static_cast<uint32_t>(surface.height));
+    header.push_back(8);  // Bits per channel
+    header.push_back(6);  // RGBA
+    header.push_back(0);
+    header.push_back(0);
+    header.push_back(0);
+
+    static const uint8_t signature[] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+    std::vector<uint8_t> png(signature, signature + sizeof(signature));
+    PutPngChunk(png, "IHDR", header);
+    PutPngChunk(png, "IDAT", zlib);
+    PutPngChunk(png, "IEND", std::vector<uint8_t>());
+    return WriteFile(path, png);
+}
+
+// Binary PPM, composited over black (the premultiplied colour channels)
+bool WritePpm(const std::string& path, const chibi::Surface& surface) {
+    char header[64];
+    int length = std::snprintf(header, sizeof(header), "P6\n%d %d\n255\n", surface.width, surface.height);
+    std::vector<uint8_t> ppm(header, header + length);
+    for (int y = 0; y < surface.height; y++) {
+        const uint32_t* row = surface.Row(y);
+        for (int x = 0; x < surface.width; x++) {
+            ppm.push_back(static_cast<uint8_t>(row[x] >> 16));
+            ppm.push_back(static_cast<uint8_t>(row[x] >> 8));
+            ppm.push_back(static_cast<uint8_t>(row[x]));
+        }
+    }
+    return WriteFile(path, ppm);
+}
+
+// ---------------------------------------------------------------------------
+// Golden files: one line per sampled frame, "<frame> <hash> <tag> <index> <flipped>".
+// Only the frame number and hash are compared; the rest says what it was.
+
+bool ReadGolden(const std::string& path, std::map<size_t, uint64_t>& hashes) {
+    FILE* file = std::fopen(path.c_str(), "r");
+    if (!file) return false;
+
+    char line[512];
+    while (std::fgets(line, sizeof(line), file)) {
+        unsigned long long frame = 0;
+        unsigned long long hash = 0;
+        if (std::sscanf(line, "%llu %llx", &frame, &hash) == 2) {
+            hashes[static_cast<size_t>(frame)] = hash;
+        }
+    }
+    std::fclose(file);
+    return true;
+}
+
+// ---------------------------------------------------------------------------
+
+void PrintUsage() {
+    std::printf(
+        "usage: chibi_render [options]\n"
+        "  --pack DIR          folder of GIF/WebP animations (default .)\n"
+        "  --frames N          frames to render (default 10000)\n"
+        "  --mode M            store, atlas or cache: how frames are kept (default store)\n"
+        "  --budget BYTES      decoded bytes per animation in store mode (default 4194304)\n"
+        "  --no-trim           compose whole canvases instead of trimmed views\n"
+        "  --switch-every N    change state every N frames, 0 never (default 250)\n"
+        "  --sample-every N    sample every Nth frame for dumps and hashes (default 100 when needed)\n"
+        "  --dump DIR          write sampled frames to DIR\n"
+        "  --format F          png or ppm (default png)\n"
+        "  --golden FILE       check sampled frame hashes against FILE; exit 1 on a mismatch\n"
+        "  --write-golden FILE record sampled frame hashes to FILE\n"
+        "  --seed N            engine random seed (default 1)\n"
+        "  --screen WxH        screen the walk bounces across (default 1920x1080)\n"
+        "  --trace FILE        write a Chrome trace (for ui.perfetto.dev) of loading and rendering\n");
+}
+
+bool ParseOptions(int argc, char** argv, RenderOptions& options) {
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        const char* value = i + 1 < argc ? argv[i + 1] : nullptr;
+        static const char* const valueOptions[] = { "--pack", "--frames", "--mode", "--budget", "--switch-every",
+                                                    "--sample-every", "--dump", "--format", "--golden",
+                                                    "--write-golden", "--seed", "--screen", "--trace" };
+        bool takesValue = std::find(valueOptions, valueOptions + sizeof(valueOptions) / sizeof(valueOptions[0]),
+                                    arg) != valueOptions + sizeof(valueOptions) / sizeof(valueOptions[0]);
+        if (takesValue && !value) {
+            std::fprintf(stderr, "chibi_render: %s needs a value\n", arg.c_str());
+            return false;
+        }
+
+        if (arg == "--pack") {
+            options.pack = value;
+        } else if (arg == "--frames") {
+            options.frames = std::strtoull(value, nullptr, 10);
+        } else if (arg == "--mode") {
+            std::string mode = value;
+            if (mode == "store") {
+                options.mode = FRAMES_STORE;
+            } else if (mode == "atlas") {
+                options.mode = FRAMES_ATLAS;
+            } else if (mode == "cache") {
+                options.mode = FRAMES_CACHE;
+            } else {
+                std::fprintf(stderr, "chibi_render: unknown mode %s\n", value);
+                return false;
+            }
+        } else if (arg == "--budget") {
+            options.budget = std::strtoull(value, nullptr, 10);
+        } else if (arg == "--no-trim") {
+            options.trim = false;
+        } else if (arg == "--switch-every") {
+            options.switchEvery = std::strtoull(value, nullptr, 10);
+        } else if (arg == "--sample-every") {
+            options.sampleEvery = std::strtoull(value, nullptr, 10);
+        } else if (arg == "--dump") {
+            options.dumpDir = value;
+        } else if (arg == "--format") {
+            options.dumpPng = std::string(value) != "ppm";
+        } else if (arg == "--golden") {
+            options.golden = value;
+        } else if (arg == "--write-golden") {
+            options.writeGolden = value;
+        } else if (arg == "--trace") {
+            options.trace = value;
+        } else if (arg == "--seed") {
+            options.seed = static_cast<uint32_t>(std::strtoul(value, nullptr, 10));
+        } else if (arg == "--screen") {
+            if (std::sscanf(value, "%dx%d", &options.screenWidth, &options.screenHeight) != 2) {
+                std::fprintf(stderr, "chibi_render: --screen takes WxH\n");
+                return false;
+            }
+        } else {
+            if (arg != "--help") std::fprintf(stderr, "chibi_render: unknown option %s\n", arg.c_str());
+            return false;
+        }
+        if (takesValue) i++;
+    }
+
+    bool sampling = !options.dumpDir.empty() || !options.golden.empty() || !options.writeGolden.empty();
+    if (sampling && options.sampleEvery == 0) options.sampleEvery = 100;
+    return true;
+}
+
+int main(int argc, char** argv) {
+    RenderOptions options;
+    if (!ParseOptions(argc, argv, options)) {
+        PrintUsage();
+        return 2;
+    }
+
+    std::map<size_t, uint64_t> golden;
+    if (!options.golden.empty() && (!ReadGolden(options.golden, golden) || golden.empty())) {
+        std::fprintf(stderr, "chibi_render: cannot read %s, or it holds no hashes\n", options.golden.c_str());
+        return 2;
+    }
+
+    // Declared first so it outlives the stores
+    chibi::FramePool pool;
+    chibi::FrameAtlas atlas;
+    std::vector<RenderAnimation> animations;
+
+    // Room for every frame's tick, compose and present, so nothing is dropped
+    chibi::Tracer& tracer = chibi::GlobalTracer();
+    if (!options.trace.empty()) {
+        tracer.Start(std::max<size_t>(chibi::TRACE_EVENTS_PER_THREAD, options.frames * 4 + 4096));
+        tracer.NameThread("main");
+    }
+
+    chibi::SteadyClock wallClock;
+    double loadStart = wallClock.NowMs();
+    std::vector<std::string> paths = ListAnimations(options.pack);
+    animations.reserve(paths.size());
+    for (size_t i = 0; i < paths.size(); i++) {
+        animations.push_back(RenderAnimation());
+        RenderAnimation& animation = animations.back();
+        animation.path = paths[i];
+        animation.tag = TagFromPath(paths[i]);
+        animation.type = TypeFromTag(animation.tag);
+        if (!LoadAnimation(options, pool, atlas, animation)) {
+            std::fprintf(stderr, "chibi_render: skipping %s\n", paths[i].c_str());
+            animations.pop_back();
+        }
+    }
+    if (options.mode == FRAMES_ATLAS) atlas.Compact();
+    double loadMs = wallClock.NowMs() - loadStart;
+
+    if (animations.empty()) {
+        std::fprintf(stderr, "chibi_render: no animations in %s\n", options.pack.c_str());
+        return 2;
+    }
+
+    // The engine runs on its own clock, jumping straight to each deadline
+    chibi::Engine engine(chibi::EngineConfig(), options.seed);
+    engine.SetScreen(options.screenWidth, options.screenHeight);
+    engine.SetWindow(chibi::PixelRect::Make(0, options.screenHeight - 200, 200, options.screenHeight));
+    for (size_t i = 0; i < animations.size(); i++) {
+        const chibi::FrameCache& cache = animations[i].cache;
+        engine.AddAnimation(animations[i].type, animations[i].tag, cache.width, cache.height, cache.delays,
+                            cache.frameCount, AnimationView(options, cache));
+    }
+    engine.SetMode(chibi::MODE_AUTOMATIC);
+
+    chibi::HeadlessPresenter presenter;
+    chibi::Compositor compositor;
+    std::vector<chibi::EngineCommand> commands;
+    FILE* goldenOut = options.writeGolden.empty() ? nullptr : std::fopen(options.writeGolden.c_str(), "w");
+    if (!options.writeGolden.empty() && !goldenOut) {
+        std::fprintf(stderr, "chibi_render: cannot write %s\n", options.writeGolden.c_str());
+        return 2;
+    }
+
+    size_t rendered = 0;
+    size_t presented = 0;
+    size_t flippedFrames = 0;
+    size_t sampled = 0;
+    size_t mismatches = 0;
+    size_t checked = 0;  // Golden frames that were rendered
+    size_t shown = SIZE_MAX;
+    double renderStart = wallClock.NowMs();
+    while (rendered < options.frames) {
+        // Whole milliseconds, as the viewer waits; a leftover fraction of a
+        // step can be too small to move the clock at all
+        double wait = engine.MsUntilNextUpdate();
+        engine.Tick(wait < 0.0 ? 16.0 : std::ceil(wait));
+        engine.TakeCommands(commands);
+
+        // Window moves cost nothing here; only the last frame of a batch is shown
+        const chibi::EngineCommand* show = nullptr;
+        for (size_t i = 0; i < commands.size(); i++) {
+            if (commands[i].type == chibi::ENGINE_SHOW_FRAME) show = &commands[i];
+        }
+        if (!show) continue;
+
+        RenderAnimation& animation = animations[show->animation];
+        if (shown != show->animation && shown < animations.size()) {
+            animations[shown].store.ReleaseHot();
+        }
+        shown = show->animation;
+
+        chibi::PixelRect view = AnimationView(options, animation.cache);
+        compositor.SetView(view);
+        chibi::Surface surface = presenter.GetSurface();
+        if (surface.width != view.Width() || surface.height != view.Height()) {
+            presenter.Resize(view.Width(), view.Height());
+            surface = presenter.GetSurface();
+            compositor.Invalidate();
+        }
+
+        bool composed;
+        {
+            chibi::TraceScope span("compose", "render", "frame", static_cast<int64_t>(show->frame));
+            if (!animation.store.Empty()) {
+                composed = compositor.Compose(surface, animation.store, show->frame, show->flipped);
+            } else if (!animation.atlas.Empty()) {
+                composed = compositor.Compose(surface, atlas, animation.atlas, show->frame, show->flipped);
+            } else {
+                composed = compositor.Compose(surface, animation.cache, show->frame, show->flipped);
+            }
+        }
+        if (composed) {
+            chibi::TraceScope span("present", "render");
+            if (presenter.Present(compositor.LastRegion())) presented++;
+        }
+        if (show->flipped) flippedFrames++;
+
+        // The presenter's history is not needed; keep it from growing
+        if (presenter.PresentCount() >= 4096) presenter.ClearHistory();
+
+        if (options.sampleEvery > 0 && rendered % options.sampleEvery == 0) {
+            chibi::TraceScope span("sample", "output");
+            sampled++;
+            uint64_t hash = chibi::HashSurface(surface);
+            bool mismatch = false;
+            if (!golden.empty()) {
+                std::map<size_t, uint64_t>::const_iterator expected = golden.find(rendered);
+                mismatch = expected == golden.end() || expected->second != hash;
+                if (expected != golden.end()) checked++;
+                if (mismatch) {
+                    mismatches++;
+                    std::fprintf(stderr, "chibi_render: frame %zu (%s frame %zu%s) does not match the golden file\n",
+                                 rendered, animation.tag.c_str(), show->frame, show->flipped ? ", flipped" : "");
+                }
+            }
+            if (goldenOut) {
+                std::fprintf(goldenOut, "%zu %016llx %s %zu %d\n", rendered, static_cast<unsigned long long>(hash),
+                             animation.tag.c_str(), show->frame, show->flipped ? 1 : 0);
+            }
+            if (!options.dumpDir.empty()) {
+                char name[64];
+                std::snprintf(name, sizeof(name), "%sframe_%06zu.%s", mismatch ? "mismatch_" : "", rendered,
+                              options.dumpPng ? "png" : "ppm");
+                std::string path = options.dumpDir + "/" + name;
+                bool written = options.dumpPng ? WritePng(path, surface) : WritePpm(path, surface);
+                if (!written) std::fprintf(stderr, "chibi_render: cannot write %s\n", path.c_str());
+            }
+        }
+
+        rendered++;
+
+        // Cycle through the states so every animation gets played
+        if (options.switchEvery > 0 && rendered % options.switchEvery == 0) {
+            engine.CycleState();
+        }
+    }
+    double renderMs = wallClock.NowMs() - renderStart;
+    if (goldenOut) std::fclose(goldenOut);
+
+    size_t traceEvents = 0;
+    bool traceWritten = true;
+    if (!options.trace.empty()) {
+        tracer.Stop();
+        std::string json;
+        tracer.AppendChromeJson(json);
+        traceEvents = tracer.EventCount();
+        FILE* traceOut = std::fopen(options.trace.c_str(), "wb");
+        traceWritten = traceOut && std::fwrite(json.data(), 1, json.size(), traceOut) == json.size();
+        if (traceOut && std::fclose(traceOut) != 0) traceWritten = false;
+        if (!traceWritten) std::fprintf(stderr, "chibi_render: cannot write %s\n", options.trace.c_str());
+    }
+
+    // A shorter run or a different --sample-every leaves golden frames out
+    if (checked < golden.size()) {
+        std::fprintf(stderr, "chibi_render: %zu frames in the golden file were not sampled\n", golden.size() - checked);
+        mismatches += golden.size() - checked;
+    }
+
+    static const char* const modeNames[] = { "store", "atlas", "cache" };
+    const chibi::CompositorStats& stats = compositor.Stats();
+    std::printf("pack            %s (%zu animations, %s mode%s)\n", options.pack.c_str(), animations.size(),
+                modeNames[options.mode], options.trim ? ", trimmed" : "");
+    std::printf("load            %.1f ms\n", loadMs);
+    std::printf("frames          %zu rendered, %zu presented, %zu flipped, %.0f ms of animation\n", rendered,
+                presented, flippedFrames, engine.NowMs());
+    std::printf("copies          %llu full, %llu partial, %.1f MB written\n",
+                static_cast<unsigned long long>(stats.fullCopies), static_cast<unsigned long long>(stats.partialCopies),
+                stats.bytesWritten / 1048576.0);
+    if (options.mode == FRAMES_ATLAS) {
+        // Packed sprites against one untrimmed canvas per frame, as the
+        // frames would be kept without the atlas
+        size_t canvasBytes = 0;
+        for (size_t i = 0; i < animations.size(); i++) {
+            canvasBytes += animations[i].cache.FrameBytes() * animations[i].atlas.FrameCount();
+        }
+        size_t allocated = atlas.AllocatedBytes();
+        std::printf("atlas           %zu pages, %.2f MB allocated, %.2f MB as canvases (%.1f%% saved), %.1f%% occupied\n",
+                    atlas.PageCount(), allocated / 1048576.0, canvasBytes / 1048576.0,
+                    canvasBytes > 0 ? 100.0 * (1.0 - static_cast<double>(allocated) / canvasBytes) : 0.0,
+                    atlas.Occupancy() * 100.0);
+    }
+    std::printf("render          %.1f ms, %.0f frames/s, %.0f ns/frame\n", renderMs,
+                renderMs > 0.0 ? rendered * 1000.0 / renderMs : 0.0,
+                rendered > 0 ? renderMs * 1e6 / rendered : 0.0);
+    if (sampled > 0) {
+        std::printf("sampled         %zu frames", sampled);
+        if (!golden.empty()) std::printf(", %zu mismatched", mismatches);
+        std::printf("\n");
+    }
+    if (!options.trace.empty()) {
+        std::printf("trace           %zu events (%zu dropped) in %s\n", traceEvents, tracer.DroppedCount(),
+                    options.trace.c_str());
+    }
+    if (!traceWritten) return 2;
+    return mismatches > 0 ? 1 : 0;
+}
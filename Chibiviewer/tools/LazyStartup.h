@@ -0,0 +1,97 @@
+// The viewer's lazy startup without a window, for timing it (and testing
+// it) on Linux: the same steps as LoadGifsFromFolder and the message loop,
+// with a HeadlessPresenter in place of the layered window.
+//
+// The WAIT animation is mapped and only its first frame decoded and
+// presented before anything else starts; that is the first pixel. The
+// loader pool then decodes every other animation while the rest of WAIT's
+// frames stream in one per pass, as the message loop interleaves them.
+// Once both are done the pack is fully loaded.
+#pragma once
+
+#include <algorithm>
+#include <cctype>
+#include <string>
+#include <vector>
+
+#include "../core/AssetLoader.h"
+#include "../core/Clock.h"
+#include "../core/Compositor.h"
+#include "../core/FrameCache.h"
+#include "../core/MappedFile.h"
+#include "../core/Presenter.h"
+#include "PackFiles.h"
+
+// The file the viewer starts with: the first whose name says "wait" (and
+// not "move", which the viewer checks first), or else the first file
+inline size_t FindWaitAnimation(const std::vector<std::string>& files) {
+    for (size_t i = 0; i < files.size(); i++) {
+        std::string name = files[i].substr(files[i].find_last_of("\\/") + 1);
+        std::transform(name.begin(), name.end(), name.begin(), ::tolower);
+        if (name.find("wait") != std::string::npos && name.find("move") == std::string::npos) return i;
+    }
+    return 0;
+}
+
+struct LazyStartupResult {
+    size_t loaded;          // Animations decoded, WAIT included
+    size_t streamedFrames;  // Frames of WAIT decoded on this thread
+
+    LazyStartupResult() : loaded(0), streamedFrames(0) {}
+};
+
+// Loads files as the viewer does, marking the first pixel and the fully
+// loaded pack in timings (on clock). The first frame is left on presenter.
+// Returns false if the WAIT animation cannot be decoded.
+inline bool RunLazyStartup(const std::vector<std::string>& files, const chibi::IClock& clock,
+                           chibi::LoadTimings& timings, chibi::HeadlessPresenter& presenter,
+                           LazyStartupResult& result, unsigned loaderThreads = 0) {
+    result = LazyStartupResult();
+    timings.Start(clock.NowMs());
+    if (files.empty()) return false;
+
+    size_t initial = FindWaitAnimation(files);
+    chibi::MappedFile file;
+    chibi::FrameCache cache;
+    chibi::FrameCacheBuilder builder;
+    if (!OpenMapped(file, files[initial]) || !builder.Begin(file.Data(), file.Size(), cache) ||
+        !builder.DecodeNext(cache)) {
+        return false;
+    }
+    result.streamedFrames = 1;
+
+    chibi::Compositor compositor;
+    if (!presenter.Resize(cache.width, cache.height)) return false;
+    if (compositor.Compose(presenter.GetSurface(), cache, 0, false) && presenter.Present(compositor.LastRegion())) {
+        timings.MarkFirstPixel(clock.NowMs());
+    }
+
+    std::vector<std::string> others;
+    for (size_t i = 0; i < files.size(); i++) {
+        if (i != initial) others.push_back(files[i]);
+    }
+    chibi::AssetLoader loader;
+    loader.Start(others.size(),
+                 [&others](size_t index, chibi::FrameCache& decoded, chibi::CompressedFrameStore& store) {
+                     (void)store;
+                     chibi::MappedFile other;
+                     return OpenMapped(other, others[index]) &&
+                            chibi::BuildFrameCache(other.Data(), other.Size(), decoded);
+                 },
+                 chibi::AssetLoader::NotifyFunc(), loaderThreads);
+
+    std::vector<chibi::AssetLoadResult> results;
+    while (!builder.Finished()) {
+        if (builder.DecodeNext(cache)) result.streamedFrames++;
+        loader.Poll(results);
+    }
+    loader.Wait();
+    loader.Poll(results);
+    timings.MarkFullyLoaded(clock.NowMs());
+
+    result.loaded = cache.Complete() ? 1 : 0;
+    for (size_t i = 0; i < results.size(); i++) {
+        if (results[i].ok) result.loaded++;
+    }
+    return true;
+}
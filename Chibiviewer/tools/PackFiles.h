@@ -0,0 +1,164 @@
+// File helpers shared by the tools (and tests): listing a pack's
+// animations, mapping or reading them, dropping them from the OS page
+// cache so a run can measure a cold start, and scratch directories.
+#pragma once
+
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <cstdint>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#include "../core/MappedFile.h"
+
+inline bool HasAnimationExtension(const std::string& name) {
+    size_t dot = name.find_last_of('.');
+    if (dot == std::string::npos) return false;
+    std::string extension = name.substr(dot);
+    std::transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
+    return extension == ".gif" || extension == ".webp";
+}
+
+// GIF and WebP files in a folder, sorted so runs are repeatable
+inline std::vector<std::string> ListAnimations(const std::string& folder) {
+    std::vector<std::string> paths;
+#ifdef _WIN32
+    WIN32_FIND_DATAA findData;
+    HANDLE find = FindFirstFileA((folder + "\\*").c_str(), &findData);
+    if (find != INVALID_HANDLE_VALUE) {
+        do {
+            if (HasAnimationExtension(findData.cFileName)) paths.push_back(folder + "\\" + findData.cFileName);
+        } while (FindNextFileA(find, &findData));
+        FindClose(find);
+    }
+#else
+    DIR* dir = opendir(folder.c_str());
+    if (dir) {
+        while (dirent* entry = readdir(dir)) {
+            if (HasAnimationExtension(entry->d_name)) paths.push_back(folder + "/" + entry->d_name);
+        }
+        closedir(dir);
+    }
+#endif
+    std::sort(paths.begin(), paths.end());
+    return paths;
+}
+
+inline bool OpenMapped(chibi::MappedFile& file, const std::string& path) {
+#ifdef _WIN32
+    std::wstring wide(path.begin(), path.end());
+    return file.Open(wide.c_str());
+#else
+    return file.Open(path.c_str());
+#endif
+}
+
+// A whole file copied into bytes
+inline bool ReadWholeFile(const std::string& path, std::vector<uint8_t>& bytes) {
+    chibi::MappedFile file;
+    if (!OpenMapped(file, path)) return false;
+    bytes.assign(file.Data(), file.Data() + file.Size());
+    return true;
+}
+
+// A whole file read into bytes through stdio (one read() of the whole
+// file on Linux), the copying path the mapping replaced
+inline bool ReadBuffered(const std::string& path, std::vector<uint8_t>& bytes) {
+    FILE* file = std::fopen(path.c_str(), "rb");
+    if (!file) return false;
+    bool ok = std::fseek(file, 0, SEEK_END) == 0;
+    long size = ok ? std::ftell(file) : -1;
+    ok = size > 0 && std::fseek(file, 0, SEEK_SET) == 0;
+    if (ok) {
+        bytes.resize(static_cast<size_t>(size));
+        ok = std::fread(bytes.data(), 1, bytes.size(), file) == bytes.size();
+    }
+    std::fclose(file);
+    return ok;
+}
+
+// Whether DropFromPageCache works on this platform
+inline bool CanDropFromPageCache() {
+#ifdef _WIN32
+    return false;  // Needs administrator rights (a standby list purge)
+#else
+    return true;
+#endif
+}
+
+// Evicts a file's cached pages, so the next read comes from the disk.
+// Dirty pages stay, so this is only reliable for files not being written.
+inline bool DropFromPageCache(const std::string& path) {
+#ifdef _WIN32
+    (void)path;
+    return false;
+#else
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) return false;
+    bool dropped = posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED) == 0;
+    close(fd);
+    return dropped;
+#endif
+}
+
+// A new empty directory under the system's temporary folder
+inline bool MakeTempDirectory(std::string& path) {
+#ifdef _WIN32
+    char folder[MAX_PATH];
+    char name[MAX_PATH];
+    if (!GetTempPathA(MAX_PATH, folder) || !GetTempFileNameA(folder, "chb", 0, name)) return false;
+    DeleteFileA(name);
+    if (!CreateDirectoryA(name, NULL)) return false;
+    path = name;
+    return true;
+#else
+    const char* folder = std::getenv("TMPDIR");
+    std::string pattern = std::string(folder && *folder ? folder : "/tmp") + "/chibi-XXXXXX";
+    std::vector<char> name(pattern.begin(), pattern.end());
+    name.push_back('\0');
+    if (!mkdtemp(name.data())) return false;
+    path = name.data();
+    return true;
+#endif
+}
+
+// Deletes the files in a directory and then the directory; it must not
+// have subdirectories
+inline bool RemoveDirectoryAndFiles(const std::string& path) {
+#ifdef _WIN32
+    WIN32_FIND_DATAA findData;
+    HANDLE find = FindFirstFileA((path + "\\*").c_str(), &findData);
+    if (find != INVALID_HANDLE_VALUE) {
+        do {
+            if (!(findData.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)) {
+                DeleteFileA((path + "\\" + findData.cFileName).c_str());
+            }
+        } while (FindNextFileA(find, &findData));
+        FindClose(find);
+    }
+    return RemoveDirectoryA(path.c_str()) != 0;
+#else
+    DIR* dir = opendir(path.c_str());
+    if (dir) {
+        while (dirent* entry = readdir(dir)) {
+            std::string name = entry->d_name;
+            if (name != "." && name != "..") unlink((path + "/" + name).c_str());
+        }
+        closedir(dir);
+    }
+    return rmdir(path.c_str()) == 0;
+#endif
+}
@@ -240,6 +240,8 @@ class TransparentGifViewer(QWidget):
         self.current_frame = 0
         self.frames = []
         self.durations = []
+        self.view = None  # Part of the canvas the window shows
+        self.canvas_size = QSize()
         self.animation_timer = QTimer(self)
         self.animation_timer.timeout.connect(self.next_frame)
         
@@ -352,11 +354,38 @@ class TransparentGifViewer(QWidget):
                 self.gif_types["pick"] = i
                 print(f"Found pick GIF: {filename}")
     
-    def crop_image(self, img):
-        """Crop the top 30% of the image and shift up"""
-        width, height = img.size().width(), img.size().height()
-        crop_top = int(height * 0.3)
-        return img.copy(QRect(0, crop_top, width, height - crop_top))
+    def opaque_view(self, images):
+        """Box around the non-transparent pixels of every frame, widened to be
+        symmetric about the centre line so the flipped frames fit it too"""
+        width, height = images[0].width(), images[0].height()
+        left, top, right, bottom = width, height, 0, 0
+        for image in images:
+            image = image.convertToFormat(QImage.Format_ARGB32)
+            bits = image.constBits()
+            bits.setsize(image.byteCount())
+            alpha = bytes(bits)[3::4]  # Little-endian ARGB32 keeps alpha in the 4th byte
+            for y in range(height):
+                row = alpha[y * width:(y + 1) * width]
+                opaque = row.lstrip(b'\0')
+                if not opaque:
+                    continue
+                top = min(top, y)
+                bottom = max(bottom, y + 1)
+                left = min(left, width - len(opaque))
+                right = max(right, len(row.rstrip(b'\0')))
+        
+        if right <= left:
+            return QRect(0, 0, width, height)
+        margin = min(left, width - right)
+        return QRect(margin, top, width - 2 * margin, bottom - top)
+    
+    def feet_position(self):
+        """Screen position of the feet (bottom centre of the canvas), or None
+        before the first animation is shown"""
+        if self.view is None:
+            return None
+        return QPoint(self.x() + self.canvas_size.width() // 2 - self.view.left(),
+                      self.y() + self.canvas_size.height() - self.view.top())
     
     def load_current_gif(self):
         """Load and display the current GIF"""
@@ -388,19 +417,10 @@ class TransparentGifViewer(QWidget):
             
             img.jumpToFrame(0)
             
+            images = []
             for i in range(frame_count):
                 try:
-                    current = img.currentImage()
-                    
-                    current = self.crop_image(current)
-                    
-                    pixmap = QPixmap.fromImage(current)
-                    
-                    # Also create flipped version for left movement
-                    flipped_pixmap = pixmap.transformed(QTransform().scale(-1, 1))
-                    
-                    self.frames.append(pixmap)
-                    self.flipped_frames.append(flipped_pixmap)
+                    images.append(img.currentImage())
                     self.durations.append(img.nextFrameDelay())
                     
                     if i < frame_count - 1:
@@ -408,11 +428,30 @@ class TransparentGifViewer(QWidget):
                 except EOFError:
                     break
             
-            if not self.frames:
+            if not images:
                 self.animation_error.emit(f"No frames found in {current_file}")
                 return
+            
+            # Trim the transparent borders all frames share
+            view = self.opaque_view(images)
+            for current in images:
+                pixmap = QPixmap.fromImage(current.copy(view))
+                
+                # Also create flipped version for left movement
+                flipped_pixmap = pixmap.transformed(QTransform().scale(-1, 1))
                 
+                self.frames.append(pixmap)
+                self.flipped_frames.append(flipped_pixmap)
+            
+            # Keep the feet where they were so the character does not jump
+            feet = self.feet_position()
+            self.view = view
+            self.canvas_size = images[0].size()
+            
             self.resize(self.frames[0].width(), self.frames[0].height())
+            if feet is not None:
+                self.move(feet.x() - (self.canvas_size.width() // 2 - view.left()),
+                          feet.y() - (self.canvas_size.height() - view.top()))
             
             self.current_frame = 0
             self.character_label.setPixmap(self.frames[0])